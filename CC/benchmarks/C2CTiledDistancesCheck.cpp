@@ -0,0 +1,176 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+
+//Compares the tiled cloud-to-cloud distances (DistanceComputationTools::computeCloud2CloudDistanceTiled)
+//with the in-memory ones (DistanceComputationTools::computeCloud2CloudDistance), with and without max
+//search distance. Uniform reference points vs clustered compared points with outliers above the
+//reference (so that some tiles have reference points in their halo but none in the search radius).
+//A subset of the distances is also checked by brute force.
+//
+//Usage: C2CTiledDistancesCheck
+//Returns EXIT_FAILURE if the distances differ.
+
+//CCLib
+#include <ChunkedPointCloud.h>
+#include <DistanceComputationTools.h>
+
+//system
+#include <cstdio>
+#include <cstdlib>
+#include <math.h>
+#include <random>
+#include <vector>
+
+using namespace CCLib;
+
+//! Tiles memory budget (MB)
+static const unsigned MEMORY_BUDGET = 1;
+
+//! Generates the reference and compared points
+/** \param outliersHeight height of the outliers above the reference points
+**/
+static void GenerateClouds(double outliersHeight, ChunkedPointCloud& reference, std::vector<CCVector3>& compared)
+{
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> uniform(0, 100);
+	std::normal_distribution<float> gauss(0, 1.5f);
+
+	//uniform reference points (100 x 100 x 20)
+	static const unsigned REFERENCE_COUNT = 120000;
+	reference.reserve(REFERENCE_COUNT);
+	for (unsigned i = 0; i < REFERENCE_COUNT; ++i)
+	{
+		reference.addPoint(CCVector3(uniform(rng), uniform(rng), uniform(rng) / 5));
+	}
+
+	//compared points: 8 clusters + 2% of outliers scattered above the reference points
+	static const unsigned COMPARED_COUNT = 60000;
+	CCVector3 centers[8];
+	for (unsigned c = 0; c < 8; ++c)
+	{
+		centers[c] = CCVector3(uniform(rng), uniform(rng), uniform(rng) / 5);
+	}
+	compared.resize(COMPARED_COUNT);
+	for (unsigned i = 0; i < COMPARED_COUNT; ++i)
+	{
+		if (i % 50 == 0)
+		{
+			compared[i] = CCVector3(uniform(rng) * 1.2f - 10, uniform(rng) * 1.2f - 10, 20 + static_cast<PointCoordinateType>(outliersHeight) + uniform(rng) / 100);
+		}
+		else
+		{
+			const CCVector3& C = centers[i % 8];
+			compared[i] = CCVector3(C.x + gauss(rng), C.y + gauss(rng), C.z + gauss(rng) / 3);
+		}
+	}
+}
+
+//! Computes the distances with both methods and compares them
+static bool Check(double maxSearchDist)
+{
+	ChunkedPointCloud reference;
+	std::vector<CCVector3> points;
+	GenerateClouds(maxSearchDist > 0 ? 0.6 * maxSearchDist : 3.0, reference, points);
+
+	ChunkedPointCloud compared[2];
+	for (unsigned k = 0; k < 2; ++k)
+	{
+		if (!compared[k].reserve(static_cast<unsigned>(points.size())))
+		{
+			fprintf(stderr, "Not enough memory\n");
+			return false;
+		}
+		for (size_t i = 0; i < points.size(); ++i)
+		{
+			compared[k].addPoint(points[i]);
+		}
+		compared[k].enableScalarField();
+	}
+
+	DistanceComputationTools::Cloud2CloudDistanceComputationParams params;
+	params.maxSearchDist = static_cast<ScalarType>(maxSearchDist);
+	int inMemoryResult = DistanceComputationTools::computeCloud2CloudDistance(&compared[0], &reference, params);
+
+	DistanceComputationTools::Cloud2CloudDistanceComputationParams tiledParams;
+	tiledParams.maxSearchDist = static_cast<ScalarType>(maxSearchDist);
+	int tiledResult = DistanceComputationTools::computeCloud2CloudDistanceTiled(&compared[1], &reference, tiledParams, MEMORY_BUDGET);
+
+	//tiled vs in-memory distances
+	unsigned differentCount = 0;
+	for (unsigned i = 0; i < compared[0].size(); ++i)
+	{
+		ScalarType d0 = compared[0].getPointScalarValue(i);
+		ScalarType d1 = compared[1].getPointScalarValue(i);
+		if (!(fabs(d0 - d1) <= 1.0e-5)) //NaN values are different too
+		{
+			++differentCount;
+		}
+	}
+
+	//brute force (outliers and a subset of the other points)
+	unsigned checkedCount = 0;
+	unsigned wrongCount[2] = { 0, 0 };
+	for (unsigned i = 0; i < compared[0].size(); i += (i % 50 == 0 ? 1 : 49))
+	{
+		double minSquareDist = -1.0;
+		for (unsigned j = 0; j < reference.size(); ++j)
+		{
+			double squareDist = (*reference.getPoint(j) - points[i]).norm2d();
+			if (minSquareDist < 0 || squareDist < minSquareDist)
+				minSquareDist = squareDist;
+		}
+		double expected = sqrt(minSquareDist);
+		if (maxSearchDist > 0 && expected > maxSearchDist)
+			expected = maxSearchDist;
+
+		++checkedCount;
+		for (unsigned k = 0; k < 2; ++k)
+		{
+			if (!(fabs(compared[k].getPointScalarValue(i) - expected) <= 1.0e-4))
+				++wrongCount[k];
+		}
+	}
+
+	bool success = (inMemoryResult == 0 && tiledResult == 0 && differentCount == 0 && wrongCount[0] == 0 && wrongCount[1] == 0);
+	printf("max search distance %4.1f: in-memory %d, tiled %d, different distances %u / %u, wrong distances (brute force, %u points) in-memory %u, tiled %u   %s\n",
+		maxSearchDist,
+		inMemoryResult,
+		tiledResult,
+		differentCount,
+		compared[0].size(),
+		checkedCount,
+		wrongCount[0],
+		wrongCount[1],
+		success ? "OK" : "FAILED");
+
+	return success;
+}
+
+int main()
+{
+	bool success = true;
+
+	//with and without max search distance
+	static const double MAX_SEARCH_DISTANCES[] = { 2.0, 5.0, 8.0, 0 };
+	for (unsigned i = 0; i < sizeof(MAX_SEARCH_DISTANCES) / sizeof(double); ++i)
+	{
+		success &= Check(MAX_SEARCH_DISTANCES[i]);
+	}
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,228 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+
+//Compares the closed-form 3x3 eigen solver (EigenSolver3x3.h) with the generic Jacobi method
+//(Jacobi.h) on random covariance matrices: accuracy (max residual |A.v - l.v|, invalid results)
+//and throughput.
+//
+//Usage: EigenSolver3x3Benchmark [matrix count]
+
+//CCLib
+#include <EigenSolver3x3.h>
+
+//system
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <math.h>
+#include <random>
+#include <vector>
+
+typedef double Scalar;
+
+//! Random covariance matrices (packed form), cycling over typical spectra
+/** Flat (planar) neighbourhoods, linear ones, two repeated eigenvalues and arbitrary ones.
+**/
+static void GenerateMatrices(unsigned count, std::vector<Scalar>& matrices)
+{
+	std::mt19937 rng(3);
+	std::normal_distribution<Scalar> gauss(0, 1);
+	std::uniform_real_distribution<Scalar> uniform(0, 1);
+
+	matrices.resize(6 * static_cast<size_t>(count));
+	for (unsigned i = 0; i < count; ++i)
+	{
+		//random rotation (from a random unit quaternion)
+		Scalar q[4] = { gauss(rng), gauss(rng), gauss(rng), gauss(rng) };
+		Scalar n = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		Scalar a = q[0] / n, b = q[1] / n, c = q[2] / n, d = q[3] / n;
+		Scalar R[3][3] = {	{ 1 - 2 * (c*c + d*d),	2 * (b*c - a*d),		2 * (b*d + a*c)		},
+							{ 2 * (b*c + a*d),		1 - 2 * (b*b + d*d),	2 * (c*d - a*b)		},
+							{ 2 * (b*d - a*c),		2 * (c*d + a*b),		1 - 2 * (b*b + c*c)	} };
+
+		Scalar L[3];
+		switch (i % 4)
+		{
+		case 0: //flat
+			L[0] = 1; L[1] = uniform(rng); L[2] = 1.0e-6 * uniform(rng);
+			break;
+		case 1: //linear
+			L[0] = 1; L[1] = 1.0e-3 * uniform(rng); L[2] = 1.0e-3 * uniform(rng);
+			break;
+		case 2: //repeated eigenvalues
+			L[0] = 1; L[1] = 1; L[2] = 1.0e-4;
+			break;
+		default: //arbitrary
+			L[0] = uniform(rng); L[1] = uniform(rng); L[2] = uniform(rng);
+			break;
+		}
+
+		//A = R.diag(L).R^t
+		Scalar A[3][3] = { { 0 } };
+		for (unsigned x = 0; x < 3; ++x)
+			for (unsigned y = 0; y < 3; ++y)
+				for (unsigned k = 0; k < 3; ++k)
+					A[x][y] += R[x][k] * L[k] * R[y][k];
+
+		Scalar* m = &matrices[6 * static_cast<size_t>(i)];
+		m[0] = A[0][0]; m[1] = A[0][1]; m[2] = A[0][2];
+		m[3] = A[1][1]; m[4] = A[1][2];
+		m[5] = A[2][2];
+	}
+}
+
+//! Solves one matrix with the generic Jacobi method (same output as EigenSolver3x3)
+static bool SolveWithJacobi(const Scalar m[6], Scalar eigenValues[3], Scalar eigenVectors[3][3])
+{
+	CCLib::SquareMatrixTpl<Scalar> A(3);
+	A.m_values[0][0] = m[0];
+	A.m_values[0][1] = A.m_values[1][0] = m[1];
+	A.m_values[0][2] = A.m_values[2][0] = m[2];
+	A.m_values[1][1] = m[3];
+	A.m_values[1][2] = A.m_values[2][1] = m[4];
+	A.m_values[2][2] = m[5];
+
+	CCLib::SquareMatrixTpl<Scalar> V;
+	Jacobi<Scalar>::EigenValues e;
+	if (	!Jacobi<Scalar>::ComputeEigenValuesAndVectors(A, V, e, false)
+		||	!Jacobi<Scalar>::SortEigenValuesAndVectors(V, e))
+	{
+		return false;
+	}
+
+	for (unsigned k = 0; k < 3; ++k)
+	{
+		eigenValues[k] = e[k];
+		Jacobi<Scalar>::GetEigenVector(V, k, eigenVectors[k]);
+	}
+	return true;
+}
+
+//! Solves one matrix with the closed-form solver
+static bool SolveClosedForm(const Scalar m[6], Scalar eigenValues[3], Scalar eigenVectors[3][3])
+{
+	return EigenSolver3x3<Scalar>::ComputeEigenValuesAndVectors(m, eigenValues, eigenVectors);
+}
+
+//! Benchmark results for one solver
+struct Results
+{
+	double timeMs;
+	Scalar maxResidual;
+	unsigned failureCount;
+	unsigned invalidCount;
+};
+
+template <class Solver> static Results Run(const std::vector<Scalar>& matrices, Solver solver)
+{
+	Results results = { 0, 0, 0, 0 };
+	const size_t count = matrices.size() / 6;
+
+	std::vector<Scalar> values(3 * count);
+	std::vector<Scalar> vectors(9 * count);
+
+	//timing (decomposition only)
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (!solver(&matrices[6 * i], &values[3 * i], reinterpret_cast<Scalar(*)[3]>(&vectors[9 * i])))
+			++results.failureCount;
+	}
+	results.timeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	//accuracy
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Scalar* m = &matrices[6 * i];
+		bool valid = true;
+		for (unsigned k = 0; k < 3; ++k)
+		{
+			Scalar l = values[3 * i + k];
+			const Scalar* v = &vectors[9 * i + 3 * k];
+			Scalar r[3] = {	m[0] * v[0] + m[1] * v[1] + m[2] * v[2] - l * v[0],
+							m[1] * v[0] + m[3] * v[1] + m[4] * v[2] - l * v[1],
+							m[2] * v[0] + m[4] * v[1] + m[5] * v[2] - l * v[2] };
+			Scalar residual = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+			Scalar norm = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+			if (residual != residual || fabs(norm - 1) > 1.0e-6) //NaN or not a unit vector
+				valid = false;
+			else if (residual > results.maxResidual)
+				results.maxResidual = residual;
+		}
+		if (!valid)
+			++results.invalidCount;
+	}
+
+	return results;
+}
+
+static void Print(const char* name, const Results& results, size_t count)
+{
+	printf("%-12s %10.1f ms %10.1f ns/matrix   max residual %.3g   failures %u   invalid %u\n",
+		name,
+		results.timeMs,
+		results.timeMs * 1.0e6 / count,
+		results.maxResidual,
+		results.failureCount,
+		results.invalidCount);
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned count = 200000;
+	if (argc > 1)
+	{
+		int value = atoi(argv[1]);
+		if (value <= 0)
+		{
+			fprintf(stderr, "Usage: %s [matrix count]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+		count = static_cast<unsigned>(value);
+	}
+
+	std::vector<Scalar> matrices;
+	GenerateMatrices(count, matrices);
+	printf("%u random covariance matrices (flat, linear, repeated and arbitrary spectra)\n", count);
+
+	Print("closed-form", Run(matrices, SolveClosedForm), count);
+	Print("Jacobi", Run(matrices, SolveWithJacobi), count);
+
+	//eigenvalues only (batch version)
+	{
+		std::vector<Scalar> soa(6 * static_cast<size_t>(count));
+		std::vector<Scalar> eigenValues(3 * static_cast<size_t>(count));
+		const Scalar* m[6];
+		Scalar* e[3];
+		for (unsigned k = 0; k < 6; ++k)
+		{
+			m[k] = &soa[k * static_cast<size_t>(count)];
+			for (unsigned i = 0; i < count; ++i)
+				soa[k * static_cast<size_t>(count) + i] = matrices[6 * static_cast<size_t>(i) + k];
+		}
+		for (unsigned k = 0; k < 3; ++k)
+			e[k] = &eigenValues[k * static_cast<size_t>(count)];
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		EigenSolver3x3<Scalar>::ComputeEigenValues(count, m, e);
+		double timeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		printf("%-12s %10.1f ms %10.1f ns/matrix   (eigenvalues only)\n", "batch", timeMs, timeMs * 1.0e6 / count);
+	}
+
+	return EXIT_SUCCESS;
+}
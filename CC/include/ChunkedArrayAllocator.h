@@ -0,0 +1,169 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CHUNKED_ARRAY_ALLOCATOR_HEADER
+#define CHUNKED_ARRAY_ALLOCATOR_HEADER
+
+//Local
+#include "CCCoreLib.h"
+#include "CCPlatform.h"
+
+//system
+#include <stddef.h>
+#include <string>
+
+//! Memory allocator for the GenericChunkedArray data
+/** The data can either be allocated on the heap (default) or in a memory-mapped
+	scratch file. In the latter case the OS handles the paging, so that arrays
+	bigger than the physical memory can be handled (as long as there's enough disk space).
+	Scratch files are temporary: they are deleted as soon as the array is released.
+
+	Heap blocks are aligned on ALIGNMENT bytes (SIMD friendly) and grow geometrically
+	(the reserved memory can be bigger than the used memory). Big released blocks are
+	kept in a pool (see SetPoolSize) so as to be recycled by the next arrays (clones,
+	filters, etc.) instead of going back and forth to the system allocator.
+**/
+class CC_CORE_LIB_API ChunkedArrayAllocator
+{
+public:
+
+	//! Heap blocks alignment (in bytes)
+	static const size_t ALIGNMENT = 64;
+
+	//! Allocation policies
+	enum Policy {	AUTO_ALLOCATION,		/**< Heap allocation as long as the global memory budget is not exceeded (see SetMemoryBudget) **/
+					HEAP_ALLOCATION,		/**< Heap allocation **/
+					FILE_MAPPED_ALLOCATION,	/**< Memory-mapped scratch file **/
+	};
+
+	//! Memory block
+	struct Block
+	{
+		//! Default constructor
+		Block()
+			: data(0)
+			, size(0)
+			, capacity(0)
+			, fileSize(0)
+			, mapped(false)
+#ifdef CC_WINDOWS
+			, file(0)
+			, mapping(0)
+#else
+			, file(-1)
+#endif
+		{}
+
+		//! Data
+		void* data;
+		//! Size (in bytes)
+		size_t size;
+		//! Reserved size (in bytes)
+		size_t capacity;
+		//! Scratch file size (in bytes)
+		size_t fileSize;
+		//! Whether the block is mapped on a scratch file or not
+		bool mapped;
+#ifdef CC_WINDOWS
+		//! Scratch file handle
+		void* file;
+		//! File mapping handle
+		void* mapping;
+#else
+		//! Scratch file descriptor
+		int file;
+#endif
+	};
+
+	//! Resizes a block
+	/** The block is allocated (or moved) depending on the specified policy.
+		New bytes are set to zero.
+		\param block memory block
+		\param size new size (in bytes)
+		\param policy allocation policy
+		\return success (the block is left unchanged otherwise)
+	**/
+	static bool Resize(Block& block, size_t size, Policy policy = AUTO_ALLOCATION);
+
+	//! Releases a block
+	static void Release(Block& block);
+
+	//! Sets the global memory budget (in bytes)
+	/** Once the heap memory used by all the arrays would exceed this budget,
+		the arrays with the AUTO_ALLOCATION policy are allocated in scratch files.
+		\param bytes memory budget (0 = no limit, default)
+	**/
+	static void SetMemoryBudget(size_t bytes);
+
+	//! Returns the global memory budget (in bytes)
+	static size_t GetMemoryBudget();
+
+	//! Sets the directory where the scratch files are created
+	/** \param path directory (empty = system temporary directory, default)
+	**/
+	static void SetScratchDirectory(const std::string& path);
+
+	//! Returns the directory where the scratch files are created
+	static std::string GetScratchDirectory();
+
+	//! Sets the maximum size of the pool of released heap blocks (in bytes)
+	/** \param bytes pool size (0 = no pool)
+	**/
+	static void SetPoolSize(size_t bytes);
+
+	//! Returns the maximum size of the pool of released heap blocks (in bytes)
+	static size_t GetPoolSize();
+
+	//! Enables (or disables) transparent huge pages for big heap blocks
+	/** \warning Only effective on Linux (disabled by default)
+	**/
+	static void SetHugePages(bool state);
+
+	//! Returns whether transparent huge pages are enabled or not
+	static bool GetHugePages();
+
+	//! Returns the heap memory currently used by all the arrays (in bytes)
+	static size_t GetHeapMemoryUsage();
+
+	//! Returns the heap memory currently reserved by all the arrays (in bytes)
+	/** This is always greater or equal to the used memory (see GetHeapMemoryUsage).
+		It doesn't include the pooled memory (see GetPooledMemory).
+	**/
+	static size_t GetHeapMemoryReserved();
+
+	//! Returns the heap memory currently kept in the pool of released blocks (in bytes)
+	static size_t GetPooledMemory();
+
+	//! Returns the memory currently mapped on scratch files by all the arrays (in bytes)
+	static size_t GetMappedMemoryUsage();
+
+protected:
+
+	//! Resizes (or creates) a mapped block
+	static bool ResizeMapped(Block& block, size_t size);
+	//! Resizes (or creates) a heap block
+	static bool ResizeHeap(Block& block, size_t size);
+	//! Moves a block from the heap to a scratch file or the other way round
+	static bool Move(Block& block, size_t size, bool toMapped);
+	//! Allocates a heap block (or takes it from the pool)
+	static void* AllocateHeap(size_t& capacity);
+	//! Releases a heap block (or puts it in the pool)
+	static void ReleaseHeap(void* data, size_t capacity);
+};
+
+#endif //CHUNKED_ARRAY_ALLOCATOR_HEADER
@@ -61,6 +61,7 @@ public:
 		//**** inherited form GenericIndexedCloud ****//
 		inline virtual const CCVector3* getPoint(unsigned index)  { return point(index); }
 		inline virtual void getPoint(unsigned index, CCVector3& P) const { P = *point(index); }
+		virtual const CCVector3* getPointsBlock(unsigned index, unsigned& count);
 
 		//**** inherited form GenericIndexedCloudPersist ****//
 		inline virtual const CCVector3* getPointPersistentPtr(unsigned index) { return point(index); }
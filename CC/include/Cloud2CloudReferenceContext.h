@@ -0,0 +1,157 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CLOUD2CLOUD_REFERENCE_CONTEXT_HEADER
+#define CLOUD2CLOUD_REFERENCE_CONTEXT_HEADER
+
+//Local
+#include "CCCoreLib.h"
+#include "CCConst.h"
+#include "CCGeom.h"
+#include "CCTypes.h"
+
+//system
+#include <atomic>
+
+namespace CCLib
+{
+
+class DgmOctree;
+class GenericIndexedCloudPersist;
+class GenericProgressCallback;
+class LocalModel;
+
+//! Persistent data of a reference cloud for repeated cloud-to-cloud distances computations
+/** Owns the octree of the reference cloud and the local models computed around its points
+	(see DistanceComputationTools::Cloud2CloudDistanceComputationParams::referenceContext).
+	When the same reference cloud is compared to several clouds (e.g. successive epochs),
+	only the compared cloud octree has to be computed for each comparison.
+
+	The octree is only rebuilt if a compared cloud doesn't fit in its bounding-box (the new
+	box is then the union of the former one and of the compared cloud bounding-box). The local
+	models are computed lazily (i.e. only around the reference points that are the nearest
+	neighbours of some compared points) and kept as long as the local model parameters don't change.
+
+	The local models are fitted on the same neighbours as without a context, but not necessarily
+	in the same order: the distances are only equal within floating-point tolerance (e.g. ~1e-8
+	with quadrics).
+
+	\warning The reference cloud should not be modified as long as the context is used.
+**/
+class CC_CORE_LIB_API Cloud2CloudReferenceContext
+{
+public:
+
+	//! Default constructor
+	/** \param referenceCloud reference cloud
+	**/
+	explicit Cloud2CloudReferenceContext(GenericIndexedCloudPersist* referenceCloud);
+
+	//! Destructor
+	~Cloud2CloudReferenceContext();
+
+	//! Returns the reference cloud
+	inline GenericIndexedCloudPersist* referenceCloud() const { return m_referenceCloud; }
+
+	//! Returns the reference cloud octree (or 0 if it has not been built yet)
+	inline DgmOctree* octree() const { return m_octree; }
+
+	//! Prepares the reference octree for a given compared cloud
+	/** The octree is (re)built if it doesn't exist yet, if the reference cloud
+		size has changed or if the compared cloud doesn't fit in its bounding-box.
+		\param comparedCloud compared cloud
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return success
+	**/
+	bool prepare(GenericIndexedCloudPersist* comparedCloud, GenericProgressCallback* progressCb = 0);
+
+	//! Builds (if necessary) the octree of a compared cloud so that it matches the reference octree
+	/** The reference octree must be ready (see prepare).
+		\param comparedOctree octree of the compared cloud (rebuilt only if its bounding-box doesn't match)
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return success
+	**/
+	bool synchronize(DgmOctree& comparedOctree, GenericProgressCallback* progressCb = 0) const;
+
+	//! Sets the parameters of the cached local models
+	/** If they differ from the parameters of the models already computed, the cache is cleared.
+		\param modelType type of local model
+		\param useSphericalSearch whether the models are computed with the neighbours inside a sphere or with the k nearest neighbours
+		\param kNN number of neighbours (if useSphericalSearch is false)
+		\param radius sphere radius (if useSphericalSearch is true)
+		\return success (false if not enough memory)
+	**/
+	bool setLocalModelParameters(CC_LOCAL_MODEL_TYPES modelType, bool useSphericalSearch, unsigned kNN, ScalarType radius);
+
+	//! Returns the cached local model computed around a reference point (if any)
+	/** Thread-safe.
+	**/
+	inline const LocalModel* getLocalModel(unsigned pointIndex) const { return m_localModels ? m_localModels[pointIndex].load() : 0; }
+
+	//! Stores the local model computed around a reference point
+	/** Thread-safe. The context takes the ownership of the model. If another model has
+		already been stored for the same point, the input one is deleted.
+		\return the model stored for this point
+	**/
+	const LocalModel* setLocalModel(unsigned pointIndex, const LocalModel* model);
+
+	//! Returns the number of cached local models
+	inline unsigned localModelCount() const { return m_localModelCount.load(); }
+
+	//! Clears the cached local models
+	void clearLocalModels();
+
+	//! Clears the context (octree and local models)
+	void clear();
+
+protected:
+
+	//! Reference cloud
+	GenericIndexedCloudPersist* m_referenceCloud;
+
+	//! Reference cloud octree
+	DgmOctree* m_octree;
+
+	//! Reference cloud size (when the octree was built)
+	unsigned m_referenceCloudSize;
+
+	//! Points filtering box (non cubical - common to the reference and the compared octrees)
+	CCVector3 m_pointsMin;
+	//! Points filtering box (non cubical - common to the reference and the compared octrees)
+	CCVector3 m_pointsMax;
+
+	//! Local models (one slot per reference point)
+	std::atomic<const LocalModel*>* m_localModels;
+	//! Number of local models slots
+	unsigned m_localModelsSize;
+	//! Number of cached local models
+	std::atomic<unsigned> m_localModelCount;
+
+	//! Cached local models type
+	CC_LOCAL_MODEL_TYPES m_modelType;
+	//! Cached local models neighbourhood type
+	bool m_useSphericalSearch;
+	//! Cached local models number of neighbours
+	unsigned m_kNN;
+	//! Cached local models sphere radius
+	ScalarType m_radius;
+};
+
+} //namespace CCLib
+
+#endif //CLOUD2CLOUD_REFERENCE_CONTEXT_HEADER
@@ -30,6 +30,7 @@ class GenericProgressCallback;
 class GenericIndexedCloud;
 class GenericIndexedCloudPersist;
 class GenericIndexedMesh;
+class GenericTiledCloudStream;
 class ReferenceCloud;
 class ReferenceCloudPersist;
 class SimpleCloud;
@@ -147,6 +148,9 @@ public:
 	//! Resamples a point cloud (process based on inter point distance)
 	/** The cloud is resampled so that there is no point nearer than a given distance to other points
 		It works by picking a reference point, removing all points which are to close to this point, and repeating these two steps until the result is reached
+		The points are picked octree block by octree block (blocks bigger than the maximum distance between points): the blocks
+		that are not adjacent are processed in parallel, in 8 successive waves. The result doesn't depend on the number of threads.
+		It differs from a selection in the points index order (usually a few more points are kept).
 		\param cloud the point cloud to resample
 		\param minDistance the distance under which a point in the resulting cloud cannot have any neighbour
 		\param modParams parameters of the subsampling behavior modulation with a scalar field (optional)
@@ -183,7 +187,7 @@ public:
 		\param nSigma number of sigmas under which the points should be kept
 		\param removeIsolatedPoints whether to remove isolated points (i.e. with 3 points or less in the neighborhood)
 		\param useKnn whether to use a constant number of neighbors instead of a radius
-		\param knn number of neighbors (if useKnn is true)
+		\param knn number of neighbors (if useKnn is true - exactly the k nearest ones are used, whatever the octree)
 		\param useAbsoluteError whether to use an absolute error instead of 'n' sigmas
 		\param absoluteError absolute error (if useAbsoluteError is true)
 		\param octree associated octree if available
@@ -201,8 +205,132 @@ public:
 										DgmOctree* octree = 0,
 										GenericProgressCallback* progressCb = 0);
 
+	//! Streamed version of the Statistical Outliers Removal (SOR) filter
+	/** Same result as sorFilter, but the cloud is processed tile by tile (see GenericTiledCloudStream)
+		so that the working memory only depends on the tiles size. Each tile is loaded with a halo
+		large enough to contain the k nearest neighbors of all its points (the halo is doubled until
+		it's the case). Two passes are made over the tiles: the first one to compute the average distance
+		and std. dev. of all the points, and the second one to write the selected points.
+		\param stream tiled cloud stream (the selected points are written to it)
+		\param knn number of neighbors
+		\param nSigma number of sigmas under which the points should be kept
+		\param initialHalo initial halo size (1% of the cloud bounding-box diagonal by default)
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return success
+	**/
+	static bool sorFilterStreamed(	GenericTiledCloudStream& stream,
+									int knn = 6,
+									double nSigma = 1.0,
+									PointCoordinateType initialHalo = 0,
+									GenericProgressCallback* progressCb = 0);
+
+	//! Streamed version of the noise filter
+	/** Same result as noiseFilter, but the cloud is processed tile by tile (see GenericTiledCloudStream)
+		so that the working memory only depends on the tiles size. Each tile is loaded with a halo
+		equal to the kernel radius (or large enough to contain the k nearest neighbors of all its points).
+		\param stream tiled cloud stream (the selected points are written to it)
+		\param kernelRadius neighborhood radius
+		\param nSigma number of sigmas under which the points should be kept
+		\param removeIsolatedPoints whether to remove isolated points (i.e. with 3 points or less in the neighborhood)
+		\param useKnn whether to use a constant number of neighbors instead of a radius
+		\param knn number of neighbors (if useKnn is true)
+		\param useAbsoluteError whether to use an absolute error instead of 'n' sigmas
+		\param absoluteError absolute error (if useAbsoluteError is true)
+		\param initialHalo initial halo size if useKnn is true (1% of the cloud bounding-box diagonal by default)
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return success
+	**/
+	static bool noiseFilterStreamed(GenericTiledCloudStream& stream,
+									PointCoordinateType kernelRadius,
+									double nSigma,
+									bool removeIsolatedPoints = false,
+									bool useKnn = false,
+									int knn = 6,
+									bool useAbsoluteError = true,
+									double absoluteError = 0.0,
+									PointCoordinateType initialHalo = 0,
+									GenericProgressCallback* progressCb = 0);
+
 protected:
 
+	//! Noise filter parameters (see noiseFilter)
+	struct NoiseFilterParams
+	{
+		PointCoordinateType kernelRadius;
+		double nSigma;
+		bool removeIsolatedPoints;
+		bool useKnn;
+		int knn;
+		bool useAbsoluteError;
+		double absoluteError;
+	};
+
+	//! Streamed filters parameters
+	struct StreamedFilterParams
+	{
+		//! Whether to apply the SOR filter (or the noise filter)
+		bool sor;
+		//! SOR filter number of neighbors
+		int knn;
+		//! Noise filter parameters
+		NoiseFilterParams noise;
+		//! Size of the whole cloud octree
+		PointCoordinateType octreeSize;
+	};
+
+	//! Computes the mean distance of each point to its k nearest neighbors (SOR filter)
+	/** \param octree octree of the cloud
+		\param knn number of neighbors
+		\param[out] meanDistances mean distance of each point to its neighbors
+		\param[out] maxDistances distance of each point to its farthest neighbor (optional - infinite if less than knn neighbors are found)
+		\param queryCount only the first 'queryCount' points of the cloud are processed (all the points if 0)
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return success
+	**/
+	static bool computeSORMeanDistances(DgmOctree* octree,
+										int knn,
+										std::vector<PointCoordinateType>& meanDistances,
+										std::vector<PointCoordinateType>* maxDistances = 0,
+										unsigned queryCount = 0,
+										GenericProgressCallback* progressCb = 0);
+
+	//! Flags the points kept by the noise filter
+	/** \param octree octree of the cloud
+		\param params noise filter parameters
+		\param[out] keptPoints whether each point is kept (1) or not (0)
+		\param[out] maxDistances distance of each point to its farthest neighbor (optional and kNN mode only - infinite if less than knn neighbors are found)
+		\param queryCount only the first 'queryCount' points of the cloud are processed (all the points if 0)
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return success
+	**/
+	static bool computeNoiseFilterSelection(DgmOctree* octree,
+											const NoiseFilterParams& params,
+											std::vector<unsigned char>& keptPoints,
+											std::vector<PointCoordinateType>* maxDistances = 0,
+											unsigned queryCount = 0,
+											GenericProgressCallback* progressCb = 0);
+
+	//! Loads a tile and applies the SOR filter or the noise filter to its points (see sorFilterStreamed and noiseFilterStreamed)
+	/** In kNN mode, the halo is doubled until the k nearest neighbors of all the core points are found in the tile (or until it reaches maxHalo).
+		\param stream tiled cloud stream
+		\param tileIndex tile index
+		\param params filter parameters
+		\param[in,out] halo halo size
+		\param maxHalo max halo size
+		\param[out] coreCount number of core points
+		\param[out] meanDistances SOR filter mean distances (tile points)
+		\param[out] keptPoints noise filter selection (tile points)
+		\return the tile cloud (or 0 if an error occurred)
+	**/
+	static GenericIndexedCloudPersist* filterStreamedTile(	GenericTiledCloudStream& stream,
+															unsigned tileIndex,
+															const StreamedFilterParams& params,
+															PointCoordinateType& halo,
+															PointCoordinateType maxHalo,
+															unsigned& coreCount,
+															std::vector<PointCoordinateType>& meanDistances,
+															std::vector<unsigned char>& keptPoints);
+
 	//! "Cellular" function to replace one set of points (contained in an octree cell) by a unique point
 	/** This function is meant to be applied to all cells of the octree
 		(it is of the form DgmOctree::localFunctionPtr). It replaces all
@@ -236,6 +364,11 @@ protected:
 	//! "Cellular" function to apply the noise filter inside an octree cell
 	/** This function is meant to be applied to all cells of the octree
 		(it is of the form DgmOctree::localFunctionPtr).
+		Method parameters (defined in "additionalParameters") are :
+		- (std::vector<unsigned char>*) kept points flags
+		- (const NoiseFilterParams*) filter parameters
+		- (std::vector<PointCoordinateType>*) distance to the farthest neighbor (optional)
+		- (unsigned*) number of query points (i.e. the first points of the cloud - all the points if 0)
 		\param cell structure describing the cell on which processing is applied
 		\param additionalParameters see method description
 		\param nProgress optional (normalized) progress notification (per-point)
@@ -247,6 +380,11 @@ protected:
 	//! "Cellular" function to apply the SOR filter inside an octree cell
 	/** This function is meant to be applied to all cells of the octree
 		(it is of the form DgmOctree::localFunctionPtr).
+		Method parameters (defined in "additionalParameters") are :
+		- (int*) number of neighbors
+		- (std::vector<PointCoordinateType>*) mean distance to the neighbors
+		- (std::vector<PointCoordinateType>*) distance to the farthest neighbor (optional)
+		- (unsigned*) number of query points (i.e. the first points of the cloud - all the points if 0)
 		\param cell structure describing the cell on which processing is applied
 		\param additionalParameters see method description
 		\param nProgress optional (normalized) progress notification (per-point)
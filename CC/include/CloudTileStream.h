@@ -0,0 +1,99 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef CLOUD_TILE_STREAM_HEADER
+#define CLOUD_TILE_STREAM_HEADER
+
+//Local
+#include "GenericTiledCloudStream.h"
+#include "ReferenceCloud.h"
+#include "TilingGrid.h"
+
+namespace CCLib
+{
+
+//! Tiled stream of an indexed point cloud
+/** The tiles are computed with a TilingGrid. The points indexes are sorted by tile
+	once (so that each tile and its halo can be loaded without scanning the whole cloud).
+	The selected points are stored in a reference cloud.
+
+	The cloud is already loaded (and this stream stores one index per point), so the
+	tiles only bound the working memory of the streamed processes (octrees, neighbourhoods,
+	etc.). See SequentialTileStream to process a cloud that is not loaded (e.g. a file).
+**/
+class CC_CORE_LIB_API CloudTileStream : public GenericTiledCloudStream
+{
+public:
+
+	//! Default constructor
+	/** \param cloud the cloud to stream
+		\param maxTilePointCount max number of points per tile (best effort: a tile can't be smaller than a cell of the tiling grid)
+	**/
+	CloudTileStream(GenericIndexedCloudPersist* cloud, unsigned maxTilePointCount);
+
+	//! Destructor
+	virtual ~CloudTileStream();
+
+	//! Computes the tiles
+	/** Must be called before any other method (it also clears the current selection).
+		\return false if not enough memory
+	**/
+	bool init();
+
+	//inherited from GenericTiledCloudStream
+	virtual unsigned tileCount();
+	virtual void getBoundingBox(CCVector3& bbMin, CCVector3& bbMax);
+	virtual GenericIndexedCloudPersist* loadTile(	unsigned tileIndex,
+													PointCoordinateType halo,
+													unsigned& coreCount,
+													CCVector3& tileMin,
+													CCVector3& tileMax);
+	virtual bool writeTileSelection(unsigned tileIndex, ReferenceCloud& selection);
+
+	//! Returns the selected points (see writeTileSelection)
+	/** The selection is associated to the input cloud (the points are sorted by tile).
+	**/
+	inline ReferenceCloud& selection() { return m_selection; }
+
+protected:
+
+	//! Streamed cloud
+	GenericIndexedCloudPersist* m_cloud;
+	//! Max number of points per tile
+	unsigned m_maxTilePointCount;
+
+	//! Cloud bounding-box (min corner)
+	CCVector3 m_bbMin;
+	//! Cloud bounding-box (max corner)
+	CCVector3 m_bbMax;
+
+	//! Tiling
+	TilingGrid m_tiling;
+	//! Points sorted by tile
+	ReferenceCloud m_sortedPoints;
+	//! Current tile points
+	ReferenceCloud m_tilePoints;
+	//! Current tile index
+	unsigned m_currentTile;
+	//! Selected points
+	ReferenceCloud m_selection;
+};
+
+}
+
+#endif //CLOUD_TILE_STREAM_HEADER
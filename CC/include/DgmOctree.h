@@ -40,6 +40,7 @@ namespace CCLib
 {
 
 class ReferenceCloud;
+class GenericIndexedCloud;
 class GenericIndexedCloudPersist;
 class GenericProgressCallback;
 class NormalizedProgress;
@@ -312,6 +313,48 @@ public:
 		{}
 	};
 
+	//! Structure used during batched nearest neighbours search
+	/** Several query points lying in the same cell share the same candidates
+		(i.e. the points lying in the neighbourhood of this cell). They are gathered
+		only once, and their coordinates are duplicated in a contiguous 'structure
+		of arrays' buffer so that the distances to each query point are computed
+		by a tight (vectorizable) loop.
+		The 'level', 'cellPos', 'cellCenter', 'minNumberOfNeighbors' and
+		'maxSearchSquareDistd' fields are used as in NearestNeighboursSearchStruct.
+		The candidates are kept between two calls: 'alreadyVisitedNeighbourhoodSize'
+		should only be reset to 0 when the cell that includes the query points changes.
+	**/
+	struct NearestNeighboursBatchSearchStruct : public NearestNeighboursSearchStruct
+	{
+		/*** Candidates (internal) ***/
+
+		//! Candidates X coordinates (same order as 'pointsInNeighbourhood')
+		std::vector<PointCoordinateType> candidatesX;
+		//! Candidates Y coordinates (same order as 'pointsInNeighbourhood')
+		std::vector<PointCoordinateType> candidatesY;
+		//! Candidates Z coordinates (same order as 'pointsInNeighbourhood')
+		std::vector<PointCoordinateType> candidatesZ;
+		//! Square distances between the current query point and the candidates
+		std::vector<double> squareDistances;
+		//! Eligible candidates of the current query point
+		std::vector<unsigned> selection;
+
+		/*** Result ***/
+
+		//! Neighbours of all the query points
+		/** The neighbours of the ith query point are stored (sorted by increasing
+			distance) in [neighbours[neighboursOffsets[i]], neighbours[neighboursOffsets[i+1]][
+		**/
+		NeighboursSet neighbours;
+		//! Offsets of the neighbours of each query point in 'neighbours' (one more than the number of query points)
+		std::vector<unsigned> neighboursOffsets;
+
+		//! Returns the number of neighbours of the ith query point
+		inline unsigned neighboursCount(unsigned i) const { return neighboursOffsets[i + 1] - neighboursOffsets[i]; }
+		//! Returns the neighbours of the ith query point
+		inline const PointDescriptor* neighboursOf(unsigned i) const { return neighbours.data() + neighboursOffsets[i]; }
+	};
+
 	//! Association between an index and the code of an octree cell
 	/** Index could be the index of a point, in which case the code
 		would correspond to the octree cell where the point lies.
@@ -344,6 +387,14 @@ public:
 		{
 		}
 
+		//! Copy assignment operator
+		inline IndexAndCode& operator = (const IndexAndCode& ic)
+		{
+			theIndex = ic.theIndex;
+			theCode = ic.theCode;
+			return *this;
+		}
+
 		//! Code-based 'less than' comparison operator
 		inline bool operator < (const IndexAndCode& iac) const
 		{
@@ -461,6 +512,34 @@ public:
 				const CCVector3* pointsMaxFilter = 0,
 				GenericProgressCallback* progressCb = 0);
 
+	/**** INCREMENTAL UPDATE ****/
+
+	//! Inserts new points in the (already built) structure
+	/** The new points should have been appended to the associated cloud (i.e.
+		they are the points [firstIndex ; cloud size[). Their codes are merged into
+		the sorted structure and only the cells statistics are updated (no rebuild).
+		If the octree has been built with user-defined limits (see DgmOctree::build),
+		the new points are filtered the same way (i.e. the points falling outside the
+		'pointsFilter' limits are not projected).
+		\warning Otherwise the octree bounding-box can't grow: if a new point lies
+		outside of it, the method fails and the octree should be rebuilt.
+		\param firstIndex index of the first new point in the associated cloud
+		\return success (the octree is left untouched otherwise)
+	**/
+	virtual bool insertPoints(unsigned firstIndex);
+
+	//! Removes points from the (already built) structure
+	/** The remaining points of the associated cloud are expected to have kept
+		their relative order (i.e. their new index is their former index minus the
+		number of removed points before them). Points not projected in the octree
+		are simply ignored.
+		\warning The 'fill indexes' and the points bounding-box are not shrunk
+		(they remain valid, but may be larger than necessary).
+		\param removedIndexes indexes (before removal) of the removed points, sorted in ascending order
+		\return success (the octree is left untouched otherwise)
+	**/
+	virtual bool removePoints(const cellIndexesContainer& removedIndexes);
+
 	/**** GETTERS ****/
 
 	//! Returns the number of points projected into the octree
@@ -640,6 +719,38 @@ public:
 												double radius,
 												bool sortValues = true) const;
 
+	//! Batched form of the nearest neighbours search algorithm (multiple neighbours)
+	/** Looks for the 'nNSS.minNumberOfNeighbors' nearest neighbours of several query points
+		lying in the same octree cell at once (see NearestNeighboursBatchSearchStruct). As opposed
+		to findNearestNeighborsStartingFromCell, exactly 'minNumberOfNeighbors' neighbours are
+		returned for each query point (unless the octree doesn't have enough points or the
+		maximum search distance is reached, in which case the farthest points are not returned).
+		\param nNSS batched NN search parameters (the results are stored in nNSS.neighbours)
+		\param queryPoints query points (all inside the cell described by nNSS)
+		\param getOnlyPointsWithValidScalar whether to ignore points having an invalid associated scalar value
+		\return success (false if not enough memory). The number of neighbours found for each query point
+		is given by nNSS.neighboursCount (it may be 0).
+	**/
+	bool findNearestNeighborsInBatch(	NearestNeighboursBatchSearchStruct &nNSS,
+										GenericIndexedCloud* queryPoints,
+										bool getOnlyPointsWithValidScalar = false) const;
+
+	//! Batched form of the nearest neighbours search algorithm (in a sphere)
+	/** Looks for the neighbours of several query points lying in the same octree cell
+		at once (see NearestNeighboursBatchSearchStruct). As opposed to findNeighborsInASphereStartingFromCell,
+		only the points actually inside the sphere are returned.
+		\param nNSS batched NN search parameters (the results are stored in nNSS.neighbours)
+		\param queryPoints query points (all inside the cell described by nNSS)
+		\param radius the sphere radius
+		\param sortValues specifies if the neighbours needs to be sorted by their distance to the query point or not
+		\return success (false if not enough memory). The number of neighbours found for each query point
+		is given by nNSS.neighboursCount (it may be 0).
+	**/
+	bool findNeighborsInASphereInBatch(	NearestNeighboursBatchSearchStruct &nNSS,
+										GenericIndexedCloud* queryPoints,
+										double radius,
+										bool sortValues = true) const;
+
 public: //extraction of points inside geometrical volumes (sphere, cylinder, box, etc.)
 
 	//deprecated
@@ -1015,6 +1126,9 @@ public:	/***** CELLS POSITION HANDLING *****/
 		(if no points lies in it) or to 1 (if some points lie in it, e.g. if it is indeed a
 		cell of this octree). This version of the algorithm can be applied by considering only
 		a specified list of octree cells (ignoring the others).
+		The cells are labeled by blocks (in parallel if possible) with a lock-free union-find
+		structure: only the input cells are stored (i.e. no dense grid). The components are
+		numbered in the order of their first cell along Z, then Y, then X.
 		\param cellCodes the cell codes to consider for the CC computation
 		\param level the level of subdivision at which to perform the algorithm
 		\param sixConnexity indicates if the CC's 3D connexity should be 6 (26 otherwise)
@@ -1173,6 +1287,8 @@ protected:
 	CCVector3 m_pointsMin;
 	//! Max coordinates of the bounding-box of the set of points projected in the octree
 	CCVector3 m_pointsMax;
+	//! Whether the octree limits and the points filter have been specified by the user (see DgmOctree::build)
+	bool m_userDefinedLimits;
 
 	//! Cell dimensions for all subdivision levels
 	PointCoordinateType m_cellSize[MAX_OCTREE_LEVEL+2];
@@ -1213,6 +1329,14 @@ protected:
 	**/
 	void computeCellsStatistics(unsigned char level);
 
+	//! Updates the cells statistics (for all levels) before inserting or removing elements
+	/** Must be called before the elements are actually merged into/removed from the structure.
+		\param codes elements that are going to be inserted or removed (sorted by code)
+		\param insertion whether the elements are going to be inserted (or removed)
+		\param[out] levelsToRecompute levels for which statistics must be computed from scratch once the structure is updated
+	**/
+	void updateCellsStatistics(const cellsContainer& codes, bool insertion, bool levelsToRecompute[MAX_OCTREE_LEVEL+1]);
+
 	//! Returns the indexes of the neighbourhing (existing) cells of a given cell
 	/** This function is used by the nearest neighbours search algorithms.
 		\param cellPos the query cell
@@ -1234,6 +1358,24 @@ protected:
 											int neighbourhoodLength,
 											bool getOnlyPointsWithValidScalar = false) const;
 
+	//! Gathers the candidates of a batched NN search up to a given neighbourhood size
+	/** \param nNSS batched NN search parameters
+		\param neighbourhoodLength the neighbourhood size (in terms of cells) to reach
+		\param getOnlyPointsWithValidScalar whether to ignore points having an invalid associated scalar value
+		\return false if not enough memory
+	**/
+	bool getBatchCandidatesAround(	NearestNeighboursBatchSearchStruct &nNSS,
+									int neighbourhoodLength,
+									bool getOnlyPointsWithValidScalar = false) const;
+
+	//! Returns the minimum and maximum neighbourhood sizes that may contain points (relatively to a given cell)
+	/** \param cellPos cell position
+		\param level level of subdivision
+		\param[out] minLength neighbourhood size below which the neighbourhood is empty
+		\param[out] maxLength neighbourhood size above which the neighbourhood contains all the points
+	**/
+	void getUsefulNeighbourhoodLengths(const Tuple3i& cellPos, unsigned char level, int& minLength, int& maxLength) const;
+
 #ifdef TEST_CELLS_FOR_SPHERICAL_NN
 	void getPointsInNeighbourCellsAround(NearestNeighboursSphericalSearchStruct &nNSS,
 												int minNeighbourhoodLength,
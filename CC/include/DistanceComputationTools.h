@@ -36,6 +36,8 @@ class ChunkedPointCloud;
 class GenericProgressCallback;
 struct OctreeAndMeshIntersection;
 class ScalarField;
+class MeshBVH;
+class Cloud2CloudReferenceContext;
 
 //! Several entity-to-entity distances computation algorithms (cloud-cloud, cloud-mesh, point-triangle, etc.)
 class CC_CORE_LIB_API DistanceComputationTools : public CCToolbox
@@ -107,6 +109,16 @@ public: //distance to clouds or meshes
 		**/
 		bool resetFormerDistances;
 
+		//! Persistent reference context (optional)
+		/** If set (and if it corresponds to the reference cloud), its octree is used instead of the
+			input reference octree and the local models are cached in it. Allows to compare several
+			clouds to the same reference cloud without recomputing the reference data each time.
+			The distances are the same as without a context, within floating-point tolerance: the local
+			models are fitted on the same neighbours, but they may be accumulated in a different order
+			(the reference octree box is not the same).
+		**/
+		Cloud2CloudReferenceContext* referenceContext;
+
 		//! Default constructor/initialization
 		Cloud2CloudDistanceComputationParams()
 			: octreeLevel(0)
@@ -120,6 +132,7 @@ public: //distance to clouds or meshes
 			, reuseExistingLocalModels(false)
 			, CPSet(0)
 			, resetFormerDistances(true)
+			, referenceContext(0)
 		{
 			splitDistances[0] = splitDistances[1] = splitDistances[2] = 0;
 		}
@@ -140,7 +153,7 @@ public: //distance to clouds or meshes
 		\param params distance computation parameters
 		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
 		\param compOctree the pre-computed octree of the compared cloud (warning: both octrees must have the same cubical bounding-box - it is automatically computed if 0)
-		\param refOctree the pre-computed octree of the reference cloud (warning: both octrees must have the same cubical bounding-box - it is automatically computed if 0)
+		\param refOctree the pre-computed octree of the reference cloud (warning: both octrees must have the same cubical bounding-box - it is automatically computed if 0 - ignored if a reference context is used)
 		\return 0 if ok, a negative value otherwise
 	**/
 	static int computeCloud2CloudDistance(	GenericIndexedCloudPersist* comparedCloud,
@@ -150,6 +163,33 @@ public: //distance to clouds or meshes
 											DgmOctree* compOctree = 0,
 											DgmOctree* refOctree = 0);
 
+	//! Computes the "nearest neighbour distance" between two point clouds by spatial tiles (out-of-core mode)
+	/** Same output as computeCloud2CloudDistance, but the compared cloud is processed by spatial tiles so that
+		the octrees and the points subsets never exceed a given memory budget (the clouds themselves can be
+		stored in memory-mapped scratch files, see ChunkedArrayAllocator). For each tile, only the reference points
+		lying in the tile bounding-box enlarged by a halo (max search distance + local model radius) are loaded.
+		The points of both clouds are sorted by tile cell once per pass (the indexes are stored in chunked arrays).
+		Without max search distance, the points whose nearest neighbour lies farther than the halo are processed
+		again by tiles (with the same memory budget) with a twice bigger halo, and so on until all the nearest
+		neighbours are found. The distances are therefore always the same as with a single (in-memory) run
+		(only the closest point set and split distances may differ in case of strictly equidistant neighbours).
+		With a local model, the models neighbourhoods depend on the octree cells: the results may then differ
+		as much as with a different octree level.
+		\warning Local models are only supported with a spherical neighbourhood (the kNN neighbourhood and the
+		'reuseExistingLocalModels' approximation depend on the tiles). The reference context is ignored.
+		\param comparedCloud the compared cloud (the distances will be computed on these points)
+		\param referenceCloud the reference cloud (the distances will be computed relatively to these points)
+		\param params distance computation parameters
+		\param memoryBudget max memory used by the structures of a tile (in MB - best effort: the tiles can't be smaller than 1/64th of the compared cloud extents)
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return 0 if ok, a negative value otherwise (-3 if the local model parameters are not compatible with this mode)
+	**/
+	static int computeCloud2CloudDistanceTiled(	GenericIndexedCloudPersist* comparedCloud,
+												GenericIndexedCloudPersist* referenceCloud,
+												Cloud2CloudDistanceComputationParams& params,
+												unsigned memoryBudget,
+												GenericProgressCallback* progressCb = 0);
+
 	//! Cloud-to-mes distances computation parameters
 	struct Cloud2MeshDistanceComputationParams
 	{
@@ -163,7 +203,7 @@ public: //distance to clouds or meshes
 
 		//! Use distance map (acceleration)
 		/** If true the distances will be aproximated by a Distance Transform.
-			\warning Incompatible with signed distances or Closest Point Set.
+			\warning Incompatible with signed distances, Closest Point Set or split distances.
 		**/
 		bool useDistanceMap;
 
@@ -176,7 +216,9 @@ public: //distance to clouds or meshes
 		//! Whether triangle normals should be computed in the 'direct' order (true) or 'indirect' (false)
 		bool flipNormals;
 
-		//! Whether to use multi-thread or single thread mode (if maxSearchDist > 0, single thread mode is forced)
+		//! Whether to use multi-thread or single thread mode
+		/** Compatible with maxSearchDist > 0 (but not with the Distance Transform - see useDistanceMap).
+		**/
 		bool multiThread;
 
 		//! Maximum number of threads to use (0 = max)
@@ -184,10 +226,36 @@ public: //distance to clouds or meshes
 
 		//! Cloud to store the Closest Point Set
 		/** The cloud should be initialized but empty on input. It will have the same size as the compared cloud on output.
-			\warning Not compatible with maxSearchDist > 0.
+			If maxSearchDist > 0, the points farther than maxSearchDist are their own 'closest point'.
+			\warning Not compatible with the Distance Transform (see useDistanceMap).
 		**/
 		ChunkedPointCloud* CPSet;
 
+		//! Split distances (one scalar field per dimension: X, Y and Z)
+		/** Each scalar field should have the same size as the compared cloud (it is ignored otherwise).
+			It receives the coordinates of the vector from the closest point (on the mesh) to the compared point.
+			The points farther than maxSearchDist (if any) get NAN_VALUE.
+			\warning Not compatible with the Distance Transform (see useDistanceMap).
+		**/
+		ScalarField* splitDistances[3];
+
+		//! Whether to use a Bounding Volume Hierarchy of the mesh triangles instead of the octree/mesh intersection
+		/** Faster and much lighter with big meshes (especially with long and thin triangles).
+			The octree level is ignored in this case and the distances can't be approximated (see useDistanceMap).
+			The unsigned distances are the same as with the octree. The signs of the signed distances may differ
+			when the closest point lies on an edge or a vertex shared by several triangles: the BVH uses the
+			angle-weighted pseudo-normal of this edge or vertex, while the octree uses the normal of the first
+			triangle found among the closest ones (see MeshBVH::computeSignedDistance).
+		**/
+		bool useBVH;
+
+		//! Pre-computed BVH of the mesh (optional - see useBVH)
+		/** Allows to reuse the same BVH for repeated calls with the same mesh (it is computed on the fly otherwise).
+			\warning The BVH is only recomputed if it was built for another mesh or another number of triangles:
+			it is up to the caller to discard it if the mesh vertices have been modified in between.
+		**/
+		const MeshBVH* bvh;
+
 		//! Default constructor
 		Cloud2MeshDistanceComputationParams()
 			: octreeLevel(0)
@@ -198,7 +266,11 @@ public: //distance to clouds or meshes
 			, multiThread(true)
 			, maxThreadCount(0)
 			, CPSet(0)
-		{}
+			, useBVH(false)
+			, bvh(0)
+		{
+			splitDistances[0] = splitDistances[1] = splitDistances[2] = 0;
+		}
 	};
 
 	//! Computes the distance between a point cloud and a mesh
@@ -227,10 +299,11 @@ public: //approximate distances to clouds or meshes
 		\param comparedCloud the compared cloud
 		\param referenceCloud the reference cloud
 		\param octreeLevel the octree level at which to compute the Distance Transform
-		\param maxSearchDist max search distance (or any negative value if no max distance is defined)
+		\param maxSearchDist max search distance (or any negative value if no max distance is defined - if defined, the Distance Transform grid is restricted to the compared cloud extents + maxSearchDist)
 		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
 		\param compOctree the pre-computed octree of the compared cloud (warning: both octrees must have the same cubical bounding-box - it is automatically computed if 0)
 		\param refOctree the pre-computed octree of the reference cloud (warning: both octrees must have the same cubical bounding-box - it is automatically computed if 0)
+		\param referenceContext persistent reference context (optional - if set, its octree is used instead of refOctree and the compared octree is built on the same box)
 		\return negative error code or a positive value in case of success
 	**/
 	static int computeApproxCloud2CloudDistance(GenericIndexedCloudPersist* comparedCloud,
@@ -239,7 +312,8 @@ public: //approximate distances to clouds or meshes
 												PointCoordinateType maxSearchDist = 0,
 												GenericProgressCallback* progressCb = 0,
 												DgmOctree* compOctree = 0,
-												DgmOctree* refOctree = 0);
+												DgmOctree* refOctree = 0,
+												Cloud2CloudReferenceContext* referenceContext = 0);
 
 public: //distance to simple entities (triangles, planes, etc.)
 
@@ -343,6 +417,23 @@ public: //other methods
 											unsigned char octreeLevel,
 											GenericProgressCallback* progressCb = 0);
 
+	//! Computes geodesic distances over a point cloud "surface" (starting from several seed points)
+	/** The fronts started from each seed are propagated at once (see FastMarchingForGeodesicDistances):
+		each point gets the distance to its nearest seed (NaN if it can't be reached).
+		The propagation is multi-threaded (block-based Fast Sweeping) if the grid is big enough.
+		\param cloud the point cloud
+		\param seedPointIndexes the indexes of the points from where to start the propagation
+		\param octreeLevel the octree at which to perform the propagation
+		\param seedLabels if set, the index (in seedPointIndexes) of the nearest seed is stored for each point (NaN if not reached). If several seeds fall in the same cell, only the first one is kept.
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return true if the method succeeds
+	**/
+	static bool computeGeodesicDistances(	GenericIndexedCloudPersist* cloud,
+											const std::vector<unsigned>& seedPointIndexes,
+											unsigned char octreeLevel,
+											ScalarField* seedLabels = 0,
+											GenericProgressCallback* progressCb = 0);
+
 	//! Computes the differences between two scalar fields associated to equivalent point clouds
 	/** The compared cloud should be smaller or equal to the reference cloud. Its points should be
 		at the same position in space as points in the other cloud. The algorithm simply computes
@@ -406,6 +497,19 @@ protected:
 													Cloud2MeshDistanceComputationParams& params,
 													GenericProgressCallback* progressCb = 0);
 
+	//! Computes the distances between a point cloud and a mesh with a BVH
+	/** This method is used by computeCloud2MeshDistance (if params.useBVH is true).
+		\param pointCloud the compared cloud
+		\param bvh the BVH of the reference mesh
+		\param params parameters
+		\param progressCb the client method can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return -1 if an error occurred (e.g. not enough memory) and 0 otherwise
+	**/
+	static int computeCloud2MeshDistanceWithBVH(	GenericIndexedCloudPersist* pointCloud,
+													const MeshBVH& bvh,
+													Cloud2MeshDistanceComputationParams& params,
+													GenericProgressCallback* progressCb = 0);
+
 	//! Computes the "nearest neighbour distance" without local modeling for all points of an octree cell
 	/** This method has the generic syntax of a "cellular function" (see DgmOctree::localFunctionPtr).
 		Specific parameters are transmitted via the "additionalParameters" structure.
@@ -429,6 +533,7 @@ protected:
 		- (GenericCloud*) the reference cloud
 		- (DgmOctree*) the octree corresponding to the compared cloud
 		- (CC_LOCAL_MODEL_TYPES*) type of local model to apply
+		The local models are cached in the reference context if any (see Cloud2CloudDistanceComputationParams::referenceContext).
 		\param cell structure describing the cell on which processing is applied
 		\param additionalParameters see method description
 		\param nProgress optional (normalized) progress notification (per-point)
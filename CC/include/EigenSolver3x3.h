@@ -0,0 +1,314 @@
+//##########################################################################
+//#                                                                        #
+//#                              CLOUDCOMPARE                              #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU General Public License as published by  #
+//#  the Free Software Foundation; version 2 or later of the License.      #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#                    COPYRIGHT: CloudCompare project                     #
+//#                                                                        #
+//##########################################################################
+
+
+#ifndef EIGEN_SOLVER_3X3_HEADER
+#define EIGEN_SOLVER_3X3_HEADER
+
+//Local
+#include "Jacobi.h"
+
+//system
+#include <algorithm>
+#include <math.h>
+
+//! Closed-form eigen decomposition of symmetric 3x3 matrices (e.g. covariance matrices)
+/** The eigenvalues are computed analytically (trigonometric solution of the characteristic
+	polynomial). The eigenvector of the most isolated eigenvalue (the biggest or the smallest one)
+	is the largest cross product of the rows of (A - l.I): it is always well-conditioned. The two
+	other ones are then computed in the orthogonal plane (2x2 problem solved by a single rotation),
+	which is robust even if their eigenvalues are equal. The generic Jacobi method (see Jacobi.h)
+	is only used as a last resort.
+
+	The matrices are given in packed form: [xx, xy, xz, yy, yz, zz].
+	Eigenvalues (and eigenvectors) are always sorted in decreasing order.
+**/
+template <typename Scalar> class EigenSolver3x3
+{
+public:
+
+	typedef CCLib::SquareMatrixTpl<Scalar> SquareMatrix;
+
+	//! Converts a symmetric (3x3) square matrix to the packed form
+	static inline void ToPacked(const SquareMatrix& matrix, Scalar m[6])
+	{
+		m[0] = matrix.m_values[0][0];
+		m[1] = matrix.m_values[0][1];
+		m[2] = matrix.m_values[0][2];
+		m[3] = matrix.m_values[1][1];
+		m[4] = matrix.m_values[1][2];
+		m[5] = matrix.m_values[2][2];
+	}
+
+	//! Computes the eigenvalues of a symmetric 3x3 matrix
+	/** \param[in] m00 matrix element (0,0)
+		\param[in] m01 matrix element (0,1)
+		\param[in] m02 matrix element (0,2)
+		\param[in] m11 matrix element (1,1)
+		\param[in] m12 matrix element (1,2)
+		\param[in] m22 matrix element (2,2)
+		\param[out] l1 biggest eigenvalue
+		\param[out] l2 intermediate eigenvalue
+		\param[out] l3 smallest eigenvalue
+	**/
+	static inline void ComputeEigenValues(	Scalar m00, Scalar m01, Scalar m02, Scalar m11, Scalar m12, Scalar m22,
+											Scalar& l1, Scalar& l2, Scalar& l3)
+	{
+		//shift by the mean eigenvalue: B = (A - q.I)
+		Scalar q = (m00 + m11 + m22) / 3;
+		Scalar b00 = m00 - q;
+		Scalar b11 = m11 - q;
+		Scalar b22 = m22 - q;
+
+		Scalar offDiag = m01 * m01 + m02 * m02 + m12 * m12;
+		Scalar p = sqrt((b00 * b00 + b11 * b11 + b22 * b22 + 2 * offDiag) / 6);
+
+		//half determinant of B / p (clamped to [-1;1] because of the round-off errors)
+		Scalar det = b00 * (b11 * b22 - m12 * m12) - m01 * (m01 * b22 - m12 * m02) + m02 * (m01 * m12 - b11 * m02);
+		Scalar p3 = p * p * p;
+		Scalar r = (p3 > 0 ? det / (2 * p3) : 0);
+		r = std::min(static_cast<Scalar>(1), std::max(static_cast<Scalar>(-1), r));
+
+		static const Scalar c_twoThirdsOfPi = static_cast<Scalar>(2.0943951023931954923);
+		Scalar phi = acos(r) / 3;
+		l1 = q + 2 * p * cos(phi);
+		l3 = q + 2 * p * cos(phi + c_twoThirdsOfPi);
+		l2 = 3 * q - l1 - l3;
+	}
+
+	//! Computes the eigenvalues of a symmetric 3x3 matrix (packed form)
+	static inline void ComputeEigenValues(const Scalar m[6], Scalar eigenValues[3])
+	{
+		ComputeEigenValues(m[0], m[1], m[2], m[3], m[4], m[5], eigenValues[0], eigenValues[1], eigenValues[2]);
+	}
+
+	//! Computes the eigenvalues of several symmetric 3x3 matrices at once
+	/** Structure of arrays: the loop body has no dependency between two matrices and can be vectorized by the compiler.
+		\param[in] count number of matrices
+		\param[in] m arrays of matrices elements (packed form: m[0][i] is the element (0,0) of the i-th matrix, etc.)
+		\param[out] eigenValues arrays of eigenvalues (eigenValues[0][i] is the biggest eigenvalue of the i-th matrix, etc.)
+	**/
+	static void ComputeEigenValues(unsigned count, const Scalar* const m[6], Scalar* const eigenValues[3])
+	{
+		for (unsigned i = 0; i < count; ++i)
+		{
+			ComputeEigenValues(	m[0][i], m[1][i], m[2][i], m[3][i], m[4][i], m[5][i],
+								eigenValues[0][i], eigenValues[1][i], eigenValues[2][i]);
+		}
+	}
+
+	//! Computes the eigenvalues and eigenvectors of a symmetric 3x3 matrix (packed form)
+	/** \param[in] m matrix (packed form)
+		\param[out] eigenValues eigenvalues (decreasing order)
+		\param[out] eigenVectors unit eigenvectors (eigenVectors[i] corresponds to eigenValues[i]) - they form a direct orthonormal base
+		\return success
+	**/
+	static bool ComputeEigenValuesAndVectors(const Scalar m[6], Scalar eigenValues[3], Scalar eigenVectors[3][3])
+	{
+		ComputeEigenValues(m, eigenValues);
+
+		Scalar range = eigenValues[0] - eigenValues[2];
+		if (range != range)
+		{
+			//invalid matrix (NaN)
+			return false;
+		}
+
+		if (range <= 0)
+		{
+			//isotropic matrix: any base will do
+			for (unsigned i = 0; i < 3; ++i)
+				for (unsigned j = 0; j < 3; ++j)
+					eigenVectors[i][j] = (i == j ? static_cast<Scalar>(1) : static_cast<Scalar>(0));
+			return true;
+		}
+
+		//the eigenvector of the most isolated eigenvalue (biggest or smallest) is well-conditioned
+		unsigned isolated = (eigenValues[0] - eigenValues[1] >= eigenValues[1] - eigenValues[2] ? 0 : 2);
+		Scalar w[3];
+		if (!EigenVectorFromRows(m, eigenValues[isolated], w))
+		{
+			return ComputeWithJacobi(m, eigenValues, eigenVectors);
+		}
+
+		//the two other ones are computed in the orthogonal plane (2x2 problem)
+		Scalar u[3], v[3];
+		if (fabs(w[0]) > fabs(w[1]))
+		{
+			Scalar norm = sqrt(w[0] * w[0] + w[2] * w[2]);
+			u[0] = -w[2] / norm; u[1] = 0; u[2] = w[0] / norm;
+		}
+		else
+		{
+			Scalar norm = sqrt(w[1] * w[1] + w[2] * w[2]);
+			u[0] = 0; u[1] = w[2] / norm; u[2] = -w[1] / norm;
+		}
+		Cross(w, u, v);
+
+		Scalar Au[3], Av[3];
+		Multiply(m, u, Au);
+		Multiply(m, v, Av);
+		Scalar a = u[0] * Au[0] + u[1] * Au[1] + u[2] * Au[2];
+		Scalar b = u[0] * Av[0] + u[1] * Av[1] + u[2] * Av[2];
+		Scalar c = v[0] * Av[0] + v[1] * Av[1] + v[2] * Av[2];
+
+		//rotation that diagonalizes the 2x2 matrix (the first vector corresponds to the biggest eigenvalue)
+		Scalar theta = atan2(2 * b, a - c) / 2;
+		Scalar cosTheta = cos(theta);
+		Scalar sinTheta = sin(theta);
+
+		Scalar* big = eigenVectors[isolated == 0 ? 1 : 0];
+		Scalar* small = eigenVectors[isolated == 0 ? 2 : 1];
+		for (unsigned k = 0; k < 3; ++k)
+		{
+			big[k] = cosTheta * u[k] + sinTheta * v[k];
+			small[k] = cosTheta * v[k] - sinTheta * u[k];
+		}
+
+		//direct base
+		if (isolated == 0)
+		{
+			eigenVectors[0][0] = w[0];
+			eigenVectors[0][1] = w[1];
+			eigenVectors[0][2] = w[2];
+			Cross(eigenVectors[0], eigenVectors[1], eigenVectors[2]);
+		}
+		else
+		{
+			Cross(eigenVectors[0], eigenVectors[1], eigenVectors[2]);
+		}
+
+		//refine the eigenvalues (Rayleigh quotients)
+		for (unsigned k = 0; k < 3; ++k)
+		{
+			Scalar Ae[3];
+			Multiply(m, eigenVectors[k], Ae);
+			eigenValues[k] = eigenVectors[k][0] * Ae[0] + eigenVectors[k][1] * Ae[1] + eigenVectors[k][2] * Ae[2];
+		}
+
+		return true;
+	}
+
+	//! Computes the eigenvalues and eigenvectors of a symmetric 3x3 matrix
+	/** See the packed version.
+	**/
+	static bool ComputeEigenValuesAndVectors(const SquareMatrix& matrix, Scalar eigenValues[3], Scalar eigenVectors[3][3])
+	{
+		if (matrix.size() != 3)
+		{
+			assert(false);
+			return false;
+		}
+
+		Scalar m[6];
+		ToPacked(matrix, m);
+		return ComputeEigenValuesAndVectors(m, eigenValues, eigenVectors);
+	}
+
+protected:
+
+	//! Computes the eigenvector of a (well separated) eigenvalue
+	/** The rows of (A - l.I) span the plane orthogonal to the eigenvector: we take the largest of their cross products.
+		\return success
+	**/
+	static bool EigenVectorFromRows(const Scalar m[6], Scalar l, Scalar vec[3])
+	{
+		const Scalar r0[3] = { m[0] - l, m[1], m[2] };
+		const Scalar r1[3] = { m[1], m[3] - l, m[4] };
+		const Scalar r2[3] = { m[2], m[4], m[5] - l };
+
+		Scalar c[3][3];
+		Cross(r0, r1, c[0]);
+		Cross(r0, r2, c[1]);
+		Cross(r1, r2, c[2]);
+
+		unsigned best = 0;
+		Scalar bestNorm2 = 0;
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			Scalar norm2 = c[i][0] * c[i][0] + c[i][1] * c[i][1] + c[i][2] * c[i][2];
+			if (norm2 > bestNorm2)
+			{
+				bestNorm2 = norm2;
+				best = i;
+			}
+		}
+
+		if (!(bestNorm2 > 0))
+		{
+			return false;
+		}
+
+		Scalar norm = sqrt(bestNorm2);
+		vec[0] = c[best][0] / norm;
+		vec[1] = c[best][1] / norm;
+		vec[2] = c[best][2] / norm;
+
+		return true;
+	}
+
+	//! Matrix (packed form) by vector product
+	static inline void Multiply(const Scalar m[6], const Scalar v[3], Scalar result[3])
+	{
+		result[0] = m[0] * v[0] + m[1] * v[1] + m[2] * v[2];
+		result[1] = m[1] * v[0] + m[3] * v[1] + m[4] * v[2];
+		result[2] = m[2] * v[0] + m[4] * v[1] + m[5] * v[2];
+	}
+
+	//! Cross product
+	static inline void Cross(const Scalar a[3], const Scalar b[3], Scalar c[3])
+	{
+		c[0] = a[1] * b[2] - a[2] * b[1];
+		c[1] = a[2] * b[0] - a[0] * b[2];
+		c[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	//! Fallback: generic Jacobi method
+	static bool ComputeWithJacobi(const Scalar m[6], Scalar eigenValues[3], Scalar eigenVectors[3][3])
+	{
+		SquareMatrix matrix(3);
+		matrix.m_values[0][0] = m[0];
+		matrix.m_values[0][1] = matrix.m_values[1][0] = m[1];
+		matrix.m_values[0][2] = matrix.m_values[2][0] = m[2];
+		matrix.m_values[1][1] = m[3];
+		matrix.m_values[1][2] = matrix.m_values[2][1] = m[4];
+		matrix.m_values[2][2] = m[5];
+
+		SquareMatrix eigVectors;
+		std::vector<Scalar> eigValues;
+		if (	!Jacobi<Scalar>::ComputeEigenValuesAndVectors(matrix, eigVectors, eigValues, false)
+			||	!Jacobi<Scalar>::SortEigenValuesAndVectors(eigVectors, eigValues))
+		{
+			return false;
+		}
+
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			eigenValues[i] = eigValues[i];
+			Jacobi<Scalar>::GetEigenVector(eigVectors, i, eigenVectors[i]);
+		}
+
+		//direct base
+		Scalar* u = eigenVectors[0];
+		const Scalar* v = eigenVectors[1];
+		Cross(u, v, eigenVectors[2]);
+
+		return true;
+	}
+};
+
+#endif //EIGEN_SOLVER_3X3_HEADER
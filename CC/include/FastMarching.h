@@ -24,6 +24,8 @@
 #include "CCGeom.h"
 
 //system
+#include <assert.h>
+#include <new>
 #include <vector>
 #include <float.h>
 #include <string.h>
@@ -197,6 +199,194 @@ protected:
 	**/
 	virtual void initTrialCells();
 
+	//! Sparse grid of cells
+	/** The cells are stored by bricks of 8x8x8 (pointers) that are only allocated
+		when a cell is set inside. Memory therefore scales with the number of non
+		empty cells (and not with the grid bounding-box). The cells are accessed
+		with their (linear) grid index, and are owned by the grid.
+		If the X and Y dimensions are powers of two, a linear index is converted
+		to a brick and a cell (inside the brick) with shifts and masks only (otherwise
+		with divisions - see FastMarching::initOther).
+	**/
+	class CellGrid
+	{
+	public:
+
+		//! Number of bits per dimension of a brick
+		static const unsigned BRICK_BITS = 3;
+		//! Brick size (per dimension)
+		static const unsigned BRICK_SIZE = (1 << BRICK_BITS);
+		//! Number of cells per brick
+		static const unsigned BRICK_CELL_COUNT = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+		//! Default constructor
+		CellGrid()
+			: m_dx(0), m_dy(0), m_dz(0)
+			, m_xBits(0), m_yBits(0)
+			, m_powerOfTwo(false)
+		{
+			m_brickCount[0] = m_brickCount[1] = m_brickCount[2] = 0;
+		}
+
+		//! Destructor
+		~CellGrid() { clear(); }
+
+		//! Returns the smallest power of two (>= BRICK_SIZE) greater than or equal to a given size
+		static unsigned PaddedSize(unsigned size)
+		{
+			unsigned padded = BRICK_SIZE;
+			while (padded < size)
+				padded <<= 1;
+			return padded;
+		}
+
+		//! Initializes the grid (dimensions include the borders)
+		/** \param dx grid size along X (should be a power of two, see PaddedSize)
+			\param dy grid size along Y (should be a power of two, see PaddedSize)
+			\param dz grid size along Z
+		**/
+		bool init(unsigned dx, unsigned dy, unsigned dz)
+		{
+			clear();
+			m_dx = dx;
+			m_dy = dy;
+			m_dz = dz;
+			m_powerOfTwo = (dx == PaddedSize(dx) && dy == PaddedSize(dy));
+			for (m_xBits = 0; (1u << m_xBits) < dx; ++m_xBits) {}
+			for (m_yBits = 0; (1u << m_yBits) < dy; ++m_yBits) {}
+			m_brickCount[0] = ((dx + BRICK_SIZE - 1) >> BRICK_BITS);
+			m_brickCount[1] = ((dy + BRICK_SIZE - 1) >> BRICK_BITS);
+			m_brickCount[2] = ((dz + BRICK_SIZE - 1) >> BRICK_BITS);
+			try
+			{
+				m_bricks.resize(static_cast<size_t>(m_brickCount[0]) * m_brickCount[1] * m_brickCount[2], 0);
+			}
+			catch (const std::bad_alloc&)
+			{
+				//not enough memory
+				return false;
+			}
+			return true;
+		}
+
+		//! Returns whether the grid is initialized
+		inline bool isInitialized() const { return !m_bricks.empty(); }
+
+		//! Deletes all the cells (and the grid structure)
+		void clear()
+		{
+			for (size_t b = 0; b < m_bricks.size(); ++b)
+			{
+				if (m_bricks[b])
+				{
+					for (unsigned i = 0; i < BRICK_CELL_COUNT; ++i)
+						if (m_bricks[b][i])
+							delete m_bricks[b][i];
+					delete[] m_bricks[b];
+				}
+			}
+			m_bricks.clear();
+		}
+
+		//! Returns the cell at a given index (or 0 if it's empty)
+		inline Cell* operator[](unsigned index) const
+		{
+			unsigned brickIndex, cellIndex;
+			locate(index, brickIndex, cellIndex);
+			Cell** brick = m_bricks[brickIndex];
+			return brick ? brick[cellIndex] : 0;
+		}
+
+		//! Sets the cell at a given index (the grid takes its ownership - no previous cell is deleted)
+		/** \return false if not enough memory
+		**/
+		bool setCell(unsigned index, Cell* cell)
+		{
+			unsigned brickIndex, cellIndex;
+			locate(index, brickIndex, cellIndex);
+			Cell**& brick = m_bricks[brickIndex];
+			if (!brick)
+			{
+				if (!cell)
+					return true;
+				brick = new (std::nothrow) Cell*[BRICK_CELL_COUNT];
+				if (!brick)
+					return false;
+				memset(brick, 0, sizeof(Cell*) * BRICK_CELL_COUNT);
+			}
+			brick[cellIndex] = cell;
+			return true;
+		}
+
+		//! Returns the number of bricks along each dimension
+		inline const unsigned* brickCount() const { return m_brickCount; }
+
+		//! Returns a brick cells (or 0 if the brick is empty)
+		/** Cells are stored with 'x' first, then 'y' and 'z'.
+		**/
+		inline Cell* const* brick(unsigned brickIndex) const { return m_bricks[brickIndex]; }
+
+		//! Returns the (linear) grid index of a brick cell
+		inline unsigned cellIndex(unsigned brickIndex, unsigned localIndex) const
+		{
+			if (!m_powerOfTwo)
+			{
+				unsigned bx = brickIndex % m_brickCount[0];
+				unsigned by = (brickIndex / m_brickCount[0]) % m_brickCount[1];
+				unsigned bz = brickIndex / (m_brickCount[0] * m_brickCount[1]);
+				unsigned x = (bx << BRICK_BITS) | (localIndex & (BRICK_SIZE - 1));
+				unsigned y = (by << BRICK_BITS) | ((localIndex >> BRICK_BITS) & (BRICK_SIZE - 1));
+				unsigned z = (bz << BRICK_BITS) | (localIndex >> (2 * BRICK_BITS));
+				return x + (y + z * m_dy) * m_dx;
+			}
+
+			const unsigned bxBits = m_xBits - BRICK_BITS;
+			const unsigned byBits = m_yBits - BRICK_BITS;
+			unsigned bx = brickIndex & (m_brickCount[0] - 1);
+			unsigned by = (brickIndex >> bxBits) & (m_brickCount[1] - 1);
+			unsigned bz = brickIndex >> (bxBits + byBits);
+			unsigned x = (bx << BRICK_BITS) | (localIndex & (BRICK_SIZE - 1));
+			unsigned y = (by << BRICK_BITS) | ((localIndex >> BRICK_BITS) & (BRICK_SIZE - 1));
+			unsigned z = (bz << BRICK_BITS) | (localIndex >> (2 * BRICK_BITS));
+			return x | (y << m_xBits) | (z << (m_xBits + m_yBits));
+		}
+
+		//! Converts a grid index to a brick index and a cell index (inside the brick)
+		inline void locate(unsigned index, unsigned& brickIndex, unsigned& cellIndex) const
+		{
+			unsigned x, y, z;
+			if (m_powerOfTwo)
+			{
+				x = index & (m_dx - 1);
+				y = (index >> m_xBits) & (m_dy - 1);
+				z = index >> (m_xBits + m_yBits);
+				brickIndex = (x >> BRICK_BITS) | (((y >> BRICK_BITS) | ((z >> BRICK_BITS) << (m_yBits - BRICK_BITS))) << (m_xBits - BRICK_BITS));
+			}
+			else
+			{
+				x = index % m_dx;
+				y = (index / m_dx) % m_dy;
+				z = index / (m_dx * m_dy);
+				brickIndex = (x >> BRICK_BITS) + ((y >> BRICK_BITS) + (z >> BRICK_BITS) * m_brickCount[1]) * m_brickCount[0];
+			}
+			assert(z < m_dz);
+			cellIndex = (x & (BRICK_SIZE - 1)) | ((y & (BRICK_SIZE - 1)) << BRICK_BITS) | ((z & (BRICK_SIZE - 1)) << (2 * BRICK_BITS));
+		}
+
+	protected:
+
+		//! Grid dimensions
+		unsigned m_dx, m_dy, m_dz;
+		//! Number of bits of the X and Y dimensions (powers of two)
+		unsigned m_xBits, m_yBits;
+		//! Whether the X and Y dimensions are powers of two
+		bool m_powerOfTwo;
+		//! Number of bricks along each dimension
+		unsigned m_brickCount[3];
+		//! Bricks (0 = empty)
+		std::vector<Cell**> m_bricks;
+	};
+
 	//! Instantiates grid in memory
 	/** Grid is also filled with zeros.
 		\param size grid size
@@ -205,19 +395,17 @@ protected:
 	virtual bool instantiateGrid(unsigned size) = 0;
 
 	//! Grid instantiation helper
+	/** The cells are now stored in a sparse grid (see CellGrid): the template
+		parameter is only kept for compatibility.
+	**/
 	template <class T> bool instantiateGridTpl(unsigned size)
 	{
-		if (m_theGrid)
+		if (m_theGrid.isInitialized())
 			return false;
 
-		T** grid = new T*[size];
-		if (!grid)
-			return false;
-		memset(grid,0,size*sizeof(T*));
-
-		m_theGrid = (Cell**)grid;
-
-		return true;
+		assert(size == m_sliceSize * (m_dz + 2));
+		(void)size;
+		return m_theGrid.init(m_rowSize, m_sliceSize / m_rowSize, m_dz + 2);
 	}
 
 	//! Add a cell to the TRIAL cells list
@@ -260,16 +448,16 @@ protected:
 	unsigned m_dy;
 	//! Grid size along the Z dimension
 	unsigned m_dz;
-	//! Shift for cell access acceleration (Y dimension)
+	//! Shift for cell access acceleration (Y dimension - power of two if possible, see CellGrid)
 	unsigned m_rowSize;
-	//! Shift for cell access acceleration (Z dimension)
+	//! Shift for cell access acceleration (Z dimension - power of two if possible, see CellGrid)
 	unsigned m_sliceSize;
 	//! First index of innerbound grid
 	unsigned m_indexShift;
 	//! Grid size
 	unsigned m_gridSize;
 	//! Grid used to process Fast Marching
-	Cell** m_theGrid;
+	CellGrid m_theGrid;
 
 	//! Associated octree
 	DgmOctree* m_octree;
@@ -0,0 +1,165 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef FAST_MARCHING_GEODESIC_HEADER
+#define FAST_MARCHING_GEODESIC_HEADER
+
+//local
+#include "FastMarching.h"
+#include "DgmOctree.h"
+
+//system
+#include <utility>
+
+namespace CCLib
+{
+
+class GenericIndexedCloudPersist;
+class ScalarField;
+
+//! Fast Marching algorithm for geodesic distances computation (with multiple seeds)
+/** The front is propagated at constant speed over the (non empty) cells of an octree
+	level. Several seeds can be set, each one with its own label: all the fronts are
+	propagated at once and each cell gets the label of its nearest seed.
+
+	Two propagation schemes are available (see setBlockSweeping):
+	- the standard Fast Marching (the trial cells are stored in a binary heap)
+	- a block-based Fast Sweeping: the grid bricks (see FastMarching::CellGrid) are
+	swept until convergence. Adjacent bricks are never processed at the same time
+	(8 colors), so that the bricks of a same color can be processed in parallel and
+	the result doesn't depend on the number of threads.
+
+	Both schemes solve the same (upwind) discrete equations: the arrival times only
+	differ by the convergence tolerance of the sweeping.
+**/
+class CC_CORE_LIB_API FastMarchingForGeodesicDistances : public FastMarching
+{
+public:
+
+	//! Default constructor
+	FastMarchingForGeodesicDistances();
+
+	//! Initializes the grid with a point cloud (and its octree)
+	/** \param cloud the point cloud
+		\param octree the associated octree
+		\param gridLevel the level of subdivision
+		\return a negative value if something went wrong
+	**/
+	int init(GenericIndexedCloudPersist* cloud, DgmOctree* octree, unsigned char gridLevel);
+
+	//! Sets a given cell as "seed" with a given label
+	/** \param pos the cell position in the grid (3 integer coordinates)
+		\param label seed label
+		\return whether the cell could be set as a seed or not (i.e. if it's empty or already a seed)
+	**/
+	bool setSeedCell(const Tuple3i& pos, unsigned label);
+
+	//! Sets whether the block-based Fast Sweeping scheme should be used
+	/** Otherwise the standard (sequential) Fast Marching is used (default).
+	**/
+	inline void setBlockSweeping(bool state) { m_blockSweeping = state; }
+
+	//! Sets the front arrival times as distances for each point
+	/** \param labels if set, the label of the nearest seed is stored for each reached point (should have the same size as the cloud)
+		\return true if ok, false otherwise
+	**/
+	bool setPropagationTimingsAsDistances(ScalarField* labels = 0);
+
+	//inherited methods (see FastMarching)
+	virtual bool setSeedCell(const Tuple3i& pos) { return setSeedCell(pos, 0); }
+	virtual int propagate();
+	virtual void cleanLastPropagation();
+
+	//! Label of the cells that have not been reached
+	static const unsigned NO_LABEL = static_cast<unsigned>(-1);
+
+protected:
+
+	//! A brick to process (block-based Fast Sweeping)
+	struct BrickTask
+	{
+		//! Brick index
+		unsigned brickIndex;
+		//! Whether the cells on the brick border have changed
+		bool borderChanged;
+	};
+
+	//! Sweeps a brick (see propagateBlockSweeping)
+	/** Adjacent bricks should not be processed at the same time.
+	**/
+	static void SweepBrick(BrickTask& task);
+
+	//! A Fast Marching grid cell for geodesic distances
+	class GeodesicCell : public Cell
+	{
+	public:
+		//! Default constructor
+		GeodesicCell()
+			: Cell()
+			, label(NO_LABEL)
+			, cellCode(0)
+		{}
+
+		//! Destructor
+		virtual ~GeodesicCell() {}
+
+		//! Label of the nearest seed
+		unsigned label;
+		//! Equivalent cell code in the octree
+		DgmOctree::CellCode cellCode;
+	};
+
+	//! Computes the arrival time at a given cell from its neighbours
+	/** Upwind (Godunov) scheme with the 6 face neighbours, and direct
+		propagation from the other neighbours (extended connectivity).
+		\param index cell index
+		\param acceptedOnly whether only the ACTIVE neighbours should be considered (Fast Marching) or all of them (Fast Sweeping)
+		\param[out] label label of the nearest neighbour
+		\return arrival time (or Cell::T_INF() if no neighbour has been reached)
+	**/
+	float solveT(unsigned index, bool acceptedOnly, unsigned& label) const;
+
+	//! Updates a cell arrival time (Fast Marching)
+	void updateTrialCell(unsigned index);
+
+	//! Sweeps a brick until convergence
+	/** \return whether the cells on the brick border have changed
+	**/
+	bool sweepBrick(unsigned brickIndex);
+
+	//! Standard Fast Marching propagation
+	int propagateFM();
+	//! Block-based Fast Sweeping propagation
+	int propagateBlockSweeping();
+
+	//inherited methods (see FastMarching)
+	virtual float computeTCoefApprox(Cell* /*currentCell*/, Cell* /*neighbourCell*/) const { return 1.0f; }
+	virtual int step();
+	virtual bool instantiateGrid(unsigned size) { return instantiateGridTpl<GeodesicCell>(size); }
+
+	//! Whether to use the block-based Fast Sweeping scheme
+	bool m_blockSweeping;
+	//! Trial cells heap (arrival time, index) - may contain outdated entries
+	std::vector< std::pair<float, unsigned> > m_trialHeap;
+	//! Seed cells
+	std::vector<unsigned> m_seedCells;
+};
+
+}
+
+#endif //FAST_MARCHING_GEODESIC_HEADER
@@ -39,6 +39,7 @@ static const unsigned ELEMENT_INDEX_BIT_MASK = MAX_NUMBER_OF_ELEMENTS_PER_CHUNK-
 #endif
 
 #include "CCShareable.h"
+#include "ChunkedArrayAllocator.h"
 
 //system
 #include <stdlib.h>
@@ -63,6 +64,7 @@ public:
 		, m_count(0)
 		, m_capacity(0)
 		, m_iterator(0)
+		, m_allocationPolicy(ChunkedArrayAllocator::AUTO_ALLOCATION)
 	{
 		memset(m_minVal, 0, sizeof(ElementType)*N);
 		memset(m_maxVal, 0, sizeof(ElementType)*N);
@@ -76,6 +78,7 @@ public:
 		, m_count(0)
 		, m_capacity(0)
 		, m_iterator(0)
+		, m_allocationPolicy(gca.m_allocationPolicy)
 	{
 		if (!gca.copy(*this))
 		{
@@ -116,11 +119,13 @@ public:
 	inline size_t memory() const
 	{
 		return sizeof(GenericChunkedArray) 
-#ifndef CC_ENV_64
+#ifdef CC_ENV_64
+				+ m_data.capacity; //reserved memory (may be bigger than the capacity)
+#else
 				+ m_theChunks.capacity()     * sizeof(ElementType*)
 				+ m_perChunkCount.capacity() * sizeof(unsigned)
-#endif
 				+ static_cast<size_t>(N) * static_cast<size_t>(capacity()) * sizeof(ElementType);
+#endif
 	}
 
 	//! Clears the array
@@ -131,7 +136,7 @@ public:
 		if (releaseMemory)
 		{
 #ifdef CC_ENV_64
-			m_data.clear();
+			ChunkedArrayAllocator::Release(m_data);
 #else
 			while (!m_theChunks.empty())
 			{
@@ -164,8 +169,7 @@ public:
 		{
 			//default fill value = 0
 #ifdef CC_ENV_64
-			ElementType zero = 0;
-			std::fill(m_data.begin(), m_data.end(), zero);
+			memset(data(), 0, static_cast<size_t>(m_capacity) * N * sizeof(ElementType));
 #else
 			for (size_t i = 0; i < m_theChunks.size(); ++i)
 				memset(m_theChunks[i], 0, m_perChunkCount[i]*sizeof(ElementType)*N);
@@ -176,7 +180,7 @@ public:
 			//we initialize the first chunk properly
 			//with a recursive copy of N*2^k bytes (k=0,1,2,...)
 #ifdef CC_ENV_64
-			ElementType* _cDest = &(m_data.front());
+			ElementType* _cDest = data();
 #else
 			ElementType* _cDest = m_theChunks.front();
 #endif
@@ -229,17 +233,16 @@ public:
 	bool reserve(unsigned capacity)
 	{
 #ifdef CC_ENV_64
-		try
+		if (capacity > m_capacity)
 		{
-			m_data.resize(capacity * N);
-		}
-		catch (const std::bad_alloc&)
-		{
-			//not enough memory
-			return false;
-		}
+			if (!ChunkedArrayAllocator::Resize(m_data, static_cast<size_t>(capacity) * N * sizeof(ElementType), m_allocationPolicy))
+			{
+				//not enough memory
+				return false;
+			}
 
-		m_capacity = capacity;
+			m_capacity = capacity;
+		}
 #else
 		while (m_capacity < capacity)
 		{
@@ -315,11 +318,7 @@ public:
 		else //last case: we have to reduce the array size
 		{
 #ifdef CC_ENV_64
-			try
-			{
-				m_data.resize(count * N); //shouldn't fail, smaller
-			}
-			catch (const std::bad_alloc&)
+			if (!ChunkedArrayAllocator::Resize(m_data, static_cast<size_t>(count) * N * sizeof(ElementType), m_allocationPolicy)) //shouldn't fail, smaller
 			{
 				//not enough memory
 				return false;
@@ -435,7 +434,7 @@ public:
 	{
 		assert(index < m_capacity);
 #ifdef CC_ENV_64
-		return &(m_data[index * N]);
+		return data() + static_cast<size_t>(index) * N;
 #else
 		return m_theChunks[index >> CHUNK_INDEX_BIT_DEC]+((index & ELEMENT_INDEX_BIT_MASK)*N);
 #endif
@@ -449,7 +448,7 @@ public:
 	{
 		assert(index < m_capacity);
 #ifdef CC_ENV_64
-		return &(m_data[index * N]);
+		return data() + static_cast<size_t>(index) * N;
 #else
 		return m_theChunks[index >> CHUNK_INDEX_BIT_DEC]+((index & ELEMENT_INDEX_BIT_MASK)*N);
 #endif
@@ -602,11 +601,43 @@ public:
 
 #ifdef CC_ENV_64
 	//! Returns a pointer on the (contiguous) data array
-	inline ElementType* data() { return &(m_data.front()); }
+	inline ElementType* data() { return static_cast<ElementType*>(m_data.data); }
 
 	//! Returns a pointer on the (contiguous) data array (const version)
-	inline const ElementType* data() const { return &(m_data.front()); }
+	inline const ElementType* data() const { return static_cast<const ElementType*>(m_data.data); }
 #endif //!CC_ENV_64
+
+	//! Returns the allocation policy (see ChunkedArrayAllocator)
+	inline ChunkedArrayAllocator::Policy allocationPolicy() const { return m_allocationPolicy; }
+
+	//! Sets the allocation policy (see ChunkedArrayAllocator)
+	/** If the array is already allocated, its content is moved
+		(from the heap to a scratch file or the other way round) if necessary.
+		\warning Scratch files are only used on 64 bits architectures (the policy is ignored otherwise)
+		\param policy allocation policy
+		\return success
+	**/
+	bool setAllocationPolicy(ChunkedArrayAllocator::Policy policy)
+	{
+		m_allocationPolicy = policy;
+#ifdef CC_ENV_64
+		if (m_data.data)
+		{
+			return ChunkedArrayAllocator::Resize(m_data, m_data.size, m_allocationPolicy);
+		}
+#endif
+		return true;
+	}
+
+	//! Returns whether the array content is currently stored in a (memory-mapped) scratch file
+	inline bool isFileMapped() const
+	{
+#ifdef CC_ENV_64
+		return m_data.mapped;
+#else
+		return false;
+#endif
+	}
 	
 	//! Returns the number of chunks
 	inline unsigned chunksCount() const
@@ -635,7 +666,7 @@ public:
 	{
 		assert(index < chunksCount());
 #ifdef CC_ENV_64
-		return data() + (index * MAX_NUMBER_OF_ELEMENTS_PER_CHUNK * N);
+		return data() + static_cast<size_t>(index) * MAX_NUMBER_OF_ELEMENTS_PER_CHUNK * N;
 #else
 		return m_theChunks[index];
 #endif
@@ -646,7 +677,7 @@ public:
 	{
 		assert(index < chunksCount());
 #ifdef CC_ENV_64
-		return data() + (index * MAX_NUMBER_OF_ELEMENTS_PER_CHUNK * N);
+		return data() + static_cast<size_t>(index) * MAX_NUMBER_OF_ELEMENTS_PER_CHUNK * N;
 #else
 		return m_theChunks[index];
 #endif
@@ -667,7 +698,8 @@ public:
 		
 		//copy content		
 #ifdef CC_ENV_64
-		std::copy(m_data.begin(), m_data.end(), dest.m_data.begin());
+		if (count)
+			memcpy(dest.data(), data(), static_cast<size_t>(count) * N * sizeof(ElementType));
 #else
 		unsigned copyCount = 0;
 		assert(dest.m_theChunks.size() <= m_theChunks.size());
@@ -689,7 +721,9 @@ protected:
 	**/
 	virtual ~GenericChunkedArray()
 	{
-#ifndef CC_ENV_64
+#ifdef CC_ENV_64
+		ChunkedArrayAllocator::Release(m_data);
+#else
 		while (!m_theChunks.empty())
 		{
 			delete[] m_theChunks.back();
@@ -705,8 +739,8 @@ protected:
 	ElementType m_maxVal[N];
 
 #ifdef CC_ENV_64
-	//! Data
-	std::vector<ElementType> m_data;
+	//! Data (heap or memory-mapped)
+	ChunkedArrayAllocator::Block m_data;
 #else
 	//! Arrays 'chunks'
 	std::vector<ElementType*> m_theChunks;
@@ -721,6 +755,9 @@ protected:
 
 	//! Iterator
 	unsigned m_iterator;
+
+	//! Allocation policy
+	ChunkedArrayAllocator::Policy m_allocationPolicy;
 };
 
 //! Specialization of GenericChunkedArray for the case where N=1 (speed up)
@@ -738,6 +775,7 @@ public:
 		, m_count(0)
 		, m_capacity(0)
 		, m_iterator(0)
+		, m_allocationPolicy(ChunkedArrayAllocator::AUTO_ALLOCATION)
 	{}
 
 	//! Copy constructor
@@ -750,6 +788,7 @@ public:
 		, m_count(0)
 		, m_capacity(0)
 		, m_iterator(0)
+		, m_allocationPolicy(gca.m_allocationPolicy)
 	{
 		if (!gca.copy(*this))
 		{
@@ -788,11 +827,13 @@ public:
 	inline size_t memory() const
 	{
 		return sizeof(GenericChunkedArray) 
-#ifndef CC_ENV_64
+#ifdef CC_ENV_64
+				+ m_data.capacity; //reserved memory (may be bigger than the capacity)
+#else
 				+ m_theChunks.capacity()     * sizeof(ElementType*)
 				+ m_perChunkCount.capacity() * sizeof(unsigned)
-#endif
 				+ static_cast<size_t>(capacity()) * sizeof(ElementType);
+#endif
 	}
 	//! Clears the array
 	/** \param releaseMemory whether memory should be released or not (for quicker "refill")
@@ -802,7 +843,7 @@ public:
 		if (releaseMemory)
 		{
 #ifdef CC_ENV_64
-			m_data.clear();
+			ChunkedArrayAllocator::Release(m_data);
 #else
 			while (!m_theChunks.empty())
 			{
@@ -831,7 +872,7 @@ public:
 		}
 
 #ifdef CC_ENV_64
-		std::fill(m_data.begin(), m_data.end(), fillValue);
+		std::fill(data(), data() + m_capacity, fillValue);
 #else
 		if (fillValue == 0)
 		{
@@ -887,17 +928,16 @@ public:
 	bool reserve(unsigned capacity)
 	{
 #ifdef CC_ENV_64
-		try
+		if (capacity > m_capacity)
 		{
-			m_data.resize(capacity);
-		}
-		catch (const std::bad_alloc&)
-		{
-			//not enough memory
-			return false;
-		}
+			if (!ChunkedArrayAllocator::Resize(m_data, static_cast<size_t>(capacity) * sizeof(ElementType), m_allocationPolicy))
+			{
+				//not enough memory
+				return false;
+			}
 
-		m_capacity = capacity;
+			m_capacity = capacity;
+		}
 #else
 		while (m_capacity < capacity)
 		{
@@ -976,11 +1016,7 @@ public:
 		else //last case: we have to reduce the array size
 		{
 #ifdef CC_ENV_64
-			try
-			{
-				m_data.resize(count); //shouldn't fail, smaller
-			}
-			catch (const std::bad_alloc&)
+			if (!ChunkedArrayAllocator::Resize(m_data, static_cast<size_t>(count) * sizeof(ElementType), m_allocationPolicy)) //shouldn't fail, smaller
 			{
 				//not enough memory
 				return false;
@@ -1104,7 +1140,7 @@ public:
 	{
 		assert(index < m_capacity);
 #ifdef CC_ENV_64
-		return m_data[index];
+		return data()[index];
 #else
 		return m_theChunks[index >> CHUNK_INDEX_BIT_DEC][index & ELEMENT_INDEX_BIT_MASK];
 #endif
@@ -1118,7 +1154,7 @@ public:
 	{
 		assert(index < m_capacity);
 #ifdef CC_ENV_64
-		return m_data[index];
+		return data()[index];
 #else
 		return m_theChunks[index >> CHUNK_INDEX_BIT_DEC][index & ELEMENT_INDEX_BIT_MASK];
 #endif
@@ -1206,12 +1242,44 @@ public:
 
 #ifdef CC_ENV_64
 	//! Returns a pointer on the (contiguous) data array
-	inline ElementType* data() { return &(m_data.front()); }
+	inline ElementType* data() { return static_cast<ElementType*>(m_data.data); }
 
 	//! Returns a pointer on the (contiguous) data array (const version)
-	inline const ElementType* data() const { return &(m_data.front()); }
+	inline const ElementType* data() const { return static_cast<const ElementType*>(m_data.data); }
 #endif //!CC_ENV_64
 
+	//! Returns the allocation policy (see ChunkedArrayAllocator)
+	inline ChunkedArrayAllocator::Policy allocationPolicy() const { return m_allocationPolicy; }
+
+	//! Sets the allocation policy (see ChunkedArrayAllocator)
+	/** If the array is already allocated, its content is moved
+		(from the heap to a scratch file or the other way round) if necessary.
+		\warning Scratch files are only used on 64 bits architectures (the policy is ignored otherwise)
+		\param policy allocation policy
+		\return success
+	**/
+	bool setAllocationPolicy(ChunkedArrayAllocator::Policy policy)
+	{
+		m_allocationPolicy = policy;
+#ifdef CC_ENV_64
+		if (m_data.data)
+		{
+			return ChunkedArrayAllocator::Resize(m_data, m_data.size, m_allocationPolicy);
+		}
+#endif
+		return true;
+	}
+
+	//! Returns whether the array content is currently stored in a (memory-mapped) scratch file
+	inline bool isFileMapped() const
+	{
+#ifdef CC_ENV_64
+		return m_data.mapped;
+#else
+		return false;
+#endif
+	}
+
 	//! Returns the number of chunks
 	inline unsigned chunksCount() const
 	{
@@ -1239,7 +1307,7 @@ public:
 	{
 		assert(index < chunksCount());
 #ifdef CC_ENV_64
-		return data() + (index * MAX_NUMBER_OF_ELEMENTS_PER_CHUNK);
+		return data() + static_cast<size_t>(index) * MAX_NUMBER_OF_ELEMENTS_PER_CHUNK;
 #else
 		return m_theChunks[index];
 #endif
@@ -1250,7 +1318,7 @@ public:
 	{
 		assert(index < chunksCount());
 #ifdef CC_ENV_64
-		return data() + (index * MAX_NUMBER_OF_ELEMENTS_PER_CHUNK);
+		return data() + static_cast<size_t>(index) * MAX_NUMBER_OF_ELEMENTS_PER_CHUNK;
 #else
 		return m_theChunks[index];
 #endif
@@ -1271,7 +1339,8 @@ public:
 		
 		//copy content		
 #ifdef CC_ENV_64
-		std::copy(m_data.begin(), m_data.end(), dest.m_data.begin());
+		if (count)
+			memcpy(dest.data(), data(), static_cast<size_t>(count) * sizeof(ElementType));
 #else
 		unsigned copyCount = 0;
 		assert(dest.m_theChunks.size() <= m_theChunks.size());
@@ -1293,7 +1362,9 @@ protected:
 	**/
 	virtual ~GenericChunkedArray()
 	{
-#ifndef CC_ENV_64
+#ifdef CC_ENV_64
+		ChunkedArrayAllocator::Release(m_data);
+#else
 		while (!m_theChunks.empty())
 		{
 			delete[] m_theChunks.back();
@@ -1309,8 +1380,8 @@ protected:
 	ElementType m_maxVal;
 
 #ifdef CC_ENV_64
-	//! Data
-	std::vector<ElementType> m_data;
+	//! Data (heap or memory-mapped)
+	ChunkedArrayAllocator::Block m_data;
 #else
 	//! Arrays 'chunks'
 	std::vector<ElementType*> m_theChunks;
@@ -1325,6 +1396,9 @@ protected:
 
 	//! Iterator
 	unsigned m_iterator;
+
+	//! Allocation policy
+	ChunkedArrayAllocator::Policy m_allocationPolicy;
 };
 
 #endif //GENERIC_CHUNKED_ARRAY_HEADER
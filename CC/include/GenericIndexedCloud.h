@@ -57,6 +57,28 @@ public:
 		\param P output point
 	**/
 	virtual void getPoint(unsigned index, CCVector3& P) const = 0;
+
+	//! Default (maximum) number of points per block (see getPointsBlock)
+	static const unsigned DEFAULT_POINTS_BLOCK_SIZE = 1024;
+
+	//! Returns a block of consecutive points (bulk access)
+	/**	Returns (up to) 'count' consecutive points, starting from the ith one.
+		Depending on the implementation, the block is either a direct pointer on
+		the cloud internal storage (see ChunkedPointCloud) or a copy of the points
+		(see ReferenceCloud). This avoids one virtual call per point in loops over
+		all the cloud points. The default implementation returns a single point.
+		WARNINGS:
+		- the returned block may not be persistent (valid until the next call)!
+		- THIS METHOD MAY NOT BE COMPATIBLE WITH PARALLEL STRATEGIES (see getPoint)
+		\param index index of the first requested point (between 0 and the cloud size minus 1)
+		\param[in,out] count max number of requested points (input) / number of points actually returned (output, at least 1)
+		\return the block of points (undefined behavior if index is invalid)
+	**/
+	virtual const CCVector3* getPointsBlock(unsigned index, unsigned& count)
+	{
+		count = 1;
+		return getPoint(index);
+	}
 };
 
 }
@@ -0,0 +1,79 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef GENERIC_TILED_CLOUD_STREAM_HEADER
+#define GENERIC_TILED_CLOUD_STREAM_HEADER
+
+//Local
+#include "CCCoreLib.h"
+#include "CCGeom.h"
+
+namespace CCLib
+{
+
+class GenericIndexedCloudPersist;
+class ReferenceCloud;
+
+//! A generic interface to stream a point cloud by spatial tiles (out-of-core processing)
+/** The cloud is read tile by tile (each tile being loaded with the points of a 'halo' around it)
+	and the points selected by the process are written tile by tile, so that the memory
+	consumption of the process only depends on the tiles size (see CloudSamplingTools::sorFilterStreamed
+	for instance). The implementation is free to read the points from (and write them to) files,
+	an out-of-core cloud, etc. See CloudTileStream for an implementation based on an indexed cloud,
+	and SequentialTileStream for an implementation based on a sequential reader (e.g. a file).
+**/
+class CC_CORE_LIB_API GenericTiledCloudStream
+{
+public:
+
+	//! Default destructor
+	virtual ~GenericTiledCloudStream() {}
+
+	//! Returns the number of tiles
+	virtual unsigned tileCount() = 0;
+
+	//! Returns the bounding-box of the whole cloud
+	virtual void getBoundingBox(CCVector3& bbMin, CCVector3& bbMax) = 0;
+
+	//! Loads a tile
+	/** The tile 'core' points (i.e. the points of this tile) must come first, followed by the
+		points of the other tiles that lie inside the tile bounding-box enlarged by 'halo'.
+		\param tileIndex tile index
+		\param halo halo size (the tile bounding-box is enlarged by this value in each direction)
+		\param[out] coreCount number of core points
+		\param[out] tileMin tile bounding-box (min corner - all the core points lie inside)
+		\param[out] tileMax tile bounding-box (max corner - all the core points lie inside)
+		\return the tile points (owned by the stream and valid until the next call) or 0 if an error occurred
+	**/
+	virtual GenericIndexedCloudPersist* loadTile(	unsigned tileIndex,
+													PointCoordinateType halo,
+													unsigned& coreCount,
+													CCVector3& tileMin,
+													CCVector3& tileMax) = 0;
+
+	//! Writes the selected points of the last loaded tile
+	/** \param tileIndex tile index
+		\param selection selected (core) points (associated to the cloud returned by the last call to loadTile)
+		\return success
+	**/
+	virtual bool writeTileSelection(unsigned tileIndex, ReferenceCloud& selection) = 0;
+};
+
+}
+
+#endif //GENERIC_TILED_CLOUD_STREAM_HEADER
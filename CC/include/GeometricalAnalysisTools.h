@@ -28,6 +28,7 @@ namespace CCLib
 
 class GenericProgressCallback;
 class GenericCloud;
+class GenericIndexedCloud;
 class ScalarField;
 
 //! Several algorithms to compute point-clouds geometric characteristics  (curvature, density, etc.)
@@ -101,6 +102,43 @@ public:
 								GenericProgressCallback* progressCb = 0,
 								DgmOctree* inputOctree = 0);
 
+	//! Geometric features (see computeMultiScaleFeatures)
+	enum GeomFeature {	FEATURE_ROUGHNESS,				/**< Distance to the LS plane of the neighbours (see computeRoughness) **/
+						FEATURE_GAUSSIAN_CURVATURE,		/**< Gaussian curvature (see computeCurvature) **/
+						FEATURE_MEAN_CURVATURE,			/**< Mean curvature (see computeCurvature) **/
+						FEATURE_NORMAL_CHANGE_RATE,		/**< Normal change rate (see computeCurvature) **/
+						FEATURE_DENSITY_KNN,			/**< Number of neighbours (see computeLocalDensity) **/
+						FEATURE_DENSITY_2D,				/**< Surface density (see computeLocalDensity) **/
+						FEATURE_DENSITY_3D,				/**< Volume density (see computeLocalDensity) **/
+						FEATURE_EIGENVALUE_1,			/**< Biggest eigenvalue of the neighbourhood covariance matrix **/
+						FEATURE_EIGENVALUE_2,			/**< Intermediate eigenvalue of the neighbourhood covariance matrix **/
+						FEATURE_EIGENVALUE_3,			/**< Smallest eigenvalue of the neighbourhood covariance matrix **/
+						FEATURE_LINEARITY,				/**< (l1 - l2) / l1 **/
+						FEATURE_PLANARITY,				/**< (l2 - l3) / l1 **/
+						FEATURE_SPHERICITY,				/**< l3 / l1 **/
+	};
+
+	//! Computes several geometric features at several scales in a single pass
+	/** The neighbours of each point are extracted once (inside the biggest sphere) and sorted
+		by distance: the features at the smaller radii are computed with the nearest neighbours
+		only (the covariance sums are accumulated incrementally from one radius to the next).
+		The features are the same as the ones computed by computeRoughness, computeCurvature and
+		computeLocalDensity. The eigenvalues features are computed with the query point included.
+		\param theCloud processed cloud
+		\param features features to compute
+		\param radii neighbouring spheres radii
+		\param outputs output scalar fields (one per feature and radius: the field of feature f at radius r is outputs[f * radii.size() + r]). They are resized to the cloud size.
+		\param progressCb client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\param inputOctree if not set as input, octree will be automatically computed.
+		\return success (0) or error code (<0)
+	**/
+	static int computeMultiScaleFeatures(	GenericIndexedCloudPersist* theCloud,
+											const std::vector<GeomFeature>& features,
+											const std::vector<PointCoordinateType>& radii,
+											const std::vector<ScalarField*>& outputs,
+											GenericProgressCallback* progressCb = 0,
+											DgmOctree* inputOctree = 0);
+
 	//! Computes the gravity center of a point cloud
 	/** \warning this method uses the cloud global iterator
 		\param theCloud cloud
@@ -108,6 +146,13 @@ public:
 	**/
 	static CCVector3 computeGravityCenter(GenericCloud* theCloud);
 
+	//! Computes the gravity center of a point cloud (indexed version)
+	/** Faster version relying on bulk point access (see GenericIndexedCloud::getPointsBlock)
+		\param theCloud cloud
+		\return gravity center
+	**/
+	static CCVector3 computeGravityCenter(GenericIndexedCloud* theCloud);
+
 	//! Computes the weighted gravity center of a point cloud
 	/** \warning this method uses the cloud global iterator
 		\param theCloud cloud
@@ -157,13 +202,25 @@ public:
 	static CCLib::SquareMatrixd computeCovarianceMatrix(GenericCloud* theCloud,
 														const PointCoordinateType* _gravityCenter = 0);
 
+	//! Computes the covariance matrix of a clouds (indexed version)
+	/** Faster version relying on bulk point access (see GenericIndexedCloud::getPointsBlock)
+		\param theCloud point cloud
+		\param _gravityCenter if available, its gravity center
+		\return covariance matrix
+	**/
+	static CCLib::SquareMatrixd computeCovarianceMatrix(GenericIndexedCloud* theCloud,
+														const PointCoordinateType* _gravityCenter = 0);
+
 	//! Flag duplicate points
 	/** This method only requires an output scalar field. Duplicate points will be
 		associated to scalar value 1 (and 0 for the others).
+		If no octree is provided, a (multi-threaded) hash grid is used instead of the octree. In this
+		case the result is deterministic: the points are processed by increasing index (i.e. for each
+		group of duplicates, the point with the lowest index is kept).
 		\param theCloud processed cloud
 		\param minDistanceBetweenPoints min distance between (output) points
 		\param progressCb client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
-		\param inputOctree if not set as input, octree will be automatically computed.
+		\param inputOctree if set, the octree is used to find the duplicate points (otherwise a hash grid is used)
 		\return success (0) or error code (<0)
 	**/
 	static int flagDuplicatePoints(	GenericIndexedCloudPersist* theCloud,
@@ -246,6 +303,15 @@ protected:
 														void** additionalParameters,
 														NormalizedProgress* nProgress = 0);
 
+	//! Computes multi-scale features inside a cell
+	/**	\param cell structure describing the cell on which processing is applied
+		\param additionalParameters see method description
+		\param nProgress optional (normalized) progress notification (per-point)
+	**/
+	static bool computeMultiScaleFeaturesInACellAtLevel(const DgmOctree::octreeCell& cell,
+														void** additionalParameters,
+														NormalizedProgress* nProgress = 0);
+
 	//! Flags duplicate points inside a cell
 	/**	\param cell structure describing the cell on which processing is applied
 		\param additionalParameters see method description
@@ -255,6 +321,11 @@ protected:
 													void** additionalParameters,
 													NormalizedProgress* nProgress = 0);
 
+	//! Flags duplicate points with a hash grid (see flagDuplicatePoints)
+	static int flagDuplicatePointsWithHashGrid(	GenericIndexedCloudPersist* theCloud,
+												double minDistanceBetweenPoints,
+												GenericProgressCallback* progressCb = 0);
+
 	//! Refines the estimation of a sphere by (iterative) least-squares
 	static bool refineSphereLS(	GenericIndexedCloudPersist* cloud,
 								CCVector3& center,
@@ -22,6 +22,9 @@
 //Local
 #include "PointProjectionTools.h"
 
+//system
+#include <vector>
+
 namespace CCLib
 {
 
@@ -29,10 +32,17 @@ class GenericIndexedCloud;
 class GenericProgressCallback;
 
 //! A Kd Tree Class which implements functions related to point to point distance
+/** The tree is stored as a flat (pre-ordered) array of nodes. The points of each leaf
+	(bucket) are stored contiguously, with their coordinates in separate arrays (SoA).
+	Once built, the tree is read-only: the search methods can be called concurrently.
+**/
 class CC_CORE_LIB_API KDTree
 {
 public:
 
+	//! Max number of points per leaf
+	static const unsigned MAX_LEAF_SIZE = 16;
+
 	//! Default constructor
 	KDTree();
 
@@ -40,7 +50,8 @@ public:
 	virtual ~KDTree();
 
 	//! Builds the KD-tree
-	/** \param cloud the point cloud from which to buil the KDtree
+	/** The sub-trees are built in parallel (if Qt is available).
+		\param cloud the point cloud from which to buil the KDtree
 		\param progressCb the client method can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
 		\return success
 	**/
@@ -59,14 +70,14 @@ public:
 	**/
 	bool findNearestNeighbour(	const PointCoordinateType *queryPoint,
 								unsigned &nearestPointIndex,
-								ScalarType maxDist);
+								ScalarType maxDist) const;
 
 
 	//! Optimized version of nearest point search method
 	/** Only checks if there is a point p into the tree such that ||p-queryPoint||<=maxDist (see FindNearestNeighbour())
 	**/
 	bool findPointBelowDistance(const PointCoordinateType *queryPoint,
-								ScalarType maxDist);
+								ScalarType maxDist) const;
 
 
 	//! Searches for the points that lie to a given distance (up to a tolerance) from a query point
@@ -79,151 +90,115 @@ public:
 	unsigned findPointsLyingToDistance(const PointCoordinateType *queryPoint,
 										ScalarType distance,
 										ScalarType tolerance,
-										std::vector<unsigned> &points);
+										std::vector<unsigned> &points) const;
+
+	//! Searches for the k nearest neighbours of a query point
+	/** \param queryPoint query point coordinates
+		\param k number of neighbours
+		\param points [out] indexes of the neighbours (sorted by increasing distance)
+		\param squareDistances [out] squared distances of the neighbours (optional)
+		\param maxDist distance above which the function doesn't consider points (< 0 = no limit)
+		\return the number of neighbours found (k at most)
+	**/
+	unsigned findNearestNeighbours(	const PointCoordinateType *queryPoint,
+									unsigned k,
+									std::vector<unsigned> &points,
+									std::vector<ScalarType>* squareDistances = 0,
+									ScalarType maxDist = -1) const;
+
+	//! Searches for the points inside a sphere
+	/** \param queryPoint sphere center
+		\param radius sphere radius
+		\param points [out] indexes of the points such that ||p-queryPoint||<=radius (appended)
+		\return the number of points found
+	**/
+	unsigned findPointsInRadius(const PointCoordinateType *queryPoint,
+								ScalarType radius,
+								std::vector<unsigned> &points) const;
 
 protected:
 
-	//! A KDTre cell struct
-	struct KdCell
+	//! A KD-tree node
+	/** Nodes are stored in pre-order: the 'lesser' child of a node is always the next node
+		(hence only the 'greater' child index is stored).
+	**/
+	struct KdNode
 	{
-		KdCell()
-			: cuttingDim(0)
-			, cuttingCoordinate(0)
-			, leSon(0)
-			, gSon(0)
-			, father(0)
-			, startingPointIndex(0)
-			, nbPoints(0)
-			, boundsMask(0)
-		{}
-		
-		//Warning: put the non aligned members (< 4 bytes) at the end to avoid too much alignment padding!
-
-		//! Inside bounding box max point
-		/** The inside bounding box is the smallest cube containing all the points in the cell
-		**/
-		CCVector3 inbbmax;																			//12 bytes
-		//! Inside bounding box min point
-		/** The inside bounding box is the smallest cube containing all the points in the cell
-		**/
-		CCVector3 inbbmin;																			//12 bytes
-		//! Outside bounding box min point
-		/** The outside bounding box is the bigest cube contained inside the cutting planes that lead to the cell
-		**/
-		CCVector3 outbbmin;																			//12 bytes
-		//! Outside bounding box max point
-		/** The outside bounding box is the bigest cube contained inside the cutting planes that lead to the cell
+		//! Inside bounding box min point (smallest box containing all the points of the node)
+		CCVector3 bbMin;																			//12 bytes
+		//! Inside bounding box max point (smallest box containing all the points of the node)
+		CCVector3 bbMax;																			//12 bytes
+		//! Place where the space is cut into two sub-spaces (children)
+		/** Each point p which lies in the 'lesser' child is such as p[cuttingDim] <= cuttingCoordinate
 		**/
-		CCVector3 outbbmax;																			//12 bytes
-
+		PointCoordinateType cuttingCoordinate;														//4 bytes
+		//! Index of the 'greater' child (0 for leaves)
+		unsigned greaterChild;																		//4 bytes
+		//! Index of the first point of the node (in the reordered points arrays)
+		unsigned firstPoint;																		//4 bytes
+		//! Number of points in the node
+		unsigned pointCount;																		//4 bytes
 		//! Dimension (0, 1 or 2 for x, y or z) which is used to separate the two children
 		unsigned cuttingDim;																		//4 bytes
-		//! Place where the space is cut into two sub-spaces (children)
-		PointCoordinateType cuttingCoordinate;														//4 bytes
-		//! Each point p which lie in leSon is such as p[cuttingDim] <= cuttingCoordinate
-		struct KdCell* leSon;																		//8 bytes
-		//! Each point p which lie in gSon is such as p[cuttingDim] > cuttingCoordinate
-		struct KdCell* gSon;																		//8 bytes
-		//! To go up in the tree
-		struct KdCell* father;																		//8 bytes
-		//! Index of the first element that belongs to this cell
-		unsigned startingPointIndex;																//4 bytes
-		//! Number of elements in this cell
-		unsigned nbPoints;																			//4 bytes
-
-		//! Mask to know if the outside box is bounded for a given dimmension
-		/** if boundsMask & (2^d) then outbbmin.u[d] is bounded (else the box is opened in outmin.u[d] - i.e. outbbmin.u[d] = -infinite)
-			if boundsmask & (2^(3+d)) then outbbmax.u[d] is bounded (else the box is opened in outmax.u[d] - i.e. outbbmax.u[d] = infinite)
-		**/
-		unsigned char boundsMask;																	//1 byte (+ 3 for alignment)
 
-		//Total																						//92 bytes
+		//! Whether the node is a leaf or not
+		inline bool isLeaf() const { return greaterChild == 0; }
+
+		//Total																						//44 bytes
 	};
 
 	/*** Protected attributes ***/
 
-	//! Tree root
-	KdCell* m_root;
-	//! Point indexes
+	//! Nodes (pre-ordered, the first one is the root)
+	std::vector<KdNode> m_nodes;
+	//! Point indexes (reordered so that the points of each node are contiguous)
 	std::vector<unsigned> m_indexes;
+	//! Reordered points X coordinates
+	std::vector<PointCoordinateType> m_pointsX;
+	//! Reordered points Y coordinates
+	std::vector<PointCoordinateType> m_pointsY;
+	//! Reordered points Z coordinates
+	std::vector<PointCoordinateType> m_pointsZ;
 	//! Associated cloud
 	GenericIndexedCloud* m_associatedCloud;
-	//! Number of cells
-	unsigned m_cellCount;
 
+	//! Build task (a node or a whole sub-tree to build)
+	struct BuildTask
+	{
+		//! Tree
+		KDTree* tree;
+		//! Node index
+		unsigned node;
+		//! First point
+		unsigned first;
+		//! Number of points
+		unsigned count;
+	};
 
 	/*** Protected methods ***/
 
-	//! Builds a sub tree
-	/** \param first first index
-		\param last last index
-		\param father father cell
-		\param nbBuildCell nbBuildCell
-		\param progressCb the client method can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
-		\return sub tree (cell)
-	**/
-	KdCell* buildSubTree(unsigned first, unsigned last, KdCell *father, unsigned &nbBuildCell, GenericProgressCallback *progressCb = 0);
+	//! Builds a single node (bounding box, cutting plane and children indexes)
+	void buildNode(const BuildTask& task);
 
-	//! Deletes a sub tree
-	void deleteSubTree(KdCell *cell);
+	//! Builds a whole sub-tree (recursively)
+	void buildSubTree(const BuildTask& task);
 
-	//! Computes a cell inside bounding box using the sons ones. The sons bounding boxes have to be up to date considering the points they contain.
-	void updateInsideBoundingBox(KdCell* cell);
+	//! Builds a single node (multi-thread wrapper)
+	static void BuildNode_MT(BuildTask& task);
 
-	//! Computes a cell outside bounding box using the father one and the cutting plane.
-	void updateOutsideBoundingBox(KdCell* cell);
+	//! Builds a whole sub-tree (multi-thread wrapper)
+	static void BuildSubTree_MT(BuildTask& task);
 
-	//! Computes the distance between a point and a cell inside bounding box
-	/** \param queryPoint queryPoint coordinates
-		\param cell the cell from which we want to compute the distance
-		\return 0 if the point is inside the cell, the suare of the distance between the two elements if the point is outside
-	**/
-	ScalarType pointToCellSquareDistance(const PointCoordinateType *queryPoint, KdCell *cell);
-
-	//! Computes the distance between a point and the outside bounding box of the cell in which it lies.
-	/** \param queryPoint the query point coordinates
-		\param cell the cell containting the query point
-		\return the distance between the point and the cell border. If this value is negative, it means that the cell has no border.
-	**/
-	ScalarType InsidePointToCellDistance(const PointCoordinateType *queryPoint, KdCell *cell);
+	//! Returns the number of nodes of a (sub-)tree containing a given number of points
+	static unsigned NodeCount(unsigned pointCount);
 
-	//! Computes the distances (min & max) between a point and a cell inside bounding box
-	/** \param queryPoint the query point coordinates
-		\param cell the cell from which we want to compute the distance
-		\param min [out] the minimal distance between the query point and the inside bounding box of cell
-		\param max [out] the maximal distance between the query point and the inside bounding box of cell
+	//! Computes the squared distance between a point and a node inside bounding box
+	/** \return 0 if the point is inside the box
 	**/
-	void pointToCellDistances(const PointCoordinateType *queryPoint, KdCell *cell, ScalarType &min, ScalarType &max);
+	static ScalarType PointToNodeSquareDistance(const PointCoordinateType *queryPoint, const KdNode& node);
 
-	//! Checks if there is a point in KdCell that is less than minDist-apart from the query point, starting from cell cell
-	/** \param queryPoint the query Point coordinates
-		\param maxSqrDist square of the maximal distance from querypoint
-		\param cell kdtree-cell from which to start the research
-		\return -1 if there is no nearer point from querypoint. The nearest point index found in cell if there is one that is at most maxdist apart from querypoint
-	**/
-	int checkNearerPointInSubTree(const PointCoordinateType *queryPoint, ScalarType& maxSqrDist, KdCell *cell);
-
-	//! Checks if there is a point in KdCell that is less than minDist-apart from the query point, starting from cell cell
-	/** Optimiszed version of CheckNearerPointInSubTree since we don't want to find the nearest point, but only check if there is a point that is close enough
-		\param queryPoint the query Point coordinates
-		\param maxSqrDist square of the maximal distance from querypoint
-		\param cell kdtree-cell from which to start the research
-		\return true if there is a point in the subtree starting at cell that is close enough from the query point
-	**/
-	bool checkDistantPointInSubTree(const PointCoordinateType *queryPoint, ScalarType &maxSqrDist, KdCell *cell);
-
-	//! Recursive function which store every point lying to a given distance from the query point
-	/** \param queryPoint the query point coordinates
-		\param distance the wished distance from the query point
-		\param tolerance tolerance for resulting points : p is in resulting array if ||p-queryPoint||<=tolerance
-		\param cell current cell to explore (used for recursion)
-		\param[out] localArray output of the algorithm. Resulting points m_indexes in associatedCloud are stored in this array
-	**/
-	void distanceScanTree(	const PointCoordinateType* queryPoint, 
-							ScalarType distance, 
-							ScalarType tolerance, 
-							KdCell* cell, 
-							std::vector<unsigned>& localArray);
+	//! Computes the squared distance between a point and the farthest corner of a node inside bounding box
+	static ScalarType PointToNodeMaxSquareDistance(const PointCoordinateType *queryPoint, const KdNode& node);
 };
 
 }
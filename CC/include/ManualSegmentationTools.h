@@ -42,6 +42,8 @@ public:
 	/** The camera parameters of the screen must be transmitted to this method,
 		as well as the polyline (generally drawn on the screen by a user)
 		expressed in the screen coordinates.
+		The polyline is rasterized first (see PolygonInclusionGrid) and the points
+		are tested in parallel (if multi-threading is enabled).
 		\param aCloud the cloud to segment
 		\param poly the polyline
 		\param keepInside if true (resp. false), the points falling inside (resp. outside) the polyline will be extracted
@@ -62,7 +64,9 @@ public:
 
 
 	//! Tests if a point is inside a polygon (2D)
-	/** \param P a 2D point
+	/** \warning All the polygon edges are tested: to test many points
+		against the same polygon, use a PolygonInclusionGrid instead.
+		\param P a 2D point
 		\param polyVertices polygon vertices (considered as ordered 2D poyline vertices)
 		\return true if P is inside poly
 	**/
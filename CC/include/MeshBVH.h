@@ -0,0 +1,176 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef MESH_BVH_HEADER
+#define MESH_BVH_HEADER
+
+//Local
+#include "CCCoreLib.h"
+#include "CCGeom.h"
+#include "CCTypes.h"
+#include "SimpleTriangle.h"
+
+//system
+#include <vector>
+
+namespace CCLib
+{
+
+class GenericIndexedMesh;
+class GenericProgressCallback;
+
+//! Bounding Volume Hierarchy of the triangles of a mesh
+/** Binary tree built with the Surface Area Heuristic (SAH). It is used to find the closest
+	triangle of a point (see DistanceComputationTools::computeCloud2MeshDistance). Contrary
+	to the octree/mesh intersection, its size only depends on the number of triangles
+	(and not on their shape or on the octree level).
+	The triangles vertices are copied: the BVH remains valid as long as the mesh is not modified
+	(it can therefore be reused for several distance computations with the same mesh).
+	The angle-weighted pseudo-normals of the vertices and edges are also computed so as to get
+	robust signed distances (see computeSignedDistance).
+	The queries are const and can be performed by several threads in parallel.
+**/
+class CC_CORE_LIB_API MeshBVH
+{
+public:
+
+	//! Maximum number of triangles per leaf
+	static const unsigned MAX_LEAF_SIZE = 4;
+
+	//! Default constructor
+	MeshBVH();
+
+	//! Builds the BVH
+	/** \param mesh mesh
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return success
+	**/
+	bool build(GenericIndexedMesh* mesh, GenericProgressCallback* progressCb = 0);
+
+	//! Clears the structure
+	void clear();
+
+	//! Returns the mesh associated to the BVH (if any)
+	inline GenericIndexedMesh* associatedMesh() const { return m_mesh; }
+
+	//! Returns the number of triangles
+	inline unsigned size() const { return static_cast<unsigned>(m_triangles.size()); }
+
+	//! Returns the number of nodes
+	inline unsigned nodeCount() const { return static_cast<unsigned>(m_nodes.size()); }
+
+	//! Searches for the closest triangle of a point
+	/** The (squared) distance is computed with DistanceComputationTools::computePoint2TriangleDistance.
+		If several triangles are at the same distance, the one with the smallest index is returned.
+		\param P query point
+		\param maxSquareDist maximum squared distance (only triangles strictly closer are considered - ignored if < 0)
+		\param[out] triangleIndex index of the closest triangle (in the associated mesh)
+		\param[out] squareDist squared distance to the closest triangle
+		\param[out] triangle closest triangle vertices (optional)
+		\return whether a triangle has been found or not
+	**/
+	bool findClosestTriangle(	const CCVector3& P,
+								ScalarType maxSquareDist,
+								unsigned& triangleIndex,
+								ScalarType& squareDist,
+								const GenericTriangle** triangle = 0) const;
+
+	//! Computes the signed distance between a point and a triangle
+	/** If the closest point lies inside the triangle, the result is the same as DistanceComputationTools::computePoint2TriangleDistance.
+		If it lies on an edge or a vertex, the sign is given by the angle-weighted pseudo-normal of this edge or vertex
+		(J. A. Baerentzen and H. Aanaes, "Signed distance computation using the angle weighted pseudonormal", 2005)
+		so that it doesn't depend on which of the triangles sharing it is the closest one.
+		\param P query point
+		\param triangleIndex triangle index (in the associated mesh - see findClosestTriangle)
+		\param[out] nearestP closest point on the triangle (optional)
+		\return signed distance
+	**/
+	ScalarType computeSignedDistance(const CCVector3& P, unsigned triangleIndex, CCVector3* nearestP = 0) const;
+
+protected:
+
+	//! A BVH node
+	/** The bounding-boxes of both children are stored in the parent node (so that
+		a single node read is required to sort and cull them). Nodes are stored in
+		pre-order: the root node is always the first one (and is never a child).
+		Each child is either:
+		- an inner node (triangleCount[i] == 0 and child[i] != 0)
+		- a leaf (triangleCount[i] > 0 and child[i] = index of its first triangle)
+		- empty (triangleCount[i] == 0 and child[i] == 0)
+	**/
+	struct Node
+	{
+		//! Children bounding-boxes min corners (SoA: [dim][child])
+		PointCoordinateType bbMin[3][2];
+		//! Children bounding-boxes max corners (SoA: [dim][child])
+		PointCoordinateType bbMax[3][2];
+		//! Children (node index or first triangle)
+		unsigned child[2];
+		//! Children triangle count (0 for inner nodes)
+		unsigned triangleCount[2];
+	};
+
+	//! Builds a node (recursively)
+	/** \return node index
+	**/
+	unsigned buildNode(unsigned first, unsigned count, unsigned depth);
+
+	//! Splits a range of triangles in two (SAH)
+	/** \return the number of triangles in the first half
+	**/
+	unsigned splitRange(unsigned first, unsigned count, unsigned depth);
+
+	//! Sets a node child (bounding-box and leaf / sub-tree)
+	void setChild(unsigned nodeIndex, unsigned char childIndex, unsigned first, unsigned count, unsigned depth);
+
+	//! Computes the angle-weighted pseudo-normals of the vertices and edges (once the triangles are sorted)
+	/** \return success (false if not enough memory)
+	**/
+	bool computePseudoNormals(GenericIndexedMesh* mesh);
+
+	//! Associated mesh
+	GenericIndexedMesh* m_mesh;
+
+	//! Nodes
+	std::vector<Node> m_nodes;
+
+	//! Triangles (sorted so that each leaf triangles are contiguous)
+	std::vector<SimpleTriangle> m_triangles;
+
+	//! Triangles indexes (in the associated mesh)
+	std::vector<unsigned> m_indexes;
+
+	//! Triangles positions (i.e. inverse of m_indexes)
+	std::vector<unsigned> m_positions;
+
+	//! Triangles vertices indexes (same order as m_triangles)
+	std::vector<unsigned> m_vertIndexes;
+
+	//! Pseudo-normals of the triangles edges (AB, BC and CA - same order as m_triangles)
+	std::vector<CCVector3> m_edgeNormals;
+
+	//! Pseudo-normals of the mesh vertices
+	std::vector<CCVector3> m_vertexNormals;
+
+	//! Triangles centroids (only used during the build process)
+	std::vector<CCVector3> m_centroids;
+};
+
+} //namespace CCLib
+
+#endif //MESH_BVH_HEADER
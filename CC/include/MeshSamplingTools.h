@@ -24,7 +24,7 @@
 #include "GenericChunkedArray.h"
 
 //system
-#include <map>
+#include <vector>
 
 namespace CCLib
 {
@@ -113,6 +113,9 @@ public:
 		handled by generating another random number between 0 and 1.
 		If this number is less than Nf, then Ni = Ni+1. The number of points
 		sampled on the triangle will simply be Ni.
+		The random numbers of each triangle are drawn from a dedicated (counter-based)
+		stream, so that the triangles can be sampled in parallel: the result is always
+		the same, whatever the number of threads.
 		\param mesh the mesh to be sampled
 		\param samplingDensity the sampling surface density
 		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
@@ -156,18 +159,20 @@ protected:
 											GenericProgressCallback* progressCb = 0,
 											GenericChunkedArray<1,unsigned>* triIndices = 0);
 
-	//! Map used to count the number of triangles using each edge
-	/** Edges are represented by two 32 bits indexes merged as a 64 integer
-	**/
-	typedef std::map<unsigned long long, unsigned> EdgeUsageMap;
-
 	//! Computes the unique key corresponding to an edge
 	static unsigned long long ComputeEdgeKey(unsigned i1, unsigned i2);
 	//! Computes the edge vertex indexes from its unique key
 	static void DecodeEdgeKey(unsigned long long key, unsigned& i1, unsigned& i2);
 
-	//! Creates a map to count the number of triangles using each edge
-	static bool buildMeshEdgeUsageMap(GenericIndexedMesh* mesh, EdgeUsageMap& edgeMap);
+	//! Creates the sorted list of the keys of all the edges of a mesh (see ComputeEdgeKey)
+	/** Each edge key appears once per triangle using it: the number of consecutive
+		identical keys is the number of triangles using the edge. Contrary to a map,
+		no memory is allocated per edge and the sort can be multi-threaded.
+		\param[in] mesh triangular mesh
+		\param[out] edgeKeys sorted edges keys (3 per triangle)
+		\return false if an error occurred (invalid input or not enough memory)
+	**/
+	static bool buildSortedMeshEdgeKeys(GenericIndexedMesh* mesh, std::vector<unsigned long long>& edgeKeys);
 };
 
 }
@@ -197,6 +197,19 @@ class CC_CORE_LIB_API Neighbourhood
 							const CCVector3& Y,
 							const CCVector3& N);
 
+		//! Computes the best interpolating plane (Least-square) from a covariance matrix
+		/** Handy when the covariance matrix has already been computed (e.g. incrementally).
+			\param covMat covariance matrix (3x3)
+			\param G gravity center
+			\param[out] planeEquation plane equation [a,b,c,d] such as ax + by + cz = d
+			\param[out] planeVectors local base vectors (X, Y and normal - optional)
+			\return success
+		**/
+		static bool ComputeLSPlane(	const CCLib::SquareMatrixd& covMat,
+									const CCVector3& G,
+									PointCoordinateType planeEquation[4],
+									CCVector3* planeVectors = 0);
+
 		//! Returns best interpolating plane (Least-square) 'X' base vector
 		/** This corresponds to the largest eigen value (i.e. the largest cloud dimension)
 			\return 0 if computation failed
@@ -0,0 +1,131 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef POLYGON_INCLUSION_GRID_HEADER
+#define POLYGON_INCLUSION_GRID_HEADER
+
+//Local
+#include "CCCoreLib.h"
+#include "CCGeom.h"
+
+//system
+#include <vector>
+
+namespace CCLib
+{
+
+class GenericIndexedCloud;
+
+//! Accelerated point-in-polygon test (2D)
+/** The polygon bounding-box is divided in a coarse grid of cells. Each cell is
+	flagged as inside, outside or 'boundary' (i.e. crossed by at least one edge).
+	The edges are also sorted by row of cells (scanline edge table). A point falling
+	in an inside or outside cell is classified by a single lookup, and the crossing
+	test of the points falling in a boundary cell only involves the edges of its row.
+	The result is the same as ManualSegmentationTools::isPointInsidePoly.
+	Once built, the queries are const and can be performed by several threads in parallel.
+**/
+class CC_CORE_LIB_API PolygonInclusionGrid
+{
+public:
+
+	//! Default number of cells along the biggest dimension of the polygon bounding-box
+	static const unsigned DEFAULT_RESOLUTION = 256;
+
+	//! Default constructor
+	PolygonInclusionGrid();
+
+	//! Builds the grid
+	/** \param polyVertices polygon vertices (considered as ordered 2D polyline vertices - only X and Y are used)
+		\param resolution number of cells along the biggest dimension of the polygon bounding-box
+		\return success (false if not enough memory)
+	**/
+	bool build(const GenericIndexedCloud* polyVertices, unsigned resolution = DEFAULT_RESOLUTION);
+
+	//! Builds the grid
+	/** \param polyVertices polygon vertices (considered as ordered 2D polyline vertices)
+		\param resolution number of cells along the biggest dimension of the polygon bounding-box
+		\return success (false if not enough memory)
+	**/
+	bool build(const std::vector<CCVector2>& polyVertices, unsigned resolution = DEFAULT_RESOLUTION);
+
+	//! Clears the structure
+	void clear();
+
+	//! Tests if a point is inside the polygon
+	/** \param P a 2D point
+		\return true if P is inside the polygon
+	**/
+	bool isInside(const CCVector2& P) const;
+
+protected:
+
+	//! Cell state
+	enum CellState
+	{
+		CELL_OUTSIDE	= 0,	/**< The cell is fully outside the polygon **/
+		CELL_INSIDE		= 1,	/**< The cell is fully inside the polygon **/
+		CELL_BOUNDARY	= 2		/**< The cell is crossed by (or close to) at least one edge **/
+	};
+
+	//! Polygon edge (from A to B)
+	struct Edge
+	{
+		PointCoordinateType ax, ay, bx, by;
+	};
+
+	//! Crossing test (with the edges of a single row)
+	bool isInsideRow(const CCVector2& P, unsigned row) const;
+
+	//! Returns the row of cells a point falls in (the point must be inside the grid)
+	inline unsigned getRow(PointCoordinateType y) const
+	{
+		unsigned row = static_cast<unsigned>((y - m_gridMin.y) / m_cellHeight);
+		return (row < m_rowCount ? row : m_rowCount - 1);
+	}
+	//! Returns the column of cells a point falls in (the point must be inside the grid)
+	inline unsigned getCol(PointCoordinateType x) const
+	{
+		unsigned col = static_cast<unsigned>((x - m_gridMin.x) / m_cellWidth);
+		return (col < m_colCount ? col : m_colCount - 1);
+	}
+
+	//! Grid min corner (polygon bounding-box + margin)
+	CCVector2 m_gridMin;
+	//! Grid max corner (polygon bounding-box + margin)
+	CCVector2 m_gridMax;
+	//! Cells width
+	PointCoordinateType m_cellWidth;
+	//! Cells height
+	PointCoordinateType m_cellHeight;
+	//! Number of columns
+	unsigned m_colCount;
+	//! Number of rows (0 if no point can be inside)
+	unsigned m_rowCount;
+
+	//! Cells states (see CellState - row by row)
+	std::vector<unsigned char> m_cells;
+	//! Index of the first edge of each row (in m_rowEdges) + total number of row edges
+	std::vector<unsigned> m_rowStart;
+	//! Edges of each row (contiguous)
+	std::vector<Edge> m_rowEdges;
+};
+
+} //namespace CCLib
+
+#endif //POLYGON_INCLUSION_GRID_HEADER
@@ -23,6 +23,9 @@
 #include "GenericIndexedCloudPersist.h"
 #include "GenericChunkedArray.h"
 
+//system
+#include <vector>
+
 namespace CCLib
 {
 
@@ -58,6 +61,7 @@ public:
 	//**** inherited form GenericIndexedCloud ****//
 	inline virtual const CCVector3* getPoint(unsigned index) { assert(m_theAssociatedCloud && index < size()); return m_theAssociatedCloud->getPoint(m_theIndexes->getValue(index)); }
 	inline virtual void getPoint(unsigned index, CCVector3& P) const { assert(m_theAssociatedCloud && index < size()); m_theAssociatedCloud->getPoint(m_theIndexes->getValue(index),P); }
+	virtual const CCVector3* getPointsBlock(unsigned index, unsigned& count);
 
 	//**** inherited form GenericIndexedCloudPersist ****//
 	inline virtual const CCVector3* getPointPersistentPtr(unsigned index) { assert(m_theAssociatedCloud && index < size()); return m_theAssociatedCloud->getPointPersistentPtr(m_theIndexes->getValue(index)); }
@@ -175,6 +179,9 @@ protected:
 	//! Iterator on the point references container
 	unsigned m_globalIterator;
 
+	//! Buffer for bulk point access (see getPointsBlock)
+	std::vector<CCVector3> m_pointsBlock;
+
 	//! Bounding-box min corner
 	CCVector3 m_bbMin;
 	//! Bounding-box max corner
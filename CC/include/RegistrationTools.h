@@ -172,6 +172,7 @@ public:
 			, dataWeights(0)
 			, transformationFilters(SKIP_NONE)
 			, maxThreadCount(0)
+			, useMeshBVH(false)
 		{}
 
 		//! Convergence type
@@ -206,6 +207,13 @@ public:
 
 		//! Maximum number of threads to use (0 = max)
 		int maxThreadCount;
+
+		//! Whether to compute the cloud/mesh distances with a BVH of the mesh (i.e. only if the model entity is a mesh)
+		/** The BVH is computed once for all the iterations (see DistanceComputationTools::Cloud2MeshDistanceComputationParams::useBVH).
+			The distances and the Closest Point Set are the same as with the octree, unless several triangles are
+			at the same distance of a point (the closest point may then differ, and so may the registration result).
+		**/
+		bool useMeshBVH;
 	};
 
 	//! Registers two clouds or a cloud and a mesh
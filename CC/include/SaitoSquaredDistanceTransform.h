@@ -91,8 +91,17 @@ namespace CCLib
 		static bool EDT_1D(GridElement* slice, size_t r, size_t c);
 		//! 2D Exact Squared Distance Transform
 		static bool SDT_2D(Grid3D<GridElement>& image, size_t sliceIndex, const std::vector<GridElement>& sq);
+		//! Final pass (along Z) of the 3D Exact Squared Distance Transform for one row of the grid
+		static bool SDT_Z(Grid3D<GridElement>& image, size_t rowIndex, const std::vector<GridElement>& sq);
 		//! 3D Exact Squared Distance Transform
+		/** The slices (2D EDT) and then the rows (final pass along Z) are processed in parallel if possible.
+		**/
 		static bool SDT_3D(Grid3D<GridElement>& image, GenericProgressCallback* progressCb = 0);
+
+		//! Inverts the input values of a slice and computes its 2D EDT (see SDT_3D)
+		static void ProcessSlice(const size_t& sliceIndex);
+		//! Computes the final distances of a row (see SDT_3D)
+		static void ProcessRow(const size_t& rowIndex);
 	};
 
 }
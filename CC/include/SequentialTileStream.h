@@ -0,0 +1,156 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef SEQUENTIAL_TILE_STREAM_HEADER
+#define SEQUENTIAL_TILE_STREAM_HEADER
+
+//Local
+#include "ChunkedArrayAllocator.h"
+#include "ChunkedPointCloud.h"
+#include "GenericTiledCloudStream.h"
+#include "TilingGrid.h"
+
+namespace CCLib
+{
+
+class GenericProgressCallback;
+
+//! Tiled stream of a point cloud that is read (and written) sequentially, e.g. a file
+/** Out-of-core implementation of GenericTiledCloudStream: the cloud is never loaded.
+	The points are read three times in a row (bounding-box, tiling - see TilingGrid - and
+	sorting). They are sorted by tile in memory-mapped scratch files (see ChunkedArrayAllocator),
+	with an opaque record per point (e.g. the raw point record of a file) so that the selected
+	points can be written as is, tile by tile.
+
+	The memory consumption only depends on the tiles size: the current tile and its halo
+	are the only points loaded in memory (the scratch files are paged by the OS).
+**/
+class CC_CORE_LIB_API SequentialTileStream : public GenericTiledCloudStream
+{
+public:
+
+	//! Sequential point reader
+	class PointReader
+	{
+	public:
+
+		//! Default destructor
+		virtual ~PointReader() {}
+
+		//! Returns the number of points
+		virtual unsigned size() = 0;
+
+		//! Returns the size of the point records (in bytes - can be 0)
+		virtual unsigned recordSize() = 0;
+
+		//! (Re)starts reading from the first point
+		virtual bool rewind() = 0;
+
+		//! Reads the next point
+		/** \param[out] P point coordinates
+			\param[out] record point record (recordSize() bytes)
+			\return success
+		**/
+		virtual bool readPoint(CCVector3& P, void* record) = 0;
+	};
+
+	//! Sequential point writer
+	class PointWriter
+	{
+	public:
+
+		//! Default destructor
+		virtual ~PointWriter() {}
+
+		//! Writes a point
+		/** \param P point coordinates
+			\param record point record (as read by the PointReader)
+			\return success
+		**/
+		virtual bool writePoint(const CCVector3& P, const void* record) = 0;
+	};
+
+	//! Default constructor
+	/** \param reader the reader of the cloud to stream
+		\param writer the writer of the selected points (in tile order)
+		\param maxTilePointCount max number of points per tile (best effort: a tile can't be smaller than a cell of the tiling grid)
+	**/
+	SequentialTileStream(PointReader* reader, PointWriter* writer, unsigned maxTilePointCount);
+
+	//! Destructor
+	virtual ~SequentialTileStream();
+
+	//! Reads the cloud and sorts the points by tile
+	/** Must be called before any other method.
+		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return false if a reading error occurred, if not enough memory or if the process was cancelled
+	**/
+	bool init(GenericProgressCallback* progressCb = 0);
+
+	//inherited from GenericTiledCloudStream
+	virtual unsigned tileCount();
+	virtual void getBoundingBox(CCVector3& bbMin, CCVector3& bbMax);
+	virtual GenericIndexedCloudPersist* loadTile(	unsigned tileIndex,
+													PointCoordinateType halo,
+													unsigned& coreCount,
+													CCVector3& tileMin,
+													CCVector3& tileMax);
+	virtual bool writeTileSelection(unsigned tileIndex, ReferenceCloud& selection);
+
+	//! Returns the number of points written so far
+	inline unsigned writtenCount() const { return m_writtenCount; }
+
+protected:
+
+	//! Releases the scratch files
+	void release();
+
+	//! Reader
+	PointReader* m_reader;
+	//! Writer
+	PointWriter* m_writer;
+	//! Max number of points per tile
+	unsigned m_maxTilePointCount;
+	//! Number of points
+	unsigned m_pointCount;
+	//! Records size (in bytes)
+	unsigned m_recordSize;
+
+	//! Cloud bounding-box (min corner)
+	CCVector3 m_bbMin;
+	//! Cloud bounding-box (max corner)
+	CCVector3 m_bbMax;
+
+	//! Tiling
+	TilingGrid m_tiling;
+	//! Points coordinates sorted by tile (scratch file)
+	ChunkedArrayAllocator::Block m_sortedPoints;
+	//! Points records sorted by tile (scratch file)
+	ChunkedArrayAllocator::Block m_sortedRecords;
+
+	//! Current tile points
+	ChunkedPointCloud m_tilePoints;
+	//! Current tile index
+	unsigned m_currentTile;
+	//! Number of written points
+	unsigned m_writtenCount;
+};
+
+}
+
+#endif //SEQUENTIAL_TILE_STREAM_HEADER
@@ -77,6 +77,17 @@ public:
 	**/
 	virtual void addPoint(const PointCoordinateType P[]);
 
+	//! Sets the coordinates of an existing point
+	/** Can be called concurrently for different points. WARNING: the bounding-box
+		is not updated (see invalidateBoundingBox).
+		\param index point index
+		\param P the point coordinates
+	**/
+	void setPoint(unsigned index, const CCVector3& P);
+
+	//! Invalidates the bounding-box (it will be recomputed next time it is requested)
+	inline void invalidateBoundingBox() { m_validBB = false; }
+
 	//! Reserves some memory for hosting the points
 	/** \param n the number of points
 	**/
@@ -0,0 +1,143 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#ifndef TILING_GRID_HEADER
+#define TILING_GRID_HEADER
+
+//Local
+#include "CCCoreLib.h"
+#include "CCGeom.h"
+
+//system
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+namespace CCLib
+{
+
+//! Spatial tiling of a point cloud (see GenericTiledCloudStream)
+/** The cloud bounding-box is covered by a coarse regular grid. The grid is recursively
+	split (along its largest dimension, by halves in terms of points count) until each
+	tile has less than a given number of points. The tiles are made of grid cells, so
+	that the tile of a point is given by its cell. The memory consumption only depends
+	on the grid resolution (not on the number of points).
+
+	Usage: init, countPoint (for all the points), computeTiles, then getTileIndex.
+**/
+class CC_CORE_LIB_API TilingGrid
+{
+public:
+
+	//! Tile
+	struct Tile
+	{
+		//! Default constructor
+		Tile(const Tuple3i& _minPos, const Tuple3i& _maxPos, unsigned _count)
+			: minPos(_minPos)
+			, maxPos(_maxPos)
+			, first(0)
+			, count(_count)
+		{}
+
+		//! First cell (included)
+		Tuple3i minPos;
+		//! Last cell (excluded)
+		Tuple3i maxPos;
+		//! Number of points in the previous tiles (i.e. index of the first point once the points are sorted by tile)
+		unsigned first;
+		//! Number of points
+		unsigned count;
+	};
+
+	//! Max number of cells of the grid along the largest dimension
+	static const int RESOLUTION = 128;
+
+	//! Default constructor
+	TilingGrid();
+
+	//! Initializes the grid
+	/** \param bbMin bounding-box of the points to tile (min corner)
+		\param bbMax bounding-box of the points to tile (max corner)
+		\return false if not enough memory
+	**/
+	bool init(const CCVector3& bbMin, const CCVector3& bbMax);
+
+	//! Counts a point (must be called for all the points before computeTiles)
+	inline void countPoint(const CCVector3& P) { ++m_cells[getCellIndex(getCellPos(P))]; }
+
+	//! Computes the tiles
+	/** Tile i contains the points [tile.first, tile.first + tile.count[ once the points are sorted by tile.
+		\param maxTilePointCount max number of points per tile (best effort: a tile can't be smaller than a grid cell)
+		\return false if not enough memory
+	**/
+	bool computeTiles(unsigned maxTilePointCount);
+
+	//! Returns the tiles
+	inline const std::vector<Tile>& tiles() const { return m_tiles; }
+
+	//! Returns the index of the tile of a point (valid once the tiles are computed)
+	inline unsigned getTileIndex(const CCVector3& P) const { return m_cells[getCellIndex(getCellPos(P))]; }
+
+	//! Returns whether the cells of a tile intersect a box
+	/** The tile cells are enlarged by one cell (round-off errors).
+	**/
+	bool tileIntersects(unsigned tileIndex, const CCVector3& boxMin, const CCVector3& boxMax) const;
+
+	//! Clears the grid and the tiles
+	void clear();
+
+protected:
+
+	//! Returns the grid cell of a point
+	inline Tuple3i getCellPos(const CCVector3& P) const
+	{
+		Tuple3i cellPos;
+		for (unsigned char d = 0; d < 3; ++d)
+		{
+			int pos = static_cast<int>(floor((P.u[d] - m_gridMin.u[d]) / m_cellSize));
+			cellPos.u[d] = std::min(std::max(pos, 0), m_gridSize.u[d] - 1);
+		}
+		return cellPos;
+	}
+
+	//! Returns the index of a grid cell
+	inline size_t getCellIndex(const Tuple3i& cellPos) const
+	{
+		return (static_cast<size_t>(cellPos.z) * m_gridSize.y + cellPos.y) * m_gridSize.x + cellPos.x;
+	}
+
+	//! Splits a box of cells (recursively) until it has less than maxTilePointCount points
+	void splitCells(const Tuple3i& minPos, const Tuple3i& maxPos, unsigned maxTilePointCount);
+
+	//! Grid min corner
+	CCVector3d m_gridMin;
+	//! Grid cell size
+	double m_cellSize;
+	//! Grid size (in cells)
+	Tuple3i m_gridSize;
+	//! Grid cells (number of points, then tile index once the tiles are computed)
+	std::vector<unsigned> m_cells;
+
+	//! Tiles
+	std::vector<Tile> m_tiles;
+};
+
+}
+
+#endif //TILING_GRID_HEADER
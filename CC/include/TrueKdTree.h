@@ -25,6 +25,7 @@
 
 //system
 #include <stdint.h> //for uint fixed-sized types
+#include <vector>
 
 namespace CCLib
 {
@@ -143,6 +144,8 @@ public:
 		\param minPointCountPerCell minimum number of points per cell (can't be smaller than 3)
 		\param maxPointCountPerCell maximum number of points per cell (speed-up - ignored if < 6)
 		\param progressCb the client application can get some notification of the process progress through this callback mechanism (see GenericProgressCallback)
+		\return false if not enough memory or if the process was canceled
+		\warning the progress notification state is static: two trees can't be built at the same time (this method is not reentrant)
 	**/
 	bool build(	double maxError,
 				DistanceComputationTools::ERROR_MEASURES errorMeasure = DistanceComputationTools::RMS,
@@ -164,8 +167,30 @@ public:
 
 protected:
 
+	//! Cell statistics (point count, bounding-box and sums for the covariance matrix)
+	struct CellStats;
+
+	//! Split task (a sub-tree to build)
+	struct SplitTask;
+
 	//! Recursive split process
-	BaseNode* split(ReferenceCloud* subset);
+	/** The cell points are m_indexes[first ; first+count[ (they are reordered).
+		\param first index of the first point of the cell (in m_indexes)
+		\param count number of points in the cell
+		\param stats cell statistics
+		\param mainThread whether the method is called from the main thread (progress notification)
+		\return 0 if not enough memory (or if the process was canceled)
+	**/
+	BaseNode* split(unsigned first, unsigned count, const CellStats& stats, bool mainThread);
+
+	//! Recursive split process (multi-thread wrapper)
+	static void Split_MT(SplitTask& task);
+
+	//! Fits a plane on a cell (incrementally, thanks to its statistics)
+	bool fitPlane(unsigned first, unsigned count, const CellStats& stats, PointCoordinateType planeEquation[4], double& rms) const;
+
+	//! Creates the subset corresponding to a cell
+	ReferenceCloud* createSubset(unsigned first, unsigned count) const;
 
 	//! Root node
 	BaseNode* m_root;
@@ -188,6 +213,13 @@ protected:
 	/** Ignored if < 6
 	**/
 	unsigned m_maxPointCountPerCell;
+
+	//! Points indexes (only used during the build process)
+	std::vector<unsigned> m_indexes;
+	//! Temporary indexes buffer (only used during the build process)
+	std::vector<unsigned> m_indexesBuffer;
+	//! Temporary coordinates buffer (only used during the build process)
+	std::vector<PointCoordinateType> m_coordsBuffer;
 };
 
 } //namespace CCLib
@@ -91,42 +91,57 @@ bool AutoSegmentationTools::extractConnectedComponents(GenericIndexedCloudPersis
 		cc.pop_back();
 	}
 
-	for (unsigned i = 0; i < numberOfPoints; ++i)
+	//1st pass: we count the number of points of each component
+	std::vector<unsigned> ccSizes;
+	try
 	{
-		ScalarType slabel = theCloud->getPointScalarValue(i);
-		if (slabel >= 1) //labels start from 1! (this test rejects NaN values as well)
+		for (unsigned i = 0; i < numberOfPoints; ++i)
 		{
-			int ccLabel = static_cast<int>(theCloud->getPointScalarValue(i)) - 1;
-
-			//we fill the components vector with empty components until we reach the current label
-			//(they will be "used" later)
-			try
+			ScalarType slabel = theCloud->getPointScalarValue(i);
+			if (slabel >= 1) //labels start from 1! (this test rejects NaN values as well)
 			{
-				while (static_cast<size_t>(ccLabel) >= cc.size())
+				size_t ccLabel = static_cast<size_t>(slabel) - 1;
+				if (ccLabel >= ccSizes.size())
 				{
-					cc.push_back(new ReferenceCloud(theCloud));
+					ccSizes.resize(ccLabel + 1, 0);
 				}
+				++ccSizes[ccLabel];
 			}
-			catch (const std::bad_alloc&)
-			{
-				//not enough memory
-				cc.clear();
-				return false;
-			}
+		}
 
-			//add the point to the current component
-			if (!cc[ccLabel]->addPointIndex(i))
+		//we create all the components at once (empty components are kept so that
+		//the component index still corresponds to its label)
+		cc.reserve(ccSizes.size());
+		for (size_t j = 0; j < ccSizes.size(); ++j)
+		{
+			ReferenceCloud* component = new ReferenceCloud(theCloud);
+			cc.push_back(component);
+			if (ccSizes[j] != 0 && !component->reserve(ccSizes[j]))
 			{
-				//not enough memory
-				while (!cc.empty())
-				{
-					delete cc.back();
-					cc.pop_back();
-				}
-				return false;
+				throw std::bad_alloc();
 			}
 		}
 	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		while (!cc.empty())
+		{
+			delete cc.back();
+			cc.pop_back();
+		}
+		return false;
+	}
+
+	//2nd pass: we add the points to their component (no reallocation)
+	for (unsigned i = 0; i < numberOfPoints; ++i)
+	{
+		ScalarType slabel = theCloud->getPointScalarValue(i);
+		if (slabel >= 1)
+		{
+			cc[static_cast<size_t>(slabel) - 1]->addPointIndex(i);
+		}
+	}
 
 	return true;
 }
@@ -0,0 +1,543 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "ChunkedArrayAllocator.h"
+
+//system
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#ifdef CC_WINDOWS
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+//global memory budget (0 = none)
+static size_t s_memoryBudget = 0;
+//scratch files directory (empty = system temporary directory)
+static std::string s_scratchDirectory;
+//heap memory currently used by the arrays
+static std::atomic<size_t> s_heapMemoryUsage(0);
+//heap memory currently reserved by the arrays
+static std::atomic<size_t> s_heapMemoryReserved(0);
+//memory currently mapped on scratch files
+static std::atomic<size_t> s_mappedMemoryUsage(0);
+
+void ChunkedArrayAllocator::SetMemoryBudget(size_t bytes)
+{
+	s_memoryBudget = bytes;
+}
+
+size_t ChunkedArrayAllocator::GetMemoryBudget()
+{
+	return s_memoryBudget;
+}
+
+void ChunkedArrayAllocator::SetScratchDirectory(const std::string& path)
+{
+	s_scratchDirectory = path;
+}
+
+std::string ChunkedArrayAllocator::GetScratchDirectory()
+{
+	if (!s_scratchDirectory.empty())
+	{
+		return s_scratchDirectory;
+	}
+
+#ifdef CC_WINDOWS
+	char buffer[MAX_PATH+1];
+	DWORD length = GetTempPathA(MAX_PATH+1, buffer);
+	if (length != 0 && length <= MAX_PATH)
+	{
+		return std::string(buffer, length);
+	}
+	return std::string(".");
+#else
+	const char* tmpDir = getenv("TMPDIR");
+	return std::string(tmpDir && tmpDir[0] ? tmpDir : "/tmp");
+#endif
+}
+
+//transparent huge pages
+static bool s_hugePages = false;
+//huge pages size
+static const size_t c_hugePageSize = (2 << 20);
+
+//pool of released heap blocks
+struct BlocksPool
+{
+	//blocks (sorted by capacity)
+	std::multimap<size_t, void*> blocks;
+	//mutex
+	std::mutex mutex;
+};
+//the pool is never destroyed (as arrays may still be released during the destruction of the static objects)
+static BlocksPool& GetPool()
+{
+	static BlocksPool* s_pool = new BlocksPool;
+	return *s_pool;
+}
+//pool max size
+static size_t s_poolSize = (256 << 20);
+//pool current size
+static std::atomic<size_t> s_pooledMemory(0);
+//min capacity of the pooled blocks (smaller ones are efficiently handled by the system allocator)
+static const size_t c_minPooledCapacity = (64 << 10);
+
+size_t ChunkedArrayAllocator::GetHeapMemoryUsage()
+{
+	return s_heapMemoryUsage;
+}
+
+size_t ChunkedArrayAllocator::GetHeapMemoryReserved()
+{
+	return s_heapMemoryReserved;
+}
+
+size_t ChunkedArrayAllocator::GetPooledMemory()
+{
+	return s_pooledMemory;
+}
+
+void ChunkedArrayAllocator::SetHugePages(bool state)
+{
+	s_hugePages = state;
+}
+
+bool ChunkedArrayAllocator::GetHugePages()
+{
+	return s_hugePages;
+}
+
+static void* AlignedAlloc(size_t size, size_t alignment)
+{
+#ifdef CC_WINDOWS
+	return _aligned_malloc(size, alignment);
+#else
+	void* data = 0;
+	return (posix_memalign(&data, alignment, size) == 0 ? data : 0);
+#endif
+}
+
+static void AlignedFree(void* data)
+{
+#ifdef CC_WINDOWS
+	_aligned_free(data);
+#else
+	free(data);
+#endif
+}
+
+void ChunkedArrayAllocator::SetPoolSize(size_t bytes)
+{
+	BlocksPool& pool = GetPool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+
+	s_poolSize = bytes;
+
+	//release the biggest blocks first
+	while (s_pooledMemory > s_poolSize)
+	{
+		std::multimap<size_t, void*>::iterator it = --pool.blocks.end();
+		s_pooledMemory -= it->first;
+		AlignedFree(it->second);
+		pool.blocks.erase(it);
+	}
+}
+
+size_t ChunkedArrayAllocator::GetPoolSize()
+{
+	return s_poolSize;
+}
+
+void* ChunkedArrayAllocator::AllocateHeap(size_t& capacity)
+{
+	assert(capacity != 0);
+
+	size_t alignment = ALIGNMENT;
+	if (s_hugePages && capacity >= c_hugePageSize)
+	{
+		alignment = c_hugePageSize;
+	}
+	//round the capacity to the alignment
+	capacity = ((capacity + alignment - 1) / alignment) * alignment;
+
+	//look for a pooled block first (wasting at most half of it)
+	if (capacity >= c_minPooledCapacity)
+	{
+		BlocksPool& pool = GetPool();
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		std::multimap<size_t, void*>::iterator it = pool.blocks.lower_bound(capacity);
+		if (it != pool.blocks.end() && it->first / 2 <= capacity)
+		{
+			void* data = it->second;
+			capacity = it->first;
+			s_pooledMemory -= capacity;
+			pool.blocks.erase(it);
+			return data;
+		}
+	}
+
+	void* data = AlignedAlloc(capacity, alignment);
+#if defined(CC_LINUX) && defined(MADV_HUGEPAGE)
+	if (data && alignment == c_hugePageSize)
+	{
+		madvise(data, capacity, MADV_HUGEPAGE);
+	}
+#endif
+
+	return data;
+}
+
+void ChunkedArrayAllocator::ReleaseHeap(void* data, size_t capacity)
+{
+	if (!data)
+	{
+		return;
+	}
+
+	if (capacity >= c_minPooledCapacity)
+	{
+		BlocksPool& pool = GetPool();
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		if (s_pooledMemory + capacity <= s_poolSize)
+		{
+			pool.blocks.insert(std::make_pair(capacity, data));
+			s_pooledMemory += capacity;
+			return;
+		}
+	}
+
+	AlignedFree(data);
+}
+
+size_t ChunkedArrayAllocator::GetMappedMemoryUsage()
+{
+	return s_mappedMemoryUsage;
+}
+
+#ifdef CC_WINDOWS
+
+//! Creates a temporary scratch file (deleted when closed)
+static HANDLE CreateScratchFile(const std::string& directory)
+{
+	char filename[MAX_PATH+1];
+	if (GetTempFileNameA(directory.c_str(), "cca", 0, filename) == 0)
+	{
+		return INVALID_HANDLE_VALUE;
+	}
+
+	return CreateFileA(	filename,
+						GENERIC_READ | GENERIC_WRITE,
+						0,
+						NULL,
+						CREATE_ALWAYS,
+						FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,
+						NULL);
+}
+
+bool ChunkedArrayAllocator::ResizeMapped(Block& block, size_t size)
+{
+	assert(size != 0);
+
+	HANDLE file = static_cast<HANDLE>(block.file);
+	if (!file)
+	{
+		file = CreateScratchFile(GetScratchDirectory());
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+	}
+
+	//the file is automatically extended by the mapping if necessary
+	unsigned long long fileSize = std::max<unsigned long long>(size, block.fileSize);
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, static_cast<DWORD>(fileSize >> 32), static_cast<DWORD>(fileSize & 0xFFFFFFFF), NULL);
+	void* data = (mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : 0);
+	if (!data)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		if (!block.file)
+			CloseHandle(file);
+		return false;
+	}
+
+	if (block.data)
+	{
+		UnmapViewOfFile(block.data);
+		CloseHandle(static_cast<HANDLE>(block.mapping));
+	}
+
+	//the file is never truncated: we must reset the bytes left by a previous (bigger) mapping
+	if (size > block.size && block.fileSize > block.size)
+	{
+		memset(static_cast<char*>(data) + block.size, 0, std::min(size, block.fileSize) - block.size);
+	}
+
+	s_mappedMemoryUsage += size;
+	s_mappedMemoryUsage -= block.size;
+
+	block.data = data;
+	block.size = size;
+	block.capacity = size;
+	block.fileSize = static_cast<size_t>(fileSize);
+	block.file = file;
+	block.mapping = mapping;
+	block.mapped = true;
+
+	return true;
+}
+
+#else
+
+bool ChunkedArrayAllocator::ResizeMapped(Block& block, size_t size)
+{
+	assert(size != 0);
+
+	int file = block.file;
+	if (file < 0)
+	{
+		std::string pattern = GetScratchDirectory() + "/cc_array_XXXXXX";
+		std::vector<char> filename(pattern.begin(), pattern.end());
+		filename.push_back(0);
+		file = mkstemp(&(filename[0]));
+		if (file < 0)
+		{
+			return false;
+		}
+		//the file will be deleted as soon as it is closed
+		unlink(&(filename[0]));
+	}
+
+	//enlarge the file first (the new bytes are set to zero)
+	if (size > block.fileSize && ftruncate(file, static_cast<off_t>(size)) != 0)
+	{
+		if (block.file < 0)
+			close(file);
+		return false;
+	}
+
+	void* data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (data == MAP_FAILED)
+	{
+		if (block.file < 0)
+		{
+			close(file);
+		}
+		else if (size > block.fileSize)
+		{
+			//restore the previous file size
+			int result = ftruncate(file, static_cast<off_t>(block.fileSize));
+			(void)result;
+		}
+		return false;
+	}
+
+	if (block.data)
+	{
+		munmap(block.data, block.size);
+	}
+
+	//eventually reduce the file size
+	size_t fileSize = std::max(size, block.fileSize);
+	if (size < fileSize && ftruncate(file, static_cast<off_t>(size)) == 0)
+	{
+		fileSize = size;
+	}
+
+	s_mappedMemoryUsage += size;
+	s_mappedMemoryUsage -= block.size;
+
+	block.data = data;
+	block.size = size;
+	block.capacity = size;
+	block.fileSize = fileSize;
+	block.file = file;
+	block.mapped = true;
+
+	return true;
+}
+
+#endif
+
+bool ChunkedArrayAllocator::ResizeHeap(Block& block, size_t size)
+{
+	assert(size != 0 && !block.mapped);
+
+	//enough room in the current block (and not too much)
+	if (block.data && size <= block.capacity && size >= block.capacity / 2)
+	{
+		if (size > block.size)
+		{
+			memset(static_cast<char*>(block.data) + block.size, 0, size - block.size);
+		}
+		s_heapMemoryUsage += size;
+		s_heapMemoryUsage -= block.size;
+		block.size = size;
+		return true;
+	}
+
+	//geometric growth (to avoid reallocating the block each time a few elements are added)
+	size_t capacity = size;
+	if (block.data && size > block.capacity)
+	{
+		capacity = std::max(size, block.capacity + block.capacity / 2);
+	}
+
+	void* data = AllocateHeap(capacity);
+	if (!data && capacity > size)
+	{
+		//retry without any margin
+		capacity = size;
+		data = AllocateHeap(capacity);
+	}
+	if (!data)
+	{
+		return false;
+	}
+
+	size_t copySize = std::min(size, block.size);
+	if (copySize)
+	{
+		memcpy(data, block.data, copySize);
+	}
+	//the new bytes (or the recycled ones) must be set to zero
+	memset(static_cast<char*>(data) + copySize, 0, size - copySize);
+
+	ReleaseHeap(block.data, block.capacity);
+
+	s_heapMemoryUsage += size;
+	s_heapMemoryUsage -= block.size;
+	s_heapMemoryReserved += capacity;
+	s_heapMemoryReserved -= block.capacity;
+
+	block.data = data;
+	block.size = size;
+	block.capacity = capacity;
+
+	return true;
+}
+
+bool ChunkedArrayAllocator::Move(Block& block, size_t size, bool toMapped)
+{
+	Block newBlock;
+	if (!(toMapped ? ResizeMapped(newBlock, size) : ResizeHeap(newBlock, size)))
+	{
+		return false;
+	}
+
+	//copy the existing data (the remaining bytes are already set to zero)
+	if (block.data)
+	{
+		memcpy(newBlock.data, block.data, std::min(size, block.size));
+	}
+
+	Release(block);
+	block = newBlock;
+
+	return true;
+}
+
+bool ChunkedArrayAllocator::Resize(Block& block, size_t size, Policy policy)
+{
+	if (size == 0)
+	{
+		Release(block);
+		return true;
+	}
+
+	bool mapped = block.mapped;
+	switch (policy)
+	{
+	case HEAP_ALLOCATION:
+		mapped = false;
+		break;
+	case FILE_MAPPED_ALLOCATION:
+		mapped = true;
+		break;
+	case AUTO_ALLOCATION:
+		//a mapped block remains mapped
+		if (!mapped && s_memoryBudget != 0)
+		{
+			mapped = (s_heapMemoryReserved - block.capacity + size > s_memoryBudget);
+		}
+		break;
+	default:
+		assert(false);
+		break;
+	}
+
+	if (!block.data)
+	{
+		return mapped ? ResizeMapped(block, size) : ResizeHeap(block, size);
+	}
+	else if (mapped != block.mapped)
+	{
+		return Move(block, size, mapped);
+	}
+	else if (size == block.size)
+	{
+		//nothing to do
+		return true;
+	}
+
+	return block.mapped ? ResizeMapped(block, size) : ResizeHeap(block, size);
+}
+
+void ChunkedArrayAllocator::Release(Block& block)
+{
+	if (block.mapped)
+	{
+#ifdef CC_WINDOWS
+		if (block.data)
+			UnmapViewOfFile(block.data);
+		if (block.mapping)
+			CloseHandle(static_cast<HANDLE>(block.mapping));
+		if (block.file)
+			CloseHandle(static_cast<HANDLE>(block.file));
+#else
+		if (block.data)
+			munmap(block.data, block.size);
+		if (block.file >= 0)
+			close(block.file);
+#endif
+		s_mappedMemoryUsage -= block.size;
+	}
+	else if (block.data)
+	{
+		ReleaseHeap(block.data, block.capacity);
+		s_heapMemoryUsage -= block.size;
+		s_heapMemoryReserved -= block.capacity;
+	}
+
+	block = Block();
+}
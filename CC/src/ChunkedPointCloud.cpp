@@ -24,6 +24,7 @@
 //system
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
 
 using namespace CCLib;
 
@@ -97,6 +98,19 @@ const CCVector3* ChunkedPointCloud::getNextPoint()
 	return (m_currentPointIndex < m_points->currentSize() ? point(m_currentPointIndex++) : 0);
 }
 
+const CCVector3* ChunkedPointCloud::getPointsBlock(unsigned index, unsigned& count)
+{
+	assert(index < size());
+	count = std::min(count, size() - index);
+#ifndef CC_ENV_64
+	//the points are only contiguous inside each chunk
+	count = std::min(count, MAX_NUMBER_OF_ELEMENTS_PER_CHUNK - (index & ELEMENT_INDEX_BIT_MASK));
+#endif
+	
+	//direct access to the points storage
+	return point(index);
+}
+
 bool ChunkedPointCloud::resize(unsigned newCount)
 {
 	unsigned oldCount = m_points->currentSize();
@@ -0,0 +1,258 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "Cloud2CloudReferenceContext.h"
+
+//local
+#include "CCMiscTools.h"
+#include "DgmOctree.h"
+#include "GenericIndexedCloudPersist.h"
+#include "LocalModel.h"
+
+//system
+#include <algorithm>
+#include <assert.h>
+#include <new>
+
+using namespace CCLib;
+
+Cloud2CloudReferenceContext::Cloud2CloudReferenceContext(GenericIndexedCloudPersist* referenceCloud)
+	: m_referenceCloud(referenceCloud)
+	, m_octree(0)
+	, m_referenceCloudSize(0)
+	, m_pointsMin(0, 0, 0)
+	, m_pointsMax(0, 0, 0)
+	, m_localModels(0)
+	, m_localModelsSize(0)
+	, m_localModelCount(0)
+	, m_modelType(NO_MODEL)
+	, m_useSphericalSearch(false)
+	, m_kNN(0)
+	, m_radius(0)
+{
+	assert(m_referenceCloud);
+}
+
+Cloud2CloudReferenceContext::~Cloud2CloudReferenceContext()
+{
+	clear();
+}
+
+void Cloud2CloudReferenceContext::clear()
+{
+	if (m_octree)
+	{
+		delete m_octree;
+		m_octree = 0;
+	}
+	m_referenceCloudSize = 0;
+
+	clearLocalModels();
+	delete[] m_localModels;
+	m_localModels = 0;
+	m_localModelsSize = 0;
+}
+
+void Cloud2CloudReferenceContext::clearLocalModels()
+{
+	for (unsigned i = 0; i < m_localModelsSize; ++i)
+	{
+		const LocalModel* model = m_localModels[i].exchange(0);
+		if (model)
+		{
+			delete model;
+		}
+	}
+	m_localModelCount = 0;
+}
+
+bool Cloud2CloudReferenceContext::prepare(GenericIndexedCloudPersist* comparedCloud, GenericProgressCallback* progressCb/*=0*/)
+{
+	if (!m_referenceCloud || !comparedCloud || m_referenceCloud->size() == 0 || comparedCloud->size() == 0)
+	{
+		return false;
+	}
+
+	//the cached local models are only valid if the reference cloud hasn't changed
+	unsigned referenceCloudSize = m_referenceCloud->size();
+	if (referenceCloudSize != m_referenceCloudSize)
+	{
+		clear();
+	}
+
+	CCVector3 compMin, compMax;
+	comparedCloud->getBoundingBox(compMin, compMax);
+
+	if (m_octree)
+	{
+		//does the compared cloud fit in the current points box?
+		bool fits = true;
+		for (unsigned char k = 0; k < 3; ++k)
+		{
+			if (compMin.u[k] < m_pointsMin.u[k] || compMax.u[k] > m_pointsMax.u[k])
+			{
+				fits = false;
+				break;
+			}
+		}
+
+		if (fits)
+		{
+			//nothing to do
+			return true;
+		}
+
+		//we extend the current box (so that the previous compared clouds would still fit)
+		for (unsigned char k = 0; k < 3; ++k)
+		{
+			m_pointsMin.u[k] = std::min(m_pointsMin.u[k], compMin.u[k]);
+			m_pointsMax.u[k] = std::max(m_pointsMax.u[k], compMax.u[k]);
+		}
+		m_octree->clear();
+	}
+	else
+	{
+		//union of both bounding-boxes (same as DistanceComputationTools::synchronizeOctrees)
+		CCVector3 refMin, refMax;
+		m_referenceCloud->getBoundingBox(refMin, refMax);
+		for (unsigned char k = 0; k < 3; ++k)
+		{
+			m_pointsMin.u[k] = std::min(refMin.u[k], compMin.u[k]);
+			m_pointsMax.u[k] = std::max(refMax.u[k], compMax.u[k]);
+		}
+
+		m_octree = new DgmOctree(m_referenceCloud);
+	}
+
+	//we make this bounding-box cubical (+1% growth to avoid round-off issues)
+	CCVector3 octreeMin = m_pointsMin;
+	CCVector3 octreeMax = m_pointsMax;
+	CCMiscTools::MakeMinAndMaxCubical(octreeMin, octreeMax, 0.01);
+
+	if (m_octree->build(octreeMin, octreeMax, &m_pointsMin, &m_pointsMax, progressCb) < 1)
+	{
+		//not enough memory
+		delete m_octree;
+		m_octree = 0;
+		return false;
+	}
+	m_referenceCloudSize = referenceCloudSize;
+
+	return true;
+}
+
+bool Cloud2CloudReferenceContext::synchronize(DgmOctree& comparedOctree, GenericProgressCallback* progressCb/*=0*/) const
+{
+	if (!m_octree)
+	{
+		//call 'prepare' first
+		assert(false);
+		return false;
+	}
+
+	const CCVector3& octreeMin = m_octree->getOctreeMins();
+	const CCVector3& octreeMax = m_octree->getOctreeMaxs();
+
+	if (comparedOctree.getNumberOfProjectedPoints() != 0)
+	{
+		bool sameBox = true;
+		for (unsigned char k = 0; k < 3; ++k)
+		{
+			if (	octreeMin.u[k] != comparedOctree.getOctreeMins().u[k]
+				||	octreeMax.u[k] != comparedOctree.getOctreeMaxs().u[k])
+			{
+				sameBox = false;
+				break;
+			}
+		}
+
+		if (sameBox)
+		{
+			//nothing to do
+			return true;
+		}
+
+		comparedOctree.clear();
+	}
+
+	return (comparedOctree.build(octreeMin, octreeMax, &m_pointsMin, &m_pointsMax, progressCb) > 0);
+}
+
+bool Cloud2CloudReferenceContext::setLocalModelParameters(CC_LOCAL_MODEL_TYPES modelType, bool useSphericalSearch, unsigned kNN, ScalarType radius)
+{
+	if (	modelType != m_modelType
+		||	useSphericalSearch != m_useSphericalSearch
+		||	(useSphericalSearch && radius != m_radius)
+		||	(!useSphericalSearch && kNN != m_kNN))
+	{
+		//the cached models are deprecated
+		clearLocalModels();
+
+		m_modelType = modelType;
+		m_useSphericalSearch = useSphericalSearch;
+		m_kNN = kNN;
+		m_radius = radius;
+	}
+
+	if (modelType == NO_MODEL || !m_referenceCloud)
+	{
+		return true;
+	}
+
+	unsigned pointCount = m_referenceCloud->size();
+	if (m_localModelsSize != pointCount)
+	{
+		clearLocalModels();
+		delete[] m_localModels;
+		m_localModels = 0;
+		m_localModelsSize = 0;
+
+		m_localModels = new (std::nothrow) std::atomic<const LocalModel*>[pointCount];
+		if (!m_localModels)
+		{
+			//not enough memory
+			return false;
+		}
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			m_localModels[i] = 0;
+		}
+		m_localModelsSize = pointCount;
+	}
+
+	return true;
+}
+
+const LocalModel* Cloud2CloudReferenceContext::setLocalModel(unsigned pointIndex, const LocalModel* model)
+{
+	assert(m_localModels && pointIndex < m_localModelsSize);
+
+	const LocalModel* expected = 0;
+	if (m_localModels[pointIndex].compare_exchange_strong(expected, model))
+	{
+		++m_localModelCount;
+		return model;
+	}
+
+	//another thread has already computed a model for this point
+	if (model)
+	{
+		delete model;
+	}
+	return expected;
+}
@@ -19,6 +19,7 @@
 #include "CloudSamplingTools.h"
 
 //local
+#include "CCMiscTools.h"
 #include "GenericIndexedCloudPersist.h"
 #include "GenericIndexedMesh.h"
 #include "SimpleCloud.h"
@@ -26,15 +27,31 @@
 #include "Neighbourhood.h"
 #include "SimpleMesh.h"
 #include "GenericProgressCallback.h"
+#include "GenericTiledCloudStream.h"
 #include "DgmOctreeReferenceCloud.h"
 #include "DistanceComputationTools.h"
 #include "ScalarField.h"
 #include "ScalarFieldTools.h"
+#include "SortAlgo.h"
 
 //system
 #include <assert.h>
+#include <atomic>
+#include <limits>
 #include <random>
 
+#ifdef USE_QT
+#ifndef _DEBUG
+//enables multi-threading handling
+#define ENABLE_MT_SPATIAL_RESAMPLING
+#endif
+#endif
+
+#ifdef ENABLE_MT_SPATIAL_RESAMPLING
+#include <QtCore>
+#include <QtConcurrentMap>
+#endif
+
 using namespace CCLib;
 
 GenericIndexedCloud* CloudSamplingTools::resampleCloudWithOctree(	GenericIndexedCloudPersist* inputCloud,
@@ -253,6 +270,119 @@ ReferenceCloud* CloudSamplingTools::subsampleCloudRandomly(GenericIndexedCloudPe
 	return newCloud;
 }
 
+/*** SPATIAL RESAMPLING ***/
+
+//! Spatial resampling point state
+enum SpatialResamplingMarker { SR_POINT_DISCARDED = 0, SR_POINT_CANDIDATE = 1, SR_POINT_KEPT = 2 };
+
+//! Spatial resampling block (i.e. the points of an octree cell)
+struct SpatialResamplingBlock
+{
+	//! First point index (in the octree structure)
+	unsigned i1;
+	//! Last point index (excluded)
+	unsigned i2;
+};
+
+//! Spatial resampling shared parameters
+struct SpatialResamplingParams
+{
+	GenericIndexedCloudPersist* cloud;
+	const DgmOctree* octree;
+	std::atomic<unsigned char>* markers;
+	PointCoordinateType minDistance;
+	const CloudSamplingTools::SFModulationParams* modParams;
+	bool modParamsEnabled;
+	ScalarType sfMin;
+	ScalarType sfMax;
+	const std::vector<unsigned char>* bestOctreeLevel;
+	NormalizedProgress* progress;
+	bool canceled;
+	bool error;
+};
+
+static SpatialResamplingParams* s_spatialResampling_MT = 0;
+
+static void ProcessSpatialResamplingBlock(const SpatialResamplingBlock& block)
+{
+	SpatialResamplingParams& params = *s_spatialResampling_MT;
+	if (params.canceled || params.error)
+		return;
+
+	try
+	{
+		//we process the points of the block in their index order
+		std::vector<unsigned> pointIndexes(block.i2 - block.i1);
+		const DgmOctree::cellsContainer& pointsAndCodes = params.octree->pointsAndTheirCellCodes();
+		for (unsigned i = block.i1; i < block.i2; ++i)
+		{
+			pointIndexes[i - block.i1] = pointsAndCodes[i].theIndex;
+		}
+		SortAlgo(pointIndexes.begin(), pointIndexes.end());
+
+		const std::vector<unsigned char>& bestOctreeLevel = *params.bestOctreeLevel;
+		DgmOctree::NeighboursSet neighbours;
+		for (size_t j = 0; j < pointIndexes.size(); ++j)
+		{
+			unsigned pointIndex = pointIndexes[j];
+
+			//no mark? we skip this point
+			if (params.markers[pointIndex].load(std::memory_order_relaxed) != SR_POINT_CANDIDATE)
+				continue;
+
+			const CCVector3* P = params.cloud->getPoint(pointIndex);
+
+			//default octree level
+			unsigned char octreeLevel = bestOctreeLevel.front();
+			//default distance between points
+			PointCoordinateType minDistBetweenPoints = params.minDistance;
+
+			//parameters modulation
+			if (params.modParamsEnabled)
+			{
+				ScalarType sfVal = params.cloud->getPointScalarValue(pointIndex);
+				if (ScalarField::ValidValue(sfVal))
+				{
+					//modulate minDistance
+					minDistBetweenPoints = static_cast<PointCoordinateType>(sfVal * params.modParams->a + params.modParams->b);
+					//get (approximate) best level
+					if (params.sfMax > params.sfMin)
+					{
+						size_t levelIndex = static_cast<size_t>(bestOctreeLevel.size() * ((sfVal - params.sfMin) / (params.sfMax - params.sfMin)));
+						octreeLevel = bestOctreeLevel[std::min(levelIndex, bestOctreeLevel.size() - 1)];
+					}
+				}
+			}
+
+			//look for neighbors and 'de-mark' them
+			neighbours.clear();
+			params.octree->getPointsInSphericalNeighbourhood(*P, minDistBetweenPoints, neighbours, octreeLevel);
+			for (DgmOctree::NeighboursSet::const_iterator it = neighbours.begin(); it != neighbours.end(); ++it)
+			{
+				//the points of the other blocks being processed at the same time are too far to be
+				//concerned: only the neighbouring (candidate) points can be 'de-marked' concurrently
+				if (it->pointIndex != pointIndex && params.markers[it->pointIndex].load(std::memory_order_relaxed) == SR_POINT_CANDIDATE)
+					params.markers[it->pointIndex].store(SR_POINT_DISCARDED, std::memory_order_relaxed);
+			}
+
+			//At this stage, the point is the only one marked in a radius of <minDistance>.
+			//Therefore it will necessarily be in the final cloud!
+			params.markers[pointIndex].store(SR_POINT_KEPT, std::memory_order_relaxed);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		params.error = true;
+		return;
+	}
+
+	if (params.progress && !params.progress->steps(block.i2 - block.i1))
+	{
+		params.canceled = true;
+	}
+}
+
 ReferenceCloud* CloudSamplingTools::resampleCloudSpatially(GenericIndexedCloudPersist* inputCloud,
 															PointCoordinateType minDistance,
 															const SFModulationParams& modParams,
@@ -276,28 +406,27 @@ ReferenceCloud* CloudSamplingTools::resampleCloudSpatially(GenericIndexedCloudPe
 
 	//output cloud
 	ReferenceCloud* sampledCloud = new ReferenceCloud(inputCloud);
-	const unsigned c_reserveStep = 65536;
-	if (!sampledCloud->reserve(std::min(cloudSize,c_reserveStep)))
-	{
-		if (!inputOctree)
-			delete octree;
-		return 0;
-	}
 
-	GenericChunkedArray<1,char>* markers = new GenericChunkedArray<1,char>(); //DGM: upgraded from vector, as this can be quite huge!
-	if (!markers->resize(cloudSize,true,1)) //true by default
+	//points state (see SpatialResamplingMarker)
+	std::atomic<unsigned char>* markers = new (std::nothrow) std::atomic<unsigned char>[cloudSize];
+	if (!markers)
 	{
-		markers->release();
 		if (!inputOctree)
 			delete octree;
 		delete sampledCloud;
 		return 0;
 	}
+	for (unsigned i = 0; i < cloudSize; ++i)
+	{
+		markers[i].store(SR_POINT_CANDIDATE, std::memory_order_relaxed);
+	}
 
 	//best octree level (there may be several of them if we use parameter modulation)
 	std::vector<unsigned char> bestOctreeLevel;
 	bool modParamsEnabled = modParams.enabled;
 	ScalarType sfMin = 0, sfMax = 0;
+	//maximum distance between points
+	PointCoordinateType maxDistance = minDistance;
 	try
 	{
 		if (modParams.enabled)
@@ -317,6 +446,7 @@ ReferenceCloud* CloudSamplingTools::resampleCloudSpatially(GenericIndexedCloudPe
 				PointCoordinateType dist1 = static_cast<PointCoordinateType>(sfMax * modParams.a + modParams.b);
 				unsigned char level0 = octree->findBestLevelForAGivenNeighbourhoodSizeExtraction(dist0);
 				unsigned char level1 = octree->findBestLevelForAGivenNeighbourhoodSizeExtraction(dist1);
+				maxDistance = std::max(maxDistance, std::max(dist0, dist1));
 
 				bestOctreeLevel.push_back(level0);
 				if (level1 != level0)
@@ -336,7 +466,8 @@ ReferenceCloud* CloudSamplingTools::resampleCloudSpatially(GenericIndexedCloudPe
 				bestOctreeLevel.push_back(level1);
 			}
 		}
-		else
+		
+		if (!modParamsEnabled)
 		{
 			unsigned char defaultLevel = octree->findBestLevelForAGivenNeighbourhoodSizeExtraction(minDistance);
 			bestOctreeLevel.push_back(defaultLevel);
@@ -345,7 +476,7 @@ ReferenceCloud* CloudSamplingTools::resampleCloudSpatially(GenericIndexedCloudPe
 	catch (const std::bad_alloc&)
 	{
 		//not enough memory
-		markers->release();
+		delete[] markers;
 		if (!inputOctree)
 		{
 			delete octree;
@@ -354,6 +485,50 @@ ReferenceCloud* CloudSamplingTools::resampleCloudSpatially(GenericIndexedCloudPe
 		return 0;
 	}
 
+	//The octree is divided in blocks (= cells) bigger than the maximum distance between points.
+	//The blocks are then processed by 'color' (i.e. by parity of their position along each
+	//dimension): two blocks with the same color are separated by at least one other block,
+	//so that they can be processed in parallel (a point can only 'de-mark' the points of its own
+	//block and of the adjacent ones). The result doesn't depend on the number of threads.
+	unsigned char blockLevel = 0;
+	while (blockLevel < DgmOctree::MAX_OCTREE_LEVEL && octree->getCellSize(blockLevel + 1) > maxDistance)
+	{
+		++blockLevel;
+	}
+
+	std::vector<SpatialResamplingBlock> blocks[8];
+	{
+		DgmOctree::cellsContainer cells;
+		bool success = octree->getCellCodesAndIndexes(blockLevel, cells, true);
+		try
+		{
+			for (size_t i = 0; success && i < cells.size(); ++i)
+			{
+				SpatialResamplingBlock block;
+				block.i1 = cells[i].theIndex;
+				block.i2 = (i + 1 < cells.size() ? cells[i + 1].theIndex : octree->getNumberOfProjectedPoints());
+				//the 3 first bits of a (truncated) cell code are the parity of its position along X, Y and Z
+				blocks[cells[i].theCode & 7].push_back(block);
+			}
+		}
+		catch (const std::bad_alloc&)
+		{
+			success = false;
+		}
+
+		if (!success)
+		{
+			//not enough memory
+			delete[] markers;
+			if (!inputOctree)
+			{
+				delete octree;
+			}
+			delete sampledCloud;
+			return 0;
+		}
+	}
+
 	//progress notification
 	NormalizedProgress normProgress(progressCb, cloudSize);
 	if (progressCb)
@@ -369,85 +544,64 @@ ReferenceCloud* CloudSamplingTools::resampleCloudSpatially(GenericIndexedCloudPe
 		progressCb->start();
 	}
 
+	SpatialResamplingParams params;
+	params.cloud = inputCloud;
+	params.octree = octree;
+	params.markers = markers;
+	params.minDistance = minDistance;
+	params.modParams = &modParams;
+	params.modParamsEnabled = modParamsEnabled;
+	params.sfMin = sfMin;
+	params.sfMax = sfMax;
+	params.bestOctreeLevel = &bestOctreeLevel;
+	params.progress = progressCb ? &normProgress : 0;
+	params.canceled = false;
+	params.error = false;
+	s_spatialResampling_MT = &params;
+
 	//for each point in the cloud that is still 'marked', we look
 	//for its neighbors and remove their own marks
-	markers->placeIteratorAtBegining();
-	bool error = false;
-	//default octree level
-	assert(!bestOctreeLevel.empty());
-	unsigned char octreeLevel = bestOctreeLevel.front();
-	//default distance between points
-	PointCoordinateType minDistBetweenPoints = minDistance;
-	for (unsigned i=0; i<cloudSize; i++, markers->forwardIterator())
+	for (unsigned char color = 0; color < 8 && !params.canceled && !params.error; ++color)
 	{
-		//no mark? we skip this point
-		if (markers->getCurrentValue() != 0)
+#ifdef ENABLE_MT_SPATIAL_RESAMPLING
+		QtConcurrent::blockingMap(blocks[color], ProcessSpatialResamplingBlock);
+#else
+		for (size_t i = 0; i < blocks[color].size(); ++i)
 		{
-			//init neighbor search structure
-			const CCVector3* P = inputCloud->getPoint(i);
+			ProcessSpatialResamplingBlock(blocks[color][i]);
+		}
+#endif
+	}
 
-			//parameters modulation
-			if (modParamsEnabled)
-			{
-				ScalarType sfVal = inputCloud->getPointScalarValue(i);
-				if (ScalarField::ValidValue(sfVal))
-				{
-					//modulate minDistance
-					minDistBetweenPoints = static_cast<PointCoordinateType>(sfVal * modParams.a + modParams.b);
-					//get (approximate) best level
-					size_t levelIndex = static_cast<size_t>(bestOctreeLevel.size() * (sfVal / (sfMax-sfMin)));
-					if (levelIndex == bestOctreeLevel.size())
-						--levelIndex;
-					octreeLevel = bestOctreeLevel[levelIndex];
-				}
-				else
-				{
-					minDistBetweenPoints = minDistance;
-					octreeLevel = bestOctreeLevel.front();
-				}
-			}
+	s_spatialResampling_MT = 0;
+	bool error = (params.canceled || params.error);
 
-			//look for neighbors and 'de-mark' them
-			{
-				DgmOctree::NeighboursSet neighbours;
-				octree->getPointsInSphericalNeighbourhood(*P,minDistBetweenPoints,neighbours,octreeLevel);
-				for (DgmOctree::NeighboursSet::iterator it = neighbours.begin(); it != neighbours.end(); ++it)
-					if (it->pointIndex != i)
-						markers->setValue(it->pointIndex,0);
-			}
+	if (!error)
+	{
+		//the points that are not projected in the octree (if any) are kept as well
+		unsigned keptCount = 0;
+		for (unsigned i = 0; i < cloudSize; ++i)
+		{
+			if (markers[i].load(std::memory_order_relaxed) != SR_POINT_DISCARDED)
+				++keptCount;
+		}
 
-			//At this stage, the ith point is the only one marked in a radius of <minDistance>.
-			//Therefore it will necessarily be in the final cloud!
-			if (sampledCloud->size() == sampledCloud->capacity() && !sampledCloud->reserve(sampledCloud->capacity() + c_reserveStep))
-			{
-				//not enough memory
-				error = true;
-				break;
-			}
-			if (!sampledCloud->addPointIndex(i))
+		if (sampledCloud->reserve(keptCount))
+		{
+			for (unsigned i = 0; i < cloudSize; ++i)
 			{
-				//not enough memory
-				error = true;
-				break;
+				if (markers[i].load(std::memory_order_relaxed) != SR_POINT_DISCARDED)
+					sampledCloud->addPointIndex(i);
 			}
 		}
-			
-		//progress indicator
-		if (progressCb && !normProgress.oneStep())
+		else
 		{
-			//cancel process
+			//not enough memory
 			error = true;
-			break;
 		}
 	}
 
-	//remove unnecessarily allocated memory
-	if (!error)
-	{
-		if (sampledCloud->capacity() > sampledCloud->size())
-			sampledCloud->resize(sampledCloud->size());
-	}
-	else
+	if (error)
 	{
 		delete sampledCloud;
 		sampledCloud = 0;
@@ -465,12 +619,53 @@ ReferenceCloud* CloudSamplingTools::resampleCloudSpatially(GenericIndexedCloudPe
 		octree = 0;
 	}
 
-	markers->release();
+	delete[] markers;
 	markers = 0;
 
 	return sampledCloud;
 }
 
+bool CloudSamplingTools::computeSORMeanDistances(	DgmOctree* octree,
+													int knn,
+													std::vector<PointCoordinateType>& meanDistances,
+													std::vector<PointCoordinateType>* maxDistances/*=0*/,
+													unsigned queryCount/*=0*/,
+													GenericProgressCallback* progressCb/*=0*/)
+{
+	assert(octree && octree->associatedCloud());
+	unsigned pointCount = octree->associatedCloud()->size();
+
+	try
+	{
+		meanDistances.resize(pointCount, 0);
+		if (maxDistances)
+		{
+			maxDistances->resize(pointCount, 0);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	//additional parameters
+	void* additionalParameters[] = {reinterpret_cast<void*>(&knn),
+									reinterpret_cast<void*>(&meanDistances),
+									reinterpret_cast<void*>(maxDistances),
+									reinterpret_cast<void*>(&queryCount)
+	};
+
+	unsigned char octreeLevel = octree->findBestLevelForAGivenPopulationPerCell(knn);
+
+	return (octree->executeFunctionForAllCellsAtLevel(	octreeLevel,
+														&applySORFilterAtLevel,
+														additionalParameters,
+														true,
+														progressCb,
+														"SOR filter") != 0);
+}
+
 ReferenceCloud* CloudSamplingTools::sorFilter(	GenericIndexedCloudPersist* inputCloud,
 												int knn/*=6*/,
 												double nSigma/*=1.0*/,
@@ -504,32 +699,11 @@ ReferenceCloud* CloudSamplingTools::sorFilter(	GenericIndexedCloudPersist* input
 		unsigned pointCount = inputCloud->size();
 
 		std::vector<PointCoordinateType> meanDistances;
-		try
-		{
-			meanDistances.resize(pointCount, 0);
-		}
-		catch (const std::bad_alloc&)
-		{
-			//not enough memory
-			break;
-		}
 		double avgDist = 0, stdDev = 0;
 
 		//1st step: compute the average distance to the neighbors
 		{
-			//additional parameters
-			void* additionalParameters[] = {reinterpret_cast<void*>(&knn),
-											reinterpret_cast<void*>(&meanDistances)
-			};
-
-			unsigned char octreeLevel = octree->findBestLevelForAGivenPopulationPerCell(knn);
-
-			if (octree->executeFunctionForAllCellsAtLevel(	octreeLevel,
-															&applySORFilterAtLevel,
-															additionalParameters,
-															true,
-															progressCb,
-															"SOR filter") == 0)
+			if (!computeSORMeanDistances(octree, knn, meanDistances, 0, 0, progressCb))
 			{
 				//something went wrong
 				break;
@@ -582,6 +756,48 @@ ReferenceCloud* CloudSamplingTools::sorFilter(	GenericIndexedCloudPersist* input
 	return filteredCloud;
 }
 
+bool CloudSamplingTools::computeNoiseFilterSelection(	DgmOctree* octree,
+														const NoiseFilterParams& params,
+														std::vector<unsigned char>& keptPoints,
+														std::vector<PointCoordinateType>* maxDistances/*=0*/,
+														unsigned queryCount/*=0*/,
+														GenericProgressCallback* progressCb/*=0*/)
+{
+	assert(octree && octree->associatedCloud());
+	unsigned pointCount = octree->associatedCloud()->size();
+
+	try
+	{
+		keptPoints.assign(pointCount, 0);
+		if (maxDistances)
+		{
+			maxDistances->resize(pointCount, 0);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	//additional parameters
+	void* additionalParameters[] = {reinterpret_cast<void*>(&keptPoints),
+									const_cast<void*>(reinterpret_cast<const void*>(&params)),
+									reinterpret_cast<void*>(maxDistances),
+									reinterpret_cast<void*>(&queryCount)
+	};
+
+	//cells of about 'knn' points, in both modes (in radius mode, cells of the kernel size are not faster)
+	unsigned char octreeLevel = octree->findBestLevelForAGivenPopulationPerCell(params.knn);
+
+	return (octree->executeFunctionForAllCellsAtLevel(	octreeLevel,
+														&applyNoiseFilterAtLevel,
+														additionalParameters,
+														true,
+														progressCb,
+														"Noise filter" ) != 0);
+}
+
 ReferenceCloud* CloudSamplingTools::noiseFilter(GenericIndexedCloudPersist* inputCloud,
 												PointCoordinateType kernelRadius,
 												double nSigma,
@@ -611,59 +827,425 @@ ReferenceCloud* CloudSamplingTools::noiseFilter(GenericIndexedCloudPersist* inpu
 		}
 	}
 
-	ReferenceCloud* filteredCloud = new ReferenceCloud(inputCloud);
+	NoiseFilterParams params;
+	params.kernelRadius = kernelRadius;
+	params.nSigma = nSigma;
+	params.removeIsolatedPoints = removeIsolatedPoints;
+	params.useKnn = useKnn;
+	params.knn = knn;
+	params.useAbsoluteError = useAbsoluteError;
+	params.absoluteError = absoluteError;
+
+	ReferenceCloud* filteredCloud = 0;
+
+	std::vector<unsigned char> keptPoints;
+	if (computeNoiseFilterSelection(octree, params, keptPoints, 0, 0, progressCb))
+	{
+		unsigned pointCount = inputCloud->size();
+		unsigned keptCount = 0;
+		for (unsigned i = 0; i < pointCount; ++i)
+		{
+			if (keptPoints[i])
+				++keptCount;
+		}
+
+		filteredCloud = new ReferenceCloud(inputCloud);
+		if (filteredCloud->reserve(keptCount))
+		{
+			for (unsigned i = 0; i < pointCount; ++i)
+			{
+				if (keptPoints[i])
+					filteredCloud->addPointIndex(i);
+			}
+		}
+		else
+		{
+			//not enough memory
+			delete filteredCloud;
+			filteredCloud = 0;
+		}
+	}
+
+	if (!inputOctree)
+	{
+		delete octree;
+		octree = 0;
+	}
+
+	return filteredCloud;
+}
+
+//! Returns the size of the (default) octree of a cloud
+static PointCoordinateType GetOctreeSize(const CCVector3& bbMin, const CCVector3& bbMax)
+{
+	CCVector3 octreeMin = bbMin;
+	CCVector3 octreeMax = bbMax;
+	CCMiscTools::MakeMinAndMaxCubical(octreeMin, octreeMax);
+	return octreeMax.x - octreeMin.x;
+}
+
+GenericIndexedCloudPersist* CloudSamplingTools::filterStreamedTile(	GenericTiledCloudStream& stream,
+																	unsigned tileIndex,
+																	const StreamedFilterParams& params,
+																	PointCoordinateType& halo,
+																	PointCoordinateType maxHalo,
+																	unsigned& coreCount,
+																	std::vector<PointCoordinateType>& meanDistances,
+																	std::vector<unsigned char>& keptPoints)
+{
+	//the SOR filter and the noise filter (in kNN mode) need all the k nearest
+	//neighbours of the core points: we enlarge the halo until they are found
+	bool knnSearch = (params.sor || params.noise.useKnn);
+	std::vector<PointCoordinateType> maxDistances;
 
-	unsigned pointCount = inputCloud->size();
-	if (!filteredCloud->reserve(pointCount))
+	while (true)
+	{
+		CCVector3 tileMin, tileMax;
+		GenericIndexedCloudPersist* tileCloud = stream.loadTile(tileIndex, halo, coreCount, tileMin, tileMax);
+		if (!tileCloud)
+		{
+			//an error occurred
+			return 0;
+		}
+		if (coreCount == 0)
+		{
+			//empty tile
+			return tileCloud;
+		}
+
+		//the tile octree cells have the same sizes as the cells of the whole cloud octree
+		//(so that the same octree levels are used as with the non-streamed filters)
+		CCVector3 octreeMin, octreeMax;
+		tileCloud->getBoundingBox(octreeMin, octreeMax);
+		{
+			CCVector3 diag = octreeMax - octreeMin;
+			PointCoordinateType tileSize = std::max(diag.x, std::max(diag.y, diag.z)) * static_cast<PointCoordinateType>(1.01);
+			PointCoordinateType octreeSize = params.octreeSize;
+			while (octreeSize / 2 >= tileSize && octreeSize / 2 > 0)
+			{
+				octreeSize /= 2;
+			}
+			CCVector3 center = (octreeMin + octreeMax) / 2;
+			CCVector3 halfDiag(octreeSize / 2, octreeSize / 2, octreeSize / 2);
+			octreeMin = center - halfDiag;
+			octreeMax = center + halfDiag;
+		}
+
+		DgmOctree octree(tileCloud);
+		if (octree.build(octreeMin, octreeMax) < 1)
+		{
+			//not enough memory
+			return 0;
+		}
+
+		std::vector<PointCoordinateType>* tileMaxDistances = (knnSearch && halo < maxHalo ? &maxDistances : 0);
+		if (params.sor)
+		{
+			if (!computeSORMeanDistances(&octree, params.knn, meanDistances, tileMaxDistances, coreCount))
+				return 0;
+		}
+		else
+		{
+			if (!computeNoiseFilterSelection(&octree, params.noise, keptPoints, tileMaxDistances, coreCount))
+				return 0;
+		}
+
+		if (!tileMaxDistances)
+		{
+			//nothing to check
+			return tileCloud;
+		}
+
+		//a neighbourhood is complete if its sphere lies inside the tile box enlarged by the halo
+		//(otherwise, as the neighbors found so far are at least as far as the actual ones, the
+		//distance to the farthest one gives the halo size that guarantees a complete neighbourhood)
+		PointCoordinateType requiredHalo = halo;
+		for (unsigned i = 0; i < coreCount; ++i)
+		{
+			const CCVector3* P = tileCloud->getPoint(i);
+			PointCoordinateType borderDist = std::min(P->x - tileMin.x, tileMax.x - P->x);
+			for (unsigned char d = 1; d < 3; ++d)
+			{
+				borderDist = std::min(borderDist, std::min(P->u[d] - tileMin.u[d], tileMax.u[d] - P->u[d]));
+			}
+			if (maxDistances[i] > halo + borderDist)
+			{
+				if (maxDistances[i] == std::numeric_limits<PointCoordinateType>::max())
+				{
+					//not enough neighbors in the tile
+					requiredHalo = std::max(requiredHalo, 2 * halo);
+				}
+				else
+				{
+					requiredHalo = std::max(requiredHalo, (maxDistances[i] - borderDist) * static_cast<PointCoordinateType>(1.01));
+				}
+			}
+		}
+
+		if (requiredHalo == halo)
+		{
+			return tileCloud;
+		}
+
+		halo = std::min(requiredHalo, maxHalo);
+	}
+}
+
+bool CloudSamplingTools::sorFilterStreamed(	GenericTiledCloudStream& stream,
+											int knn/*=6*/,
+											double nSigma/*=1.0*/,
+											PointCoordinateType initialHalo/*=0*/,
+											GenericProgressCallback* progressCb/*=0*/)
+{
+	if (knn <= 0)
+	{
+		//invalid input
+		assert(false);
+		return false;
+	}
+
+	unsigned tileCount = stream.tileCount();
+	if (tileCount == 0)
+	{
+		//nothing to do
+		return true;
+	}
+
+	CCVector3 bbMin, bbMax;
+	stream.getBoundingBox(bbMin, bbMax);
+	//beyond the cloud diagonal, the halo contains all the points
+	PointCoordinateType maxHalo = (bbMax - bbMin).norm() * static_cast<PointCoordinateType>(1.01) + ZERO_TOLERANCE;
+	PointCoordinateType halo = (initialHalo > 0 ? initialHalo : maxHalo / 100);
+
+	StreamedFilterParams params;
+	params.sor = true;
+	params.knn = knn;
+	params.octreeSize = GetOctreeSize(bbMin, bbMax);
+
+	std::vector<PointCoordinateType> tileHalos;
+	try
+	{
+		tileHalos.resize(tileCount);
+	}
+	catch (const std::bad_alloc&)
 	{
 		//not enough memory
-		if (!inputOctree)
-			delete octree;
-		delete filteredCloud;
-		return 0;
+		return false;
 	}
 
-	//additional parameters
-	void* additionalParameters[] = {reinterpret_cast<void*>(filteredCloud),
-									reinterpret_cast<void*>(&kernelRadius),
-									reinterpret_cast<void*>(&nSigma),
-									reinterpret_cast<void*>(&removeIsolatedPoints),
-									reinterpret_cast<void*>(&useKnn),
-									reinterpret_cast<void*>(&knn),
-									reinterpret_cast<void*>(&useAbsoluteError),
-									reinterpret_cast<void*>(&absoluteError)
-	};
+	NormalizedProgress normProgress(progressCb, 2 * tileCount);
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("SOR filter");
+			char buffer[64];
+			sprintf(buffer, "Tiles: %u", tileCount);
+			progressCb->setInfo(buffer);
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+
+	bool success = true;
+	std::vector<PointCoordinateType> meanDistances;
+	std::vector<unsigned char> keptPoints;
+
+	//1st pass: average distance and std. dev. (of all the points)
+	double sumDist = 0;
+	double sumSquareDist = 0;
+	unsigned pointCount = 0;
+	for (unsigned t = 0; t < tileCount && success; ++t)
+	{
+		unsigned coreCount = 0;
+		PointCoordinateType tileHalo = halo;
+		if (!filterStreamedTile(stream, t, params, tileHalo, maxHalo, coreCount, meanDistances, keptPoints))
+		{
+			success = false;
+			break;
+		}
+		tileHalos[t] = tileHalo;
+
+		for (unsigned i = 0; i < coreCount; ++i)
+		{
+			sumDist += meanDistances[i];
+			sumSquareDist += static_cast<double>(meanDistances[i]) * meanDistances[i];
+		}
+		pointCount += coreCount;
+
+		if (progressCb && !normProgress.oneStep())
+		{
+			//process cancelled by the user
+			success = false;
+		}
+	}
+
+	//2nd pass: remove the farthest points
+	if (success && pointCount != 0)
+	{
+		double avgDist = sumDist / pointCount;
+		double stdDev = sqrt(fabs(sumSquareDist / pointCount - avgDist*avgDist));
+		double maxDist = avgDist + nSigma * stdDev;
+
+		for (unsigned t = 0; t < tileCount && success; ++t)
+		{
+			unsigned coreCount = 0;
+			PointCoordinateType tileHalo = tileHalos[t];
+			GenericIndexedCloudPersist* tileCloud = filterStreamedTile(stream, t, params, tileHalo, tileHalo, coreCount, meanDistances, keptPoints);
+			if (!tileCloud)
+			{
+				success = false;
+				break;
+			}
+
+			ReferenceCloud selection(tileCloud);
+			if (!selection.reserve(coreCount))
+			{
+				//not enough memory
+				success = false;
+				break;
+			}
+			for (unsigned i = 0; i < coreCount; ++i)
+			{
+				if (meanDistances[i] <= maxDist)
+				{
+					selection.addPointIndex(i);
+				}
+			}
+			if (!stream.writeTileSelection(t, selection))
+			{
+				success = false;
+				break;
+			}
+
+			if (progressCb && !normProgress.oneStep())
+			{
+				//process cancelled by the user
+				success = false;
+			}
+		}
+	}
+
+	if (progressCb)
+	{
+		progressCb->stop();
+	}
+
+	return success;
+}
+
+bool CloudSamplingTools::noiseFilterStreamed(	GenericTiledCloudStream& stream,
+												PointCoordinateType kernelRadius,
+												double nSigma,
+												bool removeIsolatedPoints/*=false*/,
+												bool useKnn/*=false*/,
+												int knn/*=6*/,
+												bool useAbsoluteError/*=true*/,
+												double absoluteError/*=0.0*/,
+												PointCoordinateType initialHalo/*=0*/,
+												GenericProgressCallback* progressCb/*=0*/)
+{
+	if ((useKnn && knn <= 0) || (!useKnn && kernelRadius <= 0))
+	{
+		//invalid input
+		assert(false);
+		return false;
+	}
 
-	unsigned char octreeLevel = 0;
+	unsigned tileCount = stream.tileCount();
+	if (tileCount == 0)
+	{
+		//nothing to do
+		return true;
+	}
+
+	StreamedFilterParams params;
+	params.sor = false;
+	params.knn = knn;
+	params.noise.kernelRadius = kernelRadius;
+	params.noise.nSigma = nSigma;
+	params.noise.removeIsolatedPoints = removeIsolatedPoints;
+	params.noise.useKnn = useKnn;
+	params.noise.knn = knn;
+	params.noise.useAbsoluteError = useAbsoluteError;
+	params.noise.absoluteError = absoluteError;
+
+	CCVector3 bbMin, bbMax;
+	stream.getBoundingBox(bbMin, bbMax);
+	params.octreeSize = GetOctreeSize(bbMin, bbMax);
+
+	PointCoordinateType halo = kernelRadius;
+	PointCoordinateType maxHalo = kernelRadius;
 	if (useKnn)
-		octreeLevel = octree->findBestLevelForAGivenNeighbourhoodSizeExtraction(kernelRadius);
-	else
-		octreeLevel = octree->findBestLevelForAGivenPopulationPerCell(knn);
+	{
+		//beyond the cloud diagonal, the halo contains all the points
+		maxHalo = (bbMax - bbMin).norm() * static_cast<PointCoordinateType>(1.01) + ZERO_TOLERANCE;
+		halo = (initialHalo > 0 ? initialHalo : maxHalo / 100);
+	}
 
-	if (octree->executeFunctionForAllCellsAtLevel(	octreeLevel,
-													&applyNoiseFilterAtLevel,
-													additionalParameters,
-													true,
-													progressCb,
-													"Noise filter" ) == 0)
+	NormalizedProgress normProgress(progressCb, tileCount);
+	if (progressCb)
 	{
-		//something went wrong
-		delete filteredCloud;
-		filteredCloud = 0;
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("Noise filter");
+			char buffer[64];
+			sprintf(buffer, "Tiles: %u", tileCount);
+			progressCb->setInfo(buffer);
+		}
+		progressCb->update(0);
+		progressCb->start();
 	}
 
-	if (!inputOctree)
+	bool success = true;
+	std::vector<PointCoordinateType> meanDistances;
+	std::vector<unsigned char> keptPoints;
+
+	for (unsigned t = 0; t < tileCount; ++t)
 	{
-		delete octree;
-		octree = 0;
+		unsigned coreCount = 0;
+		PointCoordinateType tileHalo = halo;
+		GenericIndexedCloudPersist* tileCloud = filterStreamedTile(stream, t, params, tileHalo, maxHalo, coreCount, meanDistances, keptPoints);
+		if (!tileCloud)
+		{
+			success = false;
+			break;
+		}
+
+		ReferenceCloud selection(tileCloud);
+		if (!selection.reserve(coreCount))
+		{
+			//not enough memory
+			success = false;
+			break;
+		}
+		for (unsigned i = 0; i < coreCount; ++i)
+		{
+			if (keptPoints[i])
+			{
+				selection.addPointIndex(i);
+			}
+		}
+		if (!stream.writeTileSelection(t, selection))
+		{
+			success = false;
+			break;
+		}
+
+		if (progressCb && !normProgress.oneStep())
+		{
+			//process cancelled by the user
+			success = false;
+			break;
+		}
 	}
 
-	if (filteredCloud)
+	if (progressCb)
 	{
-		filteredCloud->resize(filteredCloud->size());
+		progressCb->stop();
 	}
 
-	return filteredCloud;
+	return success;
 }
 
 bool CloudSamplingTools::resampleCellAtLevel(	const DgmOctree::octreeCell& cell,
@@ -744,14 +1326,18 @@ bool CloudSamplingTools::applyNoiseFilterAtLevel(	const DgmOctree::octreeCell& c
 													void** additionalParameters,
 													NormalizedProgress* nProgress/*=0*/)
 {
-	ReferenceCloud* cloud				=  static_cast<ReferenceCloud*>(additionalParameters[0]);
-	PointCoordinateType kernelRadius	= *static_cast<PointCoordinateType*>(additionalParameters[1]);
-	double nSigma						= *static_cast<double*>(additionalParameters[2]);
-	bool removeIsolatedPoints			= *static_cast<bool*>(additionalParameters[3]);
-	bool useKnn							= *static_cast<bool*>(additionalParameters[4]);
-	int knn								= *static_cast<int*>(additionalParameters[5]);
-	bool useAbsoluteError				= *static_cast<bool*>(additionalParameters[6]);
-	double absoluteError				= *static_cast<double*>(additionalParameters[7]);
+	std::vector<unsigned char>& keptPoints			= *static_cast<std::vector<unsigned char>*>(additionalParameters[0]);
+	const NoiseFilterParams& params					= *static_cast<const NoiseFilterParams*>(additionalParameters[1]);
+	std::vector<PointCoordinateType>* maxDistances	=  static_cast<std::vector<PointCoordinateType>*>(additionalParameters[2]);
+	unsigned queryCount								= *static_cast<unsigned*>(additionalParameters[3]);
+
+	PointCoordinateType kernelRadius	= params.kernelRadius;
+	double nSigma						= params.nSigma;
+	bool removeIsolatedPoints			= params.removeIsolatedPoints;
+	bool useKnn							= params.useKnn;
+	int knn								= params.knn;
+	bool useAbsoluteError				= params.useAbsoluteError;
+	double absoluteError				= params.absoluteError;
 
 	//structure for nearest neighbors search
 	DgmOctree::NearestNeighboursSphericalSearchStruct nNSS;
@@ -769,6 +1355,17 @@ bool CloudSamplingTools::applyNoiseFilterAtLevel(	const DgmOctree::octreeCell& c
 	//for each point in the cell
 	for (unsigned i=0; i<n; ++i)
 	{
+		const unsigned globalIndex = cell.points->getPointGlobalIndex(i);
+		if (queryCount != 0 && globalIndex >= queryCount)
+		{
+			//not a query point
+			if (nProgress && !nProgress->oneStep())
+			{
+				return false;
+			}
+			continue;
+		}
+
 		cell.points->getPoint(i,nNSS.queryPoint);
 
 		//look for neighbors (either inside a sphere or the k nearest ones)
@@ -776,19 +1373,31 @@ bool CloudSamplingTools::applyNoiseFilterAtLevel(	const DgmOctree::octreeCell& c
 		unsigned neighborCount = 0;
 
 		if (useKnn)
+		{
 			neighborCount = cell.parentOctree->findNearestNeighborsStartingFromCell(nNSS);
+			//the search may return more (eligible) points than requested: we only keep the k nearest ones
+			//(so that the result doesn't depend on the octree)
+			neighborCount = std::min(neighborCount, static_cast<unsigned>(knn));
+
+			if (maxDistances)
+			{
+				//distance to the farthest neighbor (infinite if the neighbourhood is incomplete)
+				(*maxDistances)[globalIndex] = (neighborCount < static_cast<unsigned>(knn) ? std::numeric_limits<PointCoordinateType>::max()
+																							: static_cast<PointCoordinateType>(sqrt(nNSS.pointsInNeighbourhood[neighborCount - 1].squareDistd)));
+			}
+		}
 		else
+		{
 			neighborCount = cell.parentOctree->findNeighborsInASphereStartingFromCell(nNSS,kernelRadius,false);
+		}
 
 		if (neighborCount > 3) //we want 3 points or more (other than the point itself!)
 		{
 			//find the query point in the nearest neighbors set and place it at the end
-			const unsigned globalIndex = cell.points->getPointGlobalIndex(i);
+			//(it may not be part of the k nearest neighbors if it has duplicates)
 			unsigned localIndex = 0;
 			while (localIndex < neighborCount && nNSS.pointsInNeighbourhood[localIndex].pointIndex != globalIndex)
 				++localIndex;
-			//the query point should be in the nearest neighbors set!
-			assert(localIndex < neighborCount);
 			if (localIndex+1 < neighborCount) //no need to swap with another point if it's already at the end!
 			{
 				std::swap(nNSS.pointsInNeighbourhood[localIndex],nNSS.pointsInNeighbourhood[neighborCount-1]);
@@ -823,7 +1432,7 @@ bool CloudSamplingTools::applyNoiseFilterAtLevel(	const DgmOctree::octreeCell& c
 				double d = fabs(CCLib::DistanceComputationTools::computePoint2PlaneDistance(&nNSS.queryPoint,lsPlane));
 
 				if (d <= maxD)
-					cloud->addPointIndex(globalIndex);
+					keptPoints[globalIndex] = 1;
 			}
 			else
 			{
@@ -836,8 +1445,7 @@ bool CloudSamplingTools::applyNoiseFilterAtLevel(	const DgmOctree::octreeCell& c
 			if (!removeIsolatedPoints)
 			{
 				//we keep the point
-				unsigned globalIndex = cell.points->getPointGlobalIndex(i);
-				cloud->addPointIndex(globalIndex);
+				keptPoints[globalIndex] = 1;
 			}
 		}
 
@@ -856,31 +1464,67 @@ bool CloudSamplingTools::applySORFilterAtLevel(	const DgmOctree::octreeCell& cel
 {
 	int knn											= *static_cast<int*>(additionalParameters[0]);
 	std::vector<PointCoordinateType>& meanDistances = *static_cast<std::vector<PointCoordinateType>*>(additionalParameters[1]);
+	std::vector<PointCoordinateType>* maxDistances	=  static_cast<std::vector<PointCoordinateType>*>(additionalParameters[2]);
+	unsigned queryCount								= *static_cast<unsigned*>(additionalParameters[3]);
 
 	//structure for nearest neighbors search
-	DgmOctree::NearestNeighboursSphericalSearchStruct nNSS;
+	DgmOctree::NearestNeighboursBatchSearchStruct nNSS;
 	nNSS.level = cell.level;
 	nNSS.minNumberOfNeighbors = knn; //DGM: I woud have put knn+1 (as the point itself will be ignored) but in this case we won't get the same result as PCL!
 	cell.parentOctree->getCellPos(cell.truncatedCode, cell.level, nNSS.cellPos, true);
 	cell.parentOctree->computeCellCenter(nNSS.cellPos, cell.level, nNSS.cellCenter);
 
-	unsigned n = cell.points->size(); //number of points in the current cell
+	//query points
+	ReferenceCloud* queryPoints = cell.points;
+	ReferenceCloud selectedPoints(cell.points->getAssociatedCloud());
+	if (queryCount != 0)
+	{
+		//only the first 'queryCount' points of the cloud are processed
+		unsigned cellCount = cell.points->size();
+		if (!selectedPoints.reserve(cellCount))
+		{
+			//not enough memory
+			return false;
+		}
+		for (unsigned i = 0; i < cellCount; ++i)
+		{
+			unsigned globalIndex = cell.points->getPointGlobalIndex(i);
+			if (globalIndex < queryCount)
+			{
+				selectedPoints.addPointIndex(globalIndex);
+			}
+		}
+		queryPoints = &selectedPoints;
 
-	//for each point in the cell
+		if (nProgress && !nProgress->steps(cellCount - selectedPoints.size()))
+		{
+			return false;
+		}
+	}
+
+	unsigned n = queryPoints->size(); //number of query points in the current cell
+
+	//look for the k nearest neighbors of all the query points at once
+	if (n != 0 && !cell.parentOctree->findNearestNeighborsInBatch(nNSS, queryPoints))
+	{
+		//not enough memory
+		return false;
+	}
+
+	//for each query point
 	for (unsigned i = 0; i < n; ++i)
 	{
-		cell.points->getPoint(i, nNSS.queryPoint);
-		const unsigned globalIndex = cell.points->getPointGlobalIndex(i);
+		const unsigned globalIndex = queryPoints->getPointGlobalIndex(i);
 
-		//look for the k nearest neighbors
-		cell.parentOctree->findNearestNeighborsStartingFromCell(nNSS);
+		const DgmOctree::PointDescriptor* neighbours = nNSS.neighboursOf(i);
+		unsigned neighbourCount = nNSS.neighboursCount(i);
 		double sumDist = 0;
 		unsigned count = 0;
-		for (int j = 0; j < knn; ++j)
+		for (unsigned j = 0; j < neighbourCount; ++j)
 		{
-			if (nNSS.pointsInNeighbourhood[j].pointIndex != globalIndex)
+			if (neighbours[j].pointIndex != globalIndex)
 			{
-				sumDist += sqrt(nNSS.pointsInNeighbourhood[j].squareDistd);
+				sumDist += sqrt(neighbours[j].squareDistd);
 				++count;
 			}
 		}
@@ -895,6 +1539,13 @@ bool CloudSamplingTools::applySORFilterAtLevel(	const DgmOctree::octreeCell& cel
 			assert(false);
 		}
 
+		if (maxDistances)
+		{
+			//distance to the farthest neighbor (infinite if the neighbourhood is incomplete)
+			(*maxDistances)[globalIndex] = (neighbourCount < static_cast<unsigned>(knn) ? std::numeric_limits<PointCoordinateType>::max()
+																						: static_cast<PointCoordinateType>(sqrt(neighbours[neighbourCount - 1].squareDistd)));
+		}
+
 		if (nProgress && !nProgress->oneStep())
 		{
 			return false;
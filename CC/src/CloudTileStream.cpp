@@ -0,0 +1,243 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "CloudTileStream.h"
+
+//local
+#include "GenericIndexedCloudPersist.h"
+
+//system
+#include <assert.h>
+#include <new>
+
+using namespace CCLib;
+
+CloudTileStream::CloudTileStream(GenericIndexedCloudPersist* cloud, unsigned maxTilePointCount)
+	: m_cloud(cloud)
+	, m_maxTilePointCount(std::max<unsigned>(maxTilePointCount, 1))
+	, m_bbMin(0, 0, 0)
+	, m_bbMax(0, 0, 0)
+	, m_sortedPoints(cloud)
+	, m_tilePoints(cloud)
+	, m_currentTile(0)
+	, m_selection(cloud)
+{
+	assert(m_cloud);
+}
+
+CloudTileStream::~CloudTileStream()
+{
+}
+
+bool CloudTileStream::init()
+{
+	m_tiling.clear();
+	m_sortedPoints.clear(false);
+	m_tilePoints.clear(false);
+	m_selection.clear(false);
+	m_currentTile = 0;
+
+	if (!m_cloud)
+	{
+		assert(false);
+		return false;
+	}
+
+	unsigned pointCount = m_cloud->size();
+	if (pointCount == 0)
+	{
+		//nothing to do
+		return true;
+	}
+
+	//tiling grid
+	m_cloud->getBoundingBox(m_bbMin, m_bbMax);
+	if (!m_tiling.init(m_bbMin, m_bbMax))
+	{
+		//not enough memory
+		return false;
+	}
+
+	//number of points per cell
+	for (unsigned i = 0; i < pointCount; )
+	{
+		unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+		const CCVector3* P = m_cloud->getPointsBlock(i, blockSize);
+		for (unsigned j = 0; j < blockSize; ++j, ++P)
+		{
+			m_tiling.countPoint(*P);
+		}
+		i += blockSize;
+	}
+
+	//tiles
+	if (!m_tiling.computeTiles(m_maxTilePointCount))
+	{
+		m_tiling.clear();
+		return false;
+	}
+	const std::vector<TilingGrid::Tile>& tiles = m_tiling.tiles();
+
+	try
+	{
+		//we sort the points by tile (counting sort)
+		if (!m_sortedPoints.resize(pointCount))
+		{
+			m_tiling.clear();
+			return false;
+		}
+		std::vector<unsigned> fillIndexes(tiles.size());
+		for (size_t t = 0; t < tiles.size(); ++t)
+		{
+			fillIndexes[t] = tiles[t].first;
+		}
+		for (unsigned i = 0; i < pointCount; )
+		{
+			unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+			const CCVector3* P = m_cloud->getPointsBlock(i, blockSize);
+			for (unsigned j = 0; j < blockSize; ++j, ++P)
+			{
+				unsigned tileIndex = m_tiling.getTileIndex(*P);
+				m_sortedPoints.setPointIndex(fillIndexes[tileIndex]++, i + j);
+			}
+			i += blockSize;
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		m_tiling.clear();
+		m_sortedPoints.clear(true);
+		return false;
+	}
+
+	return true;
+}
+
+unsigned CloudTileStream::tileCount()
+{
+	return static_cast<unsigned>(m_tiling.tiles().size());
+}
+
+void CloudTileStream::getBoundingBox(CCVector3& bbMin, CCVector3& bbMax)
+{
+	bbMin = m_bbMin;
+	bbMax = m_bbMax;
+}
+
+GenericIndexedCloudPersist* CloudTileStream::loadTile(	unsigned tileIndex,
+														PointCoordinateType halo,
+														unsigned& coreCount,
+														CCVector3& tileMin,
+														CCVector3& tileMax)
+{
+	const std::vector<TilingGrid::Tile>& tiles = m_tiling.tiles();
+	if (tileIndex >= tiles.size())
+	{
+		assert(false);
+		return 0;
+	}
+
+	const TilingGrid::Tile& tile = tiles[tileIndex];
+	m_currentTile = tileIndex;
+	m_tilePoints.clear(false);
+	coreCount = tile.count;
+
+	//core points
+	if (!m_tilePoints.reserve(tile.count))
+	{
+		//not enough memory
+		return 0;
+	}
+	for (unsigned i = 0; i < tile.count; ++i)
+	{
+		unsigned globalIndex = m_sortedPoints.getPointGlobalIndex(tile.first + i);
+		m_tilePoints.addPointIndex(globalIndex);
+
+		const CCVector3* P = m_cloud->getPoint(globalIndex);
+		if (i != 0)
+		{
+			for (unsigned char d = 0; d < 3; ++d)
+			{
+				tileMin.u[d] = std::min(tileMin.u[d], P->u[d]);
+				tileMax.u[d] = std::max(tileMax.u[d], P->u[d]);
+			}
+		}
+		else
+		{
+			tileMin = tileMax = *P;
+		}
+	}
+
+	if (halo <= 0)
+	{
+		return &m_tilePoints;
+	}
+
+	//halo points
+	CCVector3 haloMin = tileMin - CCVector3(halo, halo, halo);
+	CCVector3 haloMax = tileMax + CCVector3(halo, halo, halo);
+	for (unsigned t = 0; t < tiles.size(); ++t)
+	{
+		if (t == tileIndex || !m_tiling.tileIntersects(t, haloMin, haloMax))
+			continue;
+
+		const TilingGrid::Tile& other = tiles[t];
+		for (unsigned i = 0; i < other.count; ++i)
+		{
+			unsigned globalIndex = m_sortedPoints.getPointGlobalIndex(other.first + i);
+			const CCVector3* P = m_cloud->getPoint(globalIndex);
+			if (	P->x >= haloMin.x && P->x <= haloMax.x
+				&&	P->y >= haloMin.y && P->y <= haloMax.y
+				&&	P->z >= haloMin.z && P->z <= haloMax.z )
+			{
+				if (!m_tilePoints.addPointIndex(globalIndex))
+				{
+					//not enough memory
+					m_tilePoints.clear(true);
+					return 0;
+				}
+			}
+		}
+	}
+
+	return &m_tilePoints;
+}
+
+bool CloudTileStream::writeTileSelection(unsigned tileIndex, ReferenceCloud& selection)
+{
+	if (tileIndex != m_currentTile || tileIndex >= m_tiling.tiles().size())
+	{
+		//the selection must be associated to the last loaded tile
+		assert(false);
+		return false;
+	}
+
+	unsigned count = selection.size();
+	if (!m_selection.reserve(m_selection.size() + count))
+	{
+		//not enough memory
+		return false;
+	}
+	for (unsigned i = 0; i < count; ++i)
+	{
+		m_selection.addPointIndex(m_tilePoints.getPointGlobalIndex(selection.getPointGlobalIndex(i)));
+	}
+
+	return true;
+}
@@ -21,6 +21,7 @@
 //local
 #include "GenericIndexedCloud.h"
 #include "ManualSegmentationTools.h"
+#include "PolygonInclusionGrid.h"
 #include "Polyline.h"
 #include "ChunkedPointCloud.h"
 
@@ -238,6 +239,10 @@ bool Delaunay2dMesh::removeOuterTriangles(	const std::vector<CCVector2>& vertice
 
 	unsigned lastValidIndex = 0;
 
+	//the polygon is rasterized first (so as to avoid testing all its edges for each triangle)
+	PolygonInclusionGrid polyGrid;
+	bool usePolyGrid = polyGrid.build(polygon2D);
+
 	//test each triangle center
 	{
 		const int* _triIndexes = m_triIndexes;
@@ -250,7 +255,8 @@ bool Delaunay2dMesh::removeOuterTriangles(	const std::vector<CCVector2>& vertice
 			CCVector2 G = (A + B + C) / 3.0;
 
 			//if G is inside the 'polygon'
-			bool isInside = CCLib::ManualSegmentationTools::isPointInsidePoly(G, polygon2D);
+			bool isInside = usePolyGrid	? polyGrid.isInside(G)
+										: CCLib::ManualSegmentationTools::isPointInsidePoly(G, polygon2D);
 			if ((removeOutside && isInside) || (!removeOutside && !isInside))
 			{
 				//we keep the corresponding triangle
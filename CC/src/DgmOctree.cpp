@@ -33,6 +33,9 @@
 #include <assert.h>
 #include <stdio.h>
 #include <set>
+#include <deque>
+#include <chrono>
+#include <atomic>
 
 //DGM: tests in progress
 //#define COMPUTE_NN_SEARCH_STATISTICS
@@ -45,6 +48,13 @@
 #endif
 #endif
 
+#ifdef ENABLE_MT_OCTREE
+#include <QtCore>
+#include <QApplication>
+#include <QtConcurrentMap>
+#include <QThreadPool>
+#endif
+
 using namespace CCLib;
 
 /**********************************/
@@ -183,6 +193,335 @@ bool DgmOctree::MultiThreadSupport()
 #endif
 }
 
+/**********************************/
+/*     CELLS STATISTICS (HELPER)  */
+/**********************************/
+
+//! Cells statistics for a given level of subdivision
+struct CellsStatistics
+{
+	//! Level of subdivision
+	unsigned char level;
+	//! Number of cells
+	unsigned cellCount;
+	//! Max cell population
+	unsigned maxCellPopulation;
+	//! Average cell population
+	double averageCellPopulation;
+	//! Std. dev. of cell population
+	double stdDevCellPopulation;
+};
+
+//! Computes the cells statistics for a given level of subdivision (see DgmOctree::computeCellsStatistics)
+static void ComputeCellsStatistics(const DgmOctree::cellsContainer& pointsAndCodes, CellsStatistics& stats)
+{
+	assert(stats.level <= DgmOctree::MAX_OCTREE_LEVEL);
+
+	//empty octree case?!
+	if (pointsAndCodes.empty())
+	{
+		//DGM: we make as if there were 1 point to avoid some degenerated cases!
+		stats.cellCount = 1;
+		stats.maxCellPopulation = 1;
+		stats.averageCellPopulation = 1.0;
+		stats.stdDevCellPopulation = 0.0;
+		return;
+	}
+
+	//level '0' specific case
+	if (stats.level == 0)
+	{
+		stats.cellCount = 1;
+		stats.maxCellPopulation = static_cast<unsigned>(pointsAndCodes.size());
+		stats.averageCellPopulation = static_cast<double>(pointsAndCodes.size());
+		stats.stdDevCellPopulation = 0.0;
+		return;
+	}
+
+	//binary shift for cell code truncation
+	unsigned char bitDec = DgmOctree::GET_BIT_SHIFT(stats.level);
+
+	//iterator on octree elements
+	DgmOctree::cellsContainer::const_iterator p = pointsAndCodes.begin();
+
+	//we init scan with first element
+	DgmOctree::CellCode predCode = (p->theCode >> bitDec);
+	unsigned counter = 0;
+	unsigned cellCounter = 0;
+	unsigned maxCellPop = 0;
+	double sum = 0.0, sum2 = 0.0;
+
+	for (; p != pointsAndCodes.end(); ++p)
+	{
+		DgmOctree::CellCode currentCode = (p->theCode >> bitDec);
+		if (predCode != currentCode)
+		{
+			sum += static_cast<double>(cellCounter);
+			sum2 += static_cast<double>(cellCounter) * static_cast<double>(cellCounter);
+
+			if (maxCellPop<cellCounter)
+				maxCellPop = cellCounter;
+
+			//new cell
+			predCode = currentCode;
+			cellCounter = 0;
+			++counter;
+		}
+		++cellCounter;
+	}
+
+	//don't forget last cell!
+	sum += static_cast<double>(cellCounter);
+	sum2 += static_cast<double>(cellCounter) * static_cast<double>(cellCounter);
+	if (maxCellPop < cellCounter)
+		maxCellPop = cellCounter;
+	++counter;
+
+	assert(counter > 0);
+	stats.cellCount = counter;
+	stats.maxCellPopulation = maxCellPop;
+	stats.averageCellPopulation = sum/static_cast<double>(counter);
+	stats.stdDevCellPopulation = sqrt(sum2/static_cast<double>(counter) - stats.averageCellPopulation*stats.averageCellPopulation);
+}
+
+#ifdef ENABLE_MT_OCTREE
+
+/*** FOR THE MULTI-THREADED BUILD ***/
+
+//! Minimum number of points for which the parallel build path is used
+static const unsigned MIN_POINT_COUNT_FOR_MT_BUILD = 65536;
+//! Number of points processed by each (parallel) cell codes generation job
+static const unsigned MT_BUILD_CHUNK_SIZE = 65536;
+//! Radix sort digit size (in bits)
+static const unsigned char RADIX_BITS = 8;
+//! Radix sort buckets count
+static const unsigned RADIX_BUCKETS = (1 << RADIX_BITS);
+
+//! Prevents two octrees from using the (static) parallel build wrappers at the same time
+static QMutex s_build_MT_mutex;
+
+//! Cell codes generation job
+struct octreeBuildChunk
+{
+	//! First point index (included)
+	unsigned i1;
+	//! Last point index (excluded)
+	unsigned i2;
+	//! Number of points projected in the octree
+	unsigned projectedCount;
+	//! Min and max occupied cells positions (at the deepest level)
+	int fillIndexes[6];
+};
+
+static const DgmOctree* s_buildOctree_MT = 0;
+static GenericIndexedCloudPersist* s_buildCloud_MT = 0;
+static DgmOctree::IndexAndCode* s_buildCodes_MT = 0;
+static CCVector3 s_buildPointsMin_MT;
+static CCVector3 s_buildPointsMax_MT;
+static NormalizedProgress* s_buildProgress_MT = 0;
+static bool s_build_MT_success = true;
+
+void ProjectPointsChunk_MT(octreeBuildChunk& chunk)
+{
+	chunk.projectedCount = 0;
+
+	//skip chunk if process is aborted
+	if (!s_build_MT_success)
+	{
+		return;
+	}
+
+	int* fillIndexes = chunk.fillIndexes;
+	for (unsigned i = chunk.i1; i < chunk.i2; ++i)
+	{
+		const CCVector3* P = s_buildCloud_MT->getPoint(i);
+		DgmOctree::IndexAndCode& ic = s_buildCodes_MT[i];
+		ic.theIndex = i;
+
+		//does the point falls in the 'accepted points' box?
+		if (	(P->x >= s_buildPointsMin_MT.x) && (P->x <= s_buildPointsMax_MT.x)
+			&&	(P->y >= s_buildPointsMin_MT.y) && (P->y <= s_buildPointsMax_MT.y)
+			&&	(P->z >= s_buildPointsMin_MT.z) && (P->z <= s_buildPointsMax_MT.z) )
+		{
+			//compute the position of the cell that includes this point
+			Tuple3i cellPos;
+			s_buildOctree_MT->getTheCellPosWhichIncludesThePoint(P, cellPos);
+
+			//clipping
+			for (int dim = 0; dim < 3; ++dim)
+			{
+				if (cellPos.u[dim] < 0)
+					cellPos.u[dim] = 0;
+				else if (cellPos.u[dim] >= DgmOctree::MAX_OCTREE_LENGTH)
+					cellPos.u[dim] = DgmOctree::MAX_OCTREE_LENGTH - 1;
+			}
+
+			ic.theCode = DgmOctree::GenerateTruncatedCellCode(cellPos, DgmOctree::MAX_OCTREE_LEVEL);
+
+			if (chunk.projectedCount)
+			{
+				for (int dim = 0; dim < 3; ++dim)
+				{
+					if (fillIndexes[dim] > cellPos.u[dim])
+						fillIndexes[dim] = cellPos.u[dim];
+					else if (fillIndexes[dim + 3] < cellPos.u[dim])
+						fillIndexes[dim + 3] = cellPos.u[dim];
+				}
+			}
+			else
+			{
+				fillIndexes[0] = fillIndexes[3] = cellPos.x;
+				fillIndexes[1] = fillIndexes[4] = cellPos.y;
+				fillIndexes[2] = fillIndexes[5] = cellPos.z;
+			}
+
+			++chunk.projectedCount;
+		}
+		else
+		{
+			//will be removed afterwards
+			ic.theCode = DgmOctree::INVALID_CELL_CODE;
+		}
+	}
+
+	if (s_buildProgress_MT && !s_buildProgress_MT->steps(chunk.i2 - chunk.i1))
+	{
+		s_build_MT_success = false;
+	}
+}
+
+static bool IsInvalidCode(const DgmOctree::IndexAndCode& ic)
+{
+	return ic.theCode == DgmOctree::INVALID_CELL_CODE;
+}
+
+//! Parallel LSD radix sort block
+struct radixSortBlock
+{
+	//! First element index (included)
+	unsigned i1;
+	//! Last element index (excluded)
+	unsigned i2;
+	//! Per-bucket histogram, then per-bucket output offset
+	unsigned offsets[RADIX_BUCKETS];
+};
+
+static const DgmOctree::IndexAndCode* s_radixSrc_MT = 0;
+static DgmOctree::IndexAndCode* s_radixDst_MT = 0;
+static unsigned char s_radixShift_MT = 0;
+
+void RadixSortHistogram_MT(radixSortBlock& block)
+{
+	memset(block.offsets, 0, sizeof(unsigned) * RADIX_BUCKETS);
+	for (unsigned i = block.i1; i < block.i2; ++i)
+	{
+		++block.offsets[(s_radixSrc_MT[i].theCode >> s_radixShift_MT) & (RADIX_BUCKETS - 1)];
+	}
+}
+
+void RadixSortScatter_MT(radixSortBlock& block)
+{
+	for (unsigned i = block.i1; i < block.i2; ++i)
+	{
+		const DgmOctree::IndexAndCode& ic = s_radixSrc_MT[i];
+		s_radixDst_MT[block.offsets[(ic.theCode >> s_radixShift_MT) & (RADIX_BUCKETS - 1)]++] = ic;
+	}
+}
+
+//! Sorts the octree elements by ascending code order (parallel LSD radix sort)
+/** The sort is stable: as codes are generated in the points order, the
+	result is the same whatever the number of threads.
+	\return false if not enough memory (the input container is left untouched)
+**/
+static bool RadixSortByCode_MT(DgmOctree::cellsContainer& pointsAndCodes)
+{
+	const unsigned count = static_cast<unsigned>(pointsAndCodes.size());
+	if (count == 0)
+		return true;
+
+	unsigned blockCount = std::max<unsigned>(1, std::min<unsigned>(count / MT_BUILD_CHUNK_SIZE, 4 * static_cast<unsigned>(QThread::idealThreadCount())));
+
+	DgmOctree::cellsContainer buffer;
+	std::vector<radixSortBlock> blocks;
+	try
+	{
+		buffer.resize(count);
+		blocks.resize(blockCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	unsigned blockSize = count / blockCount;
+	for (unsigned i = 0; i < blockCount; ++i)
+	{
+		blocks[i].i1 = i * blockSize;
+		blocks[i].i2 = (i + 1 == blockCount ? count : (i + 1) * blockSize);
+	}
+
+	DgmOctree::IndexAndCode* src = &(pointsAndCodes[0]);
+	DgmOctree::IndexAndCode* dst = &(buffer[0]);
+
+	//only the first 3*MAX_OCTREE_LEVEL bits are significant
+	for (unsigned shift = 0; shift < 3 * DgmOctree::MAX_OCTREE_LEVEL; shift += RADIX_BITS)
+	{
+		s_radixSrc_MT = src;
+		s_radixDst_MT = dst;
+		s_radixShift_MT = static_cast<unsigned char>(shift);
+
+		QtConcurrent::blockingMap(blocks, RadixSortHistogram_MT);
+
+		//exclusive prefix sum (bucket by bucket, then block by block to keep the sort stable)
+		unsigned sum = 0;
+		bool singleBucket = false;
+		for (unsigned b = 0; b < RADIX_BUCKETS; ++b)
+		{
+			unsigned bucketCount = 0;
+			for (unsigned i = 0; i < blockCount; ++i)
+			{
+				unsigned c = blocks[i].offsets[b];
+				blocks[i].offsets[b] = sum;
+				sum += c;
+				bucketCount += c;
+			}
+			if (bucketCount == count)
+			{
+				singleBucket = true;
+			}
+		}
+
+		//all the codes share the same digit: nothing to do for this pass
+		if (singleBucket)
+			continue;
+
+		QtConcurrent::blockingMap(blocks, RadixSortScatter_MT);
+
+		std::swap(src, dst);
+	}
+
+	s_radixSrc_MT = 0;
+	s_radixDst_MT = 0;
+
+	//the sorted elements are in the buffer?
+	if (src != &(pointsAndCodes[0]))
+	{
+		pointsAndCodes.swap(buffer);
+	}
+
+	return true;
+}
+
+static const DgmOctree::cellsContainer* s_statsPointsAndCodes_MT = 0;
+
+void ComputeCellsStatistics_MT(CellsStatistics& stats)
+{
+	ComputeCellsStatistics(*s_statsPointsAndCodes_MT, stats);
+}
+
+#endif
+
 /**********************************/
 /*        EVERYTHING ELSE!        */
 /**********************************/
@@ -204,6 +543,7 @@ void DgmOctree::clear()
 {
 	//reset internal tables
 	m_dimMin = m_pointsMin = m_dimMax = m_pointsMax = CCVector3(0,0,0);
+	m_userDefinedLimits = false;
 
 	m_numberOfProjectedPoints = 0;
 	m_thePointsAndTheirCellCodes.clear();
@@ -238,6 +578,7 @@ int DgmOctree::build(	const CCVector3& octreeMin,
 	//the user can specify boundaries for points different than the octree box!
 	m_pointsMin = (pointsMinFilter ? *pointsMinFilter : m_dimMin);
 	m_pointsMax = (pointsMaxFilter ? *pointsMaxFilter : m_dimMax);
+	m_userDefinedLimits = true;
 
 	return genericBuild(progressCb);
 }
@@ -262,6 +603,9 @@ int DgmOctree::genericBuild(GenericProgressCallback* progressCb)
 	}
 	m_numberOfProjectedPoints = 0;
 
+	//to report the build time
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
 	//update the pre-computed 'cell size per level of subdivision' array
 	updateCellSizeTable();
 
@@ -283,78 +627,170 @@ int DgmOctree::genericBuild(GenericProgressCallback* progressCb)
 	//fill indexes table (we'll fill the max. level, then deduce the others from this one)
 	int* fillIndexesAtMaxLevel = m_fillIndexes + (MAX_OCTREE_LEVEL * 6);
 
-	//for all points
-	cellsContainer::iterator it = m_thePointsAndTheirCellCodes.begin();
-	for (unsigned i=0; i<pointCount; i++)
+#ifdef ENABLE_MT_OCTREE
+	//parallel cell codes generation
+	bool codesGenerated = false;
+	if (pointCount >= MIN_POINT_COUNT_FOR_MT_BUILD && s_build_MT_mutex.tryLock())
 	{
-		const CCVector3* P = m_theAssociatedCloud->getPoint(i);
+		std::vector<octreeBuildChunk> chunks;
+		try
+		{
+			chunks.resize((pointCount + MT_BUILD_CHUNK_SIZE - 1) / MT_BUILD_CHUNK_SIZE);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory: we'll use the standard way
+		}
 
-		//does the point falls in the 'accepted points' box?
-		//(potentially different from the octree box - see DgmOctree::build)
-		if (	(P->x >= m_pointsMin[0]) && (P->x <= m_pointsMax[0])
-			&&	(P->y >= m_pointsMin[1]) && (P->y <= m_pointsMax[1])
-			&&	(P->z >= m_pointsMin[2]) && (P->z <= m_pointsMax[2]) )
+		if (!chunks.empty())
 		{
-			//compute the position of the cell that includes this point
-			Tuple3i cellPos;
-			getTheCellPosWhichIncludesThePoint(P, cellPos);
-
-			//clipping X
-			if (cellPos.x < 0)
-				cellPos.x = 0;
-			else if (cellPos.x >= MAX_OCTREE_LENGTH)
-				cellPos.x = MAX_OCTREE_LENGTH-1;
-			//clipping Y
-			if (cellPos.y < 0)
-				cellPos.y = 0;
-			else if (cellPos.y >= MAX_OCTREE_LENGTH)
-				cellPos.y = MAX_OCTREE_LENGTH-1;
-			//clipping Z
-			if (cellPos.z < 0)
-				cellPos.z = 0;
-			else if (cellPos.z >= MAX_OCTREE_LENGTH)
-				cellPos.z = MAX_OCTREE_LENGTH-1;
-
-			it->theIndex = i;
-			it->theCode = GenerateTruncatedCellCode(cellPos, MAX_OCTREE_LEVEL);
-
-			if (m_numberOfProjectedPoints)
+			for (size_t i = 0; i < chunks.size(); ++i)
 			{
-				if (fillIndexesAtMaxLevel[0] > cellPos.x)
-					fillIndexesAtMaxLevel[0] = cellPos.x;
-				else if (fillIndexesAtMaxLevel[3] < cellPos.x)
-					fillIndexesAtMaxLevel[3] = cellPos.x;
-
-				if (fillIndexesAtMaxLevel[1] > cellPos.y)
-					fillIndexesAtMaxLevel[1] = cellPos.y;
-				else if (fillIndexesAtMaxLevel[4] < cellPos.y)
-					fillIndexesAtMaxLevel[4] = cellPos.y;
-
-				if (fillIndexesAtMaxLevel[2] > cellPos.z)
-					fillIndexesAtMaxLevel[2] = cellPos.z;
-				else if (fillIndexesAtMaxLevel[5] < cellPos.z)
-					fillIndexesAtMaxLevel[5] = cellPos.z;
+				chunks[i].i1 = static_cast<unsigned>(i) * MT_BUILD_CHUNK_SIZE;
+				chunks[i].i2 = std::min(chunks[i].i1 + MT_BUILD_CHUNK_SIZE, pointCount);
 			}
-			else
+
+			//static wrap
+			s_buildOctree_MT = this;
+			s_buildCloud_MT = m_theAssociatedCloud;
+			s_buildCodes_MT = &(m_thePointsAndTheirCellCodes[0]);
+			s_buildPointsMin_MT = m_pointsMin;
+			s_buildPointsMax_MT = m_pointsMax;
+			s_buildProgress_MT = &nprogress;
+			s_build_MT_success = true;
+
+			QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+			QtConcurrent::blockingMap(chunks, ProjectPointsChunk_MT);
+
+			s_buildOctree_MT = 0;
+			s_buildCloud_MT = 0;
+			s_buildCodes_MT = 0;
+			s_buildProgress_MT = 0;
+		}
+		s_build_MT_mutex.unlock();
+
+		if (!chunks.empty())
+		{
+			if (!s_build_MT_success)
 			{
-				fillIndexesAtMaxLevel[0] = fillIndexesAtMaxLevel[3] = cellPos.x;
-				fillIndexesAtMaxLevel[1] = fillIndexesAtMaxLevel[4] = cellPos.y;
-				fillIndexesAtMaxLevel[2] = fillIndexesAtMaxLevel[5] = cellPos.z;
+				//process cancelled by the user
+				m_thePointsAndTheirCellCodes.clear();
+				m_numberOfProjectedPoints = 0;
+				if (progressCb)
+				{
+					progressCb->stop();
+				}
+				return 0;
 			}
 
-			++it;
-			++m_numberOfProjectedPoints;
+			//merge the chunks 'fill indexes' (in the same order as the standard way)
+			for (size_t i = 0; i < chunks.size(); ++i)
+			{
+				const octreeBuildChunk& chunk = chunks[i];
+				if (chunk.projectedCount == 0)
+					continue;
+
+				if (m_numberOfProjectedPoints)
+				{
+					for (int dim = 0; dim < 3; ++dim)
+					{
+						fillIndexesAtMaxLevel[dim] = std::min(fillIndexesAtMaxLevel[dim], chunk.fillIndexes[dim]);
+						fillIndexesAtMaxLevel[dim + 3] = std::max(fillIndexesAtMaxLevel[dim + 3], chunk.fillIndexes[dim + 3]);
+					}
+				}
+				else
+				{
+					memcpy(fillIndexesAtMaxLevel, chunk.fillIndexes, sizeof(int) * 6);
+				}
+				m_numberOfProjectedPoints += chunk.projectedCount;
+			}
+
+			//remove the points that have been filtered out (the points order is preserved)
+			if (m_numberOfProjectedPoints < pointCount)
+			{
+				std::remove_if(m_thePointsAndTheirCellCodes.begin(), m_thePointsAndTheirCellCodes.end(), IsInvalidCode);
+			}
+
+			codesGenerated = true;
 		}
+	}
 
-		if (!nprogress.oneStep())
+	if (!codesGenerated)
+#endif
+	{
+		//for all points
+		cellsContainer::iterator it = m_thePointsAndTheirCellCodes.begin();
+		for (unsigned i=0; i<pointCount; i++)
 		{
-			m_thePointsAndTheirCellCodes.clear();
-			m_numberOfProjectedPoints = 0;
-			if (progressCb)
+			const CCVector3* P = m_theAssociatedCloud->getPoint(i);
+
+			//does the point falls in the 'accepted points' box?
+			//(potentially different from the octree box - see DgmOctree::build)
+			if (	(P->x >= m_pointsMin[0]) && (P->x <= m_pointsMax[0])
+				&&	(P->y >= m_pointsMin[1]) && (P->y <= m_pointsMax[1])
+				&&	(P->z >= m_pointsMin[2]) && (P->z <= m_pointsMax[2]) )
 			{
-				progressCb->stop();
+				//compute the position of the cell that includes this point
+				Tuple3i cellPos;
+				getTheCellPosWhichIncludesThePoint(P, cellPos);
+
+				//clipping X
+				if (cellPos.x < 0)
+					cellPos.x = 0;
+				else if (cellPos.x >= MAX_OCTREE_LENGTH)
+					cellPos.x = MAX_OCTREE_LENGTH-1;
+				//clipping Y
+				if (cellPos.y < 0)
+					cellPos.y = 0;
+				else if (cellPos.y >= MAX_OCTREE_LENGTH)
+					cellPos.y = MAX_OCTREE_LENGTH-1;
+				//clipping Z
+				if (cellPos.z < 0)
+					cellPos.z = 0;
+				else if (cellPos.z >= MAX_OCTREE_LENGTH)
+					cellPos.z = MAX_OCTREE_LENGTH-1;
+
+				it->theIndex = i;
+				it->theCode = GenerateTruncatedCellCode(cellPos, MAX_OCTREE_LEVEL);
+
+				if (m_numberOfProjectedPoints)
+				{
+					if (fillIndexesAtMaxLevel[0] > cellPos.x)
+						fillIndexesAtMaxLevel[0] = cellPos.x;
+					else if (fillIndexesAtMaxLevel[3] < cellPos.x)
+						fillIndexesAtMaxLevel[3] = cellPos.x;
+
+					if (fillIndexesAtMaxLevel[1] > cellPos.y)
+						fillIndexesAtMaxLevel[1] = cellPos.y;
+					else if (fillIndexesAtMaxLevel[4] < cellPos.y)
+						fillIndexesAtMaxLevel[4] = cellPos.y;
+
+					if (fillIndexesAtMaxLevel[2] > cellPos.z)
+						fillIndexesAtMaxLevel[2] = cellPos.z;
+					else if (fillIndexesAtMaxLevel[5] < cellPos.z)
+						fillIndexesAtMaxLevel[5] = cellPos.z;
+				}
+				else
+				{
+					fillIndexesAtMaxLevel[0] = fillIndexesAtMaxLevel[3] = cellPos.x;
+					fillIndexesAtMaxLevel[1] = fillIndexesAtMaxLevel[4] = cellPos.y;
+					fillIndexesAtMaxLevel[2] = fillIndexesAtMaxLevel[5] = cellPos.z;
+				}
+
+				++it;
+				++m_numberOfProjectedPoints;
+			}
+
+			if (!nprogress.oneStep())
+			{
+				m_thePointsAndTheirCellCodes.clear();
+				m_numberOfProjectedPoints = 0;
+				if (progressCb)
+				{
+					progressCb->stop();
+				}
+				return 0;
 			}
-			return 0;
 		}
 	}
 
@@ -379,11 +815,30 @@ int DgmOctree::genericBuild(GenericProgressCallback* progressCb)
 	}
 
 	//we sort the 'cells' by ascending code order
-	SortAlgo(m_thePointsAndTheirCellCodes.begin(), m_thePointsAndTheirCellCodes.end(), IndexAndCode::codeComp);
+#ifdef ENABLE_MT_OCTREE
+	bool codesSorted = false;
+	if (m_numberOfProjectedPoints >= MIN_POINT_COUNT_FOR_MT_BUILD && s_build_MT_mutex.tryLock())
+	{
+		codesSorted = RadixSortByCode_MT(m_thePointsAndTheirCellCodes);
+		s_build_MT_mutex.unlock();
+	}
+
+	if (!codesSorted) //not enough memory for the radix sort
+#endif
+	{
+		SortAlgo(m_thePointsAndTheirCellCodes.begin(), m_thePointsAndTheirCellCodes.end(), IndexAndCode::codeComp);
+	}
+
+	if (progressCb && progressCb->textCanBeEdited())
+	{
+		progressCb->setInfo("Computing cells statistics...");
+	}
 
 	//update the pre-computed 'number of cells per level of subdivision' array
 	updateCellCountTable();
 
+	double buildTime_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
 	//end of process notification
 	if (progressCb)
 	{
@@ -392,14 +847,14 @@ int DgmOctree::genericBuild(GenericProgressCallback* progressCb)
 			char buffer[256];
 			if (m_numberOfProjectedPoints == pointCount)
 			{
-				sprintf(buffer, "[Octree::build] Octree successfully built... %u points (ok)!", m_numberOfProjectedPoints);
+				sprintf(buffer, "[Octree::build] Octree successfully built... %u points (ok)!\nTiming: %.3f s", m_numberOfProjectedPoints, buildTime_s);
 			}
 			else
 			{
 				if (m_numberOfProjectedPoints == 0)
 					sprintf(buffer, "[Octree::build] Warning : no point projected in the Octree!");
 				else
-					sprintf(buffer, "[Octree::build] Warning: some points have been filtered out (%u/%u)", pointCount - m_numberOfProjectedPoints, pointCount);
+					sprintf(buffer, "[Octree::build] Warning: some points have been filtered out (%u/%u)\nTiming: %.3f s", pointCount - m_numberOfProjectedPoints, pointCount, buildTime_s);
 			}
 			progressCb->setInfo(buffer);
 		}
@@ -412,6 +867,306 @@ int DgmOctree::genericBuild(GenericProgressCallback* progressCb)
 	return static_cast<int>(m_numberOfProjectedPoints);
 }
 
+//! Compares octree elements with a truncated cell code (see std::equal_range)
+struct TruncatedCodeComp
+{
+	explicit TruncatedCodeComp(unsigned char bitDec) : m_bitDec(bitDec) {}
+
+	inline bool operator()(const DgmOctree::IndexAndCode& a, DgmOctree::CellCode truncatedCode) const { return (a.theCode >> m_bitDec) < truncatedCode; }
+	inline bool operator()(DgmOctree::CellCode truncatedCode, const DgmOctree::IndexAndCode& a) const { return truncatedCode < (a.theCode >> m_bitDec); }
+
+	unsigned char m_bitDec;
+};
+
+void DgmOctree::updateCellsStatistics(const cellsContainer& codes, bool insertion, bool levelsToRecompute[MAX_OCTREE_LEVEL+1])
+{
+	const unsigned newCount = (insertion ? m_numberOfProjectedPoints + static_cast<unsigned>(codes.size()) : m_numberOfProjectedPoints - static_cast<unsigned>(codes.size()));
+
+	//level 0 is just the octree bounding-box
+	levelsToRecompute[0] = true;
+
+	cellsContainer::const_iterator octreeBegin = m_thePointsAndTheirCellCodes.begin();
+	cellsContainer::const_iterator octreeEnd = octreeBegin + m_numberOfProjectedPoints;
+
+	for (unsigned char level = 1; level <= MAX_OCTREE_LEVEL; ++level)
+	{
+		levelsToRecompute[level] = false;
+		if (m_numberOfProjectedPoints == 0 || newCount == 0)
+		{
+			levelsToRecompute[level] = true;
+			continue;
+		}
+
+		const unsigned char bitDec = GET_BIT_SHIFT(level);
+		TruncatedCodeComp comp(bitDec);
+
+		//we retrieve the sum of the squared populations from the current statistics
+		double cellCount = static_cast<double>(m_cellCount[level]);
+		double sum2 = cellCount * (m_stdDevCellPopulation[level] * m_stdDevCellPopulation[level] + m_averageCellPopulation[level] * m_averageCellPopulation[level]);
+		unsigned maxCellPop = m_maxCellPopulation[level];
+
+		//the input elements are sorted: the ones sharing the same cell are contiguous
+		for (cellsContainer::const_iterator it = codes.begin(); it != codes.end(); )
+		{
+			CellCode truncatedCode = (it->theCode >> bitDec);
+			unsigned k = 0;
+			while (it != codes.end() && (it->theCode >> bitDec) == truncatedCode)
+			{
+				++k;
+				++it;
+			}
+
+			//current population of this cell
+			std::pair<cellsContainer::const_iterator, cellsContainer::const_iterator> range = std::equal_range(octreeBegin, octreeEnd, truncatedCode, comp);
+			unsigned p = static_cast<unsigned>(range.second - range.first);
+
+			double dp = static_cast<double>(p);
+			double dk = static_cast<double>(k);
+			if (insertion)
+			{
+				sum2 += dk * (2.0 * dp + dk);
+				if (p == 0)
+					cellCount += 1.0;
+				if (maxCellPop < p + k)
+					maxCellPop = p + k;
+			}
+			else
+			{
+				assert(k <= p);
+				sum2 -= dk * (2.0 * dp - dk);
+				if (p == k)
+					cellCount -= 1.0;
+				if (p == maxCellPop)
+				{
+					//the max population may decrease
+					levelsToRecompute[level] = true;
+				}
+			}
+		}
+
+		if (!levelsToRecompute[level])
+		{
+			assert(cellCount >= 1.0);
+			m_cellCount[level] = static_cast<unsigned>(cellCount);
+			m_maxCellPopulation[level] = maxCellPop;
+			m_averageCellPopulation[level] = static_cast<double>(newCount) / cellCount;
+			m_stdDevCellPopulation[level] = sqrt(std::max(0.0, sum2 / cellCount - m_averageCellPopulation[level] * m_averageCellPopulation[level]));
+		}
+	}
+}
+
+bool DgmOctree::insertPoints(unsigned firstIndex)
+{
+	if (!m_theAssociatedCloud || m_thePointsAndTheirCellCodes.empty())
+	{
+		//the octree should be built first
+		return false;
+	}
+
+	unsigned pointCount = m_theAssociatedCloud->size();
+	if (firstIndex >= pointCount)
+	{
+		//nothing to do
+		return true;
+	}
+
+	cellsContainer newCodes;
+	try
+	{
+		newCodes.reserve(pointCount - firstIndex);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	CCVector3 pointsMin = m_pointsMin;
+	CCVector3 pointsMax = m_pointsMax;
+	int fillIndexesAtMaxLevel[6];
+	memcpy(fillIndexesAtMaxLevel, m_fillIndexes + (MAX_OCTREE_LEVEL * 6), sizeof(int) * 6);
+
+	for (unsigned i = firstIndex; i < pointCount; ++i)
+	{
+		const CCVector3* P = m_theAssociatedCloud->getPoint(i);
+
+		if (m_userDefinedLimits)
+		{
+			//same filter as genericBuild: the points outside of the 'accepted points' box are not projected
+			if (	(P->x < m_pointsMin.x) || (P->x > m_pointsMax.x)
+				||	(P->y < m_pointsMin.y) || (P->y > m_pointsMax.y)
+				||	(P->z < m_pointsMin.z) || (P->z > m_pointsMax.z) )
+			{
+				continue;
+			}
+		}
+		else
+		{
+			//the octree can't grow
+			if (	(P->x < m_dimMin.x) || (P->x > m_dimMax.x)
+				||	(P->y < m_dimMin.y) || (P->y > m_dimMax.y)
+				||	(P->z < m_dimMin.z) || (P->z > m_dimMax.z) )
+			{
+				return false;
+			}
+		}
+
+		//compute the position of the cell that includes this point
+		Tuple3i cellPos;
+		getTheCellPosWhichIncludesThePoint(P, cellPos);
+
+		//clipping (same as in genericBuild)
+		for (int dim = 0; dim < 3; ++dim)
+		{
+			if (cellPos.u[dim] < 0)
+				cellPos.u[dim] = 0;
+			else if (cellPos.u[dim] >= MAX_OCTREE_LENGTH)
+				cellPos.u[dim] = MAX_OCTREE_LENGTH - 1;
+
+			fillIndexesAtMaxLevel[dim] = std::min(fillIndexesAtMaxLevel[dim], cellPos.u[dim]);
+			fillIndexesAtMaxLevel[dim + 3] = std::max(fillIndexesAtMaxLevel[dim + 3], cellPos.u[dim]);
+
+			//the user-defined points filter is kept as is
+			if (!m_userDefinedLimits)
+			{
+				pointsMin.u[dim] = std::min(pointsMin.u[dim], P->u[dim]);
+				pointsMax.u[dim] = std::max(pointsMax.u[dim], P->u[dim]);
+			}
+		}
+
+		newCodes.push_back(IndexAndCode(i, GenerateTruncatedCellCode(cellPos, MAX_OCTREE_LEVEL)));
+	}
+
+	if (newCodes.empty())
+	{
+		//all the new points have been filtered out
+		return true;
+	}
+
+	//the new points are inserted after the existing points of the same cell (as their index is higher)
+	std::stable_sort(newCodes.begin(), newCodes.end(), IndexAndCode::codeComp);
+
+	unsigned oldCount = m_numberOfProjectedPoints;
+	try
+	{
+		m_thePointsAndTheirCellCodes.resize(oldCount + newCodes.size());
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		m_thePointsAndTheirCellCodes.resize(oldCount);
+		return false;
+	}
+
+	//update the statistics (requires the current structure)
+	bool levelsToRecompute[MAX_OCTREE_LEVEL + 1];
+	updateCellsStatistics(newCodes, true, levelsToRecompute);
+
+	//backward merge of the new (sorted) codes into the existing ones
+	{
+		cellsContainer::iterator dest = m_thePointsAndTheirCellCodes.end();
+		cellsContainer::iterator oldIt = m_thePointsAndTheirCellCodes.begin() + oldCount;
+		cellsContainer::const_iterator newIt = newCodes.end();
+		while (newIt != newCodes.begin())
+		{
+			//on equal codes, the new elements come last
+			if (oldIt != m_thePointsAndTheirCellCodes.begin() && (oldIt - 1)->theCode > (newIt - 1)->theCode)
+			{
+				*(--dest) = *(--oldIt);
+			}
+			else
+			{
+				*(--dest) = *(--newIt);
+			}
+		}
+	}
+	m_numberOfProjectedPoints = static_cast<unsigned>(m_thePointsAndTheirCellCodes.size());
+
+	m_pointsMin = pointsMin;
+	m_pointsMax = pointsMax;
+
+	//we deduce the lower levels 'fill indexes' from the highest level
+	memcpy(m_fillIndexes + (MAX_OCTREE_LEVEL * 6), fillIndexesAtMaxLevel, sizeof(int) * 6);
+	for (int k = MAX_OCTREE_LEVEL - 1; k >= 0; k--)
+	{
+		int* fillIndexes = m_fillIndexes + (k * 6);
+		for (int dim = 0; dim < 6; ++dim)
+		{
+			fillIndexes[dim] = (fillIndexes[dim + 6] >> 1);
+		}
+	}
+
+	for (unsigned char level = 0; level <= MAX_OCTREE_LEVEL; ++level)
+	{
+		if (levelsToRecompute[level])
+		{
+			computeCellsStatistics(level);
+		}
+	}
+
+	return true;
+}
+
+bool DgmOctree::removePoints(const cellIndexesContainer& removedIndexes)
+{
+	if (removedIndexes.empty())
+	{
+		//nothing to do
+		return true;
+	}
+
+	//first pass: we look for the elements to remove (they come sorted by code)
+	cellsContainer removedCodes;
+	try
+	{
+		removedCodes.reserve(std::min<size_t>(removedIndexes.size(), m_thePointsAndTheirCellCodes.size()));
+		for (cellsContainer::const_iterator it = m_thePointsAndTheirCellCodes.begin(); it != m_thePointsAndTheirCellCodes.end(); ++it)
+		{
+			if (std::binary_search(removedIndexes.begin(), removedIndexes.end(), it->theIndex))
+			{
+				removedCodes.push_back(*it);
+			}
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	//update the statistics (requires the current structure)
+	bool levelsToRecompute[MAX_OCTREE_LEVEL + 1];
+	updateCellsStatistics(removedCodes, false, levelsToRecompute);
+
+	//second pass: we remove the elements and update the indexes of the others
+	cellsContainer::iterator dest = m_thePointsAndTheirCellCodes.begin();
+	for (cellsContainer::const_iterator it = m_thePointsAndTheirCellCodes.begin(); it != m_thePointsAndTheirCellCodes.end(); ++it)
+	{
+		cellIndexesContainer::const_iterator lb = std::lower_bound(removedIndexes.begin(), removedIndexes.end(), it->theIndex);
+		if (lb != removedIndexes.end() && *lb == it->theIndex)
+		{
+			//removed point
+			continue;
+		}
+
+		dest->theCode = it->theCode;
+		dest->theIndex = it->theIndex - static_cast<unsigned>(lb - removedIndexes.begin());
+		++dest;
+	}
+	m_thePointsAndTheirCellCodes.resize(dest - m_thePointsAndTheirCellCodes.begin()); //smaller --> should always be ok
+	m_numberOfProjectedPoints = static_cast<unsigned>(m_thePointsAndTheirCellCodes.size());
+
+	for (unsigned char level = 0; level <= MAX_OCTREE_LEVEL; ++level)
+	{
+		if (levelsToRecompute[level])
+		{
+			computeCellsStatistics(level);
+		}
+	}
+
+	return true;
+}
+
 void DgmOctree::updateMinAndMaxTables()
 {
 	if (!m_theAssociatedCloud)
@@ -439,82 +1194,53 @@ void DgmOctree::updateCellSizeTable()
 
 void DgmOctree::updateCellCountTable()
 {
-	//level 0 is just the octree bounding-box
-	for (unsigned char i=0; i<=MAX_OCTREE_LEVEL; ++i)
-	{
-		computeCellsStatistics(i);
-	}
-}
-
-void DgmOctree::computeCellsStatistics(unsigned char level)
-{
-	assert(level <= MAX_OCTREE_LEVEL);
-
-	//empty octree case?!
-	if (m_thePointsAndTheirCellCodes.empty())
-	{
-		//DGM: we make as if there were 1 point to avoid some degenerated cases!
-		m_cellCount[level] = 1;
-		m_maxCellPopulation[level] = 1;
-		m_averageCellPopulation[level] = 1.0;
-		m_stdDevCellPopulation[level] = 0.0;
-		return;
-	}
-
-	//level '0' specific case
-	if (level == 0)
-	{
-		m_cellCount[level] = 1;
-		m_maxCellPopulation[level] = static_cast<unsigned>(m_thePointsAndTheirCellCodes.size());
-		m_averageCellPopulation[level] = static_cast<double>(m_thePointsAndTheirCellCodes.size());
-		m_stdDevCellPopulation[level] = 0.0;
-		return;
-	}
-
-	//binary shift for cell code truncation
-	unsigned char bitDec = GET_BIT_SHIFT(level);
-
-	//iterator on octree elements
-	cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin();
-
-	//we init scan with first element
-	CellCode predCode = (p->theCode >> bitDec);
-	unsigned counter = 0;
-	unsigned cellCounter = 0;
-	unsigned maxCellPop = 0;
-	double sum = 0.0, sum2 = 0.0;
-
-	for (; p != m_thePointsAndTheirCellCodes.end(); ++p)
+#ifdef ENABLE_MT_OCTREE
+	//each level requires a complete scan of the octree: we process them in parallel
+	if (m_thePointsAndTheirCellCodes.size() >= MIN_POINT_COUNT_FOR_MT_BUILD && s_build_MT_mutex.tryLock())
 	{
-		CellCode currentCode = (p->theCode >> bitDec);
-		if (predCode != currentCode)
+		std::vector<CellsStatistics> levelStats(MAX_OCTREE_LEVEL + 1);
+		for (unsigned char i = 0; i <= MAX_OCTREE_LEVEL; ++i)
 		{
-			sum += static_cast<double>(cellCounter);
-			sum2 += static_cast<double>(cellCounter) * static_cast<double>(cellCounter);
+			levelStats[i].level = i;
+		}
 
-			if (maxCellPop<cellCounter)
-				maxCellPop = cellCounter;
+		s_statsPointsAndCodes_MT = &m_thePointsAndTheirCellCodes;
+		QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+		QtConcurrent::blockingMap(levelStats, ComputeCellsStatistics_MT);
+		s_statsPointsAndCodes_MT = 0;
 
-			//new cell
-			predCode = currentCode;
-			cellCounter = 0;
-			++counter;
+		s_build_MT_mutex.unlock();
+
+		for (unsigned char i = 0; i <= MAX_OCTREE_LEVEL; ++i)
+		{
+			m_cellCount[i] = levelStats[i].cellCount;
+			m_maxCellPopulation[i] = levelStats[i].maxCellPopulation;
+			m_averageCellPopulation[i] = levelStats[i].averageCellPopulation;
+			m_stdDevCellPopulation[i] = levelStats[i].stdDevCellPopulation;
 		}
-		++cellCounter;
+		return;
 	}
+#endif
 
-	//don't forget last cell!
-	sum += static_cast<double>(cellCounter);
-	sum2 += static_cast<double>(cellCounter) * static_cast<double>(cellCounter);
-	if (maxCellPop < cellCounter)
-		maxCellPop = cellCounter;
-	++counter;
+	//level 0 is just the octree bounding-box
+	for (unsigned char i=0; i<=MAX_OCTREE_LEVEL; ++i)
+	{
+		computeCellsStatistics(i);
+	}
+}
 
-	assert(counter > 0);
-	m_cellCount[level] = counter;
-	m_maxCellPopulation[level] = maxCellPop;
-	m_averageCellPopulation[level] = sum/static_cast<double>(counter);
-	m_stdDevCellPopulation[level] = sqrt(sum2/static_cast<double>(counter) - m_averageCellPopulation[level]*m_averageCellPopulation[level]);
+void DgmOctree::computeCellsStatistics(unsigned char level)
+{
+	assert(level <= MAX_OCTREE_LEVEL);
+
+	CellsStatistics stats;
+	stats.level = level;
+	ComputeCellsStatistics(m_thePointsAndTheirCellCodes, stats);
+
+	m_cellCount[level] = stats.cellCount;
+	m_maxCellPopulation[level] = stats.maxCellPopulation;
+	m_averageCellPopulation[level] = stats.averageCellPopulation;
+	m_stdDevCellPopulation[level] = stats.stdDevCellPopulation;
 }
 
 void DgmOctree::getBoundingBox(CCVector3& bbMin, CCVector3& bbMax) const
@@ -1374,6 +2100,7 @@ double DgmOctree::findTheNearestNeighborStartingFromCell(NearestNeighboursSearch
 			//fill indexes for current level
 			const int* _fillIndexes = m_fillIndexes + 6*nNSS.level;
 			int diagonalDistance = 0;
+			int emptyCellsSquareDistance = 0;
 			for (int dim=0; dim<3; ++dim)
 			{
 				//distance to min border of octree along each axis
@@ -1389,6 +2116,8 @@ double DgmOctree::findTheNearestNeighborStartingFromCell(NearestNeighboursSearch
 				{
 					visitedCellDistance = std::max(distToBorder,visitedCellDistance);
 					diagonalDistance += distToBorder*distToBorder;
+					//there are at least (distToBorder-1) empty cells between the query point and the filled cells along this axis
+					emptyCellsSquareDistance += (distToBorder-1)*(distToBorder-1);
 				}
 
 				//next dimension
@@ -1401,8 +2130,9 @@ double DgmOctree::findTheNearestNeighborStartingFromCell(NearestNeighboursSearch
 
 			if (nNSS.maxSearchSquareDistd > 0)
 			{
-				//Distance to the nearest point
-				double minDist = static_cast<double>(eligibleCellDistance-1) * cs;
+				//Distance to the nearest point (lower bound)
+				//DGM: (eligibleCellDistance-1) cells is not a lower bound in the diagonal directions
+				double minDist = sqrt(static_cast<double>(emptyCellsSquareDistance)) * cs;
 				//if we are already outside of the search limit, we can quit
 				if (minDist*minDist > nNSS.maxSearchSquareDistd)
 				{
@@ -1553,6 +2283,7 @@ unsigned DgmOctree::findNearestNeighborsStartingFromCell(	NearestNeighboursSearc
 			//fill indexes for current level
 			const int* _fillIndexes = m_fillIndexes + 6*nNSS.level;
 			int diagonalDistance = 0;
+			int emptyCellsSquareDistance = 0;
 			for (int dim=0; dim<3; ++dim)
 			{
 				//distance to min border of octree along each axis
@@ -1568,6 +2299,8 @@ unsigned DgmOctree::findNearestNeighborsStartingFromCell(	NearestNeighboursSearc
 				{
 					visitedCellDistance = std::max(distToBorder,visitedCellDistance);
 					diagonalDistance += distToBorder*distToBorder;
+					//there are at least (distToBorder-1) empty cells between the query point and the filled cells along this axis
+					emptyCellsSquareDistance += (distToBorder-1)*(distToBorder-1);
 				}
 
 				//next dimension
@@ -1580,8 +2313,9 @@ unsigned DgmOctree::findNearestNeighborsStartingFromCell(	NearestNeighboursSearc
 
 			if (nNSS.maxSearchSquareDistd > 0)
 			{
-				//Distance of the nearest point
-				double minDist = static_cast<double>(eligibleCellDistance-1) * cs;
+				//Distance of the nearest point (lower bound)
+				//DGM: (eligibleCellDistance-1) cells is not a lower bound in the diagonal directions
+				double minDist = sqrt(static_cast<double>(emptyCellsSquareDistance)) * cs;
 				//if we are already outside of the search limit, we can quit
 				if (minDist*minDist > nNSS.maxSearchSquareDistd)
 				{
@@ -2281,113 +3015,457 @@ int DgmOctree::findNeighborsInASphereStartingFromCell(NearestNeighboursSpherical
 	//we deduce the minimum cell neighbourhood size (integer) that includes the search sphere
 	int minNeighbourhoodSize = 1+(radius>minDistToBorder ? static_cast<int>(ceil((radius-minDistToBorder)/cs)) : 0);
 
-	//if we don't have visited such a neighbourhood...
-	if (nNSS.alreadyVisitedNeighbourhoodSize<minNeighbourhoodSize)
+	//if we don't have visited such a neighbourhood...
+	if (nNSS.alreadyVisitedNeighbourhoodSize<minNeighbourhoodSize)
+	{
+		//... let's look for the corresponding points
+		for (int i=nNSS.alreadyVisitedNeighbourhoodSize; i<minNeighbourhoodSize; ++i)
+			getPointsInNeighbourCellsAround(nNSS,i);
+
+		//don't forget to update the visited neighbourhood size!
+		nNSS.alreadyVisitedNeighbourhoodSize = minNeighbourhoodSize;
+	}
+#endif
+
+	//squared distances comparison is faster!
+	double squareRadius = radius * radius;
+	unsigned numberOfEligiblePoints = 0;
+
+#ifdef TEST_CELLS_FOR_SPHERICAL_NN
+	//cell limit relatively to sphere tight bounding box
+	//const PointCoordinateType& half_cs=getCellSize(nNSS.level+1); //half cell size at current level
+	//CCVector3 limitMin = nNSS.queryPoint-CCVector3(radius,radius,radius)-CCVector3(half_cs,half_cs,half_cs);
+	//CCVector3 limitMax = nNSS.queryPoint+CCVector3(radius,radius,radius)+CCVector3(half_cs,half_cs,half_cs);
+
+	//cell by cell scan
+	for (NeighbourCellsSet::iterator c = nNSS.cellsInNeighbourhood.begin(); c!=nNSS.cellsInNeighbourhood.end(); ++c)
+	{
+		//we check the cell bounding box
+		/*if (limitMax.x < c->center.x || limitMin.x >  c->center.x
+		|| limitMax.y < c->center.y || limitMin.y >  c->center.y
+		|| limitMax.z < c->center.z || limitMin.z >  c->center.z)
+		continue; //sphere totally outside the cell
+		//*/
+
+		//distance between the new cell center and the sphere center
+		PointCoordinateType d2 = (c->center - nNSS.queryPoint).norm2();
+
+		//is this cell totally out of the sphere?
+		if (d2 <= nNSS.minOutD2)
+		{
+			NeighboursSet::iterator p = nNSS.pointsInSphericalNeighbourhood.begin()+c->index;
+			unsigned count = ((c+1) != nNSS.cellsInNeighbourhood.end() ? (c+1)->index : nNSS.pointsInSphericalNeighbourhood.size()) - c->index;
+			if (!sortValues && d2 <= nNSS.maxInD2) //totally inside? (+ we can skip distances computation)
+			{
+				//... we had them to the 'eligible points' part of the container
+				std::copy(p,p+count,nNSS.pointsInNeighbourhood.begin()+numberOfEligiblePoints);
+				numberOfEligiblePoints += count;
+#ifdef COMPUTE_NN_SEARCH_STATISTICS
+				s_skippedPoints += static_cast<double>(count);
+#endif
+			}
+			else
+			{
+				for (unsigned j=0; j<count; ++j,++p)
+				{
+					p->squareDist = (*p->point - nNSS.queryPoint).norm2();
+#ifdef COMPUTE_NN_SEARCH_STATISTICS
+					s_testedPoints += 1.0;
+#endif
+					//if the distance is inferior to the sphere radius...
+					if (p->squareDistd <= squareRadius)
+					{
+						//... we had it to the 'eligible points' part of the container
+						nNSS.pointsInNeighbourhood[numberOfEligiblePoints++] = *p;
+					}
+				}
+			}
+		}
+		//else cell is totally outside
+		{
+#ifdef COMPUTE_NN_SEARCH_STATISTICS
+			unsigned count = ((c+1) != nNSS.cellsInNeighbourhood.end() ? (c+1)->index : nNSS.pointsInSphericalNeighbourhood.size()) - c->index;
+			s_skippedPoints += static_cast<double>(count);
+#endif
+		}
+	}
+
+#else //TEST_CELLS_FOR_SPHERICAL_NN
+
+	//point by point scan
+	NeighboursSet::iterator p = nNSS.pointsInNeighbourhood.begin();
+	size_t k = nNSS.pointsInNeighbourhood.size();
+	for (size_t i=0; i<k; ++i,++p)
+	{
+		p->squareDistd = (*p->point - nNSS.queryPoint).norm2d();
+		//if the distance is inferior to the sphere radius...
+		if (p->squareDistd <= squareRadius)
+		{
+			//... we had it to the 'eligible points' part of the container
+			if (i > numberOfEligiblePoints)
+				std::swap(nNSS.pointsInNeighbourhood[i],nNSS.pointsInNeighbourhood[numberOfEligiblePoints]);
+
+			++numberOfEligiblePoints;
+#ifdef COMPUTE_NN_SEARCH_STATISTICS
+			s_testedPoints += 1.0;
+#endif
+		}
+	}
+
+#endif //!TEST_CELLS_FOR_SPHERICAL_NN
+
+	//eventually (if requested) we sort the eligible points
+	if (sortValues && numberOfEligiblePoints > 0)
+	{
+		std::sort(nNSS.pointsInNeighbourhood.begin(), nNSS.pointsInNeighbourhood.begin() + numberOfEligiblePoints, PointDescriptor::distComp);
+	}
+
+	//return the number of eligible points
+	return numberOfEligiblePoints;
+}
+
+void DgmOctree::getUsefulNeighbourhoodLengths(const Tuple3i& cellPos, unsigned char level, int& minLength, int& maxLength) const
+{
+	//fill indexes for current level
+	const int* _fillIndexes = m_fillIndexes + 6 * level;
+
+	minLength = 0;
+	maxLength = 0;
+	for (int dim = 0; dim < 3; ++dim)
+	{
+		int distToMin = cellPos.u[dim] - _fillIndexes[dim];
+		int distToMax = _fillIndexes[3 + dim] - cellPos.u[dim];
+
+		//a neighbourhood of size 'n' includes the cells at a distance < n
+		minLength = std::max(minLength, std::max(-distToMin, -distToMax));
+		maxLength = std::max(maxLength, std::max(distToMin, distToMax) + 1);
+	}
+}
+
+bool DgmOctree::getBatchCandidatesAround(	NearestNeighboursBatchSearchStruct &nNSS,
+											int neighbourhoodLength,
+											bool getOnlyPointsWithValidScalar/*=false*/) const
+{
+	//new cell?
+	if (nNSS.alreadyVisitedNeighbourhoodSize == 0)
+	{
+		nNSS.pointsInNeighbourhood.resize(0);
+		nNSS.candidatesX.resize(0);
+		nNSS.candidatesY.resize(0);
+		nNSS.candidatesZ.resize(0);
+
+		//no need to look at the (empty) cells outside of the octree
+		int minLength = 0;
+		int maxLength = 0;
+		getUsefulNeighbourhoodLengths(nNSS.cellPos, nNSS.level, minLength, maxLength);
+		nNSS.alreadyVisitedNeighbourhoodSize = std::min(minLength, neighbourhoodLength);
+	}
+
+	size_t previousCount = nNSS.pointsInNeighbourhood.size();
+	try
+	{
+		while (nNSS.alreadyVisitedNeighbourhoodSize < neighbourhoodLength)
+		{
+			getPointsInNeighbourCellsAround(nNSS, nNSS.alreadyVisitedNeighbourhoodSize, getOnlyPointsWithValidScalar);
+			++nNSS.alreadyVisitedNeighbourhoodSize;
+		}
+
+		size_t count = nNSS.pointsInNeighbourhood.size();
+		nNSS.candidatesX.resize(count);
+		nNSS.candidatesY.resize(count);
+		nNSS.candidatesZ.resize(count);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	//duplicate the new candidates coordinates (SoA)
+	for (size_t i = previousCount; i < nNSS.pointsInNeighbourhood.size(); ++i)
+	{
+		const CCVector3* P = nNSS.pointsInNeighbourhood[i].point;
+		nNSS.candidatesX[i] = P->x;
+		nNSS.candidatesY[i] = P->y;
+		nNSS.candidatesZ[i] = P->z;
+	}
+
+	return true;
+}
+
+//! Computes the square distances between a query point and a set of candidates (SoA)
+/** Straightforward loop on contiguous arrays (auto-vectorized by the compiler).
+**/
+static void ComputeSquareDistances(	const CCVector3& Q,
+									const PointCoordinateType* X,
+									const PointCoordinateType* Y,
+									const PointCoordinateType* Z,
+									double* squareDistances,
+									size_t count)
+{
+	const PointCoordinateType qx = Q.x;
+	const PointCoordinateType qy = Q.y;
+	const PointCoordinateType qz = Q.z;
+
+	//same precision as CCVector3::norm2d (so as to get the same results as the standard search algorithms)
+	for (size_t i = 0; i < count; ++i)
+	{
+		double dx = static_cast<double>(X[i] - qx);
+		double dy = static_cast<double>(Y[i] - qy);
+		double dz = static_cast<double>(Z[i] - qz);
+		squareDistances[i] = dx*dx + dy*dy + dz*dz;
+	}
+}
+
+//! Square distance comparison (for the batched NN search algorithms)
+struct CandidateDistComp
+{
+	explicit CandidateDistComp(const std::vector<double>& squareDistances) : m_squareDistances(squareDistances) {}
+
+	inline bool operator()(unsigned a, unsigned b) const { return m_squareDistances[a] < m_squareDistances[b]; }
+
+	const std::vector<double>& m_squareDistances;
+};
+
+bool DgmOctree::findNearestNeighborsInBatch(NearestNeighboursBatchSearchStruct &nNSS,
+											GenericIndexedCloud* queryPoints,
+											bool getOnlyPointsWithValidScalar/*=false*/) const
+{
+	assert(queryPoints);
+	const unsigned queryCount = queryPoints->size();
+	const unsigned k = nNSS.minNumberOfNeighbors;
+
+	nNSS.neighbours.resize(0);
+	try
+	{
+		nNSS.neighboursOffsets.resize(queryCount + 1);
+		nNSS.neighbours.reserve(static_cast<size_t>(queryCount) * k);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+	nNSS.neighboursOffsets[0] = 0;
+
+	//cell size at the current level of subdivision
+	const PointCoordinateType& cs = getCellSize(nNSS.level);
+
+	//neighbourhood size above which all the octree points are candidates
+	int minLength = 0;
+	int maxLength = 0;
+	getUsefulNeighbourhoodLengths(nNSS.cellPos, nNSS.level, minLength, maxLength);
+
+	//the first cell (including the query points) should always be visited
+	if (!getBatchCandidatesAround(nNSS, std::max(nNSS.alreadyVisitedNeighbourhoodSize, 1), getOnlyPointsWithValidScalar))
+		return false;
+
+	for (unsigned q = 0; q < queryCount; ++q)
+	{
+		const CCVector3* Q = queryPoints->getPoint(q);
+
+		//this distance corresponds to the maximal radius of a sphere centered on
+		//the query point and totally included inside the query point cell
+		PointCoordinateType minDistToBorder = ComputeMinDistanceToCellBorder(*Q, cs, nNSS.cellCenter);
+
+		//points for which we have already computed the distance to the query point
+		size_t processedCount = 0;
+
+		double squareEligibleDist = 0;
+		while (true)
+		{
+			//we compute distances for the new points
+			size_t candidateCount = nNSS.pointsInNeighbourhood.size();
+			try
+			{
+				nNSS.squareDistances.resize(candidateCount);
+			}
+			catch (const std::bad_alloc&)
+			{
+				//not enough memory
+				return false;
+			}
+			if (candidateCount > processedCount)
+			{
+				ComputeSquareDistances(	*Q,
+										nNSS.candidatesX.data() + processedCount,
+										nNSS.candidatesY.data() + processedCount,
+										nNSS.candidatesZ.data() + processedCount,
+										nNSS.squareDistances.data() + processedCount,
+										candidateCount - processedCount);
+				processedCount = candidateCount;
+			}
+
+			//equivalent spherical neighbourhood radius (see findNearestNeighborsStartingFromCell)
+			bool allCandidates = (nNSS.alreadyVisitedNeighbourhoodSize >= maxLength);
+			double eligibleDist = static_cast<double>(nNSS.alreadyVisitedNeighbourhoodSize - 1) * cs + minDistToBorder;
+			squareEligibleDist = (allCandidates ? -1.0 : eligibleDist * eligibleDist);
+			bool limitReached = (nNSS.maxSearchSquareDistd > 0 && (allCandidates || squareEligibleDist >= nNSS.maxSearchSquareDistd));
+			if (limitReached)
+			{
+				squareEligibleDist = nNSS.maxSearchSquareDistd;
+			}
+
+			//count the eligible points (and track the nearest non eligible one)
+			unsigned eligibleCount = 0;
+			double minSquareDist = -1.0;
+			for (size_t i = 0; i < candidateCount; ++i)
+			{
+				double d2 = nNSS.squareDistances[i];
+				if (squareEligibleDist < 0 || d2 <= squareEligibleDist)
+				{
+					++eligibleCount;
+				}
+				else if (minSquareDist < 0 || d2 < minSquareDist)
+				{
+					minSquareDist = d2;
+				}
+			}
+
+			if (eligibleCount >= k || allCandidates || limitReached)
+				break;
+
+			//we need a bigger neighbourhood
+			int newLength = nNSS.alreadyVisitedNeighbourhoodSize + 1;
+			if (minSquareDist > 0)
+			{
+				//what would be the correct neighbourhood size to be sure of it?
+				int eligibleLength = 1 + static_cast<int>(ceil((sqrt(minSquareDist) - minDistToBorder) / cs));
+				newLength = std::max(newLength, eligibleLength);
+			}
+			if (!getBatchCandidatesAround(nNSS, std::min(newLength, maxLength), getOnlyPointsWithValidScalar))
+				return false;
+		}
+
+		//partial selection of the k nearest eligible points
+		try
+		{
+			nNSS.selection.resize(0);
+			for (unsigned i = 0; i < static_cast<unsigned>(processedCount); ++i)
+			{
+				if (squareEligibleDist < 0 || nNSS.squareDistances[i] <= squareEligibleDist)
+					nNSS.selection.push_back(i);
+			}
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			return false;
+		}
+
+		CandidateDistComp comp(nNSS.squareDistances);
+		size_t neighbourCount = std::min<size_t>(k, nNSS.selection.size());
+		if (neighbourCount < nNSS.selection.size())
+		{
+			std::nth_element(nNSS.selection.begin(), nNSS.selection.begin() + neighbourCount, nNSS.selection.end(), comp);
+		}
+		std::sort(nNSS.selection.begin(), nNSS.selection.begin() + neighbourCount, comp);
+
+		for (size_t j = 0; j < neighbourCount; ++j)
+		{
+			unsigned i = nNSS.selection[j];
+			const PointDescriptor& P = nNSS.pointsInNeighbourhood[i];
+			nNSS.neighbours.push_back(PointDescriptor(P.point, P.pointIndex, nNSS.squareDistances[i])); //can't fail (see above)
+		}
+		nNSS.neighboursOffsets[q + 1] = static_cast<unsigned>(nNSS.neighbours.size());
+	}
+
+	return true;
+}
+
+bool DgmOctree::findNeighborsInASphereInBatch(	NearestNeighboursBatchSearchStruct &nNSS,
+												GenericIndexedCloud* queryPoints,
+												double radius,
+												bool sortValues/*=true*/) const
+{
+	assert(queryPoints);
+	const unsigned queryCount = queryPoints->size();
+
+	nNSS.neighbours.resize(0);
+	try
+	{
+		nNSS.neighboursOffsets.resize(queryCount + 1);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+	nNSS.neighboursOffsets[0] = 0;
+
+	//current level cell size
+	const PointCoordinateType& cs = getCellSize(nNSS.level);
+
+	//we deduce the minimum cell neighbourhood size (integer) that includes the search sphere for ALL the query points
+	int neighbourhoodLength = 1;
+	for (unsigned q = 0; q < queryCount; ++q)
 	{
-		//... let's look for the corresponding points
-		for (int i=nNSS.alreadyVisitedNeighbourhoodSize; i<minNeighbourhoodSize; ++i)
-			getPointsInNeighbourCellsAround(nNSS,i);
+		PointCoordinateType minDistToBorder = ComputeMinDistanceToCellBorder(*queryPoints->getPoint(q), cs, nNSS.cellCenter);
+		if (radius > minDistToBorder)
+		{
+			neighbourhoodLength = std::max(neighbourhoodLength, 1 + static_cast<int>(ceil((radius - minDistToBorder) / cs)));
+		}
+	}
+	int minLength = 0;
+	int maxLength = 0;
+	getUsefulNeighbourhoodLengths(nNSS.cellPos, nNSS.level, minLength, maxLength);
+	neighbourhoodLength = std::min(neighbourhoodLength, std::max(maxLength, 1));
 
-		//don't forget to update the visited neighbourhood size!
-		nNSS.alreadyVisitedNeighbourhoodSize = minNeighbourhoodSize;
+	if (!getBatchCandidatesAround(nNSS, std::max(nNSS.alreadyVisitedNeighbourhoodSize, neighbourhoodLength)))
+		return false;
+
+	size_t candidateCount = nNSS.pointsInNeighbourhood.size();
+	try
+	{
+		nNSS.squareDistances.resize(candidateCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
 	}
-#endif
 
 	//squared distances comparison is faster!
 	double squareRadius = radius * radius;
-	unsigned numberOfEligiblePoints = 0;
-
-#ifdef TEST_CELLS_FOR_SPHERICAL_NN
-	//cell limit relatively to sphere tight bounding box
-	//const PointCoordinateType& half_cs=getCellSize(nNSS.level+1); //half cell size at current level
-	//CCVector3 limitMin = nNSS.queryPoint-CCVector3(radius,radius,radius)-CCVector3(half_cs,half_cs,half_cs);
-	//CCVector3 limitMax = nNSS.queryPoint+CCVector3(radius,radius,radius)+CCVector3(half_cs,half_cs,half_cs);
 
-	//cell by cell scan
-	for (NeighbourCellsSet::iterator c = nNSS.cellsInNeighbourhood.begin(); c!=nNSS.cellsInNeighbourhood.end(); ++c)
+	for (unsigned q = 0; q < queryCount; ++q)
 	{
-		//we check the cell bounding box
-		/*if (limitMax.x < c->center.x || limitMin.x >  c->center.x
-		|| limitMax.y < c->center.y || limitMin.y >  c->center.y
-		|| limitMax.z < c->center.z || limitMin.z >  c->center.z)
-		continue; //sphere totally outside the cell
-		//*/
+		const CCVector3* Q = queryPoints->getPoint(q);
 
-		//distance between the new cell center and the sphere center
-		PointCoordinateType d2 = (c->center - nNSS.queryPoint).norm2();
+		ComputeSquareDistances(	*Q,
+								nNSS.candidatesX.data(),
+								nNSS.candidatesY.data(),
+								nNSS.candidatesZ.data(),
+								nNSS.squareDistances.data(),
+								candidateCount);
 
-		//is this cell totally out of the sphere?
-		if (d2 <= nNSS.minOutD2)
+		size_t firstNeighbour = nNSS.neighbours.size();
+		try
 		{
-			NeighboursSet::iterator p = nNSS.pointsInSphericalNeighbourhood.begin()+c->index;
-			unsigned count = ((c+1) != nNSS.cellsInNeighbourhood.end() ? (c+1)->index : nNSS.pointsInSphericalNeighbourhood.size()) - c->index;
-			if (!sortValues && d2 <= nNSS.maxInD2) //totally inside? (+ we can skip distances computation)
-			{
-				//... we had them to the 'eligible points' part of the container
-				std::copy(p,p+count,nNSS.pointsInNeighbourhood.begin()+numberOfEligiblePoints);
-				numberOfEligiblePoints += count;
-#ifdef COMPUTE_NN_SEARCH_STATISTICS
-				s_skippedPoints += static_cast<double>(count);
-#endif
-			}
-			else
+			for (size_t i = 0; i < candidateCount; ++i)
 			{
-				for (unsigned j=0; j<count; ++j,++p)
+				double d2 = nNSS.squareDistances[i];
+				if (d2 <= squareRadius)
 				{
-					p->squareDist = (*p->point - nNSS.queryPoint).norm2();
-#ifdef COMPUTE_NN_SEARCH_STATISTICS
-					s_testedPoints += 1.0;
-#endif
-					//if the distance is inferior to the sphere radius...
-					if (p->squareDistd <= squareRadius)
-					{
-						//... we had it to the 'eligible points' part of the container
-						nNSS.pointsInNeighbourhood[numberOfEligiblePoints++] = *p;
-					}
+					const PointDescriptor& P = nNSS.pointsInNeighbourhood[i];
+					nNSS.neighbours.push_back(PointDescriptor(P.point, P.pointIndex, d2));
 				}
 			}
 		}
-		//else cell is totally outside
+		catch (const std::bad_alloc&)
 		{
-#ifdef COMPUTE_NN_SEARCH_STATISTICS
-			unsigned count = ((c+1) != nNSS.cellsInNeighbourhood.end() ? (c+1)->index : nNSS.pointsInSphericalNeighbourhood.size()) - c->index;
-			s_skippedPoints += static_cast<double>(count);
-#endif
+			//not enough memory
+			return false;
 		}
-	}
-
-#else //TEST_CELLS_FOR_SPHERICAL_NN
 
-	//point by point scan
-	NeighboursSet::iterator p = nNSS.pointsInNeighbourhood.begin();
-	size_t k = nNSS.pointsInNeighbourhood.size();
-	for (size_t i=0; i<k; ++i,++p)
-	{
-		p->squareDistd = (*p->point - nNSS.queryPoint).norm2d();
-		//if the distance is inferior to the sphere radius...
-		if (p->squareDistd <= squareRadius)
+		if (sortValues)
 		{
-			//... we had it to the 'eligible points' part of the container
-			if (i > numberOfEligiblePoints)
-				std::swap(nNSS.pointsInNeighbourhood[i],nNSS.pointsInNeighbourhood[numberOfEligiblePoints]);
-
-			++numberOfEligiblePoints;
-#ifdef COMPUTE_NN_SEARCH_STATISTICS
-			s_testedPoints += 1.0;
-#endif
+			std::sort(nNSS.neighbours.begin() + firstNeighbour, nNSS.neighbours.end(), PointDescriptor::distComp);
 		}
+		nNSS.neighboursOffsets[q + 1] = static_cast<unsigned>(nNSS.neighbours.size());
 	}
 
-#endif //!TEST_CELLS_FOR_SPHERICAL_NN
-
-	//eventually (if requested) we sort the eligible points
-	if (sortValues && numberOfEligiblePoints > 0)
-	{
-		std::sort(nNSS.pointsInNeighbourhood.begin(), nNSS.pointsInNeighbourhood.begin() + numberOfEligiblePoints, PointDescriptor::distComp);
-	}
-
-	//return the number of eligible points
-	return numberOfEligiblePoints;
+	return true;
 }
 
 unsigned char DgmOctree::findBestLevelForAGivenNeighbourhoodSizeExtraction(PointCoordinateType radius) const
@@ -2767,165 +3845,486 @@ int DgmOctree::extractCCs(unsigned char level, bool sixConnexity, GenericProgres
 	return extractCCs(cellCodes, level, sixConnexity, progressCb);
 }
 
-struct IndexAndCodeExt
+/*** CONNECTED COMPONENTS EXTRACTION ***/
+
+//! Size (in bits, i.e. log2 of the number of cells along each dimension) of the connected components labeling blocks
+/** The blocks are the octree cells at level 'level - CC_BLOCK_BITS': as the cell codes
+	are sorted, the cells of each block are contiguous.
+**/
+static const unsigned char CC_BLOCK_BITS = 4;
+//! Number of points processed by each (parallel) points labeling job
+static const unsigned CC_LABELING_CHUNK_SIZE = 65536;
+
+//! Range of (sorted) elements processed by a connected components extraction job
+struct ccLabelingRange
 {
-#ifdef OCTREE_CODES_64_BITS
-	typedef unsigned long long IndexType;
-#else
-	typedef unsigned IndexType;
-#endif
-	
-	//! index
-	IndexType theIndex;
+	//! First element index (included)
+	unsigned i1;
+	//! Last element index (excluded)
+	unsigned i2;
+};
+
+//! Connected components labeling of a sparse set of octree cells
+/** The cells are sorted by code (there's no dense grid). Each block of cells (see CC_BLOCK_BITS)
+	is first labeled independently, then the components crossing the blocks boundaries are merged.
+	Both steps rely on a lock-free union-find structure and can be performed in parallel. As a
+	component root is always its cell with the smallest index, the result doesn't depend on the
+	order in which the blocks are processed.
+**/
+class OctreeCellsLabeling
+{
+public:
 
-	//! cell code
-	DgmOctree::CellCode theCode;
+	//! Invalid index
+	static const unsigned NO_CELL = static_cast<unsigned>(-1);
 
 	//! Default constructor
-	IndexAndCodeExt()
-		: theIndex(0)
-		, theCode(0)
-	{}
-
-	//! Compares two IndexAndCodeExt instances based on their index
-	/** \param a first IndexAndCode structure
-		\param b second IndexAndCode structure
-		\return whether the index of 'a' is smaller than the index of 'b'
+	OctreeCellsLabeling(const DgmOctree* octree, unsigned char level, bool sixConnexity)
+		: m_octree(octree)
+		, m_level(level)
+		, m_blockBits(std::min(level, CC_BLOCK_BITS))
+		, m_gridSize(1 << level)
+		, m_neighbourCount(0)
+		, m_parents(0)
+	{
+		//half of the neighbours (the other half will be processed by the neighbours themselves)
+		if (sixConnexity)
+		{
+			addNeighbourShift(-1, 0, 0);
+			addNeighbourShift(0, -1, 0);
+			addNeighbourShift(0, 0, -1);
+		}
+		else
+		{
+			for (int k = -1; k <= 1; ++k)
+				for (int j = -1; j <= 1; ++j)
+					for (int i = -1; i <= 1; ++i)
+						if (k < 0 || (k == 0 && (j < 0 || (j == 0 && i < 0))))
+							addNeighbourShift(i, j, k);
+		}
+		assert(m_neighbourCount <= 13);
+	}
+
+	//! Destructor
+	~OctreeCellsLabeling()
+	{
+		delete[] m_parents;
+	}
+
+	//! Initializes the structure
+	/** \param cellCodes the (non truncated) cell codes
+		\return false if not enough memory
 	**/
-	static bool indexComp(const IndexAndCodeExt& a, const IndexAndCodeExt& b) throw()
+	bool init(const DgmOctree::cellCodesContainer& cellCodes)
 	{
-		return a.theIndex < b.theIndex;
+		unsigned char bitDec = DgmOctree::GET_BIT_SHIFT(m_level);
+		try
+		{
+			m_codes.resize(cellCodes.size());
+			for (size_t i = 0; i < cellCodes.size(); ++i)
+			{
+				m_codes[i] = (cellCodes[i] >> bitDec);
+			}
+			//the input codes may not be sorted (and unique) if they are not the whole set of octree cells
+			SortAlgo(m_codes.begin(), m_codes.end());
+			m_codes.erase(std::unique(m_codes.begin(), m_codes.end()), m_codes.end());
+
+			m_positions.resize(m_codes.size());
+
+			//blocks
+			unsigned char blockShift = 3 * m_blockBits;
+			unsigned cellCount = cellsCount();
+			ccLabelingRange block;
+			block.i1 = 0;
+			for (unsigned i = 1; i <= cellCount; ++i)
+			{
+				if (i == cellCount || (m_codes[i] >> blockShift) != (m_codes[block.i1] >> blockShift))
+				{
+					block.i2 = i;
+					m_blocks.push_back(block);
+					m_blockCodes.push_back(m_codes[block.i1] >> blockShift);
+					block.i1 = i;
+				}
+			}
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			return false;
+		}
+
+		m_parents = new (std::nothrow) std::atomic<unsigned>[m_codes.size()];
+		if (!m_parents)
+		{
+			//not enough memory
+			return false;
+		}
+		for (unsigned i = 0; i < cellsCount(); ++i)
+		{
+			m_parents[i].store(i, std::memory_order_relaxed);
+		}
+
+		return true;
 	}
 
-};
+	//! Returns the number of (distinct) cells
+	inline unsigned cellsCount() const { return static_cast<unsigned>(m_codes.size()); }
 
-int DgmOctree::extractCCs(const cellCodesContainer& cellCodes, unsigned char level, bool sixConnexity, GenericProgressCallback* progressCb) const
-{
-	size_t numberOfCells = cellCodes.size();
-	if (numberOfCells == 0) //no cells!
-		return -1;
+	//! Returns the labeling blocks
+	inline std::vector<ccLabelingRange>& blocks() { return m_blocks; }
 
-	//filled octree cells
-	std::vector<IndexAndCodeExt> ccCells;
-	try
+	//! First step: labels the cells of a block (considering the neighbours inside the block only)
+	void labelBlock(const ccLabelingRange& block)
 	{
-		ccCells.resize(numberOfCells);
+		//we compute the cells positions
+		//and we project them in a (small) dense grid for fast neighbours look-up
+		unsigned localGrid[1 << (3 * CC_BLOCK_BITS)];
+		memset(localGrid, 0xFF, sizeof(unsigned) * (static_cast<size_t>(1) << (3 * m_blockBits))); //NO_CELL everywhere
+		unsigned char blockShift = 3 * m_blockBits;
+		Tuple3i blockPos;
+		m_octree->getCellPos(m_codes[block.i1] >> blockShift, m_level - m_blockBits, blockPos, true);
+		blockPos *= (1 << m_blockBits);
+		for (unsigned i = block.i1; i < block.i2; ++i)
+		{
+			//position inside the block
+			DgmOctree::CellCode code = m_codes[i];
+			Tuple3i& cellPos = m_positions[i];
+			cellPos.x = blockPos.x;
+			cellPos.y = blockPos.y;
+			cellPos.z = blockPos.z;
+			for (unsigned char k = 0; k < m_blockBits; ++k, code >>= 3)
+			{
+				cellPos.x |= static_cast<int>(code & 1) << k;
+				cellPos.y |= static_cast<int>((code >> 1) & 1) << k;
+				cellPos.z |= static_cast<int>((code >> 2) & 1) << k;
+			}
+			localGrid[localIndex(cellPos)] = i;
+		}
+
+		//no other thread can access the cells of this block during the 1st step (no need for atomic merges)
+		for (unsigned i = block.i1; i < block.i2; ++i)
+		{
+			const Tuple3i& cellPos = m_positions[i];
+			unsigned root = findRoot(i);
+			for (unsigned char n = 0; n < m_neighbourCount; ++n)
+			{
+				Tuple3i neighbourPos = cellPos + m_neighbourShifts[n];
+				if (isInGrid(neighbourPos) && inSameBlock(cellPos, neighbourPos))
+				{
+					unsigned j = localGrid[localIndex(neighbourPos)];
+					if (j != NO_CELL)
+					{
+						unsigned neighbourRoot = findRoot(j);
+						if (neighbourRoot < root)
+						{
+							m_parents[root].store(neighbourRoot, std::memory_order_relaxed);
+							root = neighbourRoot;
+						}
+						else if (neighbourRoot > root)
+						{
+							m_parents[neighbourRoot].store(root, std::memory_order_relaxed);
+						}
+					}
+				}
+			}
+		}
 	}
-	catch (const std::bad_alloc&)
+
+	//! Second step: merges the components of a block with the ones of the neighbouring blocks
+	void mergeBlock(const ccLabelingRange& block)
 	{
-		//not enough memory
-		return -2;
+		unsigned char blockShift = 3 * m_blockBits;
+		for (unsigned i = block.i1; i < block.i2; ++i)
+		{
+			const Tuple3i& cellPos = m_positions[i];
+			for (unsigned char n = 0; n < m_neighbourCount; ++n)
+			{
+				Tuple3i neighbourPos = cellPos + m_neighbourShifts[n];
+				if (isInGrid(neighbourPos) && !inSameBlock(cellPos, neighbourPos))
+				{
+					//we look for the neighbour block first (the blocks codes table is much smaller than the cells one)
+					DgmOctree::CellCode neighbourCode = DgmOctree::GenerateTruncatedCellCode(neighbourPos, m_level);
+					std::vector<DgmOctree::CellCode>::const_iterator it = std::lower_bound(m_blockCodes.begin(), m_blockCodes.end(), neighbourCode >> blockShift);
+					if (it == m_blockCodes.end() || *it != (neighbourCode >> blockShift))
+						continue;
+					const ccLabelingRange& neighbourBlock = m_blocks[it - m_blockCodes.begin()];
+					unsigned j = findCell(neighbourCode, neighbourBlock.i1, neighbourBlock.i2);
+					if (j != NO_CELL)
+					{
+						merge(i, j);
+					}
+				}
+			}
+		}
 	}
 
-	//we compute the position of each cell (grid coordinates)
-	Tuple3i indexMin, indexMax;
+	//! Last step: numbers the components
+	/** The components are numbered (from 1) in the order of their first cell
+		along Z, then Y, then X (so that the labels don't depend on the octree
+		cells ordering).
+		\return the number of components (or -2 if not enough memory)
+	**/
+	int numberComponents()
 	{
-		//binary shift for cell code truncation
-		unsigned char bitDec = GET_BIT_SHIFT(level);
+		unsigned cellCount = cellsCount();
 
-		for (size_t i = 0; i < numberOfCells; i++)
+		std::vector<unsigned long long> firstCells;
+		try
 		{
-			ccCells[i].theCode = (cellCodes[i] >> bitDec);
+			m_labels.resize(cellCount);
+			firstCells.resize(cellCount, static_cast<unsigned long long>(-1));
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			return -2;
+		}
 
-			Tuple3i cellPos;
-			getCellPos(ccCells[i].theCode, level, cellPos, true);
+		//roots (a cell parent always has a smaller index)
+		for (unsigned i = 0; i < cellCount; ++i)
+		{
+			unsigned parent = m_parents[i];
+			m_labels[i] = (parent == i ? i : m_labels[parent]);
+		}
 
-			//we look for the actual min and max dimensions of the input cells set
-			//(which may not be the whole set of octree cells!)
-			if (i != 0)
+		//first cell of each component
+		for (unsigned i = 0; i < cellCount; ++i)
+		{
+			const Tuple3i& cellPos = m_positions[i];
+			unsigned long long index =		static_cast<unsigned long long>(cellPos.x)
+										+	(static_cast<unsigned long long>(cellPos.y) << m_level)
+										+	(static_cast<unsigned long long>(cellPos.z) << (2 * m_level));
+			unsigned long long& firstCell = firstCells[m_labels[i]];
+			if (index < firstCell)
+				firstCell = index;
+		}
+
+		std::vector< std::pair<unsigned long long, unsigned> > components;
+		try
+		{
+			for (unsigned i = 0; i < cellCount; ++i)
 			{
-				for (unsigned char k = 0; k < 3; k++)
-				{
-					if (cellPos.u[k] < indexMin.u[k])
-						indexMin.u[k] = cellPos.u[k];
-					else if (cellPos.u[k] > indexMax.u[k])
-						indexMax.u[k] = cellPos.u[k];
-				}
+				if (m_labels[i] == i)
+					components.push_back(std::pair<unsigned long long, unsigned>(firstCells[i], i));
 			}
-			else
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			return -2;
+		}
+		SortAlgo(components.begin(), components.end());
+
+		//we reuse 'firstCells' to store each root label
+		for (size_t c = 0; c < components.size(); ++c)
+		{
+			firstCells[components[c].second] = static_cast<unsigned long long>(c + 1); //labels start at '1'
+		}
+		for (unsigned i = 0; i < cellCount; ++i)
+		{
+			m_labels[i] = static_cast<unsigned>(firstCells[m_labels[i]]);
+		}
+
+		return static_cast<int>(components.size());
+	}
+
+	//! Sets the label of a range of points (as their scalar value)
+	/** \param pointsAndCodes the octree points and their codes
+		\param range points range
+		\param cloud the octree cloud
+	**/
+	void labelPoints(const DgmOctree::cellsContainer& pointsAndCodes, const ccLabelingRange& range, GenericIndexedCloudPersist* cloud) const
+	{
+		unsigned char bitDec = DgmOctree::GET_BIT_SHIFT(m_level);
+
+		//first cell (points and cells are sorted in the same order)
+		unsigned c = static_cast<unsigned>(std::lower_bound(m_codes.begin(), m_codes.end(), pointsAndCodes[range.i1].theCode >> bitDec) - m_codes.begin());
+		for (unsigned i = range.i1; i < range.i2 && c < m_codes.size(); ++i)
+		{
+			DgmOctree::CellCode code = (pointsAndCodes[i].theCode >> bitDec);
+			while (c < m_codes.size() && m_codes[c] < code)
+				++c;
+			if (c < m_codes.size() && m_codes[c] == code)
 			{
-				indexMin.x = indexMax.x = cellPos.x;
-				indexMin.y = indexMax.y = cellPos.y;
-				indexMin.z = indexMax.z = cellPos.z;
+				cloud->setPointScalarValue(pointsAndCodes[i].theIndex, static_cast<ScalarType>(m_labels[c]));
 			}
-
-			//Warning: the cells will have to be sorted inside a slice afterwards!
-			ccCells[i].theIndex = (static_cast<IndexAndCodeExt::IndexType>(cellPos.x))
-								+ (static_cast<IndexAndCodeExt::IndexType>(cellPos.y) << level)
-								+ (static_cast<IndexAndCodeExt::IndexType>(cellPos.z) << (2 * level));
 		}
 	}
 
-	//we deduce the size of the grid that totally includes input cells
-	Tuple3i gridSize = indexMax - indexMin + Tuple3i(1, 1, 1);
+protected:
 
-	//we sort the cells
-	SortAlgo(ccCells.begin(), ccCells.end(), IndexAndCodeExt::indexComp); //ascending index code order
+	//! Returns whether a cell position is inside the octree grid
+	inline bool isInGrid(const Tuple3i& cellPos) const
+	{
+		return		cellPos.x >= 0 && cellPos.x < m_gridSize
+				&&	cellPos.y >= 0 && cellPos.y < m_gridSize
+				&&	cellPos.z >= 0 && cellPos.z < m_gridSize;
+	}
 
-	const int& di = gridSize.x;
-	const int& dj = gridSize.y;
-	const int& step = gridSize.z;
+	//! Returns whether two cells belong to the same block
+	inline bool inSameBlock(const Tuple3i& cellPosA, const Tuple3i& cellPosB) const
+	{
+		return		(cellPosA.x >> m_blockBits) == (cellPosB.x >> m_blockBits)
+				&&	(cellPosA.y >> m_blockBits) == (cellPosB.y >> m_blockBits)
+				&&	(cellPosA.z >> m_blockBits) == (cellPosB.z >> m_blockBits);
+	}
 
-	//relative neighbos positions (either 6 or 26 total - but we only use half of it)
-	unsigned char neighborsInCurrentSlice = 0, neighborsInPrecedingSlice = 0;
-	int currentSliceNeighborsShifts[4], precedingSliceNeighborsShifts[9]; //maximum size to simplify code...
+	//! Returns the index of a cell in its block dense grid
+	inline unsigned localIndex(const Tuple3i& cellPos) const
+	{
+		const int mask = (1 << m_blockBits) - 1;
+		return		static_cast<unsigned>(cellPos.x & mask)
+				|	(static_cast<unsigned>(cellPos.y & mask) << m_blockBits)
+				|	(static_cast<unsigned>(cellPos.z & mask) << (2 * m_blockBits));
+	}
 
-	if (sixConnexity) //6-connexity
+	//! Looks for a cell (by its truncated code) in a range of cells
+	/** \return the cell index or NO_CELL if the cell is not in the range
+	**/
+	inline unsigned findCell(DgmOctree::CellCode truncatedCode, unsigned i1, unsigned i2) const
 	{
-		neighborsInCurrentSlice = 2;
-		currentSliceNeighborsShifts[0] = -(di + 2);
-		currentSliceNeighborsShifts[1] = -1;
+		std::vector<DgmOctree::CellCode>::const_iterator it = std::lower_bound(m_codes.begin() + i1, m_codes.begin() + i2, truncatedCode);
+		return (it != m_codes.begin() + i2 && *it == truncatedCode ? static_cast<unsigned>(it - m_codes.begin()) : NO_CELL);
+	}
 
-		neighborsInPrecedingSlice = 1;
-		precedingSliceNeighborsShifts[0] = 0;
+	//! Returns the root of a cell component (with path halving)
+	inline unsigned findRoot(unsigned i)
+	{
+		while (true)
+		{
+			unsigned parent = m_parents[i].load();
+			if (parent == i)
+				return i;
+			unsigned grandParent = m_parents[parent].load();
+			if (grandParent != parent)
+			{
+				//another thread may have updated the parent in the meantime (we don't care)
+				m_parents[i].compare_exchange_weak(parent, grandParent);
+			}
+			i = grandParent;
+		}
 	}
-	else //26-connexity
+
+	//! Merges the components of two cells
+	/** The root with the largest index is always attached to the other one
+		(parents indexes can only decrease, whatever the threads interleaving).
+	**/
+	inline void merge(unsigned i, unsigned j)
 	{
-		neighborsInCurrentSlice = 4;
-		currentSliceNeighborsShifts[0] = -1 - (di + 2);
-		currentSliceNeighborsShifts[1] = -(di + 2);
-		currentSliceNeighborsShifts[2] = 1 - (di + 2);
-		currentSliceNeighborsShifts[3] = -1;
+		while (true)
+		{
+			i = findRoot(i);
+			j = findRoot(j);
+			if (i == j)
+				return;
+			if (i < j)
+				std::swap(i, j);
+
+			unsigned expected = i;
+			if (m_parents[i].compare_exchange_strong(expected, j))
+				return;
+			//'i' is not a root anymore: let's try again
+		}
+	}
 
-		neighborsInPrecedingSlice = 9;
-		precedingSliceNeighborsShifts[0] = -1 - (di + 2);
-		precedingSliceNeighborsShifts[1] = -(di + 2);
-		precedingSliceNeighborsShifts[2] = 1 - (di + 2);
-		precedingSliceNeighborsShifts[3] = -1;
-		precedingSliceNeighborsShifts[4] = 0;
-		precedingSliceNeighborsShifts[5] = 1;
-		precedingSliceNeighborsShifts[6] = -1 + (di + 2);
-		precedingSliceNeighborsShifts[7] = (di + 2);
-		precedingSliceNeighborsShifts[8] = 1 + (di + 2);
+	//! Adds a (processed) neighbour relative position
+	inline void addNeighbourShift(int i, int j, int k)
+	{
+		Tuple3i& shift = m_neighbourShifts[m_neighbourCount++];
+		shift.x = i;
+		shift.y = j;
+		shift.z = k;
 	}
 
-	//shared structures (to avoid repeated allocations)
-	std::vector<int> neighboursVal, neighboursMin;
-	try
-	{
-		neighboursVal.reserve(neighborsInCurrentSlice + neighborsInPrecedingSlice);
-		neighboursMin.reserve(neighborsInCurrentSlice + neighborsInPrecedingSlice);
-	}
-	catch (const std::bad_alloc&)
+	//! Associated octree
+	const DgmOctree* m_octree;
+	//! Level of subdivision
+	unsigned char m_level;
+	//! Size of the blocks (in bits)
+	unsigned char m_blockBits;
+	//! Number of cells along each dimension
+	int m_gridSize;
+
+	//! Relative positions of the (processed) neighbours
+	Tuple3i m_neighbourShifts[13];
+	//! Number of (processed) neighbours
+	unsigned char m_neighbourCount;
+
+	//! Truncated cell codes (sorted)
+	std::vector<DgmOctree::CellCode> m_codes;
+	//! Cells positions
+	std::vector<Tuple3i> m_positions;
+	//! Cells parents (union-find)
+	std::atomic<unsigned>* m_parents;
+	//! Labeling blocks
+	std::vector<ccLabelingRange> m_blocks;
+	//! Labeling blocks codes (i.e. their truncated code at level 'm_level - m_blockBits')
+	std::vector<DgmOctree::CellCode> m_blockCodes;
+	//! Cells labels
+	std::vector<unsigned> m_labels;
+};
+
+const unsigned OctreeCellsLabeling::NO_CELL;
+
+#ifdef ENABLE_MT_OCTREE
+
+//! Prevents two octrees from using the (static) parallel connected components extraction wrappers at the same time
+static QMutex s_ccLabeling_MT_mutex;
+
+static OctreeCellsLabeling* s_ccLabeling_MT = 0;
+static const DgmOctree::cellsContainer* s_ccPointsAndCodes_MT = 0;
+static GenericIndexedCloudPersist* s_ccCloud_MT = 0;
+static NormalizedProgress* s_ccProgress_MT = 0;
+
+void LabelCellsBlock_MT(ccLabelingRange& block)
+{
+	s_ccLabeling_MT->labelBlock(block);
+	if (s_ccProgress_MT)
+		s_ccProgress_MT->oneStep();
+}
+
+void MergeCellsBlock_MT(ccLabelingRange& block)
+{
+	s_ccLabeling_MT->mergeBlock(block);
+	if (s_ccProgress_MT)
+		s_ccProgress_MT->oneStep();
+}
+
+void LabelPointsChunk_MT(ccLabelingRange& chunk)
+{
+	s_ccLabeling_MT->labelPoints(*s_ccPointsAndCodes_MT, chunk, s_ccCloud_MT);
+	if (s_ccProgress_MT)
+		s_ccProgress_MT->oneStep();
+}
+
+#endif
+
+int DgmOctree::extractCCs(const cellCodesContainer& cellCodes, unsigned char level, bool sixConnexity, GenericProgressCallback* progressCb) const
+{
+	if (cellCodes.empty()) //no cells!
+		return -1;
+
+	OctreeCellsLabeling labeling(this, level, sixConnexity);
+	if (!labeling.init(cellCodes))
 	{
 		//not enough memory
 		return -2;
 	}
 
-	//temporary virtual 'slices'
-	int sliceSize = (di + 2) * (dj + 2); //add a margin to avoid "boundary effects"
-	std::vector<int> slice;
-	std::vector<int> oldSlice;
-	//equivalence table between 'on the fly' labels
-	std::vector<int> equivalentLabels;
-	std::vector<int> cellIndexToLabel;
+	std::vector<ccLabelingRange>& blocks = labeling.blocks();
+	unsigned blockCount = static_cast<unsigned>(blocks.size());
 
+	//points labeling jobs
+	std::vector<ccLabelingRange> chunks;
 	try
 	{
-		slice.resize(sliceSize);
-		oldSlice.resize(sliceSize, 0); //previous slice is empty by default
-		equivalentLabels.resize(numberOfCells + 2, 0);
-		cellIndexToLabel.resize(numberOfCells, 0);
+		unsigned pointCount = static_cast<unsigned>(m_thePointsAndTheirCellCodes.size());
+		chunks.resize((pointCount + CC_LABELING_CHUNK_SIZE - 1) / CC_LABELING_CHUNK_SIZE);
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			chunks[i].i1 = static_cast<unsigned>(i) * CC_LABELING_CHUNK_SIZE;
+			chunks[i].i2 = std::min(chunks[i].i1 + CC_LABELING_CHUNK_SIZE, pointCount);
+		}
 	}
 	catch (const std::bad_alloc&)
 	{
@@ -2940,207 +4339,67 @@ int DgmOctree::extractCCs(const cellCodesContainer& cellCodes, unsigned char lev
 		{
 			progressCb->setMethodTitle("Components Labeling");
 			char buffer[256];
-			sprintf(buffer, "Box: [%i*%i*%i]", gridSize.x, gridSize.y, gridSize.z);
+			sprintf(buffer, "Cells: %u (%u blocks)", labeling.cellsCount(), blockCount);
 			progressCb->setInfo(buffer);
 		}
 		progressCb->update(0);
 		progressCb->start();
 	}
 
-	//current label
-	size_t currentLabel = 1;
+	bool processed = false;
 
-	//process each slice
+	//1st step: local labeling of each block, 2nd step: merge across the blocks boundaries
 	{
-		unsigned counter = 0;
-		const IndexAndCodeExt::IndexType gridCoordMask = (static_cast<IndexAndCodeExt::IndexType>(1) << level) - 1;
-		std::vector<IndexAndCodeExt>::const_iterator _ccCells = ccCells.begin();
-		NormalizedProgress nprogress(progressCb, step);
+		NormalizedProgress nprogress(progressCb, 2 * blockCount);
 
-		for (int k = indexMin.z; k < indexMin.z + step; k++)
+#ifdef ENABLE_MT_OCTREE
+		if (blockCount > 1 && s_ccLabeling_MT_mutex.tryLock())
 		{
-			//initialize the 'current' slice
-			std::fill(slice.begin(), slice.end(), 0);
-
-			//for each cell of the slice
-			while (counter < numberOfCells && static_cast<int>(_ccCells->theIndex >> (level << 1)) == k)
-			{
-				int iind = static_cast<int>(_ccCells->theIndex & gridCoordMask);
-				int jind = static_cast<int>((_ccCells->theIndex >> level) & gridCoordMask);
-				int cellIndex = (iind - indexMin.x + 1) + (jind - indexMin.y + 1)*(di + 2);
-				++_ccCells;
-
-				//we look if the cell has neighbors inside the slice
-				int* _slice = &(slice[cellIndex]);
-				{
-					for (unsigned char n = 0; n < neighborsInCurrentSlice; n++)
-					{
-						assert(cellIndex + currentSliceNeighborsShifts[n] < sliceSize);
-						const int& neighborLabel = _slice[currentSliceNeighborsShifts[n]];
-						if (neighborLabel > 1)
-							neighboursVal.push_back(neighborLabel);
-					}
-				}
-
-				//and in the previous slice
-				const int* _oldSlice = &(oldSlice[cellIndex]);
-				{
-					for (unsigned char n = 0; n < neighborsInPrecedingSlice; n++)
-					{
-						assert(cellIndex + precedingSliceNeighborsShifts[n] < sliceSize);
-						const int& neighborLabel = _oldSlice[precedingSliceNeighborsShifts[n]];
-						if (neighborLabel > 1)
-							neighboursVal.push_back(neighborLabel);
-					}
-				}
-
-				//number of neighbors for current cell
-				size_t p = neighboursVal.size();
-
-				if (p == 0) //no neighbor
-				{
-					*_slice = static_cast<int>(++currentLabel); //we create a new label
-				}
-				else if (p == 1) //1 neighbor
-				{
-					*_slice = neighboursVal.back(); //we'll use its label
-					neighboursVal.pop_back();
-				}
-				else //more than 1 neighbor?
-				{
-					//we get the smallest label
-					SortAlgo(neighboursVal.begin(), neighboursVal.end());
-					int smallestLabel = neighboursVal[0];
-
-					//if they are not the same
-					if (smallestLabel != neighboursVal.back())
-					{
-						int lastLabel = 0;
-						neighboursMin.clear();
-						//we get the smallest equivalent label for each neighbor's branch
-						{
-							for (size_t n = 0; n < p; n++)
-							{
-								// ... we start from its C.C. index
-								int label = neighboursVal[n];
-								//if it's not the same as the previous neighbor's
-								if (label != lastLabel)
-								{
-									//we update the 'before' value
-									assert(label < static_cast<int>(numberOfCells)+2);
-									lastLabel = label;
-
-									//we look for its real equivalent value
-									while (equivalentLabels[label] > 1)
-									{
-										label = equivalentLabels[label];
-										assert(label < static_cast<int>(numberOfCells)+2);
-									}
-
-									neighboursMin.push_back(label);
-								}
-							}
-						}
-
-						//get the smallest one
-						SortAlgo(neighboursMin.begin(), neighboursMin.end());
-						smallestLabel = neighboursMin.front();
+			s_ccLabeling_MT = &labeling;
+			s_ccProgress_MT = &nprogress;
 
-						//update the equivalence table by the way
-						//for all other branches
-						lastLabel = smallestLabel;
-						{
-							for (size_t n = 1; n < neighboursMin.size(); n++)
-							{
-								int label = neighboursMin[n];
-								assert(label < static_cast<int>(numberOfCells)+2);
-								//we don't process it if it's the same label as the previous neighbor
-								if (label != lastLabel)
-								{
-									equivalentLabels[label] = smallestLabel;
-									lastLabel = label;
-								}
-							}
-						}
-					}
+			QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+			QtConcurrent::blockingMap(blocks, LabelCellsBlock_MT);
+			QtConcurrent::blockingMap(blocks, MergeCellsBlock_MT);
 
-					//update current cell label
-					*_slice = smallestLabel;
-					neighboursVal.clear();
-				}
+			s_ccLabeling_MT = 0;
+			s_ccProgress_MT = 0;
+			s_ccLabeling_MT_mutex.unlock();
 
-				cellIndexToLabel[counter++] = *_slice;
+			processed = true;
+		}
+#endif
+		if (!processed)
+		{
+			for (unsigned i = 0; i < blockCount; ++i)
+			{
+				labeling.labelBlock(blocks[i]);
+				nprogress.oneStep();
+			}
+			for (unsigned i = 0; i < blockCount; ++i)
+			{
+				labeling.mergeBlock(blocks[i]);
+				nprogress.oneStep();
 			}
-
-			if (counter == numberOfCells)
-				break;
-
-			std::swap(slice, oldSlice);
-
-			nprogress.oneStep();
 		}
 	}
 
-	//release some memory
-	slice.clear();
-	oldSlice.clear();
-
 	if (progressCb)
 	{
 		progressCb->stop();
 	}
 
-	if (currentLabel < 2)
-	{
-		//No component found
-		return -3;
-	}
-
-	//path compression (http://en.wikipedia.org/wiki/Union_find)
-	assert(currentLabel < numberOfCells + 2);
-	{
-		for (size_t i = 2; i <= currentLabel; i++)
-		{
-			int label = equivalentLabels[i];
-			assert(label < static_cast<int>(numberOfCells)+2);
-			while (equivalentLabels[label] > 1) //equivalentLabels[0] == 0 !!!
-			{
-				label = equivalentLabels[label];
-				assert(label < static_cast<int>(numberOfCells)+2);
-			}
-			equivalentLabels[i] = label;
-		}
-	}
-
-	//update leaves
+	int numberOfComponents = labeling.numberComponents();
+	if (numberOfComponents < 0)
 	{
-		for (size_t i = 0; i < numberOfCells; i++)
-		{
-			int label = cellIndexToLabel[i];
-			assert(label < static_cast<int>(numberOfCells)+2);
-			if (equivalentLabels[label] > 1)
-				cellIndexToLabel[i] = equivalentLabels[label];
-		}
+		//not enough memory
+		return numberOfComponents;
 	}
-
-	//hack: we use "equivalentLabels" to count how many components will have to be created
-	int numberOfComponents = 0;
+	else if (numberOfComponents == 0)
 	{
-		std::fill(equivalentLabels.begin(), equivalentLabels.end(), 0);
-
-		for (size_t i = 0; i < numberOfCells; i++)
-		{
-			assert(cellIndexToLabel[i] > 1 && cellIndexToLabel[i] < static_cast<int>(numberOfCells)+2);
-			equivalentLabels[cellIndexToLabel[i]] = 1;
-		}
-
-		//we create (following) indexes for each components
-		for (size_t i = 2; i < numberOfCells + 2; i++)
-			if (equivalentLabels[i] == 1)
-				equivalentLabels[i] = ++numberOfComponents; //labels start at '1'
+		//No component found
+		return -3;
 	}
-	assert(equivalentLabels[0] == 0);
-	assert(equivalentLabels[1] == 0);
 
 	//we flag each component's points with its label
 	{
@@ -3156,25 +4415,35 @@ int DgmOctree::extractCCs(const cellCodesContainer& cellCodes, unsigned char lev
 			progressCb->update(0);
 			progressCb->start();
 		}
-		NormalizedProgress nprogress(progressCb, static_cast<unsigned>(numberOfCells));
+		NormalizedProgress nprogress(progressCb, static_cast<unsigned>(chunks.size()));
 
-		ReferenceCloud Y(m_theAssociatedCloud);
-		for (size_t i = 0; i < numberOfCells; i++)
+		processed = false;
+#ifdef ENABLE_MT_OCTREE
+		if (chunks.size() > 1 && s_ccLabeling_MT_mutex.tryLock())
 		{
-			assert(cellIndexToLabel[i] < static_cast<int>(numberOfCells)+2);
+			s_ccLabeling_MT = &labeling;
+			s_ccPointsAndCodes_MT = &m_thePointsAndTheirCellCodes;
+			s_ccCloud_MT = m_theAssociatedCloud;
+			s_ccProgress_MT = &nprogress;
 
-			const int& label = equivalentLabels[cellIndexToLabel[i]];
-			assert(label > 0);
-			getPointsInCell(ccCells[i].theCode, level, &Y, true);
-			Y.placeIteratorAtBegining();
-			ScalarType d = static_cast<ScalarType>(label);
-			for (unsigned j = 0; j < Y.size(); ++j)
+			QtConcurrent::blockingMap(chunks, LabelPointsChunk_MT);
+
+			s_ccLabeling_MT = 0;
+			s_ccPointsAndCodes_MT = 0;
+			s_ccCloud_MT = 0;
+			s_ccProgress_MT = 0;
+			s_ccLabeling_MT_mutex.unlock();
+
+			processed = true;
+		}
+#endif
+		if (!processed)
+		{
+			for (size_t i = 0; i < chunks.size(); ++i)
 			{
-				Y.setCurrentPointScalarValue(d);
-				Y.forwardIterator();
+				labeling.labelPoints(m_thePointsAndTheirCellCodes, chunks[i], m_theAssociatedCloud);
+				nprogress.oneStep();
 			}
-
-			nprogress.oneStep();
 		}
 
 		if (progressCb)
@@ -3224,11 +4493,6 @@ DgmOctree::octreeCell::~octreeCell()
 
 #ifdef ENABLE_MT_OCTREE
 
-#include <QtCore>
-#include <QApplication>
-#include <QtConcurrentMap>
-#include <QThreadPool>
-
 /*** FOR THE MULTI THREADING WRAPPER ***/
 struct octreeCellDesc
 {
@@ -3237,44 +4501,91 @@ struct octreeCellDesc
 	unsigned char level;
 };
 
+//! Work item of the multi-threaded cells scheduler (a set of consecutive cells)
+struct octreeCellBatch
+{
+	//! First element (index in the cell codes table, or in the cell descriptors table if any)
+	unsigned first;
+	//! Last element (included)
+	unsigned last;
+	//! Number of points
+	unsigned population;
+};
+
+//! Queue of batches of a worker thread (work-stealing scheduler)
+struct octreeWorkerQueue
+{
+	QMutex mutex;
+	std::deque<unsigned> batchIndexes;
+};
+
+//! Average number of batches per thread
+/** The bigger, the better the load balancing (but the higher the scheduling overhead).
+**/
+static const unsigned MT_CELL_BATCHES_PER_THREAD = 16;
+
 static DgmOctree* s_octree_MT = 0;
 static DgmOctree::octreeCellFunc s_func_MT = 0;
 static void** s_userParams_MT = 0;
 static GenericProgressCallback* s_progressCb_MT = 0;
 static NormalizedProgress* s_normProgressCb_MT = 0;
 static bool s_cellFunc_MT_success = true;
+static unsigned s_maxCellPopulation_MT = 0;
+//! Cells level (only used when the cells are generated on the fly)
+static unsigned char s_cellLevel_MT = 0;
+//! Pre-computed cell descriptors (if null, the cells are generated on the fly)
+static const std::vector<octreeCellDesc>* s_cellDescs_MT = 0;
+static const std::vector<octreeCellBatch>* s_cellBatches_MT = 0;
+static std::vector<octreeWorkerQueue>* s_workerQueues_MT = 0;
+
+//! Returns the number of points that should (roughly) be processed by each batch
+static unsigned GetCellBatchTargetPopulation(unsigned pointCount, int threadCount)
+{
+	return std::max<unsigned>(1, pointCount / (static_cast<unsigned>(std::max(threadCount, 1)) * MT_CELL_BATCHES_PER_THREAD));
+}
 
-void LaunchOctreeCellFunc_MT(const octreeCellDesc& desc)
+//! Retrieves the next batch to be processed by a given worker
+/** The worker first takes the largest batches of its own queue. Once it is
+	empty, it steals the smallest batches of the other workers queues.
+**/
+static bool PopCellBatch_MT(unsigned workerIndex, unsigned& batchIndex)
 {
-	//skip cell if process is aborted/has failed
-	if (!s_cellFunc_MT_success)
+	std::vector<octreeWorkerQueue>& queues = *s_workerQueues_MT;
+
+	//own queue
 	{
-		return;
+		octreeWorkerQueue& queue = queues[workerIndex];
+		QMutexLocker locker(&queue.mutex);
+		if (!queue.batchIndexes.empty())
+		{
+			batchIndex = queue.batchIndexes.front();
+			queue.batchIndexes.pop_front();
+			return true;
+		}
 	}
 
-	const DgmOctree::cellsContainer& pointsAndCodes = s_octree_MT->pointsAndTheirCellCodes();
-
-	//cell descriptor
-	DgmOctree::octreeCell cell(s_octree_MT);
-	cell.level = desc.level;
-	cell.index = desc.i1;
-	cell.truncatedCode = desc.truncatedCode;
-	if (cell.points->reserve(desc.i2 - desc.i1 + 1))
+	//work stealing
+	for (size_t i = 1; i < queues.size(); ++i)
 	{
-		for (unsigned i = desc.i1; i <= desc.i2; ++i)
+		octreeWorkerQueue& queue = queues[(workerIndex + i) % queues.size()];
+		QMutexLocker locker(&queue.mutex);
+		if (!queue.batchIndexes.empty())
 		{
-			cell.points->addPointIndex(pointsAndCodes[i].theIndex);
+			batchIndex = queue.batchIndexes.back();
+			queue.batchIndexes.pop_back();
+			return true;
 		}
-
-		s_cellFunc_MT_success &= (*s_func_MT)(cell, s_userParams_MT, s_normProgressCb_MT);
 	}
-	else
+
+	return false;
+}
+
+static void ProcessCell_MT(const DgmOctree::octreeCell& cell)
+{
+	if (!(*s_func_MT)(cell, s_userParams_MT, s_normProgressCb_MT))
 	{
 		s_cellFunc_MT_success = false;
-	}
 
-	if (!s_cellFunc_MT_success)
-	{
 		//TODO: display a message to make clear that the cancel order has been acknowledged!
 		if (s_progressCb_MT)
 		{
@@ -3284,17 +4595,134 @@ void LaunchOctreeCellFunc_MT(const octreeCellDesc& desc)
 			}
 			QApplication::processEvents();
 		}
+	}
+}
 
-		//if (s_normProgressCb_MT)
-		//{
-		//	//QApplication::processEvents(); //let the application breath!
-		//	if (!s_normProgressCb_MT->oneStep())
-		//	{
-		//		s_cellFunc_MT_success = false;
-		//		return;
-		//	}
-		//}
+void LaunchOctreeCellWorker_MT(const unsigned& workerIndex)
+{
+	//the cell descriptor (and its points container) is reused for all the cells processed by this worker
+	DgmOctree::octreeCell cell(s_octree_MT);
+	if (!cell.points->reserve(s_maxCellPopulation_MT))
+	{
+		//not enough memory
+		s_cellFunc_MT_success = false;
+		return;
+	}
+
+	const DgmOctree::cellsContainer& pointsAndCodes = s_octree_MT->pointsAndTheirCellCodes();
+
+	unsigned batchIndex = 0;
+	//skip the remaining batches if process is aborted/has failed
+	while (s_cellFunc_MT_success && PopCellBatch_MT(workerIndex, batchIndex))
+	{
+		const octreeCellBatch& batch = (*s_cellBatches_MT)[batchIndex];
+
+		if (s_cellDescs_MT)
+		{
+			for (unsigned c = batch.first; c <= batch.last && s_cellFunc_MT_success; ++c)
+			{
+				const octreeCellDesc& desc = (*s_cellDescs_MT)[c];
+				cell.level = desc.level;
+				cell.index = desc.i1;
+				cell.truncatedCode = desc.truncatedCode;
+				cell.points->clear(false);
+				for (unsigned i = desc.i1; i <= desc.i2; ++i)
+				{
+					cell.points->addPointIndex(pointsAndCodes[i].theIndex); //can't fail (see above)
+				}
+
+				ProcessCell_MT(cell);
+			}
+		}
+		else
+		{
+			//the cells are generated on the fly (a batch always contains whole cells)
+			unsigned char bitDec = DgmOctree::GET_BIT_SHIFT(s_cellLevel_MT);
+
+			cell.level = s_cellLevel_MT;
+			cell.index = batch.first;
+			cell.truncatedCode = (pointsAndCodes[batch.first].theCode >> bitDec);
+			cell.points->clear(false);
+
+			for (unsigned i = batch.first; i <= batch.last; ++i)
+			{
+				DgmOctree::CellCode nextCode = (pointsAndCodes[i].theCode >> bitDec);
+				if (nextCode != cell.truncatedCode)
+				{
+					ProcessCell_MT(cell);
+					if (!s_cellFunc_MT_success)
+						break;
+
+					//we start a new cell
+					cell.index = i;
+					cell.points->clear(false);
+					cell.truncatedCode = nextCode;
+				}
+
+				cell.points->addPointIndex(pointsAndCodes[i].theIndex); //can't fail (see above)
+			}
+
+			//don't forget the last cell!
+			if (s_cellFunc_MT_success)
+				ProcessCell_MT(cell);
+		}
+	}
+}
+
+//! Processes a set of cell batches with the work-stealing scheduler
+/** The static wrappers must have been set beforehand.
+	\return false if not enough memory
+**/
+static bool ProcessCellBatches_MT(const std::vector<octreeCellBatch>& batches, int maxThreadCount)
+{
+	if (batches.empty())
+		return true;
+
+	if (maxThreadCount <= 0)
+	{
+		maxThreadCount = QThread::idealThreadCount();
+	}
+	size_t workerCount = std::min<size_t>(static_cast<size_t>(std::max(maxThreadCount, 1)), batches.size());
+
+	try
+	{
+		std::vector<octreeWorkerQueue> queues(workerCount);
+		std::vector<unsigned> workerIndexes(workerCount);
+		for (size_t i = 0; i < workerCount; ++i)
+		{
+			workerIndexes[i] = static_cast<unsigned>(i);
+		}
+
+		//the largest batches are processed first, and they are
+		//evenly distributed among the workers (round robin)
+		std::vector<unsigned> order(batches.size());
+		for (size_t i = 0; i < batches.size(); ++i)
+		{
+			order[i] = static_cast<unsigned>(i);
+		}
+		std::stable_sort(order.begin(), order.end(), [&batches](unsigned a, unsigned b) { return batches[a].population > batches[b].population; });
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			queues[i % workerCount].batchIndexes.push_back(order[i]);
+		}
+
+		s_cellBatches_MT = &batches;
+		s_workerQueues_MT = &queues;
+
+		QThreadPool::globalInstance()->setMaxThreadCount(maxThreadCount);
+		QtConcurrent::blockingMap(workerIndexes, LaunchOctreeCellWorker_MT);
+
+		s_cellBatches_MT = 0;
+		s_workerQueues_MT = 0;
+	}
+	catch (const std::bad_alloc&)
+	{
+		s_cellBatches_MT = 0;
+		s_workerQueues_MT = 0;
+		return false;
 	}
+
+	return true;
 }
 
 #endif
@@ -3312,15 +4740,41 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 
 #ifdef ENABLE_MT_OCTREE
 
-	//cells that will be processed by QtConcurrent::map
-	const unsigned cellsNumber = getCellNumber(level);
-	std::vector<octreeCellDesc> cells;
+	//batches of cells that will be processed by the worker threads
+	std::vector<octreeCellBatch> batches;
 
 	if (multiThread)
 	{
+		if (maxThreadCount == 0)
+		{
+			maxThreadCount = QThread::idealThreadCount();
+		}
+
+		//the batches are (roughly) sized by population and always contain whole cells
+		//(the cells themselves will be generated on the fly by the worker threads)
+		const unsigned targetPopulation = GetCellBatchTargetPopulation(m_numberOfProjectedPoints, maxThreadCount);
+		TruncatedCodeComp comp(GET_BIT_SHIFT(level));
+
 		try
 		{
-			cells.reserve(cellsNumber);
+			unsigned first = 0;
+			while (first < m_numberOfProjectedPoints)
+			{
+				unsigned last = first + std::min(targetPopulation, m_numberOfProjectedPoints - first) - 1;
+
+				//look for the end of the last cell
+				CellCode truncatedCode = (m_thePointsAndTheirCellCodes[last].theCode >> comp.m_bitDec);
+				cellsContainer::const_iterator cellEnd = std::upper_bound(m_thePointsAndTheirCellCodes.begin() + last, m_thePointsAndTheirCellCodes.end(), truncatedCode, comp);
+				last = static_cast<unsigned>(cellEnd - m_thePointsAndTheirCellCodes.begin()) - 1;
+
+				octreeCellBatch batch;
+				batch.first = first;
+				batch.last = last;
+				batch.population = last - first + 1;
+				batches.push_back(batch);
+
+				first = last + 1;
+			}
 		}
 		catch (const std::bad_alloc&)
 		{
@@ -3438,38 +4892,8 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 #ifdef ENABLE_MT_OCTREE
 	else
 	{
-		assert(cells.capacity() == cellsNumber);
-
-		//binary shift for cell code truncation
-		unsigned char bitDec = GET_BIT_SHIFT(level);
-
-		//iterator on cell codes
-		cellsContainer::const_iterator p = m_thePointsAndTheirCellCodes.begin();
-
-		//cell descriptor (init. with first point/cell)
-		octreeCellDesc cellDesc;
-		cellDesc.i1 = 0;
-		cellDesc.i2 = 0;
-		cellDesc.level = level;
-		cellDesc.truncatedCode = (p->theCode >> bitDec);
-		++p;
-
-		//sweep through the octree
-		for (; p!=m_thePointsAndTheirCellCodes.end(); ++p)
-		{
-			CellCode nextCode = (p->theCode >> bitDec);
-
-			if (nextCode != cellDesc.truncatedCode)
-			{
-				cells.push_back(cellDesc);
-				cellDesc.i1=cellDesc.i2+1;
-			}
-
-			cellDesc.truncatedCode = nextCode;
-			++cellDesc.i2;
-		}
-		//don't forget the last cell!
-		cells.push_back(cellDesc);
+		//number of cells for this level
+		unsigned cellCount = getCellNumber(level);
 
 		//static wrap
 		s_octree_MT = this;
@@ -3477,6 +4901,9 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 		s_userParams_MT = additionalParameters;
 		s_cellFunc_MT_success = true;
 		s_progressCb_MT = progressCb;
+		s_cellLevel_MT = level;
+		s_maxCellPopulation_MT = m_maxCellPopulation[level];
+		s_cellDescs_MT = 0;
 		if (s_normProgressCb_MT)
 		{
 			delete s_normProgressCb_MT;
@@ -3493,7 +4920,7 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 					progressCb->setMethodTitle(functionTitle);
 				}
 				char buffer[512];
-				sprintf(buffer, "Octree level %i\nCells: %i\nAverage population: %3.2f (+/-%3.2f)\nMax population: %u", level, static_cast<int>(cells.size()), m_averageCellPopulation[level], m_stdDevCellPopulation[level], m_maxCellPopulation[level]);
+				sprintf(buffer, "Octree level %i\nCells: %u\nAverage population: %3.2f (+/-%3.2f)\nMax population: %u", level, cellCount, m_averageCellPopulation[level], m_stdDevCellPopulation[level], m_maxCellPopulation[level]);
 				progressCb->setInfo(buffer);
 			}
 			progressCb->update(0);
@@ -3508,12 +4935,11 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 		s_binarySearchCount = 0.0;
 #endif
 
-		if (maxThreadCount == 0)
+		if (!ProcessCellBatches_MT(batches, maxThreadCount))
 		{
-			maxThreadCount = QThread::idealThreadCount();
+			//not enough memory
+			s_cellFunc_MT_success = false;
 		}
-		QThreadPool::globalInstance()->setMaxThreadCount(maxThreadCount);
-		QtConcurrent::blockingMap(cells, LaunchOctreeCellFunc_MT);
 
 #ifdef COMPUTE_NN_SEARCH_STATISTICS
 		FILE* fp = fopen("octree_log.txt", "at");
@@ -3533,6 +4959,7 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 		s_octree_MT = 0;
 		s_func_MT = 0;
 		s_userParams_MT = 0;
+		s_progressCb_MT = 0;
 
 		if (progressCb)
 		{
@@ -3540,14 +4967,10 @@ unsigned DgmOctree::executeFunctionForAllCellsAtLevel(	unsigned char level,
 			if (s_normProgressCb_MT)
 				delete s_normProgressCb_MT;
 			s_normProgressCb_MT = 0;
-			s_progressCb_MT = 0;
 		}
 
-		//if something went wrong, we clear everything and return 0!
-		if (!s_cellFunc_MT_success)
-			cells.clear();
-
-		return static_cast<unsigned>(cells.size());
+		//if something went wrong, we return 0
+		return (s_cellFunc_MT_success ? cellCount : 0);
 	}
 #endif
 }
@@ -4020,11 +5443,46 @@ unsigned DgmOctree::executeFunctionForAllCellsStartingAtLevel(unsigned char star
 		double mean = static_cast<double>(popSum) / cells.size();
 		double stddev = sqrt(static_cast<double>(popSum2 - popSum*popSum)) / cells.size();
 
+		if (maxThreadCount == 0)
+		{
+			maxThreadCount = QThread::idealThreadCount();
+		}
+
+		//we group the cells in batches (roughly) sized by population
+		std::vector<octreeCellBatch> batches;
+		try
+		{
+			const unsigned targetPopulation = GetCellBatchTargetPopulation(m_numberOfProjectedPoints, maxThreadCount);
+
+			octreeCellBatch batch;
+			batch.first = 0;
+			batch.population = 0;
+			for (size_t i = 0; i < cells.size(); ++i)
+			{
+				batch.population += cells[i].i2 - cells[i].i1 + 1;
+				if (batch.population >= targetPopulation || i + 1 == cells.size())
+				{
+					batch.last = static_cast<unsigned>(i);
+					batches.push_back(batch);
+					batch.first = batch.last + 1;
+					batch.population = 0;
+				}
+			}
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			return 0;
+		}
+
 		//static wrap
 		s_octree_MT = this;
 		s_func_MT = func;
 		s_userParams_MT = additionalParameters;
 		s_cellFunc_MT_success = true;
+		s_progressCb_MT = progressCb;
+		s_maxCellPopulation_MT = static_cast<unsigned>(maxPop);
+		s_cellDescs_MT = &cells;
 		if (s_normProgressCb_MT)
 			delete s_normProgressCb_MT;
 		s_normProgressCb_MT = 0;
@@ -4058,12 +5516,11 @@ unsigned DgmOctree::executeFunctionForAllCellsStartingAtLevel(unsigned char star
 		s_binarySearchCount = 0.0;
 #endif
 
-		if (maxThreadCount == 0)
+		if (!ProcessCellBatches_MT(batches, maxThreadCount))
 		{
-			maxThreadCount = QThread::idealThreadCount();
+			//not enough memory
+			s_cellFunc_MT_success = false;
 		}
-		QThreadPool::globalInstance()->setMaxThreadCount(maxThreadCount);
-		QtConcurrent::blockingMap(cells, LaunchOctreeCellFunc_MT);
 
 #ifdef COMPUTE_NN_SEARCH_STATISTICS
 		FILE* fp=fopen("octree_log.txt","at");
@@ -4083,6 +5540,8 @@ unsigned DgmOctree::executeFunctionForAllCellsStartingAtLevel(unsigned char star
 		s_octree_MT = 0;
 		s_func_MT = 0;
 		s_userParams_MT = 0;
+		s_progressCb_MT = 0;
+		s_cellDescs_MT = 0;
 
 		if (progressCb)
 		{
@@ -30,12 +30,15 @@
 #include "GenericProgressCallback.h"
 #include "SaitoSquaredDistanceTransform.h"
 #include "FastMarchingForPropagation.h"
+#include "FastMarchingForGeodesicDistances.h"
 #include "ScalarFieldTools.h"
 #include "CCConst.h"
 #include "CCMiscTools.h"
 #include "LocalModel.h"
 #include "SimpleTriangle.h"
 #include "ScalarField.h"
+#include "MeshBVH.h"
+#include "Cloud2CloudReferenceContext.h"
 
 //system
 #include <assert.h>
@@ -154,14 +157,58 @@ int DistanceComputationTools::computeCloud2CloudDistance(	GenericIndexedCloudPer
 		return -666;
 	}
 
+	//persistent reference context (if any)
+	Cloud2CloudReferenceContext* context = params.referenceContext;
+	if (context && context->referenceCloud() != referenceCloud)
+	{
+		//the context doesn't correspond to the reference cloud
+		assert(false);
+		context = 0;
+	}
+
 	//we spatially 'synchronize' the octrees
 	DgmOctree *comparedOctree = compOctree, *referenceOctree = refOctree;
-	SOReturnCode soCode = synchronizeOctrees(	comparedCloud,
-												referenceCloud,
-												comparedOctree,
-												referenceOctree,
-												params.maxSearchDist,
-												progressCb);
+	SOReturnCode soCode = SYNCHRONIZED;
+	if (context)
+	{
+		//the reference octree is the context one (it is only rebuilt if the compared cloud doesn't fit inside)
+		if (!context->prepare(comparedCloud, progressCb))
+		{
+			//not enough memory (or invalid input)
+			return -1;
+		}
+		referenceOctree = context->octree();
+
+		if (!comparedOctree)
+		{
+			comparedOctree = new DgmOctree(comparedCloud);
+		}
+		if (!context->synchronize(*comparedOctree, progressCb))
+		{
+			//not enough memory
+			if (!compOctree)
+				delete comparedOctree;
+			return -1;
+		}
+
+		if (	params.localModel != NO_MODEL
+			&&	!context->setLocalModelParameters(params.localModel, params.useSphericalSearchForLocalModel, params.kNNForLocalModel, params.radiusForLocalModel))
+		{
+			//not enough memory
+			if (!compOctree)
+				delete comparedOctree;
+			return -1;
+		}
+	}
+	else
+	{
+		soCode = synchronizeOctrees(comparedCloud,
+									referenceCloud,
+									comparedOctree,
+									referenceOctree,
+									params.maxSearchDist,
+									progressCb);
+	}
 	
 	if (soCode != SYNCHRONIZED && soCode != DISJOINT)
 	{
@@ -189,7 +236,7 @@ int DistanceComputationTools::computeCloud2CloudDistance(	GenericIndexedCloudPer
 			//not enough memory
 			if (comparedOctree && !compOctree)
 				delete comparedOctree;
-			if (referenceOctree && !refOctree)
+			if (referenceOctree && !refOctree && !context)
 				delete referenceOctree;
 			return -1;
 		}
@@ -212,56 +259,733 @@ int DistanceComputationTools::computeCloud2CloudDistance(	GenericIndexedCloudPer
 		return 0;
 	}
 
-	//if necessary we try to guess the best octree level for distances computation
-	if (params.octreeLevel == 0 && referenceOctree) //DGM: referenceOctree can be 0 if the input entities bounding-boxes are disjoint!
+	//if necessary we try to guess the best octree level for distances computation
+	if (params.octreeLevel == 0 && referenceOctree) //DGM: referenceOctree can be 0 if the input entities bounding-boxes are disjoint!
+	{
+		params.octreeLevel = comparedOctree->findBestLevelForComparisonWithOctree(referenceOctree);
+	}
+
+	//whether to compute split distances or not
+	bool computeSplitDistances = false;
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			if (params.splitDistances[i] && params.splitDistances[i]->currentSize() == comparedCloud->size())
+			{
+				computeSplitDistances = true;
+				params.splitDistances[i]->fill(NAN_VALUE);
+			}
+		}
+	}
+
+	//additional parameters
+	void* additionalParameters[] = {	reinterpret_cast<void*>(referenceCloud),
+										reinterpret_cast<void*>(referenceOctree),
+										reinterpret_cast<void*>(&params),
+										reinterpret_cast<void*>(&maxSearchSquareDistd),
+										reinterpret_cast<void*>(&computeSplitDistances),
+										reinterpret_cast<void*>(context)
+	};
+
+	int result = 0;
+
+	if (comparedOctree->executeFunctionForAllCellsAtLevel(	params.octreeLevel,
+															params.localModel == NO_MODEL ? computeCellHausdorffDistance : computeCellHausdorffDistanceWithLocalModel,
+															additionalParameters,
+															params.multiThread,
+															progressCb,
+															"Cloud-Cloud Distance",
+															params.maxThreadCount) == 0)
+	{
+		//something went wrong
+		result = -2;
+	}
+
+	if (comparedOctree && !compOctree)
+	{
+		delete comparedOctree;
+		comparedOctree = 0;
+	}
+	if (referenceOctree && !refOctree && !context)
+	{
+		delete referenceOctree;
+		referenceOctree = 0;
+	}
+
+	return result;
+}
+
+//! Number of points counts per cell (with a summed-volume table) for the tiled cloud-to-cloud distances
+struct C2CTilingGrid
+{
+	//! Grid size (in cells)
+	Tuple3i size;
+	//! Summed-volume table ((size.x+1) * (size.y+1) * (size.z+1) values)
+	std::vector<unsigned> sums;
+
+	bool init(const Tuple3i& gridSize)
+	{
+		size.x = gridSize.x;
+		size.y = gridSize.y;
+		size.z = gridSize.z;
+		try
+		{
+			sums.resize(static_cast<size_t>(size.x + 1) * (size.y + 1) * (size.z + 1), 0);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			return false;
+		}
+		return true;
+	}
+
+	//! Returns a value of the table (0 <= i <= size.x, etc.)
+	inline unsigned& at(int i, int j, int k) { return sums[(static_cast<size_t>(k) * (size.y + 1) + j) * (size.x + 1) + i]; }
+
+	//! Counts a point in a given cell
+	inline void add(const Tuple3i& cellPos) { ++at(cellPos.x + 1, cellPos.y + 1, cellPos.z + 1); }
+
+	//! Converts the counts into the summed-volume table
+	void integrate()
+	{
+		//(unsigned overflows cancel out as long as the total is < 2^32)
+		for (int k = 1; k <= size.z; ++k)
+			for (int j = 1; j <= size.y; ++j)
+				for (int i = 1; i <= size.x; ++i)
+					at(i, j, k) += at(i - 1, j, k) + at(i, j - 1, k) + at(i, j, k - 1)
+								-  at(i - 1, j - 1, k) - at(i - 1, j, k - 1) - at(i, j - 1, k - 1)
+								+  at(i - 1, j - 1, k - 1);
+	}
+
+	//! Returns the number of points in the cells [minPos ; maxPos[ (clamped to the grid)
+	unsigned count(Tuple3i minPos, Tuple3i maxPos)
+	{
+		for (unsigned char d = 0; d < 3; ++d)
+		{
+			minPos.u[d] = std::max(minPos.u[d], 0);
+			maxPos.u[d] = std::min(maxPos.u[d], size.u[d]);
+			if (minPos.u[d] >= maxPos.u[d])
+				return 0;
+		}
+		return	  at(maxPos.x, maxPos.y, maxPos.z) - at(minPos.x, maxPos.y, maxPos.z) - at(maxPos.x, minPos.y, maxPos.z) - at(maxPos.x, maxPos.y, minPos.z)
+				+ at(minPos.x, minPos.y, maxPos.z) + at(minPos.x, maxPos.y, minPos.z) + at(maxPos.x, minPos.y, minPos.z) - at(minPos.x, minPos.y, minPos.z);
+	}
+};
+
+//! Cells range of a tile (see computeCloud2CloudDistanceTiled)
+struct C2CTile
+{
+	C2CTile(const Tuple3i& _minPos, const Tuple3i& _maxPos) : minPos(_minPos), maxPos(_maxPos) {}
+
+	Tuple3i minPos; //included
+	Tuple3i maxPos; //excluded
+};
+
+//! Points indexes sorted by cell of the tiling grid (see computeCloud2CloudDistanceTiled)
+/** The indexes are stored in a ReferenceCloud (i.e. in a chunked array, see ChunkedArrayAllocator)
+	so that the points of each tile are gathered without scanning the whole cloud again.
+**/
+struct C2CCellBuckets
+{
+	//! Grid size (in cells)
+	Tuple3i size;
+	//! First index of each cell in 'points' (+ total number of points at the end)
+	std::vector<unsigned> cellStart;
+	//! Points indexes (sorted by cell)
+	ReferenceCloud points;
+
+	explicit C2CCellBuckets(GenericIndexedCloudPersist* cloud) : points(cloud) {}
+
+	bool init(const Tuple3i& gridSize)
+	{
+		size.x = gridSize.x;
+		size.y = gridSize.y;
+		size.z = gridSize.z;
+		try
+		{
+			cellStart.resize(static_cast<size_t>(size.x) * size.y * size.z + 1, 0);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			return false;
+		}
+		return true;
+	}
+
+	//! Returns the (linear) index of a cell
+	inline size_t cellIndex(int i, int j, int k) const { return (static_cast<size_t>(k) * size.y + j) * size.x + i; }
+
+	//! Counts a point in a given cell (first pass)
+	inline void count(const Tuple3i& cellPos) { ++cellStart[cellIndex(cellPos.x, cellPos.y, cellPos.z) + 1]; }
+
+	//! Allocates the indexes (once all the points have been counted)
+	bool allocate()
+	{
+		for (size_t i = 1; i < cellStart.size(); ++i)
+			cellStart[i] += cellStart[i - 1];
+		return points.resize(cellStart.back());
+	}
+
+	//! Stores a point index in a given cell (second pass)
+	/** The 'cellStart' values are temporarily shifted (see finalize).
+	**/
+	inline void place(const Tuple3i& cellPos, unsigned pointIndex) { points.setPointIndex(cellStart[cellIndex(cellPos.x, cellPos.y, cellPos.z)]++, pointIndex); }
+
+	//! Restores the 'cellStart' values (once all the points have been stored)
+	void finalize()
+	{
+		for (size_t i = cellStart.size() - 1; i != 0; --i)
+			cellStart[i] = cellStart[i - 1];
+		cellStart[0] = 0;
+	}
+
+	//! Adds the points of the cells [minPos ; maxPos[ (clamped to the grid) to a subset
+	/** \return false if not enough memory
+	**/
+	bool getPoints(Tuple3i minPos, Tuple3i maxPos, ReferenceCloud& subset) const
+	{
+		for (unsigned char d = 0; d < 3; ++d)
+		{
+			minPos.u[d] = std::max(minPos.u[d], 0);
+			maxPos.u[d] = std::min(maxPos.u[d], size.u[d]);
+			if (minPos.u[d] >= maxPos.u[d])
+				return true;
+		}
+
+		for (int k = minPos.z; k < maxPos.z; ++k)
+		{
+			for (int j = minPos.y; j < maxPos.y; ++j)
+			{
+				//the cells of a row are contiguous
+				unsigned first = cellStart[cellIndex(minPos.x, j, k)];
+				unsigned last = cellStart[cellIndex(maxPos.x - 1, j, k) + 1];
+				for (unsigned n = first; n < last; ++n)
+				{
+					if (!subset.addPointIndex(points.getPointGlobalIndex(n)))
+					{
+						//not enough memory
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+};
+
+//! Returns the cell of a compared point in the tiling grid (clamped to the tiles - see computeCloud2CloudDistanceTiled)
+static inline Tuple3i GetC2CTileCellPos(const CCVector3& P, const CCVector3d& gridMin, double cellSize, int haloCells, const Tuple3i& tilesSize)
+{
+	Tuple3i cellPos;
+	for (unsigned char d = 0; d < 3; ++d)
+	{
+		int pos = static_cast<int>(floor((P.u[d] - gridMin.u[d]) / cellSize));
+		cellPos.u[d] = std::min(std::max(pos, haloCells), haloCells + tilesSize.u[d] - 1);
+	}
+	return cellPos;
+}
+
+//! Returns the cell of a reference point in the tiling grid (or false if it's outside - see computeCloud2CloudDistanceTiled)
+static inline bool GetC2CGridCellPos(const CCVector3& P, const CCVector3d& gridMin, double cellSize, const Tuple3i& gridSize, Tuple3i& cellPos)
+{
+	for (unsigned char d = 0; d < 3; ++d)
+	{
+		double pos = floor((P.u[d] - gridMin.u[d]) / cellSize);
+		if (pos < 0 || pos >= gridSize.u[d])
+			return false;
+		cellPos.u[d] = static_cast<int>(pos);
+	}
+	return true;
+}
+
+//! Returns whether at least one point of a cloud lies in the bounding-box of another cloud enlarged by a given distance
+/** Same test as the points filter of the octrees built by DistanceComputationTools::synchronizeOctrees
+	(see computeCloud2CloudDistanceTiled).
+**/
+static bool HasPointsNearBoundingBox(GenericIndexedCloudPersist& cloud, GenericIndexedCloudPersist& boxCloud, PointCoordinateType distance)
+{
+	CCVector3 bbMin, bbMax;
+	boxCloud.getBoundingBox(bbMin, bbMax);
+	bbMin -= CCVector3(distance, distance, distance);
+	bbMax += CCVector3(distance, distance, distance);
+
+	unsigned pointCount = cloud.size();
+	for (unsigned i = 0; i < pointCount; ++i)
+	{
+		const CCVector3* P = cloud.getPoint(i);
+		if (	(P->x >= bbMin.x) && (P->x <= bbMax.x)
+			&&	(P->y >= bbMin.y) && (P->y <= bbMax.y)
+			&&	(P->z >= bbMin.z) && (P->z <= bbMax.z) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//! Computes the cloud-to-cloud distances for the compared points of a tile (see computeCloud2CloudDistanceTiled)
+/** \param compTile compared points of the tile
+	\param refTile reference points of the tile region (i.e. the tile + the halo + the local model radius)
+	\param params distance computation parameters (CPSet and split distances are relative to the whole compared cloud)
+	\param computeSplitDistances whether split distances should be computed
+	\param halo halo size (only used to detect the points whose nearest neighbour may lie outside of the region)
+	\param[out] farPoints points whose nearest neighbour may lie outside of the region (ignored if 0)
+	\param progressCb progress callback
+	\return 0 if ok, a negative value otherwise
+**/
+static int ComputeC2CTileDistances(	ReferenceCloud& compTile,
+									ReferenceCloud& refTile,
+									const DistanceComputationTools::Cloud2CloudDistanceComputationParams& params,
+									bool computeSplitDistances,
+									double halo,
+									ReferenceCloud* farPoints,
+									GenericProgressCallback* progressCb)
+{
+	unsigned tileSize = compTile.size();
+	GenericIndexedCloudPersist* comparedCloud = compTile.getAssociatedCloud();
+	GenericIndexedCloudPersist* referenceCloud = refTile.getAssociatedCloud();
+
+	bool noNeighbour = (refTile.size() == 0);
+	if (!noNeighbour && !farPoints && params.maxSearchDist > 0)
+	{
+		//with a max search distance, the octrees only cover the intersection of both bounding-boxes enlarged by this
+		//distance (see synchronizeOctrees). If one of the clouds has no point inside, all the compared points are
+		//farther than the max search distance (and computeCloud2CloudDistance would fail to build the octrees)
+		noNeighbour = (		!HasPointsNearBoundingBox(compTile, refTile, params.maxSearchDist)
+						||	!HasPointsNearBoundingBox(refTile, compTile, params.maxSearchDist) );
+	}
+
+	if (noNeighbour)
+	{
+		if (farPoints)
+		{
+			//all the points have to be processed again
+			if (!farPoints->add(compTile))
+			{
+				//not enough memory
+				return -1;
+			}
+		}
+		else if (params.resetFormerDistances)
+		{
+			//all the points are farther than the max search distance (same value as computeCloud2CloudDistance)
+			ScalarType resetValue = params.maxSearchDist > 0 ? params.maxSearchDist : NAN_VALUE;
+			for (unsigned i = 0; i < tileSize; ++i)
+			{
+				compTile.setPointScalarValue(i, resetValue);
+			}
+		}
+		return 0;
+	}
+
+	DistanceComputationTools::Cloud2CloudDistanceComputationParams tileParams = params;
+	tileParams.referenceContext = 0;
+	tileParams.CPSet = 0;
+	tileParams.splitDistances[0] = tileParams.splitDistances[1] = tileParams.splitDistances[2] = 0;
+
+	//the nearest neighbours are required for the closest point set and to detect the far points
+	ReferenceCloud tileCPSet(&refTile);
+	if (params.CPSet || farPoints)
+	{
+		tileParams.CPSet = &tileCPSet;
+	}
+
+	int result = 0;
+	if (computeSplitDistances)
+	{
+		for (unsigned char d = 0; d < 3; ++d)
+		{
+			if (params.splitDistances[d] && params.splitDistances[d]->currentSize() == comparedCloud->size())
+			{
+				tileParams.splitDistances[d] = new ScalarField("split");
+				tileParams.splitDistances[d]->link();
+				if (!tileParams.splitDistances[d]->resize(tileSize))
+				{
+					//not enough memory
+					result = -1;
+				}
+			}
+		}
+	}
+
+	if (result == 0)
+	{
+		result = DistanceComputationTools::computeCloud2CloudDistance(&compTile, &refTile, tileParams, progressCb);
+	}
+
+	if (result == 0)
+	{
+		for (unsigned i = 0; i < tileSize; ++i)
+		{
+			unsigned globalIndex = compTile.getPointGlobalIndex(i);
+
+			//the closest point set forces the computation for all points
+			bool visible = true;
+			if (tileParams.CPSet && !params.CPSet)
+			{
+				visible = (referenceCloud->testVisibility(*compTile.getPoint(i)) == POINT_VISIBLE);
+				if (!visible)
+				{
+					compTile.setPointScalarValue(i, NAN_VALUE);
+				}
+			}
+
+			if (params.CPSet)
+			{
+				params.CPSet->setPointIndex(globalIndex, refTile.getPointGlobalIndex(tileCPSet.getPointGlobalIndex(i)));
+			}
+
+			for (unsigned char d = 0; d < 3; ++d)
+			{
+				if (tileParams.splitDistances[d])
+				{
+					params.splitDistances[d]->setValue(globalIndex, visible ? tileParams.splitDistances[d]->getValue(i) : NAN_VALUE);
+				}
+			}
+
+			if (farPoints && visible)
+			{
+				//is the nearest neighbour in the region the true one?
+				CCVector3d P = CCVector3d::fromArray(compTile.getPoint(i)->u);
+				CCVector3d Q = CCVector3d::fromArray(tileCPSet.getPoint(i)->u);
+				if ((P - Q).norm() > halo && !farPoints->addPointIndex(globalIndex))
+				{
+					//not enough memory
+					result = -1;
+					break;
+				}
+			}
+		}
+	}
+
+	for (unsigned char d = 0; d < 3; ++d)
+	{
+		if (tileParams.splitDistances[d])
+		{
+			tileParams.splitDistances[d]->release();
+		}
+	}
+
+	return result;
+}
+
+//! Computes the cloud-to-cloud distances of (a subset of) the compared points by tiles (see computeCloud2CloudDistanceTiled)
+/** \param comparedCloud compared cloud
+	\param compSubset compared points to process (all the points if 0)
+	\param referenceCloud reference cloud
+	\param params distance computation parameters
+	\param computeSplitDistances whether split distances should be computed
+	\param halo halo size (max search distance, or 0 to use the tiling grid cell size - updated in this case)
+	\param maxTilePointCount max number of (compared + reference) points per tile (best effort)
+	\param[out] farPoints points whose nearest neighbour may lie farther than the halo (ignored if 0)
+	\param progressCb progress callback
+	\return 0 if ok, a negative value otherwise
+**/
+static int ComputeC2CTiledDistances(GenericIndexedCloudPersist* comparedCloud,
+									ReferenceCloud* compSubset,
+									GenericIndexedCloudPersist* referenceCloud,
+									const DistanceComputationTools::Cloud2CloudDistanceComputationParams& params,
+									bool computeSplitDistances,
+									double& halo,
+									double maxTilePointCount,
+									ReferenceCloud* farPoints,
+									GenericProgressCallback* progressCb)
+{
+	GenericIndexedCloudPersist* compPoints = compSubset ? static_cast<GenericIndexedCloudPersist*>(compSubset) : comparedCloud;
+	unsigned compCount = compPoints->size();
+	if (compCount == 0)
+	{
+		return 0;
+	}
+
+	//tiles bounding-box (= compared points bounding-box)
+	CCVector3d compMin, compMax;
+	{
+		CCVector3 bbMin, bbMax;
+		compPoints->getBoundingBox(bbMin, bbMax);
+		compMin = CCVector3d::fromArray(bbMin.u);
+		compMax = CCVector3d::fromArray(bbMax.u);
+	}
+	CCVector3d compDiag = compMax - compMin;
+	double maxExtent = std::max(compDiag.x, std::max(compDiag.y, compDiag.z));
+
+	//histogram cell size
+	static const int TILING_GRID_RESOLUTION = 64;
+	double cellSize = maxExtent / TILING_GRID_RESOLUTION;
+
+	//halo: max search distance (or one cell, the farther points will be processed again) + local model radius
+	bool fixedHalo = (halo > 0);
+	if (fixedHalo)
+	{
+		//the grid (tiles + halo) shouldn't be too big either
+		cellSize = std::max(cellSize, (maxExtent + 2 * halo) / (2 * TILING_GRID_RESOLUTION));
+	}
+	if (cellSize <= 0)
+	{
+		//flat or single point cloud
+		cellSize = std::max(halo, 1.0);
+	}
+	if (!fixedHalo)
+	{
+		//(slightly less than one cell, so that the region is only one cell wider than the tile)
+		halo = cellSize * (1.0 - 1.0e-5);
+	}
+	double modelRadius = (params.localModel != NO_MODEL ? static_cast<double>(params.radiusForLocalModel) : 0);
+	double regionMargin = (halo + modelRadius) * (1.0 + 1.0e-6);
+	int haloCells = static_cast<int>(ceil(regionMargin / cellSize));
+
+	//the grid covers the tiles bounding-box + the halo
+	CCVector3d gridMin = compMin - CCVector3d(haloCells * cellSize, haloCells * cellSize, haloCells * cellSize);
+	Tuple3i tilesSize;
+	for (unsigned char d = 0; d < 3; ++d)
+	{
+		tilesSize.u[d] = std::max(1, static_cast<int>(ceil(compDiag.u[d] / cellSize)));
+	}
+	Tuple3i gridSize(tilesSize.x + 2 * haloCells, tilesSize.y + 2 * haloCells, tilesSize.z + 2 * haloCells);
+
+	C2CTilingGrid compGrid, refGrid;
+	C2CCellBuckets compBuckets(comparedCloud), refBuckets(referenceCloud);
+	if (	!compGrid.init(gridSize) || !refGrid.init(gridSize)
+		||	!compBuckets.init(gridSize) || !refBuckets.init(gridSize))
+	{
+		//not enough memory
+		return -1;
+	}
+
+	//points histograms
+	for (unsigned i = 0; i < compCount; )
+	{
+		unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+		const CCVector3* P = compPoints->getPointsBlock(i, blockSize);
+		for (unsigned j = 0; j < blockSize; ++j, ++P)
+		{
+			Tuple3i cellPos = GetC2CTileCellPos(*P, gridMin, cellSize, haloCells, tilesSize);
+			compGrid.add(cellPos);
+			compBuckets.count(cellPos);
+		}
+		i += blockSize;
+	}
+	unsigned refCount = referenceCloud->size();
+	for (unsigned i = 0; i < refCount; )
+	{
+		unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+		const CCVector3* P = referenceCloud->getPointsBlock(i, blockSize);
+		for (unsigned j = 0; j < blockSize; ++j, ++P)
+		{
+			Tuple3i cellPos;
+			if (GetC2CGridCellPos(*P, gridMin, cellSize, gridSize, cellPos))
+			{
+				refGrid.add(cellPos);
+				refBuckets.count(cellPos);
+			}
+		}
+		i += blockSize;
+	}
+	compGrid.integrate();
+	refGrid.integrate();
+
+	//we sort the points by cell once (instead of scanning the clouds again for each tile)
+	if (!compBuckets.allocate() || !refBuckets.allocate())
+	{
+		//not enough memory
+		return -1;
+	}
+	for (unsigned i = 0; i < compCount; )
+	{
+		unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+		const CCVector3* P = compPoints->getPointsBlock(i, blockSize);
+		for (unsigned j = 0; j < blockSize; ++j, ++P)
+		{
+			compBuckets.place(GetC2CTileCellPos(*P, gridMin, cellSize, haloCells, tilesSize), compSubset ? compSubset->getPointGlobalIndex(i + j) : i + j);
+		}
+		i += blockSize;
+	}
+	for (unsigned i = 0; i < refCount; )
+	{
+		unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+		const CCVector3* P = referenceCloud->getPointsBlock(i, blockSize);
+		for (unsigned j = 0; j < blockSize; ++j, ++P)
+		{
+			Tuple3i cellPos;
+			if (GetC2CGridCellPos(*P, gridMin, cellSize, gridSize, cellPos))
+			{
+				refBuckets.place(cellPos, i + j);
+			}
+		}
+		i += blockSize;
+	}
+	compBuckets.finalize();
+	refBuckets.finalize();
+
+	//we recursively split the tiles bounding-box until each tile fits in the memory budget
+	Tuple3i haloShift(haloCells, haloCells, haloCells);
+	std::vector<C2CTile> tiles;
+	try
+	{
+		std::vector<C2CTile> toSplit;
+		toSplit.push_back(C2CTile(haloShift, haloShift + tilesSize));
+
+		while (!toSplit.empty())
+		{
+			C2CTile tile = toSplit.back();
+			toSplit.pop_back();
+
+			unsigned tileCompCount = compGrid.count(tile.minPos, tile.maxPos);
+			if (tileCompCount == 0)
+			{
+				continue;
+			}
+			unsigned tileRefCount = refGrid.count(tile.minPos - haloShift, tile.maxPos + haloShift);
+
+			//largest dimension
+			unsigned char dim = 0;
+			for (unsigned char d = 1; d < 3; ++d)
+			{
+				if (tile.maxPos.u[d] - tile.minPos.u[d] > tile.maxPos.u[dim] - tile.minPos.u[dim])
+					dim = d;
+			}
+
+			if (	static_cast<double>(tileCompCount) + tileRefCount <= maxTilePointCount
+				||	tile.maxPos.u[dim] - tile.minPos.u[dim] < 2)
+			{
+				tiles.push_back(tile);
+				continue;
+			}
+
+			//we look for the position that splits the compared points in two halves
+			C2CTile subTiles[2] = { tile, tile };
+			int splitPos = tile.minPos.u[dim] + 1;
+			for (; splitPos < tile.maxPos.u[dim] - 1; ++splitPos)
+			{
+				C2CTile firstHalf = tile;
+				firstHalf.maxPos.u[dim] = splitPos;
+				if (2 * compGrid.count(firstHalf.minPos, firstHalf.maxPos) >= tileCompCount)
+					break;
+			}
+			subTiles[0].maxPos.u[dim] = splitPos;
+			subTiles[1].minPos.u[dim] = splitPos;
+			toSplit.push_back(subTiles[1]);
+			toSplit.push_back(subTiles[0]);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return -1;
+	}
+
+	//process each tile
+	int result = 0;
+	for (size_t t = 0; t < tiles.size() && result == 0; ++t)
+	{
+		const C2CTile& tile = tiles[t];
+
+		//compared points in the tile and reference points in the tile region (tile + halo)
+		ReferenceCloud compTile(comparedCloud), refTile(referenceCloud);
+		if (	!compTile.reserve(compGrid.count(tile.minPos, tile.maxPos))
+			||	!refTile.reserve(refGrid.count(tile.minPos - haloShift, tile.maxPos + haloShift))
+			||	!compBuckets.getPoints(tile.minPos, tile.maxPos, compTile)
+			||	!refBuckets.getPoints(tile.minPos - haloShift, tile.maxPos + haloShift, refTile))
+		{
+			//not enough memory
+			result = -1;
+			break;
+		}
+
+		try
+		{
+			result = ComputeC2CTileDistances(compTile, refTile, params, computeSplitDistances, halo, farPoints, progressCb);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory
+			result = -1;
+		}
+	}
+
+	return result;
+}
+
+int DistanceComputationTools::computeCloud2CloudDistanceTiled(	GenericIndexedCloudPersist* comparedCloud,
+																GenericIndexedCloudPersist* referenceCloud,
+																Cloud2CloudDistanceComputationParams& params,
+																unsigned memoryBudget,
+																GenericProgressCallback* progressCb/*=0*/)
+{
+	assert(comparedCloud && referenceCloud);
+
+	if (params.CPSet && params.maxSearchDist > 0)
+	{
+		//we can't use a 'max search distance' criterion if the "Closest Point Set" is requested
+		assert(false);
+		return -666;
+	}
+
+	if (	params.localModel != NO_MODEL
+		&&	(!params.useSphericalSearchForLocalModel || params.reuseExistingLocalModels))
+	{
+		//the result would depend on the tiles
+		return -3;
+	}
+
+	unsigned compCount = comparedCloud->size();
+	if (compCount == 0 || referenceCloud->size() == 0)
+	{
+		return -1;
+	}
+
+	if (!comparedCloud->enableScalarField())
+	{
+		//not enough memory
+		return -1;
+	}
+
+	if (params.CPSet && !params.CPSet->resize(compCount))
 	{
-		params.octreeLevel = comparedOctree->findBestLevelForComparisonWithOctree(referenceOctree);
+		//not enough memory
+		return -1;
 	}
 
-	//whether to compute split distances or not
 	bool computeSplitDistances = false;
+	for (unsigned char d = 0; d < 3; ++d)
 	{
-		for (int i = 0; i < 3; ++i)
+		if (params.splitDistances[d] && params.splitDistances[d]->currentSize() == compCount)
 		{
-			if (params.splitDistances[i] && params.splitDistances[i]->currentSize() == comparedCloud->size())
-			{
-				computeSplitDistances = true;
-				params.splitDistances[i]->fill(NAN_VALUE);
-			}
+			computeSplitDistances = true;
+			params.splitDistances[d]->fill(NAN_VALUE);
 		}
 	}
 
-	//additional parameters
-	void* additionalParameters[] = {	reinterpret_cast<void*>(referenceCloud),
-										reinterpret_cast<void*>(referenceOctree),
-										reinterpret_cast<void*>(&params),
-										reinterpret_cast<void*>(&maxSearchSquareDistd),
-										reinterpret_cast<void*>(&computeSplitDistances)
-	};
+	bool boundedSearch = (params.maxSearchDist > 0);
 
-	int result = 0;
+	//max number of (compared + reference) points per tile
+	size_t bytesPerPoint = sizeof(unsigned) + 2 * sizeof(DgmOctree::IndexAndCode); //indexes + octree (and sort buffer)
+	if (params.CPSet || !boundedSearch)
+		bytesPerPoint += sizeof(unsigned);
+	if (computeSplitDistances)
+		bytesPerPoint += 3 * sizeof(ScalarType);
+	double maxTilePointCount = static_cast<double>(memoryBudget) * (1 << 20) / bytesPerPoint;
 
-	if (comparedOctree->executeFunctionForAllCellsAtLevel(	params.octreeLevel,
-															params.localModel == NO_MODEL ? computeCellHausdorffDistance : computeCellHausdorffDistanceWithLocalModel,
-															additionalParameters,
-															params.multiThread,
-															progressCb,
-															"Cloud-Cloud Distance",
-															params.maxThreadCount) == 0)
-	{
-		//something went wrong
-		result = -2;
-	}
+	//first pass: all the compared points
+	double halo = boundedSearch ? static_cast<double>(params.maxSearchDist) : 0;
+	ReferenceCloud farPointsA(comparedCloud), farPointsB(comparedCloud);
+	ReferenceCloud* farPoints = &farPointsA;
+	int result = ComputeC2CTiledDistances(	comparedCloud, 0, referenceCloud, params, computeSplitDistances,
+											halo, maxTilePointCount, boundedSearch ? 0 : farPoints, progressCb);
 
-	if (comparedOctree && !compOctree)
-	{
-		delete comparedOctree;
-		comparedOctree = 0;
-	}
-	if (referenceOctree && !refOctree)
+	//without max search distance, the points whose nearest neighbour may lie farther than the halo
+	//are processed again (with the same tiling process) with a twice bigger halo, and so on
+	ReferenceCloud* nextFarPoints = &farPointsB;
+	while (result == 0 && farPoints->size() != 0)
 	{
-		delete referenceOctree;
-		referenceOctree = 0;
+		halo *= 2;
+		nextFarPoints->clear(false);
+		result = ComputeC2CTiledDistances(	comparedCloud, farPoints, referenceCloud, params, computeSplitDistances,
+											halo, maxTilePointCount, nextFarPoints, progressCb);
+		std::swap(farPoints, nextFarPoints);
 	}
 
 	return result;
@@ -494,6 +1218,8 @@ bool DistanceComputationTools::computeCellHausdorffDistance(const DgmOctree::oct
 // [1] -> (Octree*): reference cloud octree
 // [2] -> (Cloud2CloudDistanceComputationParams*): parameters
 // [3] -> (ScalarType*): max search distance (squared)
+// [4] -> (bool*): whether to compute split distances
+// [5] -> (Cloud2CloudReferenceContext*): reference context (local models cache - may be 0)
 bool DistanceComputationTools::computeCellHausdorffDistanceWithLocalModel(	const DgmOctree::octreeCell& cell,
 																			void** additionalParameters,
 																			NormalizedProgress* nProgress/*=0*/)
@@ -504,6 +1230,7 @@ bool DistanceComputationTools::computeCellHausdorffDistanceWithLocalModel(	const
 	Cloud2CloudDistanceComputationParams* params	= reinterpret_cast<Cloud2CloudDistanceComputationParams*>(additionalParameters[2]);
 	const double* maxSearchSquareDistd				= reinterpret_cast<double*>(additionalParameters[3]);
 	bool computeSplitDistances						= *reinterpret_cast<bool*>(additionalParameters[4]);
+	Cloud2CloudReferenceContext* context			= reinterpret_cast<Cloud2CloudReferenceContext*>(additionalParameters[5]);
 
 	assert(params && params->localModel != NO_MODEL);
 
@@ -532,6 +1259,7 @@ bool DistanceComputationTools::computeCellHausdorffDistanceWithLocalModel(	const
 	}
 
 	//already computed models
+	//(if a reference context is used, the models belong to it and they are not deleted here)
 	std::vector<const LocalModel*> models;
 
 	//for each point of the current cell (compared octree) we look for its nearest neighbour in the reference cloud
@@ -558,7 +1286,13 @@ bool DistanceComputationTools::computeCellHausdorffDistanceWithLocalModel(	const
 				//local model for the 'nearest point'
 				const LocalModel* lm = 0;
 
-				if (params->reuseExistingLocalModels)
+				if (context)
+				{
+					//we look if a model has already been computed around this point
+					lm = context->getLocalModel(nNSS.theNearestPointIndex);
+				}
+
+				if (!lm && params->reuseExistingLocalModels)
 				{
 					//we look if the nearest point is close to existing models
 					for (std::vector<const LocalModel*>::const_iterator it = models.begin(); it!=models.end(); ++it)
@@ -624,6 +1358,11 @@ bool DistanceComputationTools::computeCellHausdorffDistanceWithLocalModel(	const
 						if (maxSquareDist > 0) //DGM: it happens with duplicate points :(
 						{
 							lm = LocalModel::New(params->localModel, Z, nearestPoint, static_cast<PointCoordinateType>(maxSquareDist));
+							if (lm && context)
+							{
+								//the context takes the ownership of the model
+								lm = context->setLocalModel(nNSS.theNearestPointIndex, lm);
+							}
 							if (lm && params->reuseExistingLocalModels)
 							{
 								//we add the model to the 'existing models' list
@@ -636,7 +1375,8 @@ bool DistanceComputationTools::computeCellHausdorffDistanceWithLocalModel(	const
 									//not enough memory!
 									while (!models.empty())
 									{
-										delete models.back();
+										if (!context)
+											delete models.back();
 										models.pop_back();
 									}
 									return false;
@@ -666,7 +1406,7 @@ bool DistanceComputationTools::computeCellHausdorffDistanceWithLocalModel(	const
 						nearestPoint = nearestModelPoint;
 					}
 
-					if (!params->reuseExistingLocalModels)
+					if (!params->reuseExistingLocalModels && !context)
 					{
 						//we don't need the local model anymore!
 						delete lm;
@@ -711,7 +1451,8 @@ bool DistanceComputationTools::computeCellHausdorffDistanceWithLocalModel(	const
 	//clear all models for this cell
 	while (!models.empty())
 	{
-		delete models.back();
+		if (!context)
+			delete models.back();
 		models.pop_back();
 	}
 
@@ -978,6 +1719,49 @@ int DistanceComputationTools::intersectMeshWithOctree(	OctreeAndMeshIntersection
 	return result;
 }
 
+//! Saves the closest point of a compared point (Closest Point Set and/or split distances)
+static inline void SaveClosestPoint(const CCLib::DistanceComputationTools::Cloud2MeshDistanceComputationParams& params,
+									unsigned pointIndex,
+									const CCVector3& P,
+									const CCVector3& nearestPoint)
+{
+	if (params.CPSet)
+	{
+		*const_cast<CCVector3*>(params.CPSet->getPoint(pointIndex)) = nearestPoint;
+	}
+	for (unsigned char d = 0; d < 3; ++d)
+	{
+		if (params.splitDistances[d])
+		{
+			params.splitDistances[d]->setValue(pointIndex, static_cast<ScalarType>(P.u[d] - nearestPoint.u[d]));
+		}
+	}
+}
+
+//! Initializes the Closest Point Set
+/** If a max search distance is defined, the points farther than this distance
+	won't be updated: they are initialized with the compared points themselves.
+**/
+static bool InitClosestPointSet(const CCLib::DistanceComputationTools::Cloud2MeshDistanceComputationParams& params, GenericIndexedCloudPersist* cloud)
+{
+	assert(params.CPSet && cloud);
+	if (!params.CPSet->resize(cloud->size()))
+	{
+		//not enough memory
+		return false;
+	}
+
+	if (params.maxSearchDist > 0)
+	{
+		for (unsigned i = 0; i < cloud->size(); ++i)
+		{
+			*const_cast<CCVector3*>(params.CPSet->getPoint(i)) = *cloud->getPoint(i);
+		}
+	}
+
+	return true;
+}
+
 //! Method used by computeCloud2MeshDistanceWithOctree
 void ComparePointsAndTriangles(	ReferenceCloud& Yk,
 								unsigned& remainingPoints,
@@ -995,7 +1779,8 @@ void ComparePointsAndTriangles(	ReferenceCloud& Yk,
 	bool firstComparisonDone = (trianglesToTestCount != 0);
 
 	CCVector3 nearestPoint;
-	CCVector3* _nearestPoint = params.CPSet ? &nearestPoint : 0;
+	bool saveNearestPoint = (params.CPSet || params.splitDistances[0] || params.splitDistances[1] || params.splitDistances[2]);
+	CCVector3* _nearestPoint = saveNearestPoint ? &nearestPoint : 0;
 
 	//for each triangle
 	while (trianglesToTestCount != 0)
@@ -1017,11 +1802,10 @@ void ComparePointsAndTriangles(	ReferenceCloud& Yk,
 				if (!ScalarField::ValidValue(min_d) || min_d*min_d > dPTri*dPTri)
 				{
 					Yk.setPointScalarValue(j, params.flipNormals ? -dPTri : dPTri);
-					if (params.CPSet)
+					if (saveNearestPoint)
 					{
-						//Closest Point Set: save the nearest point as well
-						assert(_nearestPoint);
-						*const_cast<CCVector3*>(params.CPSet->getPoint(Yk.getPointGlobalIndex(j))) = *_nearestPoint;
+						//Closest Point Set / split distances: save the nearest point as well
+						SaveClosestPoint(params, Yk.getPointGlobalIndex(j), *Yk.getPoint(j), nearestPoint);
 					}
 				}
 			}
@@ -1037,11 +1821,10 @@ void ComparePointsAndTriangles(	ReferenceCloud& Yk,
 				if (!ScalarField::ValidValue(min_d) || dPTri < min_d)
 				{
 					Yk.setPointScalarValue(j, dPTri);
-					if (params.CPSet)
+					if (saveNearestPoint)
 					{
-						//Closest Point Set: save the nearest point as well
-						assert(_nearestPoint);
-						*const_cast<CCVector3*>(params.CPSet->getPoint(Yk.getPointGlobalIndex(j))) = *_nearestPoint;
+						//Closest Point Set / split distances: save the nearest point as well
+						SaveClosestPoint(params, Yk.getPointGlobalIndex(j), *Yk.getPoint(j), nearestPoint);
 					}
 				}
 			}
@@ -1191,7 +1974,10 @@ void cloudMeshDistCellFunc_MT(const DgmOctree::IndexAndCode& desc)
 	size_t trianglesToTestCapacity = 0;
 
 	//bit mask for efficient comparisons
+	//(the bit masks are always released 'clean': we only reset the bits we have set, instead
+	//of the whole mask, as only a few triangles are tested when the search distance is bounded)
 	QBitArray* bitArray = 0;
+	std::vector<unsigned> markedTriangles;
 	if (s_useBitArrays_MT)
 	{
 		s_currentBitMaskMutex.lock();
@@ -1207,7 +1993,6 @@ void cloudMeshDistCellFunc_MT(const DgmOctree::IndexAndCode& desc)
 			s_bitArrayPool_MT.pop_back();
 		}
 		s_currentBitMaskMutex.unlock();
-		bitArray->fill(0);
 	}
 
 	//for each point, we pre-compute its distance to the nearest cell border
@@ -1272,6 +2057,7 @@ void cloudMeshDistCellFunc_MT(const DgmOctree::IndexAndCode& desc)
 									{
 										trianglesToTest[trianglesToTestCount++] = indexTri;
 										bitArray->setBit(indexTri);
+										markedTriangles.push_back(indexTri);
 									}
 								}
 								else
@@ -1307,6 +2093,7 @@ void cloudMeshDistCellFunc_MT(const DgmOctree::IndexAndCode& desc)
 									{
 										trianglesToTest[trianglesToTestCount++] = indexTri;
 										bitArray->setBit(indexTri);
+										markedTriangles.push_back(indexTri);
 									}
 								}
 								else
@@ -1340,6 +2127,7 @@ void cloudMeshDistCellFunc_MT(const DgmOctree::IndexAndCode& desc)
 									{
 										trianglesToTest[trianglesToTestCount++] = indexTri;
 										bitArray->setBit(indexTri);
+										markedTriangles.push_back(indexTri);
 									}
 								}
 								else
@@ -1359,6 +2147,10 @@ void cloudMeshDistCellFunc_MT(const DgmOctree::IndexAndCode& desc)
 	//release bit mask
 	if (bitArray)
 	{
+		for (size_t i = 0; i < markedTriangles.size(); ++i)
+		{
+			bitArray->clearBit(markedTriangles[i]);
+		}
 		s_currentBitMaskMutex.lock();
 		s_bitArrayPool_MT.push_back(bitArray);
 		s_currentBitMaskMutex.unlock();
@@ -1373,7 +2165,6 @@ int DistanceComputationTools::computeCloud2MeshDistanceWithOctree(	OctreeAndMesh
 {
 	assert(intersection);
 	assert(!params.signedDistances || !intersection->distanceTransform); //signed distances are not compatible with Distance Transform acceleration
-	assert(!params.multiThread || params.maxSearchDist <= 0); //maxSearchDist is not compatible with parallel processing
 
 	DgmOctree* octree = intersection->octree;
 	if (!octree)
@@ -1386,11 +2177,10 @@ int DistanceComputationTools::computeCloud2MeshDistanceWithOctree(	OctreeAndMesh
 	//Closest Point Set
 	if (params.CPSet)
 	{
-		assert(params.maxSearchDist <= 0);
 		assert(params.useDistanceMap == false);
 
 		//reserve memory for the Closest Point Set
-		if (!params.CPSet->resize(octree->associatedCloud()->size()))
+		if (!InitClosestPointSet(params, octree->associatedCloud()))
 		{
 			//not enough memory
 			return -1;
@@ -1731,7 +2521,7 @@ int DistanceComputationTools::computeCloud2MeshDistanceWithOctree(	OctreeAndMesh
 				char buffer[256];
 				sprintf(buffer, "Cells: %u", numberOfCells);
 				progressCb->setInfo(buffer);
-				progressCb->setMethodTitle("Compute signed distances");
+				progressCb->setMethodTitle(params.signedDistances ? "Compute signed distances" : "Compute distances");
 			}
 			progressCb->update(0);
 			progressCb->start();
@@ -1800,9 +2590,49 @@ int DistanceComputationTools::computeCloud2MeshDistance(	GenericIndexedCloudPers
 	}
 	if (params.CPSet)
 	{
-		//Closest Point Set determination is incompatible with distance map approximation and max search distance
+		//Closest Point Set determination is incompatible with distance map approximation
+		params.useDistanceMap = false;
+	}
+	for (unsigned char d = 0; d < 3; ++d)
+	{
+		if (params.splitDistances[d])
+		{
+			if (params.splitDistances[d]->currentSize() != pointCloud->size())
+			{
+				//invalid split distances scalar field (ignored)
+				params.splitDistances[d] = 0;
+				continue;
+			}
+			params.splitDistances[d]->fill(NAN_VALUE);
+			//split distances are incompatible with distance map approximation
+			params.useDistanceMap = false;
+		}
+	}
+
+	if (params.useBVH)
+	{
+		//the distances can't be approximated with a BVH
 		params.useDistanceMap = false;
-		params.maxSearchDist = 0;
+
+		//we reuse the input BVH if it corresponds to the mesh
+		MeshBVH tempBVH;
+		const MeshBVH* bvh = params.bvh;
+		if (!bvh || bvh->associatedMesh() != mesh || bvh->size() != mesh->size())
+		{
+			if (!tempBVH.build(mesh, progressCb))
+			{
+				//not enough memory
+				return -4;
+			}
+			bvh = &tempBVH;
+		}
+
+		if (computeCloud2MeshDistanceWithBVH(pointCloud, *bvh, params, progressCb) < 0)
+		{
+			return -7;
+		}
+
+		return 0;
 	}
 
 	//compute the (cubical) bounding box that contains both the cloud and the mehs BBs
@@ -1931,6 +2761,189 @@ int DistanceComputationTools::computeCloud2MeshDistance(	GenericIndexedCloudPers
 	return 0;
 }
 
+//! Computes the distances between a range of points and a mesh (with a BVH)
+static void ComputePointsToMeshDistanceWithBVH(	GenericIndexedCloudPersist* cloud,
+												const MeshBVH& bvh,
+												const DistanceComputationTools::Cloud2MeshDistanceComputationParams& params,
+												unsigned firstPoint,
+												unsigned count)
+{
+	//internally we use the square of maxSearchDist
+	ScalarType maxSquareDist = (params.maxSearchDist > 0 ? params.maxSearchDist * params.maxSearchDist : -1);
+
+	CCVector3 nearestPoint;
+	bool saveNearestPoint = (params.CPSet || params.splitDistances[0] || params.splitDistances[1] || params.splitDistances[2]);
+	CCVector3* _nearestPoint = saveNearestPoint ? &nearestPoint : 0;
+
+	for (unsigned i = firstPoint; i < firstPoint + count; ++i)
+	{
+		const CCVector3* P = cloud->getPoint(i);
+
+		unsigned triangleIndex = 0;
+		ScalarType squareDist = 0;
+		const GenericTriangle* tri = 0;
+		ScalarType dist = NAN_VALUE;
+		if (bvh.findClosestTriangle(*P, maxSquareDist, triangleIndex, squareDist, &tri))
+		{
+			if (params.signedDistances)
+			{
+				//robust sign (see MeshBVH::computeSignedDistance)
+				dist = bvh.computeSignedDistance(*P, triangleIndex, _nearestPoint);
+				if (params.flipNormals)
+					dist = -dist;
+			}
+			else
+			{
+				dist = sqrt(squareDist);
+				if (_nearestPoint)
+				{
+					DistanceComputationTools::computePoint2TriangleDistance(P, tri, false, _nearestPoint);
+				}
+			}
+
+			if (saveNearestPoint)
+			{
+				//Closest Point Set / split distances: save the nearest point as well
+				SaveClosestPoint(params, i, *P, nearestPoint);
+			}
+		}
+		else if (maxSquareDist >= 0)
+		{
+			//no triangle below 'maxSearchDist'
+			dist = params.maxSearchDist;
+		}
+
+		cloud->setPointScalarValue(i, dist);
+	}
+}
+
+//! Number of points processed at once by the BVH-based cloud-to-mesh distances computation
+static const unsigned BVH_POINTS_CHUNK_SIZE = 1024;
+
+#ifdef ENABLE_CLOUD2MESH_DIST_MT
+
+/*** MULTI THREADING WRAPPER (BVH) ***/
+
+static GenericIndexedCloudPersist* s_bvhCloud_MT = 0;
+static const MeshBVH* s_bvh_MT = 0;
+
+void cloudMeshDistBVHFunc_MT(const unsigned& firstPoint)
+{
+	if (!s_cellFunc_MT_success)
+	{
+		//skip this chunk if the process is aborted / has failed
+		return;
+	}
+
+	if (s_normProgressCb_MT && !s_normProgressCb_MT->oneStep())
+	{
+		s_cellFunc_MT_success = false;
+		return;
+	}
+
+	unsigned count = std::min(BVH_POINTS_CHUNK_SIZE, s_bvhCloud_MT->size() - firstPoint);
+	ComputePointsToMeshDistanceWithBVH(s_bvhCloud_MT, *s_bvh_MT, s_params_MT, firstPoint, count);
+}
+
+#endif
+
+int DistanceComputationTools::computeCloud2MeshDistanceWithBVH(	GenericIndexedCloudPersist* pointCloud,
+																const MeshBVH& bvh,
+																Cloud2MeshDistanceComputationParams& params,
+																GenericProgressCallback* progressCb/*=0*/)
+{
+	assert(pointCloud);
+	unsigned pointCount = pointCloud->size();
+
+	//Closest Point Set
+	if (params.CPSet)
+	{
+		//reserve memory for the Closest Point Set
+		if (!InitClosestPointSet(params, pointCloud))
+		{
+			//not enough memory
+			return -1;
+		}
+	}
+
+	//reset the output distances
+	if (!pointCloud->enableScalarField())
+	{
+		//not enough memory
+		return -1;
+	}
+
+	//the points are processed by chunks
+	std::vector<unsigned> chunks;
+	try
+	{
+		chunks.reserve((pointCount + BVH_POINTS_CHUNK_SIZE - 1) / BVH_POINTS_CHUNK_SIZE);
+		for (unsigned i = 0; i < pointCount; i += BVH_POINTS_CHUNK_SIZE)
+		{
+			chunks.push_back(i);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return -1;
+	}
+	unsigned chunkCount = static_cast<unsigned>(chunks.size());
+
+	//Progress callback
+	NormalizedProgress nProgress(progressCb, chunkCount);
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			char buffer[256];
+			sprintf(buffer, "Points: %u\nTriangles: %u", pointCount, bvh.size());
+			progressCb->setInfo(buffer);
+			progressCb->setMethodTitle(params.signedDistances ? "Compute signed distances" : "Compute distances");
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+
+#ifdef ENABLE_CLOUD2MESH_DIST_MT
+	if (params.multiThread)
+	{
+		s_bvhCloud_MT = pointCloud;
+		s_bvh_MT = &bvh;
+		s_params_MT = params;
+		s_normProgressCb_MT = &nProgress;
+		s_cellFunc_MT_success = true;
+
+		int maxThreadCount = params.maxThreadCount;
+		if (maxThreadCount == 0)
+		{
+			maxThreadCount = QThread::idealThreadCount();
+		}
+		QThreadPool::globalInstance()->setMaxThreadCount(maxThreadCount);
+		QtConcurrent::blockingMap(chunks, cloudMeshDistBVHFunc_MT);
+
+		s_bvhCloud_MT = 0;
+		s_bvh_MT = 0;
+		s_normProgressCb_MT = 0;
+
+		return (s_cellFunc_MT_success ? 0 : -2);
+	}
+#endif
+
+	for (unsigned i = 0; i < chunkCount; ++i)
+	{
+		ComputePointsToMeshDistanceWithBVH(pointCloud, bvh, params, chunks[i], std::min(BVH_POINTS_CHUNK_SIZE, pointCount - chunks[i]));
+
+		if (progressCb && !nProgress.oneStep())
+		{
+			//process cancelled by the user
+			return -2;
+		}
+	}
+
+	return 0;
+}
+
 // Inspired from documents and code by:
 // David Eberly
 // Geometric Tools, LLC
@@ -2315,14 +3328,47 @@ ScalarType DistanceComputationTools::ComputeCloud2PlaneDistance(CCLib::GenericCl
 }
 
 bool DistanceComputationTools::computeGeodesicDistances(GenericIndexedCloudPersist* cloud, unsigned seedPointIndex, unsigned char octreeLevel, GenericProgressCallback* progressCb)
+{
+	std::vector<unsigned> seedPointIndexes;
+	try
+	{
+		seedPointIndexes.push_back(seedPointIndex);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	return computeGeodesicDistances(cloud, seedPointIndexes, octreeLevel, 0, progressCb);
+}
+
+//! Minimum number of octree cells to use the (multi-threaded) block-based Fast Sweeping
+static const unsigned GEODESIC_SWEEPING_MIN_CELL_COUNT = 65536;
+
+bool DistanceComputationTools::computeGeodesicDistances(GenericIndexedCloudPersist* cloud,
+														const std::vector<unsigned>& seedPointIndexes,
+														unsigned char octreeLevel,
+														ScalarField* seedLabels/*=0*/,
+														GenericProgressCallback* progressCb/*=0*/)
 {
 	assert(cloud);
 
 	unsigned n = cloud->size();
-	if (n == 0 || seedPointIndex >= n)
+	if (n == 0 || seedPointIndexes.empty())
 		return false;
+	for (size_t i = 0; i < seedPointIndexes.size(); ++i)
+		if (seedPointIndexes[i] >= n)
+			return false;
+
+	if (seedLabels)
+	{
+		if (!seedLabels->resize(n))
+			return false;
+		seedLabels->fill(NAN_VALUE);
+	}
 
-	cloud->enableScalarField();
+	if (!cloud->enableScalarField())
+		return false;
 	cloud->forEach(ScalarFieldTools::SetScalarValueToNaN);
 
 	DgmOctree* octree = new DgmOctree(cloud);
@@ -2332,21 +3378,26 @@ bool DistanceComputationTools::computeGeodesicDistances(GenericIndexedCloudPersi
 		return false;
 	}
 
-	FastMarchingForPropagation fm;
-	if (fm.init(cloud,octree,octreeLevel,true) < 0)
+	FastMarchingForGeodesicDistances fm;
+	if (fm.init(cloud, octree, octreeLevel) < 0)
 	{
 		delete octree;
 		return false;
 	}
+	fm.setExtendedConnectivity(true);
+	fm.setBlockSweeping(octree->getCellNumber(octreeLevel) >= GEODESIC_SWEEPING_MIN_CELL_COUNT);
 
-	//on cherche la cellule de l'octree qui englobe le "seedPoint"
-	Tuple3i cellPos;
-	octree->getTheCellPosWhichIncludesThePoint(cloud->getPoint(seedPointIndex), cellPos, octreeLevel);
-	fm.setSeedCell(cellPos);
+	//we look for the octree cells that include the seed points
+	for (size_t i = 0; i < seedPointIndexes.size(); ++i)
+	{
+		Tuple3i cellPos;
+		octree->getTheCellPosWhichIncludesThePoint(cloud->getPoint(seedPointIndexes[i]), cellPos, octreeLevel);
+		fm.setSeedCell(cellPos, static_cast<unsigned>(i));
+	}
 
 	bool result = false;
 	if (fm.propagate() >= 0)
-		result = fm.setPropagationTimingsAsDistances();
+		result = fm.setPropagationTimingsAsDistances(seedLabels);
 
 	delete octree;
 	octree = 0;
@@ -2394,17 +3445,45 @@ int DistanceComputationTools::computeApproxCloud2CloudDistance(	GenericIndexedCl
 																PointCoordinateType maxSearchDist/*=-PC_ONE*/,
 																GenericProgressCallback* progressCb/*=0*/,
 																DgmOctree* compOctree/*=0*/,
-																DgmOctree* refOctree/*=0*/)
+																DgmOctree* refOctree/*=0*/,
+																Cloud2CloudReferenceContext* referenceContext/*=0*/)
 {
 	if (!comparedCloud || !referenceCloud)
 		return -1;
 	if (octreeLevel < 1 || octreeLevel > DgmOctree::MAX_OCTREE_LEVEL)
 		return -2;
 
+	if (referenceContext && referenceContext->referenceCloud() != referenceCloud)
+	{
+		//the context doesn't correspond to the reference cloud
+		assert(false);
+		referenceContext = 0;
+	}
+
 	//compute octrees with the same bounding-box
 	DgmOctree *octreeA = compOctree, *octreeB = refOctree;
-	if (synchronizeOctrees(comparedCloud, referenceCloud, octreeA, octreeB, maxSearchDist, progressCb) != SYNCHRONIZED)
+	if (referenceContext)
+	{
+		//the reference octree is the context one (see computeCloud2CloudDistance)
+		if (!referenceContext->prepare(comparedCloud, progressCb))
+			return -3;
+		octreeB = referenceContext->octree();
+
+		if (!octreeA)
+			octreeA = new DgmOctree(comparedCloud);
+		if (!referenceContext->synchronize(*octreeA, progressCb))
+		{
+			if (!compOctree)
+				delete octreeA;
+			return -3;
+		}
+	}
+	else if (synchronizeOctrees(comparedCloud, referenceCloud, octreeA, octreeB, maxSearchDist, progressCb) != SYNCHRONIZED)
+	{
 		return -3;
+	}
+	//the context octree belongs to the context
+	const bool deleteOctreeB = (!refOctree && !referenceContext);
 
 	const int* minIndexesA = octreeA->getMinFillIndexes(octreeLevel);
 	const int* maxIndexesA = octreeA->getMaxFillIndexes(octreeLevel);
@@ -2417,6 +3496,18 @@ int DistanceComputationTools::computeApproxCloud2CloudDistance(	GenericIndexedCl
 	Tuple3i maxIndexes(	std::max(maxIndexesA[0],maxIndexesB[0]),
 						std::max(maxIndexesA[1],maxIndexesB[1]),
 						std::max(maxIndexesA[2],maxIndexesB[2]) );
+
+	if (maxSearchDist > 0)
+	{
+		//the reference cells farther than 'maxSearchDist' from the compared cells bounding-box
+		//can't change the distances below 'maxSearchDist': the grid only has to cover this box + margin
+		int margin = static_cast<int>(ceil(maxSearchDist / octreeA->getCellSize(octreeLevel))) + 1;
+		for (unsigned char k = 0; k < 3; ++k)
+		{
+			minIndexes.u[k] = std::max(minIndexes.u[k], minIndexesA[k] - margin);
+			maxIndexes.u[k] = std::min(maxIndexes.u[k], maxIndexesA[k] + margin);
+		}
+	}
 	
 	Tuple3ui boxSize(	static_cast<unsigned>(maxIndexes.x - minIndexes.x + 1),
 						static_cast<unsigned>(maxIndexes.y - minIndexes.y + 1),
@@ -2455,13 +3546,28 @@ int DistanceComputationTools::computeApproxCloud2CloudDistance(	GenericIndexedCl
 				theCodes.pop_back();
 				Tuple3i cellPos;
 				octreeB->getCellPos(theCode, octreeLevel, cellPos, true);
+				if (	cellPos.x < minIndexes.x || cellPos.x > maxIndexes.x
+					||	cellPos.y < minIndexes.y || cellPos.y > maxIndexes.y
+					||	cellPos.z < minIndexes.z || cellPos.z > maxIndexes.z)
+				{
+					//out of the grid (see 'maxSearchDist' above)
+					continue;
+				}
 				cellPos -= minIndexes;
 				dtGrid.setValue(cellPos, 1);
 			}
 		}
 
 		//propagate the Distance Transform over the grid
-		dtGrid.propagateDistance(progressCb);
+		if (!dtGrid.propagateDistance(progressCb))
+		{
+			//not enough memory or process cancelled by user
+			if (!compOctree)
+				delete octreeA;
+			if (deleteOctreeB)
+				delete octreeB;
+			return -5;
+		}
 
 		//eventually get the approx. distance for each cell of octree A
 		//and assign it to the points inside
@@ -2473,7 +3579,7 @@ int DistanceComputationTools::computeApproxCloud2CloudDistance(	GenericIndexedCl
 			//not enough memory
 			if (!compOctree)
 				delete octreeA;
-			if (!refOctree)
+			if (deleteOctreeB)
 				delete octreeB;
 			return -5;
 		}
@@ -2491,6 +3597,11 @@ int DistanceComputationTools::computeApproxCloud2CloudDistance(	GenericIndexedCl
 			cellPos -= minIndexes;
 			unsigned di = dtGrid.getValue(cellPos);
 			ScalarType d = sqrt(static_cast<ScalarType>(di)) * cellSize;
+			if (maxSearchDist > 0 && d > maxSearchDist)
+			{
+				//the reference cells out of the grid are ignored
+				d = static_cast<ScalarType>(maxSearchDist);
+			}
 			if (d > maxD)
 				maxD = d;
 			
@@ -2515,7 +3626,7 @@ int DistanceComputationTools::computeApproxCloud2CloudDistance(	GenericIndexedCl
 		delete octreeA;
 		octreeA = 0;
 	}
-	if (!refOctree)
+	if (deleteOctreeB)
 	{
 		delete octreeB;
 		octreeB = 0;
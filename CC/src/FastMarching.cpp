@@ -23,6 +23,7 @@
 
 //system
 #include <assert.h>
+#include <limits>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -38,7 +39,6 @@ FastMarching::FastMarching()
 	, m_sliceSize(0)
 	, m_indexShift(0)
 	, m_gridSize(0)
-	, m_theGrid(0)
 	, m_octree(0)
 	, m_gridLevel(0)
 	, m_cellSize(1.0f)
@@ -51,14 +51,7 @@ FastMarching::FastMarching()
 
 FastMarching::~FastMarching()
 {
-	if (m_theGrid)
-	{
-		for (unsigned i=0; i<m_gridSize; ++i)
-			if (m_theGrid[i])
-				delete m_theGrid[i];
-
-		delete[] m_theGrid;
-	}
+	//the grid deletes the cells
 }
 
 float FastMarching::getTime(Tuple3i& pos, bool absoluteCoordinates) const
@@ -119,8 +112,20 @@ int FastMarching::initGridWithOctree(DgmOctree* octree, unsigned char gridLevel)
 
 int FastMarching::initOther()
 {
-	m_rowSize = m_dx+2;
-	m_sliceSize = m_rowSize*(m_dy+2);
+	//the rows and slices sizes are padded to powers of two (see CellGrid)
+	m_rowSize = CellGrid::PaddedSize(m_dx+2);
+	m_sliceSize = m_rowSize*CellGrid::PaddedSize(m_dy+2);
+	if (static_cast<double>(m_sliceSize)*(m_dz+2) > std::numeric_limits<unsigned>::max())
+	{
+		//the padded grid indexes would overflow: we use the unpadded sizes instead (slower cell access)
+		m_rowSize = m_dx+2;
+		m_sliceSize = m_rowSize*(m_dy+2);
+		if (static_cast<double>(m_sliceSize)*(m_dz+2) > std::numeric_limits<unsigned>::max())
+		{
+			//the grid is too big
+			return -3;
+		}
+	}
 	m_gridSize = m_sliceSize*(m_dz+2);
 	m_indexShift = 1+m_rowSize+m_sliceSize;
 
@@ -0,0 +1,551 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "FastMarchingForGeodesicDistances.h"
+
+//local
+#include "GenericIndexedCloudPersist.h"
+#include "ReferenceCloud.h"
+#include "ScalarField.h"
+
+//system
+#include <algorithm>
+#include <assert.h>
+#include <functional>
+#include <math.h>
+
+//Qt
+#ifdef USE_QT
+#ifndef _DEBUG
+//enables multi-threading handling
+#define ENABLE_MT_FM_SWEEPING
+#endif
+#endif
+
+#ifdef ENABLE_MT_FM_SWEEPING
+#include <QtCore>
+#include <QtConcurrentMap>
+#endif
+
+using namespace CCLib;
+
+//! Sweeps tolerance (relatively to the cell size)
+static const float SWEEPING_TOLERANCE = 1.0e-5f;
+
+FastMarchingForGeodesicDistances::FastMarchingForGeodesicDistances()
+	: FastMarching()
+	, m_blockSweeping(false)
+{
+}
+
+int FastMarchingForGeodesicDistances::init(GenericIndexedCloudPersist* cloud, DgmOctree* octree, unsigned char gridLevel)
+{
+	assert(cloud && octree);
+	(void)cloud;
+
+	int result = initGridWithOctree(octree, gridLevel);
+	if (result < 0)
+		return result;
+
+	//we fill the grid with the non empty cells
+	DgmOctree::cellCodesContainer cellCodes;
+	if (!octree->getCellCodes(gridLevel, cellCodes, true))
+	{
+		//not enough memory
+		return -1;
+	}
+
+	for (size_t i = 0; i < cellCodes.size(); ++i)
+	{
+		Tuple3i cellPos;
+		octree->getCellPos(cellCodes[i], gridLevel, cellPos, true);
+
+		GeodesicCell* aCell = new GeodesicCell;
+		aCell->cellCode = cellCodes[i];
+
+		if (!m_theGrid.setCell(pos2index(cellPos), aCell))
+		{
+			//not enough memory
+			delete aCell;
+			return -1;
+		}
+	}
+
+	m_initialized = true;
+
+	return 0;
+}
+
+bool FastMarchingForGeodesicDistances::setSeedCell(const Tuple3i& pos, unsigned label)
+{
+	if (!m_initialized)
+		return false;
+
+	if (	pos.x < m_minFillIndexes.x || pos.x >= m_minFillIndexes.x + static_cast<int>(m_dx)
+		||	pos.y < m_minFillIndexes.y || pos.y >= m_minFillIndexes.y + static_cast<int>(m_dy)
+		||	pos.z < m_minFillIndexes.z || pos.z >= m_minFillIndexes.z + static_cast<int>(m_dz))
+	{
+		//out of the grid
+		return false;
+	}
+
+	unsigned index = pos2index(pos);
+	GeodesicCell* aCell = static_cast<GeodesicCell*>(m_theGrid[index]);
+	if (!aCell || aCell->state == Cell::ACTIVE_CELL)
+	{
+		//empty cell or already a seed
+		return false;
+	}
+
+	try
+	{
+		m_seedCells.push_back(index);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	aCell->T = 0;
+	aCell->label = label;
+	addActiveCell(index);
+
+	return true;
+}
+
+float FastMarchingForGeodesicDistances::solveT(unsigned index, bool acceptedOnly, unsigned& label) const
+{
+	//earliest neighbour along each dimension (6 face neighbours)
+	double Tmin[3] = { Cell::T_INF(), Cell::T_INF(), Cell::T_INF() };
+	unsigned labels[3] = { NO_LABEL, NO_LABEL, NO_LABEL };
+	for (unsigned n = 0; n < 6; ++n)
+	{
+		const GeodesicCell* nCell = static_cast<const GeodesicCell*>(m_theGrid[index + m_neighboursIndexShift[n]]);
+		if (!nCell || (acceptedOnly && nCell->state != Cell::ACTIVE_CELL))
+			continue;
+
+		unsigned char dim = (c_FastMarchingNeighbourPosShift[n * 3] != 0 ? 0 : c_FastMarchingNeighbourPosShift[n * 3 + 1] != 0 ? 1 : 2);
+		if (nCell->T < Tmin[dim])
+		{
+			Tmin[dim] = nCell->T;
+			labels[dim] = nCell->label;
+		}
+	}
+
+	//sort the 3 values
+	for (unsigned i = 0; i < 2; ++i)
+	{
+		for (unsigned j = 0; j < 2 - i; ++j)
+		{
+			if (Tmin[j + 1] < Tmin[j])
+			{
+				std::swap(Tmin[j], Tmin[j + 1]);
+				std::swap(labels[j], labels[j + 1]);
+			}
+		}
+	}
+
+	//upwind scheme
+	double T = Cell::T_INF();
+	label = NO_LABEL;
+	if (Tmin[0] < Cell::T_INF())
+	{
+		double h = m_cellSize;
+		label = labels[0];
+
+		//1D
+		T = Tmin[0] + h;
+		if (T > Tmin[1])
+		{
+			//2D
+			double delta = Tmin[0] - Tmin[1];
+			T = (Tmin[0] + Tmin[1] + sqrt(2 * h * h - delta * delta)) / 2;
+			if (T > Tmin[2])
+			{
+				//3D
+				double s = Tmin[0] + Tmin[1] + Tmin[2];
+				double s2 = Tmin[0] * Tmin[0] + Tmin[1] * Tmin[1] + Tmin[2] * Tmin[2];
+				double delta3 = s * s - 3 * (s2 - h * h);
+				T = (s + sqrt(std::max(0.0, delta3))) / 3;
+			}
+		}
+	}
+
+	//direct propagation from the other neighbours (extended connectivity)
+	for (unsigned n = 6; n < m_numberOfNeighbours; ++n)
+	{
+		const GeodesicCell* nCell = static_cast<const GeodesicCell*>(m_theGrid[index + m_neighboursIndexShift[n]]);
+		if (!nCell || (acceptedOnly && nCell->state != Cell::ACTIVE_CELL))
+			continue;
+
+		double nT = static_cast<double>(nCell->T) + m_neighboursDistance[n];
+		if (nT < T)
+		{
+			T = nT;
+			label = nCell->label;
+		}
+	}
+
+	return static_cast<float>(T);
+}
+
+void FastMarchingForGeodesicDistances::updateTrialCell(unsigned index)
+{
+	GeodesicCell* aCell = static_cast<GeodesicCell*>(m_theGrid[index]);
+	if (!aCell || aCell->state == Cell::ACTIVE_CELL)
+		return;
+
+	unsigned label = NO_LABEL;
+	float T = solveT(index, true, label);
+	if (T < aCell->T)
+	{
+		aCell->T = T;
+		aCell->label = label;
+		if (aCell->state == Cell::FAR_CELL)
+		{
+			addTrialCell(index);
+		}
+
+		//the former entry (if any) will be ignored
+		m_trialHeap.push_back(std::make_pair(T, index));
+		std::push_heap(m_trialHeap.begin(), m_trialHeap.end(), std::greater< std::pair<float, unsigned> >());
+	}
+}
+
+int FastMarchingForGeodesicDistances::step()
+{
+	while (!m_trialHeap.empty())
+	{
+		std::pop_heap(m_trialHeap.begin(), m_trialHeap.end(), std::greater< std::pair<float, unsigned> >());
+		std::pair<float, unsigned> entry = m_trialHeap.back();
+		m_trialHeap.pop_back();
+
+		Cell* minTCell = m_theGrid[entry.second];
+		assert(minTCell);
+		if (minTCell->state == Cell::ACTIVE_CELL || minTCell->T != entry.first)
+		{
+			//outdated entry
+			continue;
+		}
+
+		//we add this cell to the "ACTIVE" set
+		addActiveCell(entry.second);
+
+		//and we update its neighbours
+		for (unsigned n = 0; n < m_numberOfNeighbours; ++n)
+		{
+			updateTrialCell(entry.second + m_neighboursIndexShift[n]);
+		}
+
+		return 1;
+	}
+
+	//no more trial cells
+	return 0;
+}
+
+int FastMarchingForGeodesicDistances::propagateFM()
+{
+	try
+	{
+		for (size_t i = 0; i < m_seedCells.size(); ++i)
+		{
+			for (unsigned n = 0; n < m_numberOfNeighbours; ++n)
+			{
+				updateTrialCell(m_seedCells[i] + m_neighboursIndexShift[n]);
+			}
+		}
+
+		int result = 1;
+		while (result > 0)
+		{
+			result = step();
+		}
+		return result;
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return -1;
+	}
+}
+
+//current instance (block-based Fast Sweeping)
+static FastMarchingForGeodesicDistances* s_sweepingInstance = 0;
+
+void FastMarchingForGeodesicDistances::SweepBrick(BrickTask& task)
+{
+	assert(s_sweepingInstance);
+	task.borderChanged = s_sweepingInstance->sweepBrick(task.brickIndex);
+}
+
+bool FastMarchingForGeodesicDistances::sweepBrick(unsigned brickIndex)
+{
+	static const unsigned S = CellGrid::BRICK_SIZE;
+
+	Cell* const* cells = m_theGrid.brick(brickIndex);
+	if (!cells)
+		return false;
+
+	const float tolerance = SWEEPING_TOLERANCE * m_cellSize;
+	bool borderChanged = false;
+
+	//Gauss-Seidel sweeps (alternating the 8 directions) until convergence
+	for (unsigned sweep = 0; ; ++sweep)
+	{
+		bool changed = false;
+		for (unsigned kk = 0; kk < S; ++kk)
+		{
+			unsigned k = (sweep & 4) ? S - 1 - kk : kk;
+			for (unsigned jj = 0; jj < S; ++jj)
+			{
+				unsigned j = (sweep & 2) ? S - 1 - jj : jj;
+				for (unsigned ii = 0; ii < S; ++ii)
+				{
+					unsigned i = (sweep & 1) ? S - 1 - ii : ii;
+
+					unsigned localIndex = i + ((j + k * S) << CellGrid::BRICK_BITS);
+					GeodesicCell* aCell = static_cast<GeodesicCell*>(cells[localIndex]);
+					if (!aCell || aCell->state == Cell::ACTIVE_CELL) //seeds are ACTIVE
+						continue;
+
+					unsigned label = NO_LABEL;
+					float T = solveT(m_theGrid.cellIndex(brickIndex, localIndex), false, label);
+					if (T < aCell->T - tolerance)
+					{
+						aCell->T = T;
+						aCell->label = label;
+						changed = true;
+						if (i == 0 || j == 0 || k == 0 || i == S - 1 || j == S - 1 || k == S - 1)
+						{
+							borderChanged = true;
+						}
+					}
+				}
+			}
+		}
+
+		if (!changed)
+			break;
+	}
+
+	return borderChanged;
+}
+
+int FastMarchingForGeodesicDistances::propagateBlockSweeping()
+{
+	const unsigned* brickCount = m_theGrid.brickCount();
+	size_t totalBrickCount = static_cast<size_t>(brickCount[0]) * brickCount[1] * brickCount[2];
+
+	//active bricks (per color - adjacent bricks never have the same color)
+	std::vector<char> isActive;
+	std::vector<BrickTask> activeBricks[8];
+	try
+	{
+		isActive.resize(totalBrickCount, 0);
+
+		//the bricks of the seeds and their neighbours
+		for (size_t i = 0; i < m_seedCells.size(); ++i)
+		{
+			unsigned brickIndex = 0, localIndex = 0;
+			m_theGrid.locate(m_seedCells[i], brickIndex, localIndex);
+
+			unsigned bx = brickIndex % brickCount[0];
+			unsigned by = (brickIndex / brickCount[0]) % brickCount[1];
+			unsigned bz = brickIndex / (brickCount[0] * brickCount[1]);
+			for (int dz = -1; dz <= 1; ++dz)
+			for (int dy = -1; dy <= 1; ++dy)
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				int nx = static_cast<int>(bx) + dx, ny = static_cast<int>(by) + dy, nz = static_cast<int>(bz) + dz;
+				if (	nx < 0 || ny < 0 || nz < 0
+					||	nx >= static_cast<int>(brickCount[0]) || ny >= static_cast<int>(brickCount[1]) || nz >= static_cast<int>(brickCount[2]))
+					continue;
+				unsigned nIndex = static_cast<unsigned>(nx + (ny + nz * static_cast<int>(brickCount[1])) * static_cast<int>(brickCount[0]));
+				if (!isActive[nIndex] && m_theGrid.brick(nIndex))
+				{
+					isActive[nIndex] = 1;
+					BrickTask task = { nIndex, false };
+					activeBricks[(nx & 1) | ((ny & 1) << 1) | ((nz & 1) << 2)].push_back(task);
+				}
+			}
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return -1;
+	}
+
+	s_sweepingInstance = this;
+
+	std::vector<BrickTask> tasks;
+	bool activeBricksRemain = true;
+	while (activeBricksRemain)
+	{
+		activeBricksRemain = false;
+
+		for (unsigned color = 0; color < 8; ++color)
+		{
+			if (activeBricks[color].empty())
+				continue;
+
+			activeBricksRemain = true;
+			tasks.swap(activeBricks[color]);
+			activeBricks[color].clear();
+			for (size_t t = 0; t < tasks.size(); ++t)
+			{
+				isActive[tasks[t].brickIndex] = 0;
+			}
+
+			//the bricks of a same color are independent
+#ifdef ENABLE_MT_FM_SWEEPING
+			QtConcurrent::blockingMap(tasks, SweepBrick);
+#else
+			for (size_t t = 0; t < tasks.size(); ++t)
+			{
+				SweepBrick(tasks[t]);
+			}
+#endif
+
+			//the neighbours of the bricks whose border has changed must be processed (again)
+			try
+			{
+				for (size_t t = 0; t < tasks.size(); ++t)
+				{
+					if (!tasks[t].borderChanged)
+						continue;
+
+					unsigned brickIndex = tasks[t].brickIndex;
+					unsigned bx = brickIndex % brickCount[0];
+					unsigned by = (brickIndex / brickCount[0]) % brickCount[1];
+					unsigned bz = brickIndex / (brickCount[0] * brickCount[1]);
+					for (int dz = -1; dz <= 1; ++dz)
+					for (int dy = -1; dy <= 1; ++dy)
+					for (int dx = -1; dx <= 1; ++dx)
+					{
+						if (dx == 0 && dy == 0 && dz == 0)
+							continue;
+						int nx = static_cast<int>(bx) + dx, ny = static_cast<int>(by) + dy, nz = static_cast<int>(bz) + dz;
+						if (	nx < 0 || ny < 0 || nz < 0
+							||	nx >= static_cast<int>(brickCount[0]) || ny >= static_cast<int>(brickCount[1]) || nz >= static_cast<int>(brickCount[2]))
+							continue;
+						unsigned nIndex = static_cast<unsigned>(nx + (ny + nz * static_cast<int>(brickCount[1])) * static_cast<int>(brickCount[0]));
+						if (!isActive[nIndex] && m_theGrid.brick(nIndex))
+						{
+							isActive[nIndex] = 1;
+							BrickTask task = { nIndex, false };
+							activeBricks[(nx & 1) | ((ny & 1) << 1) | ((nz & 1) << 2)].push_back(task);
+						}
+					}
+				}
+			}
+			catch (const std::bad_alloc&)
+			{
+				//not enough memory
+				s_sweepingInstance = 0;
+				return -1;
+			}
+		}
+	}
+
+	s_sweepingInstance = 0;
+
+	return 0;
+}
+
+int FastMarchingForGeodesicDistances::propagate()
+{
+	if (!m_initialized)
+		return -1;
+
+	return m_blockSweeping ? propagateBlockSweeping() : propagateFM();
+}
+
+void FastMarchingForGeodesicDistances::cleanLastPropagation()
+{
+	const unsigned* brickCount = m_theGrid.brickCount();
+	unsigned totalBrickCount = brickCount[0] * brickCount[1] * brickCount[2];
+	for (unsigned b = 0; b < totalBrickCount; ++b)
+	{
+		Cell* const* cells = m_theGrid.brick(b);
+		if (!cells)
+			continue;
+		for (unsigned i = 0; i < CellGrid::BRICK_CELL_COUNT; ++i)
+		{
+			GeodesicCell* aCell = static_cast<GeodesicCell*>(cells[i]);
+			if (aCell)
+			{
+				aCell->state = Cell::FAR_CELL;
+				aCell->T = Cell::T_INF();
+				aCell->label = NO_LABEL;
+			}
+		}
+	}
+
+	m_activeCells.clear();
+	m_trialCells.clear();
+	m_ignoredCells.clear();
+	m_trialHeap.clear();
+	m_seedCells.clear();
+}
+
+bool FastMarchingForGeodesicDistances::setPropagationTimingsAsDistances(ScalarField* labels/*=0*/)
+{
+	if (!m_initialized || !m_octree || m_gridLevel > DgmOctree::MAX_OCTREE_LEVEL)
+		return false;
+
+	ReferenceCloud Yk(m_octree->associatedCloud());
+
+	const unsigned* brickCount = m_theGrid.brickCount();
+	unsigned totalBrickCount = brickCount[0] * brickCount[1] * brickCount[2];
+	for (unsigned b = 0; b < totalBrickCount; ++b)
+	{
+		Cell* const* cells = m_theGrid.brick(b);
+		if (!cells)
+			continue;
+
+		for (unsigned i = 0; i < CellGrid::BRICK_CELL_COUNT; ++i)
+		{
+			const GeodesicCell* aCell = static_cast<const GeodesicCell*>(cells[i]);
+			if (!aCell || aCell->T >= Cell::T_INF())
+			{
+				//empty or not reached
+				continue;
+			}
+
+			if (!m_octree->getPointsInCell(aCell->cellCode, m_gridLevel, &Yk, true))
+			{
+				//not enough memory?
+				return false;
+			}
+
+			for (unsigned k = 0; k < Yk.size(); ++k)
+			{
+				Yk.setPointScalarValue(k, aCell->T);
+				if (labels)
+				{
+					labels->setValue(Yk.getPointGlobalIndex(k), static_cast<ScalarType>(aCell->label));
+				}
+			}
+		}
+	}
+
+	return true;
+}
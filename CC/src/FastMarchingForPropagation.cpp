@@ -74,7 +74,12 @@ int FastMarchingForPropagation::init(	GenericCloud* theCloud,
 		aCell->cellCode = cellCodes.back();
 		aCell->f = (constantAcceleration ? 1.0f : static_cast<float>(ScalarFieldTools::computeMeanScalarValue(&Yk)));
 
-		m_theGrid[gridPos] = aCell;
+		if (!m_theGrid.setCell(gridPos, aCell))
+		{
+			//not enough memory
+			delete aCell;
+			return -1;
+		}
 
 		cellCodes.pop_back();
 	}
@@ -28,10 +28,30 @@
 #include "DgmOctreeReferenceCloud.h"
 #include "ScalarField.h"
 #include "ScalarFieldTools.h"
+#include "EigenSolver3x3.h"
 
 //system
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <math.h>
+#include <new>
 #include <random>
+#include <stdint.h>
+#include <stdio.h> //for sprintf
+
+//Qt
+#ifdef USE_QT
+#ifndef _DEBUG
+//enables multi-threading handling
+#define ENABLE_MT_DUPLICATES
+#endif
+#endif
+
+#ifdef ENABLE_MT_DUPLICATES
+#include <QtCore>
+#include <QtConcurrentMap>
+#endif
 
 using namespace CCLib;
 
@@ -173,6 +193,435 @@ bool GeometricalAnalysisTools::computeCellCurvatureAtLevel(	const DgmOctree::oct
 	return true;
 }
 
+//! Hash grid for duplicate points detection (see GeometricalAnalysisTools::flagDuplicatePoints)
+/** Open addressing hash table of the non empty cells of a regular grid (the cell size is
+	at least twice the tolerance, so that the duplicates of a point can only lie in the 8
+	cells around it at most). The points of each cell are stored contiguously.
+	The insertion and the search can be performed by several threads at once.
+**/
+class DuplicatesHashGrid
+{
+public:
+
+	//! Invalid index
+	static const unsigned NO_INDEX = static_cast<unsigned>(-1);
+
+	//! Default constructor
+	DuplicatesHashGrid(GenericIndexedCloudPersist* cloud, double tolerance)
+		: m_cloud(cloud)
+		, m_tolerance(tolerance)
+		, m_cellSize(0)
+		, m_invCellSize(0)
+		, m_slots(0)
+		, m_cursors(0)
+		, m_mask(0)
+	{
+		assert(m_cloud);
+	}
+
+	//! Destructor
+	~DuplicatesHashGrid()
+	{
+		delete[] m_slots;
+		delete[] m_cursors;
+	}
+
+	//! Allocates the structures
+	bool init()
+	{
+		unsigned pointCount = m_cloud->size();
+
+		CCVector3 bbMin, bbMax;
+		m_cloud->getBoundingBox(bbMin, bbMax);
+		m_origin = CCVector3d::fromArray(bbMin.u);
+		CCVector3 diag = bbMax - bbMin;
+		double maxDim = std::max(diag.x, std::max(diag.y, diag.z));
+
+		//the neighbourhood of a point spans at most 2 cells along each dimension (+ the cell indexes must fit on 30 bits)
+		m_cellSize = std::max(2 * m_tolerance, maxDim / (1 << 30));
+		if (!(m_cellSize > 0))
+		{
+			//all the points are at the same position
+			m_cellSize = 1.0;
+		}
+		m_invCellSize = 1.0 / m_cellSize;
+
+		//hash table (load factor <= 0.5)
+		unsigned capacity = 1024;
+		while (capacity < 2 * static_cast<uint64_t>(pointCount) && capacity < (1u << 31))
+			capacity <<= 1;
+		m_mask = capacity - 1;
+
+		m_slots = new (std::nothrow) std::atomic<unsigned>[capacity];
+		m_cursors = new (std::nothrow) std::atomic<unsigned>[capacity];
+		if (!m_slots || !m_cursors)
+		{
+			return false;
+		}
+		for (unsigned i = 0; i < capacity; ++i)
+		{
+			m_slots[i] = 0;
+			m_cursors[i] = 0;
+		}
+
+		try
+		{
+			m_pointSlots.resize(pointCount);
+			m_sortedIndexes.resize(pointCount);
+			m_lowestNeighbours.resize(pointCount, NO_INDEX);
+		}
+		catch (const std::bad_alloc&)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	//! Inserts a range of points in the table (first step)
+	void insert(unsigned first, unsigned count)
+	{
+		for (unsigned j = first; j < first + count; ++j)
+		{
+			Tuple3i cell = cellPos(*m_cloud->getPointPersistentPtr(j));
+			unsigned slot = static_cast<unsigned>(hash(cell) & m_mask);
+			while (true)
+			{
+				unsigned value = m_slots[slot].load();
+				if (value == 0)
+				{
+					//empty slot: we try to take it
+					if (m_slots[slot].compare_exchange_strong(value, j + 1))
+						break;
+					//another thread has been faster ('value' has been updated)
+				}
+
+				if (sameCell(cellPos(*m_cloud->getPointPersistentPtr(value - 1)), cell))
+					break;
+
+				slot = (slot + 1) & m_mask;
+			}
+
+			m_pointSlots[j] = slot;
+			++m_cursors[slot];
+		}
+	}
+
+	//! Converts the cells population into positions (second step)
+	void computeOffsets()
+	{
+		unsigned offset = 0;
+		for (unsigned i = 0; i <= m_mask; ++i)
+		{
+			unsigned count = m_cursors[i];
+			m_cursors[i] = offset;
+			offset += count;
+		}
+	}
+
+	//! Stores the indexes of a range of points in their cells (third step)
+	void fill(unsigned first, unsigned count)
+	{
+		for (unsigned j = first; j < first + count; ++j)
+		{
+			unsigned pos = m_cursors[m_pointSlots[j]]++;
+			m_sortedIndexes[pos] = j;
+		}
+	}
+
+	//! Releases the temporary structures (after the third step)
+	void releaseTemporaryData()
+	{
+		m_pointSlots.clear();
+		m_pointSlots.shrink_to_fit();
+	}
+
+	//! Looks for the nearest neighbour with a lower index of a range of points (fourth step)
+	void searchLowestNeighbours(unsigned first, unsigned count)
+	{
+		for (unsigned j = first; j < first + count; ++j)
+		{
+			m_lowestNeighbours[j] = findLowerNeighbour(j, 0);
+		}
+	}
+
+	//! Flags the duplicate points (fifth step - sequential)
+	/** A point is a duplicate if a point with a lower index, which is not a duplicate
+		itself, lies in its neighbourhood.
+		\param[out] flags duplicate flags (per point)
+	**/
+	void flagDuplicates(std::vector<unsigned char>& flags) const
+	{
+		unsigned pointCount = m_cloud->size();
+		for (unsigned j = 0; j < pointCount; ++j)
+		{
+			unsigned lowest = m_lowestNeighbours[j];
+			if (lowest == NO_INDEX)
+			{
+				flags[j] = 0;
+			}
+			else if (flags[lowest] == 0)
+			{
+				flags[j] = 1;
+			}
+			else
+			{
+				//the lowest neighbour is a duplicate itself: we look for another one
+				flags[j] = (findLowerNeighbour(j, &flags) != NO_INDEX ? 1 : 0);
+			}
+		}
+	}
+
+protected:
+
+	//! Returns the grid cell of a point
+	template <typename T> inline Tuple3i cellPos(const Vector3Tpl<T>& P) const
+	{
+		return Tuple3i(	static_cast<int>(floor((P.x - m_origin.x) * m_invCellSize)),
+						static_cast<int>(floor((P.y - m_origin.y) * m_invCellSize)),
+						static_cast<int>(floor((P.z - m_origin.z) * m_invCellSize)) );
+	}
+
+	//! Returns whether two grid cells are the same
+	static inline bool sameCell(const Tuple3i& a, const Tuple3i& b)
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+
+	//! Hashes a grid cell
+	static inline uint64_t hash(const Tuple3i& cell)
+	{
+		uint64_t h =	static_cast<uint64_t>(static_cast<uint32_t>(cell.x)) * UINT64_C(0x9E3779B97F4A7C15)
+					^	static_cast<uint64_t>(static_cast<uint32_t>(cell.y)) * UINT64_C(0xC2B2AE3D27D4EB4F)
+					^	static_cast<uint64_t>(static_cast<uint32_t>(cell.z)) * UINT64_C(0x165667B19E3779F9);
+		return h ^ (h >> 29);
+	}
+
+	//! Returns the slot of a grid cell (or NO_INDEX if it's empty)
+	unsigned findSlot(const Tuple3i& cell) const
+	{
+		unsigned slot = static_cast<unsigned>(hash(cell) & m_mask);
+		while (true)
+		{
+			unsigned value = m_slots[slot].load();
+			if (value == 0)
+				return NO_INDEX;
+			if (sameCell(cellPos(*m_cloud->getPointPersistentPtr(value - 1)), cell))
+				return slot;
+			slot = (slot + 1) & m_mask;
+		}
+	}
+
+	//! Looks for the lowest neighbour of a point with a lower index
+	/** \param j point index
+		\param flags if set, only the points with a null flag are considered
+	**/
+	unsigned findLowerNeighbour(unsigned j, const std::vector<unsigned char>* flags) const
+	{
+		const double squareTolerance = m_tolerance * m_tolerance;
+		const CCVector3* P = m_cloud->getPointPersistentPtr(j);
+
+		//cells intersecting the neighbourhood box
+		const CCVector3d tolerance(m_tolerance, m_tolerance, m_tolerance);
+		Tuple3i minCell = cellPos(CCVector3d::fromArray(P->u) - tolerance);
+		Tuple3i maxCell = cellPos(CCVector3d::fromArray(P->u) + tolerance);
+
+		unsigned lowest = NO_INDEX;
+		Tuple3i neighbourCell;
+		for (neighbourCell.z = minCell.z; neighbourCell.z <= maxCell.z; ++neighbourCell.z)
+		for (neighbourCell.y = minCell.y; neighbourCell.y <= maxCell.y; ++neighbourCell.y)
+		for (neighbourCell.x = minCell.x; neighbourCell.x <= maxCell.x; ++neighbourCell.x)
+		{
+			unsigned slot = findSlot(neighbourCell);
+			if (slot == NO_INDEX)
+				continue;
+
+			//after the third step, the cursors point to the end of each cell
+			unsigned begin = (slot == 0 ? 0 : m_cursors[slot - 1].load());
+			unsigned end = m_cursors[slot];
+			for (unsigned k = begin; k < end; ++k)
+			{
+				unsigned i = m_sortedIndexes[k];
+				if (	i < j
+					&&	i < lowest
+					&&	(!flags || (*flags)[i] == 0)
+					&&	(*m_cloud->getPointPersistentPtr(i) - *P).norm2d() <= squareTolerance)
+				{
+					lowest = i;
+				}
+			}
+		}
+
+		return lowest;
+	}
+
+	//! Associated cloud
+	GenericIndexedCloudPersist* m_cloud;
+	//! Tolerance
+	double m_tolerance;
+	//! Grid origin
+	CCVector3d m_origin;
+	//! Grid cell size
+	double m_cellSize;
+	//! Inverse of the grid cell size
+	double m_invCellSize;
+
+	//! Hash table slots (index of the first inserted point of each cell + 1, or 0 if empty)
+	std::atomic<unsigned>* m_slots;
+	//! Cells population, then cells positions in m_sortedIndexes
+	std::atomic<unsigned>* m_cursors;
+	//! Hash table mask (capacity - 1)
+	unsigned m_mask;
+
+	//! Slot of each point (temporary)
+	std::vector<unsigned> m_pointSlots;
+	//! Points indexes sorted by cell
+	std::vector<unsigned> m_sortedIndexes;
+	//! Lowest neighbour of each point (with a lower index)
+	std::vector<unsigned> m_lowestNeighbours;
+};
+
+const unsigned DuplicatesHashGrid::NO_INDEX;
+
+//! Range of points (duplicate points detection)
+struct DuplicatesChunk
+{
+	//! First point index
+	unsigned first;
+	//! Number of points
+	unsigned count;
+};
+
+//! Duplicate points detection step (see DuplicatesHashGrid)
+enum DuplicatesStep { DUPLICATES_INSERT, DUPLICATES_FILL, DUPLICATES_SEARCH };
+
+static DuplicatesHashGrid* s_duplicatesGrid_MT = 0;
+static DuplicatesStep s_duplicatesStep_MT = DUPLICATES_INSERT;
+static NormalizedProgress* s_duplicatesProgress_MT = 0;
+static bool s_duplicatesCanceled_MT = false;
+
+static void ProcessDuplicatesChunk(const DuplicatesChunk& chunk)
+{
+	if (s_duplicatesCanceled_MT)
+		return;
+
+	switch (s_duplicatesStep_MT)
+	{
+	case DUPLICATES_INSERT:
+		s_duplicatesGrid_MT->insert(chunk.first, chunk.count);
+		break;
+	case DUPLICATES_FILL:
+		s_duplicatesGrid_MT->fill(chunk.first, chunk.count);
+		break;
+	case DUPLICATES_SEARCH:
+		s_duplicatesGrid_MT->searchLowestNeighbours(chunk.first, chunk.count);
+		break;
+	}
+
+	if (s_duplicatesProgress_MT && !s_duplicatesProgress_MT->steps(chunk.count))
+	{
+		s_duplicatesCanceled_MT = true;
+	}
+}
+
+int GeometricalAnalysisTools::flagDuplicatePointsWithHashGrid(	GenericIndexedCloudPersist* theCloud,
+																double minDistanceBetweenPoints,
+																GenericProgressCallback* progressCb/*=0*/)
+{
+	assert(theCloud);
+	unsigned numberOfPoints = theCloud->size();
+
+	DuplicatesHashGrid grid(theCloud, minDistanceBetweenPoints);
+	std::vector<unsigned char> flags;
+	std::vector<DuplicatesChunk> chunks;
+	try
+	{
+		flags.resize(numberOfPoints, 0);
+
+		static const unsigned CHUNK_SIZE = 65536;
+		for (unsigned first = 0; first < numberOfPoints; first += CHUNK_SIZE)
+		{
+			DuplicatesChunk chunk = { first, std::min(CHUNK_SIZE, numberOfPoints - first) };
+			chunks.push_back(chunk);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		return -5;
+	}
+
+	if (!grid.init())
+	{
+		//not enough memory
+		return -5;
+	}
+
+	NormalizedProgress normProgress(progressCb, 3 * numberOfPoints);
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("Flag duplicate points");
+			char buffer[256];
+			sprintf(buffer, "Points: %u", numberOfPoints);
+			progressCb->setInfo(buffer);
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+
+	s_duplicatesGrid_MT = &grid;
+	s_duplicatesProgress_MT = progressCb ? &normProgress : 0;
+	s_duplicatesCanceled_MT = false;
+
+	static const DuplicatesStep steps[3] = { DUPLICATES_INSERT, DUPLICATES_FILL, DUPLICATES_SEARCH };
+	for (unsigned s = 0; s < 3 && !s_duplicatesCanceled_MT; ++s)
+	{
+		s_duplicatesStep_MT = steps[s];
+		if (steps[s] == DUPLICATES_FILL)
+		{
+			grid.computeOffsets();
+		}
+#ifdef ENABLE_MT_DUPLICATES
+		QtConcurrent::blockingMap(chunks, ProcessDuplicatesChunk);
+#else
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			ProcessDuplicatesChunk(chunks[i]);
+		}
+#endif
+		if (steps[s] == DUPLICATES_FILL)
+		{
+			grid.releaseTemporaryData();
+		}
+	}
+
+	bool canceled = s_duplicatesCanceled_MT;
+	s_duplicatesGrid_MT = 0;
+	s_duplicatesProgress_MT = 0;
+
+	if (progressCb)
+	{
+		progressCb->stop();
+	}
+
+	if (canceled)
+	{
+		return -4;
+	}
+
+	//sequential (and deterministic) resolution
+	grid.flagDuplicates(flags);
+
+	theCloud->enableScalarField();
+	for (unsigned j = 0; j < numberOfPoints; ++j)
+	{
+		theCloud->setPointScalarValue(j, static_cast<ScalarType>(flags[j]));
+	}
+
+	return 0;
+}
+
 int GeometricalAnalysisTools::flagDuplicatePoints(	GenericIndexedCloudPersist* theCloud,
 													double minDistanceBetweenPoints/*=1.0e-12*/,
 													GenericProgressCallback* progressCb/*=0*/,
@@ -185,29 +634,24 @@ int GeometricalAnalysisTools::flagDuplicatePoints(	GenericIndexedCloudPersist* t
 	if (numberOfPoints <= 1)
 		return -2;
 
-	DgmOctree* theOctree = inputOctree;
-	if (!theOctree)
+	if (!inputOctree)
 	{
-		theOctree = new DgmOctree(theCloud);
-		if (theOctree->build(progressCb) < 1)
-		{
-			delete theOctree;
-			return -3;
-		}
+		//no need to compute an octree
+		return flagDuplicatePointsWithHashGrid(theCloud, minDistanceBetweenPoints, progressCb);
 	}
 
 	theCloud->enableScalarField();
 	//set all flags to 0 by default
 	theCloud->forEach(CCLib::ScalarFieldTools::SetScalarValueToZero);
 
-	unsigned char level = theOctree->findBestLevelForAGivenNeighbourhoodSizeExtraction(static_cast<PointCoordinateType>(minDistanceBetweenPoints));
+	unsigned char level = inputOctree->findBestLevelForAGivenNeighbourhoodSizeExtraction(static_cast<PointCoordinateType>(minDistanceBetweenPoints));
 
 	//parameters
 	void* additionalParameters[1] = { static_cast<void*>(&minDistanceBetweenPoints) };
 
 	int result = 0;
 
-	if (theOctree->executeFunctionForAllCellsAtLevel(	level,
+	if (inputOctree->executeFunctionForAllCellsAtLevel(	level,
 														&flagDuplicatePointsInACellAtLevel,
 														additionalParameters,
 														false, //doesn't work in parallel!
@@ -218,9 +662,6 @@ int GeometricalAnalysisTools::flagDuplicatePoints(	GenericIndexedCloudPersist* t
 		result = -4;
 	}
 
-	if (!inputOctree)
-		delete theOctree;
-
 	return result;
 }
 
@@ -339,7 +780,7 @@ bool GeometricalAnalysisTools::computeApproxPointsDensityInACellAtLevel(const Dg
 	//extract additional parameter(s)
 	Density densityType = *static_cast<Density*>(additionalParameters[0]);
 	
-	DgmOctree::NearestNeighboursSearchStruct nNSS;
+	DgmOctree::NearestNeighboursBatchSearchStruct nNSS;
 	nNSS.level								= cell.level;
 	nNSS.alreadyVisitedNeighbourhoodSize	= 0;
 	nNSS.minNumberOfNeighbors				= 2;
@@ -347,14 +788,20 @@ bool GeometricalAnalysisTools::computeApproxPointsDensityInACellAtLevel(const Dg
 	cell.parentOctree->computeCellCenter(nNSS.cellPos,cell.level,nNSS.cellCenter);
 
 	unsigned n = cell.points->size();
-	for (unsigned i=0; i<n; ++i)
+
+	//we look for the neighbours of all the cell points at once
+	if (n != 0 && !cell.parentOctree->findNearestNeighborsInBatch(nNSS, cell.points))
 	{
-		cell.points->getPoint(i,nNSS.queryPoint);
+		//not enough memory
+		return false;
+	}
 
+	for (unsigned i=0; i<n; ++i)
+	{
 		//the first point is always the point itself!
-		if (cell.parentOctree->findNearestNeighborsStartingFromCell(nNSS) > 1)
+		if (nNSS.neighboursCount(i) > 1)
 		{
-			double R2 = nNSS.pointsInNeighbourhood[1].squareDistd;
+			double R2 = nNSS.neighboursOf(i)[1].squareDistd;
 
 			ScalarType density = NAN_VALUE;
 			if (R2 > ZERO_TOLERANCE)
@@ -630,6 +1077,368 @@ bool GeometricalAnalysisTools::computePointsRoughnessInACellAtLevel(const DgmOct
 	return true;
 }
 
+int GeometricalAnalysisTools::computeMultiScaleFeatures(GenericIndexedCloudPersist* theCloud,
+														const std::vector<GeomFeature>& features,
+														const std::vector<PointCoordinateType>& radii,
+														const std::vector<ScalarField*>& outputs,
+														GenericProgressCallback* progressCb/*=0*/,
+														DgmOctree* inputOctree/*=0*/)
+{
+	if (!theCloud || features.empty() || radii.empty() || outputs.size() != features.size() * radii.size())
+		return -1;
+
+	unsigned numberOfPoints = theCloud->size();
+	if (numberOfPoints < 3)
+		return -2;
+
+	//we process the radii in ascending order (the neighbourhood of a radius is a prefix of the next one)
+	std::vector<unsigned> radiiOrder;
+	try
+	{
+		radiiOrder.resize(radii.size());
+	}
+	catch (const std::bad_alloc&)
+	{
+		return -5;
+	}
+	for (size_t i = 0; i < radii.size(); ++i)
+	{
+		if (radii[i] <= 0)
+			return -1;
+		radiiOrder[i] = static_cast<unsigned>(i);
+	}
+	std::sort(radiiOrder.begin(), radiiOrder.end(), [&radii](unsigned a, unsigned b) { return radii[a] < radii[b]; });
+	PointCoordinateType maxRadius = radii[radiiOrder.back()];
+
+	for (size_t i = 0; i < outputs.size(); ++i)
+	{
+		if (!outputs[i])
+			return -1;
+		if (!outputs[i]->resize(numberOfPoints))
+			return -5;
+		outputs[i]->fill(NAN_VALUE);
+	}
+
+	DgmOctree* theOctree = inputOctree;
+	if (!theOctree)
+	{
+		theOctree = new DgmOctree(theCloud);
+		if (theOctree->build(progressCb) < 1)
+		{
+			delete theOctree;
+			return -3;
+		}
+	}
+
+	unsigned char level = theOctree->findBestLevelForAGivenNeighbourhoodSizeExtraction(maxRadius);
+
+	//parameters
+	void* additionalParameters[4] = {	const_cast<void*>(static_cast<const void*>(&features)),
+										const_cast<void*>(static_cast<const void*>(&radii)),
+										static_cast<void*>(&radiiOrder),
+										const_cast<void*>(static_cast<const void*>(&outputs)) };
+
+	int result = 0;
+
+	if (theOctree->executeFunctionForAllCellsAtLevel(	level,
+														&computeMultiScaleFeaturesInACellAtLevel,
+														additionalParameters,
+														true,
+														progressCb,
+														"Multi-scale Features Computation") == 0)
+	{
+		//something went wrong
+		result = -4;
+	}
+
+	if (!inputOctree)
+		delete theOctree;
+
+	return result;
+}
+
+//! Computes a covariance matrix (packed form: xx, xy, xz, yy, yz, zz) from the sums of the (relative) coordinates and of their products
+/** \return the mean (relative) position
+**/
+static CCVector3d ComputeCovarianceFromSums(const double sum[3], const double sum2[6], unsigned count, double cov[6])
+{
+	assert(count != 0);
+
+	CCVector3d mean(sum[0] / count, sum[1] / count, sum[2] / count);
+	cov[0] = sum2[0] / count - mean.x * mean.x;
+	cov[1] = sum2[1] / count - mean.x * mean.y;
+	cov[2] = sum2[2] / count - mean.x * mean.z;
+	cov[3] = sum2[3] / count - mean.y * mean.y;
+	cov[4] = sum2[4] / count - mean.y * mean.z;
+	cov[5] = sum2[5] / count - mean.z * mean.z;
+
+	return mean;
+}
+
+//"PER-CELL" METHOD: MULTI-SCALE FEATURES
+//ADDITIONNAL PARAMETERS (4):
+// [0] -> (const std::vector<GeomFeature>*) features
+// [1] -> (const std::vector<PointCoordinateType>*) radii
+// [2] -> (std::vector<unsigned>*) radiiOrder : radii indexes in ascending order
+// [3] -> (const std::vector<ScalarField*>*) outputs : output scalar fields
+bool GeometricalAnalysisTools::computeMultiScaleFeaturesInACellAtLevel(	const DgmOctree::octreeCell& cell,
+																		void** additionalParameters,
+																		NormalizedProgress* nProgress/*=0*/)
+{
+	//parameters
+	const std::vector<GeomFeature>& features		= *static_cast<const std::vector<GeomFeature>*>(additionalParameters[0]);
+	const std::vector<PointCoordinateType>& radii	= *static_cast<const std::vector<PointCoordinateType>*>(additionalParameters[1]);
+	const std::vector<unsigned>& radiiOrder			= *static_cast<const std::vector<unsigned>*>(additionalParameters[2]);
+	const std::vector<ScalarField*>& outputs		= *static_cast<const std::vector<ScalarField*>*>(additionalParameters[3]);
+
+	const size_t radiusCount = radii.size();
+	const PointCoordinateType maxRadius = radii[radiiOrder.back()];
+
+	//which intermediate results are required
+	bool needCovariance = false;
+	bool needQuadric = false;
+	for (size_t f = 0; f < features.size(); ++f)
+	{
+		switch (features[f])
+		{
+		case FEATURE_ROUGHNESS:
+		case FEATURE_EIGENVALUE_1:
+		case FEATURE_EIGENVALUE_2:
+		case FEATURE_EIGENVALUE_3:
+		case FEATURE_LINEARITY:
+		case FEATURE_PLANARITY:
+		case FEATURE_SPHERICITY:
+			needCovariance = true;
+			break;
+		case FEATURE_GAUSSIAN_CURVATURE:
+		case FEATURE_MEAN_CURVATURE:
+		case FEATURE_NORMAL_CHANGE_RATE:
+			needQuadric = true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	//structure for nearest neighbors search
+	DgmOctree::NearestNeighboursSphericalSearchStruct nNSS;
+	nNSS.level = cell.level;
+	nNSS.prepare(maxRadius,cell.parentOctree->getCellSize(nNSS.level));
+	cell.parentOctree->getCellPos(cell.truncatedCode,cell.level,nNSS.cellPos,true);
+	cell.parentOctree->computeCellCenter(nNSS.cellPos,cell.level,nNSS.cellCenter);
+
+	//per radius buffers
+	std::vector<unsigned> counts;
+	std::vector<ScalarType> roughness;
+	std::vector<double> covariances; //packed covariance matrices (SoA)
+	std::vector<double> eigenValues; //eigenvalues (SoA)
+	try
+	{
+		counts.resize(radiusCount);
+		roughness.resize(radiusCount);
+		if (needCovariance)
+		{
+			covariances.resize(6 * radiusCount);
+			eigenValues.resize(3 * radiusCount);
+		}
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+	double* cov[6] = { 0, 0, 0, 0, 0, 0 };
+	double* eig[3] = { 0, 0, 0 };
+	if (needCovariance)
+	{
+		for (unsigned k = 0; k < 6; ++k)
+			cov[k] = &covariances[k * radiusCount];
+		for (unsigned k = 0; k < 3; ++k)
+			eig[k] = &eigenValues[k * radiusCount];
+	}
+
+	CCLib::SquareMatrixd covMat(3);
+	unsigned n = cell.points->size(); //number of points in the current cell
+
+	//for each point in the cell
+	for (unsigned i=0; i<n; ++i)
+	{
+		cell.points->getPoint(i,nNSS.queryPoint);
+		const CCVector3 P = nNSS.queryPoint;
+		const unsigned globalIndex = cell.points->getPointGlobalIndex(i);
+
+		//look for the neighbors inside the biggest sphere (sorted by distance)
+		unsigned neighborCount = cell.parentOctree->findNeighborsInASphereStartingFromCell(nNSS,maxRadius,true);
+
+		//covariance sums (relatively to the query point)
+		double sum[3] = { 0, 0, 0 };
+		double sum2[6] = { 0, 0, 0, 0, 0, 0 }; //xx, xy, xz, yy, yz, zz
+		unsigned count = 0;
+
+		//first pass: neighbourhoods and covariance matrices
+		for (size_t r = 0; r < radiusCount; ++r)
+		{
+			const double radius = radii[radiiOrder[r]];
+			const double squareRadius = radius * radius;
+
+			//the neighbours inside the current sphere are a prefix of the sorted set
+			unsigned prefixEnd = count;
+			while (prefixEnd < neighborCount && nNSS.pointsInNeighbourhood[prefixEnd].squareDistd <= squareRadius)
+				++prefixEnd;
+
+			if (needCovariance)
+			{
+				for (unsigned k = count; k < prefixEnd; ++k)
+				{
+					CCVector3d d = CCVector3d::fromArray((*nNSS.pointsInNeighbourhood[k].point - P).u);
+					sum[0] += d.x;
+					sum[1] += d.y;
+					sum[2] += d.z;
+					sum2[0] += d.x * d.x;
+					sum2[1] += d.x * d.y;
+					sum2[2] += d.x * d.z;
+					sum2[3] += d.y * d.y;
+					sum2[4] += d.y * d.z;
+					sum2[5] += d.z * d.z;
+				}
+			}
+			count = prefixEnd;
+			counts[r] = count;
+
+			//roughness: LS plane of the neighbours (without the query point - its contribution to the sums is null)
+			roughness[r] = NAN_VALUE;
+			if (needCovariance && count > 3)
+			{
+				double m[6];
+				CCVector3d mean = ComputeCovarianceFromSums(sum, sum2, count - 1, m);
+				covMat.m_values[0][0] = m[0];
+				covMat.m_values[0][1] = covMat.m_values[1][0] = m[1];
+				covMat.m_values[0][2] = covMat.m_values[2][0] = m[2];
+				covMat.m_values[1][1] = m[3];
+				covMat.m_values[1][2] = covMat.m_values[2][1] = m[4];
+				covMat.m_values[2][2] = m[5];
+
+				CCVector3 G = P + CCVector3::fromArray(mean.u);
+				PointCoordinateType lsPlane[4];
+				if (Neighbourhood::ComputeLSPlane(covMat, G, lsPlane))
+					roughness[r] = fabs(DistanceComputationTools::computePoint2PlaneDistance(&P, lsPlane));
+			}
+
+			//covariance matrix (with the query point)
+			if (needCovariance)
+			{
+				double m[6] = { 0, 0, 0, 0, 0, 0 };
+				if (count >= 3)
+					ComputeCovarianceFromSums(sum, sum2, count, m);
+				for (unsigned k = 0; k < 6; ++k)
+					cov[k][r] = m[k];
+			}
+		}
+
+		//eigenvalues of all the radii at once
+		if (needCovariance)
+		{
+			EigenSolver3x3<double>::ComputeEigenValues(static_cast<unsigned>(radiusCount), cov, eig);
+		}
+
+		//second pass: features
+		for (size_t r = 0; r < radiusCount; ++r)
+		{
+			const unsigned radiusIndex = radiiOrder[r];
+			const double radius = radii[radiusIndex];
+			const double squareRadius = radius * radius;
+			count = counts[r];
+
+			//eigenvalues (decreasing order - the covariance matrix is positive semi-definite)
+			bool validEigenValues = (needCovariance && count >= 3);
+			double eigValues[3] = { 0, 0, 0 };
+			if (validEigenValues)
+			{
+				for (unsigned k = 0; k < 3; ++k)
+					eigValues[k] = std::max(0.0, eig[k][r]);
+			}
+
+			//local quadric (shared by all the curvature types)
+			DgmOctreeReferenceCloud neighboursCloud(&nNSS.pointsInNeighbourhood,count);
+			Neighbourhood Z(&neighboursCloud);
+			bool validQuadric = (needQuadric && count > 5);
+			unsigned indexInNeighbourhood = 0;
+			if (validQuadric)
+			{
+				for (unsigned j=0; j<count; ++j)
+				{
+					if (nNSS.pointsInNeighbourhood[j].pointIndex == globalIndex)
+					{
+						indexInNeighbourhood = j;
+						break;
+					}
+				}
+			}
+
+			for (size_t f = 0; f < features.size(); ++f)
+			{
+				ScalarType value = NAN_VALUE;
+				switch (features[f])
+				{
+				case FEATURE_ROUGHNESS:
+					value = roughness[r];
+					break;
+				case FEATURE_GAUSSIAN_CURVATURE:
+					if (validQuadric)
+						value = Z.computeCurvature(indexInNeighbourhood,Neighbourhood::GAUSSIAN_CURV);
+					break;
+				case FEATURE_MEAN_CURVATURE:
+					if (validQuadric)
+						value = Z.computeCurvature(indexInNeighbourhood,Neighbourhood::MEAN_CURV);
+					break;
+				case FEATURE_NORMAL_CHANGE_RATE:
+					if (validQuadric)
+						value = Z.computeCurvature(indexInNeighbourhood,Neighbourhood::NORMAL_CHANGE_RATE);
+					break;
+				case FEATURE_DENSITY_KNN:
+					value = static_cast<ScalarType>(count);
+					break;
+				case FEATURE_DENSITY_2D:
+					value = static_cast<ScalarType>(count / (M_PI * squareRadius));
+					break;
+				case FEATURE_DENSITY_3D:
+					value = static_cast<ScalarType>(count / (s_UnitSphereVolume * squareRadius * radius));
+					break;
+				case FEATURE_EIGENVALUE_1:
+				case FEATURE_EIGENVALUE_2:
+				case FEATURE_EIGENVALUE_3:
+					if (validEigenValues)
+						value = static_cast<ScalarType>(eigValues[features[f] - FEATURE_EIGENVALUE_1]);
+					break;
+				case FEATURE_LINEARITY:
+					if (validEigenValues && eigValues[0] > 0)
+						value = static_cast<ScalarType>((eigValues[0] - eigValues[1]) / eigValues[0]);
+					break;
+				case FEATURE_PLANARITY:
+					if (validEigenValues && eigValues[0] > 0)
+						value = static_cast<ScalarType>((eigValues[1] - eigValues[2]) / eigValues[0]);
+					break;
+				case FEATURE_SPHERICITY:
+					if (validEigenValues && eigValues[0] > 0)
+						value = static_cast<ScalarType>(eigValues[2] / eigValues[0]);
+					break;
+				default:
+					assert(false);
+					break;
+				}
+
+				outputs[f * radiusCount + radiusIndex]->setValue(globalIndex,value);
+			}
+		}
+
+		if (nProgress && !nProgress->oneStep())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 CCVector3 GeometricalAnalysisTools::computeGravityCenter(GenericCloud* theCloud)
 {
 	assert(theCloud);
@@ -651,6 +1460,31 @@ CCVector3 GeometricalAnalysisTools::computeGravityCenter(GenericCloud* theCloud)
 	return CCVector3::fromArray(sum.u);
 }
 
+CCVector3 GeometricalAnalysisTools::computeGravityCenter(GenericIndexedCloud* theCloud)
+{
+	assert(theCloud);
+	
+	unsigned count = theCloud->size();
+	if (count == 0)
+		return CCVector3();
+
+	CCVector3d sum(0,0,0);
+
+	for (unsigned i = 0; i < count; )
+	{
+		unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+		const CCVector3* P = theCloud->getPointsBlock(i, blockSize);
+		for (unsigned j = 0; j < blockSize; ++j, ++P)
+		{
+			sum += CCVector3d::fromArray(P->u);
+		}
+		i += blockSize;
+	}
+
+	sum /= static_cast<double>(count);
+	return CCVector3::fromArray(sum.u);
+}
+
 CCVector3 GeometricalAnalysisTools::computeWeightedGravityCenter(GenericCloud* theCloud, ScalarField* weights)
 {
 	assert(theCloud && weights);
@@ -715,8 +1549,56 @@ CCLib::SquareMatrixd GeometricalAnalysisTools::computeCovarianceMatrix(GenericCl
 	}
 
 	covMat.m_values[0][0] = mXX/static_cast<double>(n);
-	covMat.m_values[0][0] = mYY/static_cast<double>(n);
-	covMat.m_values[0][0] = mZZ/static_cast<double>(n);
+	covMat.m_values[1][1] = mYY/static_cast<double>(n);
+	covMat.m_values[2][2] = mZZ/static_cast<double>(n);
+	covMat.m_values[1][0] = covMat.m_values[0][1] = mXY/static_cast<double>(n);
+	covMat.m_values[2][0] = covMat.m_values[0][2] = mXZ/static_cast<double>(n);
+	covMat.m_values[2][1] = covMat.m_values[1][2] = mYZ/static_cast<double>(n);
+
+	return covMat;
+}
+
+CCLib::SquareMatrixd GeometricalAnalysisTools::computeCovarianceMatrix(GenericIndexedCloud* theCloud, const PointCoordinateType* _gravityCenter)
+{
+	assert(theCloud);
+	unsigned n = (theCloud ? theCloud->size() : 0);
+	if (n==0)
+		return CCLib::SquareMatrixd();
+
+	CCLib::SquareMatrixd covMat(3);
+	covMat.clear();
+
+	//gravity center
+	CCVector3 G = (_gravityCenter ?  CCVector3(_gravityCenter) : computeGravityCenter(theCloud));
+
+	//cross sums (we use doubles to avoid overflow)
+	double mXX = 0;
+	double mYY = 0;
+	double mZZ = 0;
+	double mXY = 0;
+	double mXZ = 0;
+	double mYZ = 0;
+
+	for (unsigned i = 0; i < n; )
+	{
+		unsigned count = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+		const CCVector3* Q = theCloud->getPointsBlock(i, count);
+		for (unsigned j = 0; j < count; ++j, ++Q)
+		{
+			CCVector3 P = *Q-G;
+			mXX += static_cast<double>(P.x*P.x);
+			mYY += static_cast<double>(P.y*P.y);
+			mZZ += static_cast<double>(P.z*P.z);
+			mXY += static_cast<double>(P.x*P.y);
+			mXZ += static_cast<double>(P.x*P.z);
+			mYZ += static_cast<double>(P.y*P.z);
+		}
+		i += count;
+	}
+
+	covMat.m_values[0][0] = mXX/static_cast<double>(n);
+	covMat.m_values[1][1] = mYY/static_cast<double>(n);
+	covMat.m_values[2][2] = mZZ/static_cast<double>(n);
 	covMat.m_values[1][0] = covMat.m_values[0][1] = mXY/static_cast<double>(n);
 	covMat.m_values[2][0] = covMat.m_values[0][2] = mXZ/static_cast<double>(n);
 	covMat.m_values[2][1] = covMat.m_values[1][2] = mYZ/static_cast<double>(n);
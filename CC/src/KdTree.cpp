@@ -22,538 +22,595 @@
 
 //system
 #include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifdef USE_QT
+#ifndef _DEBUG
+//enables multi-threading handling
+#define ENABLE_MT_KDTREE
+#endif
+#endif
+
+#ifdef ENABLE_MT_KDTREE
+#include <QtCore>
+#include <QtConcurrentMap>
+#include <QThreadPool>
+#endif
 
 using namespace CCLib;
 
+//! Min number of points to build the tree in parallel
+static const unsigned MT_MIN_POINT_COUNT = 65536;
+//! Max depth of the tree (way enough for 2^32 points)
+static const unsigned MAX_TREE_DEPTH = 64;
+
 KDTree::KDTree()
-	: m_root(0)
-	, m_associatedCloud(0)
-	, m_cellCount(0)
+	: m_associatedCloud(0)
 {
 }
 
 KDTree::~KDTree()
 {
-    deleteSubTree(m_root);
 }
 
-bool KDTree::buildFromCloud(GenericIndexedCloud *cloud, GenericProgressCallback *progressCb)
+unsigned KDTree::NodeCount(unsigned pointCount)
+{
+	if (pointCount <= MAX_LEAF_SIZE)
+		return 1;
+
+	unsigned lesserCount = (pointCount + 1) / 2;
+	return 1 + NodeCount(lesserCount) + NodeCount(pointCount - lesserCount);
+}
+
+//! Compares the coordinates of two points (along a given dimension) designated by their index
+struct KdCoordinateComparator
+{
+	KdCoordinateComparator(const PointCoordinateType* coordinates) : m_coordinates(coordinates) {}
+	inline bool operator()(unsigned a, unsigned b) const { return m_coordinates[a] < m_coordinates[b]; }
+	const PointCoordinateType* m_coordinates;
+};
+
+void KDTree::buildNode(const BuildTask& task)
 {
-    unsigned cloudsize = cloud->size();
+	assert(task.count != 0);
+	KdNode& node = m_nodes[task.node];
+	node.firstPoint = task.first;
+	node.pointCount = task.count;
 
-    m_indexes.clear();
-    m_cellCount = 0;
+	//inside bounding box (at this stage the points coordinates are still in the cloud order)
+	const unsigned* indexes = &(m_indexes[task.first]);
+	{
+		unsigned index = indexes[0];
+		node.bbMin = node.bbMax = CCVector3(m_pointsX[index], m_pointsY[index], m_pointsZ[index]);
+		for (unsigned i = 1; i < task.count; ++i)
+		{
+			index = indexes[i];
+			CCVector3 P(m_pointsX[index], m_pointsY[index], m_pointsZ[index]);
+			node.bbMin.x = std::min(node.bbMin.x, P.x);
+			node.bbMin.y = std::min(node.bbMin.y, P.y);
+			node.bbMin.z = std::min(node.bbMin.z, P.z);
+			node.bbMax.x = std::max(node.bbMax.x, P.x);
+			node.bbMax.y = std::max(node.bbMax.y, P.y);
+			node.bbMax.z = std::max(node.bbMax.z, P.z);
+		}
+	}
+
+	//leaf
+	if (task.count <= MAX_LEAF_SIZE)
+	{
+		node.cuttingDim = 0;
+		node.cuttingCoordinate = 0;
+		node.greaterChild = 0;
+		return;
+	}
+
+	//we cut along the largest dimension
+	CCVector3 diag = node.bbMax - node.bbMin;
+	node.cuttingDim = (diag.x >= diag.y ? (diag.x >= diag.z ? 0 : 2) : (diag.y >= diag.z ? 1 : 2));
+	const PointCoordinateType* coordinates = (node.cuttingDim == 0 ? &(m_pointsX[0]) : node.cuttingDim == 1 ? &(m_pointsY[0]) : &(m_pointsZ[0]));
+
+	//median partition
+	unsigned lesserCount = (task.count + 1) / 2;
+	std::vector<unsigned>::iterator first = m_indexes.begin() + task.first;
+	std::nth_element(first, first + (lesserCount - 1), first + task.count, KdCoordinateComparator(coordinates));
+	node.cuttingCoordinate = coordinates[m_indexes[task.first + lesserCount - 1]];
+
+	//the 'lesser' child is the next node (pre-order)
+	node.greaterChild = task.node + 1 + NodeCount(lesserCount);
+}
+
+void KDTree::buildSubTree(const BuildTask& task)
+{
+	buildNode(task);
+
+	const KdNode& node = m_nodes[task.node];
+	if (!node.isLeaf())
+	{
+		unsigned lesserCount = (task.count + 1) / 2;
+
+		BuildTask lesserTask = task;
+		lesserTask.node = task.node + 1;
+		lesserTask.count = lesserCount;
+		buildSubTree(lesserTask);
+
+		BuildTask greaterTask = task;
+		greaterTask.node = node.greaterChild;
+		greaterTask.first = task.first + lesserCount;
+		greaterTask.count = task.count - lesserCount;
+		buildSubTree(greaterTask);
+	}
+}
+
+void KDTree::BuildNode_MT(BuildTask& task)
+{
+	task.tree->buildNode(task);
+}
+
+void KDTree::BuildSubTree_MT(BuildTask& task)
+{
+	task.tree->buildSubTree(task);
+}
+
+bool KDTree::buildFromCloud(GenericIndexedCloud *cloud, GenericProgressCallback *progressCb)
+{
+	m_nodes.clear();
+	m_indexes.clear();
+	m_pointsX.clear();
+	m_pointsY.clear();
+	m_pointsZ.clear();
 	m_associatedCloud = 0;
-	m_root = 0;
 
-    if (cloudsize == 0)
-        return false;
+	unsigned cloudsize = (cloud ? cloud->size() : 0);
+	if (cloudsize == 0)
+		return false;
 
+	std::vector<PointCoordinateType> buffer;
 	try
 	{
+		m_nodes.resize(NodeCount(cloudsize));
 		m_indexes.resize(cloudsize);
+		m_pointsX.resize(cloudsize);
+		m_pointsY.resize(cloudsize);
+		m_pointsZ.resize(cloudsize);
+		buffer.resize(cloudsize);
 	}
-	catch (.../*const std::bad_alloc&*/) //out of memory
+	catch (const std::bad_alloc&) //out of memory
 	{
+		m_nodes.clear();
+		m_indexes.clear();
+		m_pointsX.clear();
+		m_pointsY.clear();
+		m_pointsZ.clear();
 		return false;
 	}
 
 	m_associatedCloud = cloud;
 
-	for (unsigned i=0; i<cloudsize; i++)
-        m_indexes[i] = i;
-
-    if (progressCb)
-    {
+	if (progressCb)
+	{
 		if (progressCb->textCanBeEdited())
 		{
 			progressCb->setInfo("Building KD-tree");
 		}
 		progressCb->update(0);
 		progressCb->start();
-    }
-
-    m_root = buildSubTree(0, cloudsize-1, (KdCell*)0, m_cellCount, progressCb);
+	}
 
-    if (progressCb)
-        progressCb->stop();
+	//copy the points coordinates (in the cloud order for now)
+	for (unsigned i = 0; i < cloudsize; )
+	{
+		unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+		const CCVector3* P = cloud->getPointsBlock(i, blockSize);
+		for (unsigned j = 0; j < blockSize; ++j, ++i, ++P)
+		{
+			m_indexes[i] = i;
+			m_pointsX[i] = P->x;
+			m_pointsY[i] = P->y;
+			m_pointsZ[i] = P->z;
+		}
+	}
 
-    //if the tree building has failed (memory issues)
-    if (!m_root)
-    {
-        m_associatedCloud = 0;
-        m_cellCount = 0;
-        return false;
-    }
+	BuildTask rootTask;
+	rootTask.tree = this;
+	rootTask.node = 0;
+	rootTask.first = 0;
+	rootTask.count = cloudsize;
+	std::vector<BuildTask> tasks(1, rootTask);
 
-	try
+#ifdef ENABLE_MT_KDTREE
+	if (cloudsize >= MT_MIN_POINT_COUNT)
 	{
-		m_indexes.resize(cloudsize);
+		QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+		size_t maxTaskCount = 4 * static_cast<size_t>(QThread::idealThreadCount());
+
+		//the first levels are built one at a time (the nodes of each level in parallel)
+		while (!tasks.empty() && tasks.size() < maxTaskCount)
+		{
+			QtConcurrent::blockingMap(tasks, BuildNode_MT);
+
+			std::vector<BuildTask> children;
+			children.reserve(tasks.size() * 2);
+			for (size_t i = 0; i < tasks.size(); ++i)
+			{
+				const BuildTask& task = tasks[i];
+				const KdNode& node = m_nodes[task.node];
+				if (!node.isLeaf())
+				{
+					unsigned lesserCount = (task.count + 1) / 2;
+
+					BuildTask lesserTask = task;
+					lesserTask.node = task.node + 1;
+					lesserTask.count = lesserCount;
+					children.push_back(lesserTask);
+
+					BuildTask greaterTask = task;
+					greaterTask.node = node.greaterChild;
+					greaterTask.first = task.first + lesserCount;
+					greaterTask.count = task.count - lesserCount;
+					children.push_back(greaterTask);
+				}
+			}
+			tasks.swap(children);
+		}
+
+		if (progressCb)
+			progressCb->update(20.0f);
+
+		//then the remaining sub-trees are built in parallel
+		QtConcurrent::blockingMap(tasks, BuildSubTree_MT);
 	}
-	catch (.../*const std::bad_alloc&*/) //out of memory
+	else
+#endif
 	{
-        m_associatedCloud = 0;
-        m_cellCount = 0;
-        return false;
-    }
-
-    return true;
-}
+		buildSubTree(rootTask);
+	}
 
+	if (progressCb)
+		progressCb->update(90.0f);
 
-void KDTree::deleteSubTree(KdCell *cell)
-{
-    if (!cell)
-        return;
-
-    deleteSubTree(cell->leSon);
-    deleteSubTree(cell->gSon);
-    delete cell;
-	assert(m_cellCount>0);
-    m_cellCount--;
-}
+	//eventually we reorder the points coordinates (so that the points of each node are contiguous)
+	std::vector<PointCoordinateType>* coordinates[3] = { &m_pointsX, &m_pointsY, &m_pointsZ };
+	for (unsigned d = 0; d < 3; ++d)
+	{
+		const std::vector<PointCoordinateType>& source = *coordinates[d];
+		for (unsigned i = 0; i < cloudsize; ++i)
+			buffer[i] = source[m_indexes[i]];
+		coordinates[d]->swap(buffer);
+	}
 
-/*** Comparison functions used by the sort function (Strict ordering must be used) ***/
-static CCLib::GenericIndexedCloud* s_comparisonCloud = 0;
+	if (progressCb)
+		progressCb->stop();
 
-//! Compares X coordinates of two points designated by their index
-static bool ComparisonX(const unsigned &a, const unsigned &b)
-{
-	return (s_comparisonCloud->getPoint(a)->x < s_comparisonCloud->getPoint(b)->x);
+	return true;
 }
 
-//! Compares Y coordinates of two points designated by their index
-static bool ComparisonY(const unsigned &a, const unsigned &b)
+ScalarType KDTree::PointToNodeSquareDistance(const PointCoordinateType *queryPoint, const KdNode& node)
 {
-	return (s_comparisonCloud->getPoint(a)->y < s_comparisonCloud->getPoint(b)->y);
-}
+	PointCoordinateType d2 = 0;
+	for (unsigned d = 0; d < 3; ++d)
+	{
+		PointCoordinateType delta = 0;
+		if (queryPoint[d] < node.bbMin.u[d])
+			delta = node.bbMin.u[d] - queryPoint[d];
+		else if (queryPoint[d] > node.bbMax.u[d])
+			delta = queryPoint[d] - node.bbMax.u[d];
+		d2 += delta * delta;
+	}
 
-//! Compares Z coordinates of two points designated by their index
-static bool ComparisonZ(const unsigned &a, const unsigned &b)
-{
-	return (s_comparisonCloud->getPoint(a)->z < s_comparisonCloud->getPoint(b)->z);
+	return static_cast<ScalarType>(d2);
 }
 
-KDTree::KdCell* KDTree::buildSubTree(unsigned first, unsigned last, KdCell* father, unsigned &nbBuildCell, GenericProgressCallback *progressCb)
+ScalarType KDTree::PointToNodeMaxSquareDistance(const PointCoordinateType *queryPoint, const KdNode& node)
 {
-    KdCell* cell = new KdCell;
-    if (!cell)
-        return 0;
-    m_cellCount++;
-
-    unsigned dim = (father == 0 ? 0 : ((father->cuttingDim+1) % 3));
-
-    //Compute outside bounding box (have to be done before building the current cell sons)
-    cell->father = father;
-    cell->startingPointIndex = first;
-    cell->nbPoints = last-first+1;
-    cell->cuttingDim = dim;
-    updateOutsideBoundingBox(cell);
-    if (progressCb)
-        progressCb->update(m_cellCount*100.0f/(m_indexes.size()*2.0f-1.0f));
-
-    //If there is only one point to insert, build a leaf
-    if (first == last)
-    {
-        cell->cuttingDim = 0;
-        cell->leSon = 0;
-        cell->gSon = 0;
-    }
-    else
-    {
-        //sort the remaining points considering dimension dim
-		s_comparisonCloud = m_associatedCloud; //TODO: not compatible with parallelism!!!
-        if (dim == 0)
-            sort(m_indexes.begin()+first, m_indexes.begin()+(last+1), ComparisonX);
-        else if (dim == 1)
-            sort(m_indexes.begin()+first, m_indexes.begin()+(last+1), ComparisonY);
-        else if (dim == 2)
-            sort(m_indexes.begin()+first, m_indexes.begin()+(last+1), ComparisonZ);
-        //find the median point in the sorted tab
-        unsigned split = (first+last)/2;
-        const CCVector3* P = m_associatedCloud->getPoint(m_indexes[split]);
-        cell->cuttingCoordinate = P->u[dim];
-        //recursively build the other two sub trees
-        //trap the memory issues. At this point, none of the cell sons can be set to 0. Otherwise there has been memory allocation failure.
-        cell->leSon = cell->gSon = 0;
-        cell->leSon = buildSubTree(first, split, cell, nbBuildCell, progressCb);
-        if (cell->leSon == 0)
-        {
-            deleteSubTree(cell);
-            //the tree beyond the current cell will be deleted when noticing that this cell is set to 0
-            return 0;
-        }
-        cell->gSon = buildSubTree(split+1, last, cell, nbBuildCell, progressCb);
-        if (cell->gSon == 0)
-        {
-            deleteSubTree(cell);
-            //the tree beyond the current cell will be deleted when noticing that this cell is set to 0
-            return 0;
-        }
-
-    }
-    //Compute inside bounding box (have to be done once sons have been built)
-    updateInsideBoundingBox(cell);
-
-    return cell;
-}
+	PointCoordinateType d2 = 0;
+	for (unsigned d = 0; d < 3; ++d)
+	{
+		PointCoordinateType delta = std::max(std::abs(queryPoint[d] - node.bbMin.u[d]), std::abs(queryPoint[d] - node.bbMax.u[d]));
+		d2 += delta * delta;
+	}
 
+	return static_cast<ScalarType>(d2);
+}
 
 bool KDTree::findNearestNeighbour(	const PointCoordinateType *queryPoint,
 									unsigned &nearestPointIndex,
-									ScalarType maxDist)
+									ScalarType maxDist) const
 {
-    if (m_root == 0)
-        return false;
-
-    maxDist *= maxDist;
-
-    //Go down the tree to find which cell contains the query point (at most log2(N) tests where N is the total number of points in the cloud)
-	KdCell* cellPtr = m_root;
-    while (cellPtr->leSon != 0 || cellPtr->gSon != 0)
-    {
-        if (queryPoint[cellPtr->cuttingDim] <= cellPtr->cuttingCoordinate)
-            cellPtr = cellPtr->leSon;
-        else
-            cellPtr = cellPtr->gSon;
-    }
-
-    //Once we found the cell containing the query point, the nearest neighbour has great chances to lie in this cell
-    bool found = false;
-    for (unsigned i=0; i<cellPtr->nbPoints; i++)
-    {
-        const CCVector3 *p = m_associatedCloud->getPoint(m_indexes[cellPtr->startingPointIndex+i]);
-        PointCoordinateType sqrdist = CCVector3::vdistance2(p->u, queryPoint);
-        if (sqrdist < maxDist)
-        {
-            maxDist = static_cast<ScalarType>(sqrdist);
-            nearestPointIndex = m_indexes[cellPtr->startingPointIndex+i];
-            found = true;
-        }
-    }
-
-    //Go up in the tree to check that neighbours cells do not contain a nearer point than the one we found
-    while (cellPtr != 0)
-    {
-        KdCell* prevPtr = cellPtr;
-        cellPtr = cellPtr->father;
-        if (cellPtr != 0)
-        {
-            ScalarType sqrdist = InsidePointToCellDistance(queryPoint, cellPtr);
-            if (sqrdist >= 0 && sqrdist*sqrdist < maxDist)
-            {
-				KdCell* brotherPtr = (cellPtr->leSon == prevPtr ? cellPtr->gSon : cellPtr->leSon);
-                int a = checkNearerPointInSubTree(queryPoint, maxDist, brotherPtr);
-                if (a >= 0)
-                {
-                    nearestPointIndex = a;
-                    found = true;
-                }
-            }
-            else
+	if (m_nodes.empty())
+		return false;
+
+	ScalarType maxSqrDist = maxDist*maxDist;
+	bool found = false;
+
+	unsigned stack[MAX_TREE_DEPTH + 1];
+	unsigned stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize != 0)
+	{
+		unsigned nodeIndex = stack[--stackSize];
+		const KdNode& node = m_nodes[nodeIndex];
+		if (PointToNodeSquareDistance(queryPoint, node) >= maxSqrDist)
+			continue;
+
+		if (node.isLeaf())
+		{
+			const PointCoordinateType* X = &(m_pointsX[node.firstPoint]);
+			const PointCoordinateType* Y = &(m_pointsY[node.firstPoint]);
+			const PointCoordinateType* Z = &(m_pointsZ[node.firstPoint]);
+			for (unsigned i = 0; i < node.pointCount; ++i)
+			{
+				PointCoordinateType dx = X[i] - queryPoint[0];
+				PointCoordinateType dy = Y[i] - queryPoint[1];
+				PointCoordinateType dz = Z[i] - queryPoint[2];
+				PointCoordinateType sqrdist = dx*dx + dy*dy + dz*dz;
+				if (sqrdist < maxSqrDist)
+				{
+					maxSqrDist = static_cast<ScalarType>(sqrdist);
+					nearestPointIndex = m_indexes[node.firstPoint + i];
+					found = true;
+				}
+			}
+		}
+		else
+		{
+			//the nearest child is processed first
+			if (queryPoint[node.cuttingDim] <= node.cuttingCoordinate)
+			{
+				stack[stackSize++] = node.greaterChild;
+				stack[stackSize++] = nodeIndex + 1;
+			}
+			else
 			{
-                cellPtr = 0;
+				stack[stackSize++] = nodeIndex + 1;
+				stack[stackSize++] = node.greaterChild;
 			}
-        }
-    }
+		}
+	}
 
-    return found;
+	return found;
 }
 
 bool KDTree::findPointBelowDistance(const PointCoordinateType *queryPoint,
-									ScalarType maxDist)
+									ScalarType maxDist) const
 {
-    if (m_root == 0)
-        return false;
-
-    maxDist *= maxDist;
-
-	KdCell* cellPtr = m_root;
-    //Go down the tree to find which cell contains the query point (at most log2(N) tests where N is the total number of points in the cloud)
-    while (!(cellPtr->leSon == 0 && cellPtr->gSon == 0))
-    {
-        if (queryPoint[cellPtr->cuttingDim] <= cellPtr->cuttingCoordinate)
-            cellPtr = cellPtr->leSon;
-        else
-            cellPtr = cellPtr->gSon;
-    }
-
-    //Once we found the cell containing the query point, there are great chance to find a point if it exists
-    for (unsigned i=0; i<cellPtr->nbPoints; i++)
-    {
-		const CCVector3 *p = m_associatedCloud->getPoint(m_indexes[cellPtr->startingPointIndex+i]);
-        PointCoordinateType sqrdist = CCVector3::vdistance2(p->u, queryPoint);
-        if (sqrdist < static_cast<PointCoordinateType>(maxDist))
-            return true;
-    }
-
-    //Go up in the tree to check that neighbours cells do not contain a point
-    while (cellPtr != 0)
-    {
-        KdCell* prevPtr = cellPtr;
-        cellPtr = cellPtr->father;
-        if (cellPtr != 0)
-        {
-            ScalarType sqrdist = InsidePointToCellDistance(queryPoint, cellPtr);
-            if (sqrdist >= 0 && sqrdist*sqrdist < maxDist)
-            {
-				KdCell* brotherPtr = (cellPtr->leSon == prevPtr ? cellPtr->gSon : cellPtr->leSon);
-                if (checkDistantPointInSubTree(queryPoint, maxDist, brotherPtr))
-                    return true;
-            }
-            else
+	if (m_nodes.empty())
+		return false;
+
+	ScalarType maxSqrDist = maxDist*maxDist;
+
+	unsigned stack[MAX_TREE_DEPTH + 1];
+	unsigned stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize != 0)
+	{
+		unsigned nodeIndex = stack[--stackSize];
+		const KdNode& node = m_nodes[nodeIndex];
+		if (PointToNodeSquareDistance(queryPoint, node) >= maxSqrDist)
+			continue;
+
+		if (node.isLeaf())
+		{
+			const PointCoordinateType* X = &(m_pointsX[node.firstPoint]);
+			const PointCoordinateType* Y = &(m_pointsY[node.firstPoint]);
+			const PointCoordinateType* Z = &(m_pointsZ[node.firstPoint]);
+			for (unsigned i = 0; i < node.pointCount; ++i)
 			{
-                cellPtr = 0;
+				PointCoordinateType dx = X[i] - queryPoint[0];
+				PointCoordinateType dy = Y[i] - queryPoint[1];
+				PointCoordinateType dz = Z[i] - queryPoint[2];
+				if (dx*dx + dy*dy + dz*dz < maxSqrDist)
+					return true;
 			}
-        }
-    }
+		}
+		else
+		{
+			//the nearest child is processed first
+			if (queryPoint[node.cuttingDim] <= node.cuttingCoordinate)
+			{
+				stack[stackSize++] = node.greaterChild;
+				stack[stackSize++] = nodeIndex + 1;
+			}
+			else
+			{
+				stack[stackSize++] = nodeIndex + 1;
+				stack[stackSize++] = node.greaterChild;
+			}
+		}
+	}
 
-    return false;
+	return false;
 }
 
 unsigned KDTree::findPointsLyingToDistance(const PointCoordinateType *queryPoint,
 											ScalarType distance,
 											ScalarType tolerance,
-											std::vector<unsigned> &points)
+											std::vector<unsigned> &points) const
 {
-    if (m_root == 0)
-        return 0;
+	if (m_nodes.empty())
+		return 0;
 
-    distanceScanTree(queryPoint, distance, tolerance, m_root, points);
+	ScalarType minDist = distance - tolerance;
+	ScalarType maxDist = distance + tolerance;
+	if (maxDist < 0)
+		return static_cast<unsigned>(points.size());
+	ScalarType minSqrDist = (minDist > 0 ? minDist*minDist : 0);
+	ScalarType maxSqrDist = maxDist*maxDist;
 
-    return static_cast<unsigned>(points.size());
-}
+	unsigned stack[MAX_TREE_DEPTH + 1];
+	unsigned stackSize = 0;
+	stack[stackSize++] = 0;
 
+	while (stackSize != 0)
+	{
+		unsigned nodeIndex = stack[--stackSize];
+		const KdNode& node = m_nodes[nodeIndex];
 
-void KDTree::updateInsideBoundingBox(KdCell* cell)
-{
-    if (cell->leSon != 0 && cell->gSon != 0)
-    {
-        cell->inbbmax.x = std::max(cell->leSon->inbbmax.x, cell->gSon->inbbmax.x);
-        cell->inbbmax.y = std::max(cell->leSon->inbbmax.y, cell->gSon->inbbmax.y);
-        cell->inbbmax.z = std::max(cell->leSon->inbbmax.z, cell->gSon->inbbmax.z);
-        cell->inbbmin.x = std::min(cell->leSon->inbbmin.x, cell->gSon->inbbmin.x);
-        cell->inbbmin.y = std::min(cell->leSon->inbbmin.y, cell->gSon->inbbmin.y);
-        cell->inbbmin.z = std::min(cell->leSon->inbbmin.z, cell->gSon->inbbmin.z);
-    }
-    else
-    {
-        const CCVector3* P = m_associatedCloud->getPoint(m_indexes[cell->startingPointIndex]);
-        cell->inbbmin = cell->inbbmax = *P;
-        for (unsigned i=1; i<cell->nbPoints; i++)
-        {
-            P = m_associatedCloud->getPoint(m_indexes[i+cell->startingPointIndex]);
-            cell->inbbmax.x = std::max(cell->inbbmax.x, P->x);
-            cell->inbbmax.y = std::max(cell->inbbmax.y, P->y);
-            cell->inbbmax.z = std::max(cell->inbbmax.z, P->z);
-            cell->inbbmin.x = std::min(cell->inbbmin.x, P->x);
-            cell->inbbmin.y = std::min(cell->inbbmin.y, P->y);
-            cell->inbbmin.z = std::min(cell->inbbmin.z, P->z);
-        }
-    }
-}
+		//the node is outside of the spherical shell
+		if (PointToNodeSquareDistance(queryPoint, node) > maxSqrDist)
+			continue;
+		ScalarType nodeMaxSqrDist = PointToNodeMaxSquareDistance(queryPoint, node);
+		if (nodeMaxSqrDist < minSqrDist)
+			continue;
 
+		if (node.isLeaf())
+		{
+			const PointCoordinateType* X = &(m_pointsX[node.firstPoint]);
+			const PointCoordinateType* Y = &(m_pointsY[node.firstPoint]);
+			const PointCoordinateType* Z = &(m_pointsZ[node.firstPoint]);
+			for (unsigned i = 0; i < node.pointCount; ++i)
+			{
+				PointCoordinateType dx = X[i] - queryPoint[0];
+				PointCoordinateType dy = Y[i] - queryPoint[1];
+				PointCoordinateType dz = Z[i] - queryPoint[2];
+				ScalarType sqrdist = static_cast<ScalarType>(dx*dx + dy*dy + dz*dz);
+				if (sqrdist >= minSqrDist && sqrdist <= maxSqrDist)
+					points.push_back(m_indexes[node.firstPoint + i]);
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node.greaterChild;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
 
-void KDTree::updateOutsideBoundingBox(KdCell *cell)
-{
-    if (cell->father == 0)
-    {
-        cell->boundsMask = 0;
-    }
-    else
-    {
-        unsigned char bound = 1;
-        cell->boundsMask = cell->father->boundsMask;
-        cell->outbbmax = cell->father->outbbmax;
-        cell->outbbmin = cell->father->outbbmin;
-        const CCVector3* P = m_associatedCloud->getPoint(m_indexes[cell->startingPointIndex]);
-        //Check if this cell is its father leSon (if...) or gSon (else...)
-        if (P->u[cell->father->cuttingDim] <= cell->father->cuttingCoordinate)
-        {
-            //Bounding box max point is linked to the bits [3..5] in the bounds mask
-            bound = bound<<(3+cell->father->cuttingDim);
-            cell->boundsMask = cell->boundsMask | bound;
-            cell->outbbmax.u[cell->father->cuttingDim] = cell->father->cuttingCoordinate;
-        }
-        else
-        {
-            //Bounding box min point is linked to the bits[0..2] in the bounds mask
-            bound = bound<<(cell->father->cuttingDim);
-            cell->boundsMask = cell->boundsMask | bound;
-            cell->outbbmin.u[cell->father->cuttingDim] = cell->father->cuttingCoordinate;
-        }
-    }
+	return static_cast<unsigned>(points.size());
 }
 
-ScalarType KDTree::pointToCellSquareDistance(const PointCoordinateType *queryPoint, KdCell *cell)
+unsigned KDTree::findPointsInRadius(const PointCoordinateType *queryPoint,
+									ScalarType radius,
+									std::vector<unsigned> &points) const
 {
-    PointCoordinateType dx, dy, dz;
-
-    //Each d(x)(y)(z) represents the distance to the nearest bounding box plane (if the point is outside)
-    if (cell->inbbmin.x <= queryPoint[0] && queryPoint[0] <= cell->inbbmax.x)
-        dx = 0;
-    else
-        dx = std::min(fabs(queryPoint[0]-cell->inbbmin.x), fabs(queryPoint[0]-cell->inbbmax.x));
-    
-	if (cell->inbbmin.y <= queryPoint[1] && queryPoint[1] <= cell->inbbmax.y)
-        dy = 0;
-    else
-        dy = std::min(fabs(queryPoint[1]-cell->inbbmin.y), fabs(queryPoint[1]-cell->inbbmax.y));
-    
-	if (cell->inbbmin.z <= queryPoint[2] && queryPoint[2] <= cell->inbbmax.z)
-        dz = 0;
-    else
-        dz = std::min(fabs(queryPoint[2]-cell->inbbmin.z), fabs(queryPoint[2]-cell->inbbmax.z));
-
-    return static_cast<ScalarType>(dx*dx + dy*dy + dz*dz);
-}
+	if (m_nodes.empty() || radius < 0)
+		return 0;
 
-void KDTree::pointToCellDistances(	const PointCoordinateType *queryPoint,
-									KdCell *cell,
-									ScalarType& min,
-									ScalarType& max)
-{
-    PointCoordinateType dx, dy, dz;
+	size_t previousCount = points.size();
+	ScalarType sqrRadius = radius*radius;
 
-    min = sqrt(pointToCellSquareDistance(queryPoint, cell));
-    dx = std::max(fabs(queryPoint[0]-cell->inbbmin.x), fabs(queryPoint[0]-cell->inbbmax.x));
-    dy = std::max(fabs(queryPoint[1]-cell->inbbmin.y), fabs(queryPoint[1]-cell->inbbmax.y));
-    dz = std::max(fabs(queryPoint[2]-cell->inbbmin.z), fabs(queryPoint[2]-cell->inbbmax.z));
-    max = static_cast<ScalarType>( sqrt(dx*dx + dy*dy + dz*dz) );
-}
+	unsigned stack[MAX_TREE_DEPTH + 1];
+	unsigned stackSize = 0;
+	stack[stackSize++] = 0;
 
-ScalarType KDTree::InsidePointToCellDistance(const PointCoordinateType *queryPoint, KdCell *cell)
-{
-    PointCoordinateType dx, dy, dz, max;
-
-    dx = dy = dz = -1;
-
-    if ((cell->boundsMask&1) && (cell->boundsMask&8))
-        dx = std::min(fabs(queryPoint[0]-cell->outbbmin.x), fabs(queryPoint[0]-cell->outbbmax.x));
-    else if (cell->boundsMask&1)
-        dx = fabs(queryPoint[0]-cell->outbbmin.x);
-    else if (cell->boundsMask&8)
-        dx = fabs(queryPoint[0]-cell->outbbmax.x);
-
-    if ((cell->boundsMask&2) && (cell->boundsMask&16))
-        dy = std::min(fabs(queryPoint[1]-cell->outbbmin.y), fabs(queryPoint[1]-cell->outbbmax.y));
-    else if (cell->boundsMask&2)
-        dy = fabs(queryPoint[1]-cell->outbbmin.y);
-    else if (cell->boundsMask&16)
-        dy = fabs(queryPoint[1]-cell->outbbmax.y);
-
-    if ((cell->boundsMask&4) && (cell->boundsMask&32))
-        dz = std::min(fabs(queryPoint[2]-cell->outbbmin.z), fabs(queryPoint[2]-cell->outbbmax.z));
-    else if (cell->boundsMask&4)
-        dz = fabs(queryPoint[2]-cell->outbbmin.z);
-    else if (cell->boundsMask&32)
-        dz = fabs(queryPoint[2]-cell->outbbmax.z);
-
-    if (dx < 0 && dy < 0 && dz < 0)
-        return -1;
-
-    max = std::max(dx, std::max(dy, dz));
-    if (dx < 0)
-        dx = max;
-    if (dy < 0)
-        dy = max;
-    if (dz < 0)
-        dz = max;
-
-    return static_cast<ScalarType>( std::min(dx, std::min(dy, dz)) );
-}
+	while (stackSize != 0)
+	{
+		unsigned nodeIndex = stack[--stackSize];
+		const KdNode& node = m_nodes[nodeIndex];
 
-int KDTree::checkNearerPointInSubTree(	const PointCoordinateType *queryPoint,
-										ScalarType& maxSqrDist,
-										KdCell *cell)
-{
-    if (pointToCellSquareDistance(queryPoint, cell) >= maxSqrDist)
-        return -1;
-
-    if (cell->leSon == 0 && cell->gSon == 0)
-    {
-        int a = -1;
-        for (unsigned i=0; i<cell->nbPoints; i++)
-        {
-            const CCVector3 *p = m_associatedCloud->getPoint(m_indexes[cell->startingPointIndex+i]);
-            PointCoordinateType dist = CCVector3::vdistance2(p->u, queryPoint);
-            if (dist < maxSqrDist)
-            {
-                a = m_indexes[cell->startingPointIndex+i];
-                maxSqrDist = static_cast<ScalarType>(dist);
-            }
-        }
-
-        return a;
-    }
-
-	int b = checkNearerPointInSubTree(queryPoint, maxSqrDist, cell->gSon);
-	if (b >= 0)
-		return b;
-
-	return checkNearerPointInSubTree(queryPoint, maxSqrDist, cell->leSon);
-}
+		if (PointToNodeSquareDistance(queryPoint, node) > sqrRadius)
+			continue;
 
-bool KDTree::checkDistantPointInSubTree(const PointCoordinateType *queryPoint, ScalarType &maxSqrDist, KdCell *cell)
-{
-    if (pointToCellSquareDistance(queryPoint, cell)>=maxSqrDist)
-        return false;
-
-    if (cell->leSon == 0 && cell->gSon == 0)
-    {
-        for (unsigned i=0; i<cell->nbPoints; i++)
-        {
-            const CCVector3 *p = m_associatedCloud->getPoint(m_indexes[cell->startingPointIndex+i]);
-            PointCoordinateType dist = CCVector3::vdistance2(p->u, queryPoint);
-            if (dist < maxSqrDist)
-                return true;
-        }
-        return false;
-    }
-
-    if (checkDistantPointInSubTree(queryPoint,  maxSqrDist, cell->leSon))
-        return true;
-    if (checkDistantPointInSubTree(queryPoint,  maxSqrDist, cell->gSon))
-        return true;
-
-    return false;
+		//the node is completely inside the sphere
+		if (PointToNodeMaxSquareDistance(queryPoint, node) <= sqrRadius)
+		{
+			points.insert(points.end(), m_indexes.begin() + node.firstPoint, m_indexes.begin() + (node.firstPoint + node.pointCount));
+		}
+		else if (node.isLeaf())
+		{
+			const PointCoordinateType* X = &(m_pointsX[node.firstPoint]);
+			const PointCoordinateType* Y = &(m_pointsY[node.firstPoint]);
+			const PointCoordinateType* Z = &(m_pointsZ[node.firstPoint]);
+			for (unsigned i = 0; i < node.pointCount; ++i)
+			{
+				PointCoordinateType dx = X[i] - queryPoint[0];
+				PointCoordinateType dy = Y[i] - queryPoint[1];
+				PointCoordinateType dz = Z[i] - queryPoint[2];
+				if (dx*dx + dy*dy + dz*dz <= sqrRadius)
+					points.push_back(m_indexes[node.firstPoint + i]);
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node.greaterChild;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+
+	return static_cast<unsigned>(points.size() - previousCount);
 }
 
-void KDTree::distanceScanTree(
-    const PointCoordinateType *queryPoint,
-    ScalarType distance,
-    ScalarType tolerance,
-    KdCell *cell,
-    std::vector<unsigned> &localArray)
+unsigned KDTree::findNearestNeighbours(	const PointCoordinateType *queryPoint,
+										unsigned k,
+										std::vector<unsigned> &points,
+										std::vector<ScalarType>* squareDistances/*=0*/,
+										ScalarType maxDist/*=-1*/) const
 {
-    ScalarType min, max;
-
-    pointToCellDistances(queryPoint, cell, min, max);
-
-    if ((min<=distance+tolerance) && (max>=distance-tolerance))
-    {
-        if ((cell->leSon!=0) && (cell->gSon!=0))
-        {
-            //This case shall always happen (the other case is for leaves that contain more than one point - bucket KDtree)
-            if (cell->nbPoints == 1)
-            {
-                localArray.push_back(m_indexes[cell->startingPointIndex]);
-            }
-            else
-            {
-                for (unsigned i=0; i<cell->nbPoints; i++)
-                {
-                    const CCVector3 *p = m_associatedCloud->getPoint(m_indexes[i+cell->startingPointIndex]);
-                    PointCoordinateType dist = CCVector3::vdistance(queryPoint, p->u);
-                    if (distance-tolerance <= dist && dist <= distance+tolerance)
-                        localArray.push_back(m_indexes[cell->startingPointIndex+i]);
-                }
-            }
-        }
-        else
-        {
-            distanceScanTree(queryPoint, distance, tolerance, cell->leSon, localArray);
-            distanceScanTree(queryPoint, distance, tolerance, cell->gSon, localArray);
-        }
-    }
+	points.clear();
+	if (m_nodes.empty() || k == 0)
+		return 0;
+
+	std::vector<ScalarType> localSquareDistances;
+	std::vector<ScalarType>& sqrDists = (squareDistances ? *squareDistances : localSquareDistances);
+	sqrDists.clear();
+
+	//squared distance of the k-th neighbour (or max distance)
+	ScalarType worstSqrDist = (maxDist >= 0 ? maxDist*maxDist : std::numeric_limits<ScalarType>::max());
+
+	unsigned stack[MAX_TREE_DEPTH + 1];
+	unsigned stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize != 0)
+	{
+		unsigned nodeIndex = stack[--stackSize];
+		const KdNode& node = m_nodes[nodeIndex];
+		if (PointToNodeSquareDistance(queryPoint, node) > worstSqrDist)
+			continue;
+
+		if (node.isLeaf())
+		{
+			const PointCoordinateType* X = &(m_pointsX[node.firstPoint]);
+			const PointCoordinateType* Y = &(m_pointsY[node.firstPoint]);
+			const PointCoordinateType* Z = &(m_pointsZ[node.firstPoint]);
+			for (unsigned i = 0; i < node.pointCount; ++i)
+			{
+				PointCoordinateType dx = X[i] - queryPoint[0];
+				PointCoordinateType dy = Y[i] - queryPoint[1];
+				PointCoordinateType dz = Z[i] - queryPoint[2];
+				ScalarType sqrdist = static_cast<ScalarType>(dx*dx + dy*dy + dz*dz);
+				if (sqrdist > worstSqrDist)
+					continue;
+
+				//insertion (the neighbours are kept sorted)
+				size_t pos = sqrDists.size();
+				if (pos < k)
+				{
+					sqrDists.push_back(sqrdist);
+					points.push_back(0);
+				}
+				else
+				{
+					--pos;
+				}
+				for (; pos > 0 && sqrDists[pos - 1] > sqrdist; --pos)
+				{
+					sqrDists[pos] = sqrDists[pos - 1];
+					points[pos] = points[pos - 1];
+				}
+				sqrDists[pos] = sqrdist;
+				points[pos] = m_indexes[node.firstPoint + i];
+
+				if (sqrDists.size() == k)
+					worstSqrDist = sqrDists.back();
+			}
+		}
+		else
+		{
+			//the nearest child is processed first
+			if (queryPoint[node.cuttingDim] <= node.cuttingCoordinate)
+			{
+				stack[stackSize++] = node.greaterChild;
+				stack[stackSize++] = nodeIndex + 1;
+			}
+			else
+			{
+				stack[stackSize++] = nodeIndex + 1;
+				stack[stackSize++] = node.greaterChild;
+			}
+		}
+	}
+
+	return static_cast<unsigned>(points.size());
 }
@@ -24,6 +24,7 @@
 #include "GenericIndexedMesh.h"
 #include "DistanceComputationTools.h"
 #include "Neighbourhood.h"
+#include "SimpleTriangle.h"
 
 //system
 #include <string.h>
@@ -66,12 +67,15 @@ protected:
 };
 
 //! Delaunay 2D1/2 "local modelization"
+/** The triangles are accessed by index (and not with the mesh iterator) so that
+	the model can be shared by several threads (see Cloud2CloudReferenceContext).
+**/
 class DelaunayLocalModel : public LocalModel
 {
 public:
 
 	//! Constructor
-	DelaunayLocalModel(GenericMesh* tri, const CCVector3 &center, PointCoordinateType squaredRadius)
+	DelaunayLocalModel(GenericIndexedMesh* tri, const CCVector3 &center, PointCoordinateType squaredRadius)
 		: LocalModel(center, squaredRadius)
 		, m_tri(tri)
 	{
@@ -90,16 +94,21 @@ public:
 		ScalarType minDist2 = NAN_VALUE;
 		if (m_tri)
 		{
-			m_tri->placeIteratorAtBegining();
+			CCVector3 triNearestPoint;
 			unsigned numberOfTriangles = m_tri->size();
 			for (unsigned i=0; i<numberOfTriangles; ++i)
 			{
-				GenericTriangle* tri = m_tri->_getNextTriangle();
-				ScalarType dist2 = DistanceComputationTools::computePoint2TriangleDistance(P, tri, false, nearestPoint);
+				SimpleTriangle tri;
+				m_tri->getTriangleVertices(i, tri.A, tri.B, tri.C);
+				ScalarType dist2 = DistanceComputationTools::computePoint2TriangleDistance(P, &tri, false, nearestPoint ? &triNearestPoint : 0);
 				if (dist2 < minDist2 || i == 0)
 				{
 					//keep track of the smallest distance
 					minDist2 = dist2;
+					if (nearestPoint)
+					{
+						*nearestPoint = triNearestPoint;
+					}
 				}
 			}
 		}
@@ -113,7 +122,7 @@ public:
 protected:
 
 	//! Associated triangulation
-	GenericMesh* m_tri;
+	GenericIndexedMesh* m_tri;
 };
 
 //! Quadric "local modelization"
@@ -204,7 +213,7 @@ LocalModel* LocalModel::New(CC_LOCAL_MODEL_TYPES type,
 
 	case TRI:
 	{
-		GenericMesh* tri = subset.triangulateOnPlane(true); //'subset' is potentially associated to a volatile ReferenceCloud, so we must duplicate vertices!
+		GenericIndexedMesh* tri = subset.triangulateOnPlane(true); //'subset' is potentially associated to a volatile ReferenceCloud, so we must duplicate vertices!
 		if (tri)
 		{
 			return new DelaunayLocalModel(tri, center, squaredRadius);
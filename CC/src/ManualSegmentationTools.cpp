@@ -28,50 +28,167 @@
 #include "SimpleMesh.h"
 #include "Polyline.h"
 #include "ChunkedPointCloud.h"
+#include "PolygonInclusionGrid.h"
 
 //system
+#include <algorithm>
 #include <string.h>
 #include <assert.h>
+#include <new>
+#include <vector>
+
+#ifdef USE_QT
+#ifndef _DEBUG
+//enables multi-threading handling
+#define ENABLE_MT_SEGMENTATION
+#endif
+#endif
+
+#ifdef ENABLE_MT_SEGMENTATION
+#include <QtCore>
+#include <QtConcurrentMap>
+#endif
 
 using namespace CCLib;
 
+//! Number of points per block (segmentation by polygon)
+static const unsigned SEGMENTATION_BLOCK_SIZE = 65536;
+
+//! Segmentation by polygon parameters
+struct PolySegmentationParams
+{
+	GenericIndexedCloudPersist* cloud;
+	const SquareMatrix* trans;
+	const PolygonInclusionGrid* grid;
+	const Polyline* poly;
+	bool keepInside;
+	std::vector<unsigned char>* keptPoints;
+};
+
+//! Flags the points of a block that should be kept
+static void SegmentBlock(const PolySegmentationParams& params, unsigned blockIndex)
+{
+	unsigned firstIndex = blockIndex * SEGMENTATION_BLOCK_SIZE;
+	unsigned lastIndex = std::min(firstIndex + SEGMENTATION_BLOCK_SIZE, params.cloud->size());
+	for (unsigned i = firstIndex; i < lastIndex; ++i)
+	{
+		CCVector3 P;
+		params.cloud->getPoint(i, P);
+
+		//we project the point in screen space first if necessary
+		if (params.trans)
+		{
+			P = (*params.trans) * P;
+		}
+
+		CCVector2 P2D(P.x, P.y);
+		bool pointInside = (params.grid ? params.grid->isInside(P2D) : ManualSegmentationTools::isPointInsidePoly(P2D, params.poly));
+		(*params.keptPoints)[i] = (params.keepInside == pointInside ? 1 : 0);
+	}
+}
+
+#ifdef ENABLE_MT_SEGMENTATION
+static QMutex s_polySegmentation_MT_mutex;
+static const PolySegmentationParams* s_polySegmentation_MT = 0;
+
+static void SegmentBlock_MT(const unsigned& blockIndex)
+{
+	SegmentBlock(*s_polySegmentation_MT, blockIndex);
+}
+#endif
+
 ReferenceCloud* ManualSegmentationTools::segment(GenericIndexedCloudPersist* aCloud, const Polyline* poly, bool keepInside, const float* viewMat)
 {
 	assert(poly && aCloud);
 
+	unsigned count = aCloud->size();
+
+	//the polygon is rasterized first (so as to avoid testing all its edges for each point)
+	PolygonInclusionGrid grid;
+	bool useGrid = grid.build(poly);
+
+	std::vector<unsigned char> keptPoints;
+	try
+	{
+		keptPoints.resize(count, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return 0;
+	}
+
 	CCLib::SquareMatrix* trans = (viewMat ? new CCLib::SquareMatrix(viewMat) : 0);
 
-	ReferenceCloud* Y = new ReferenceCloud(aCloud);
+	PolySegmentationParams params;
+	params.cloud = aCloud;
+	params.trans = trans;
+	params.grid = (useGrid ? &grid : 0);
+	params.poly = poly;
+	params.keepInside = keepInside;
+	params.keptPoints = &keptPoints;
 
 	//we check for each point if it falls inside the polyline
-	unsigned count = aCloud->size();
-	for (unsigned i = 0; i < count; ++i)
+	unsigned blockCount = (count + SEGMENTATION_BLOCK_SIZE - 1) / SEGMENTATION_BLOCK_SIZE;
+	bool processed = false;
+#ifdef ENABLE_MT_SEGMENTATION
+	if (blockCount > 1 && s_polySegmentation_MT_mutex.tryLock())
 	{
-		CCVector3 P;
-		aCloud->getPoint(i, P);
+		std::vector<unsigned> blocks;
+		try
+		{
+			blocks.resize(blockCount);
+			for (unsigned b = 0; b < blockCount; ++b)
+			{
+				blocks[b] = b;
+			}
 
-		//we project the point in screen space first if necessary
-		if (trans)
+			s_polySegmentation_MT = &params;
+			QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+			QtConcurrent::blockingMap(blocks, SegmentBlock_MT);
+			s_polySegmentation_MT = 0;
+			processed = true;
+		}
+		catch (const std::bad_alloc&)
 		{
-			P = (*trans) * P;
+			//not enough memory: we'll use the sequential version
 		}
-
-		bool pointInside = isPointInsidePoly(CCVector2(P.x, P.y), poly);
-		if ((keepInside && pointInside) || (!keepInside && !pointInside))
+		s_polySegmentation_MT_mutex.unlock();
+	}
+#endif
+	if (!processed)
+	{
+		for (unsigned b = 0; b < blockCount; ++b)
 		{
-			if (!Y->addPointIndex(i))
-			{
-				//not engouh memory
-				delete Y;
-				Y = 0;
-				break;
-			}
+			SegmentBlock(params, b);
 		}
 	}
 
 	if (trans)
 		delete trans;
 
+	ReferenceCloud* Y = new ReferenceCloud(aCloud);
+
+	unsigned keptCount = 0;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		keptCount += keptPoints[i];
+	}
+	if (keptCount != 0 && !Y->reserve(keptCount))
+	{
+		//not enough memory
+		delete Y;
+		return 0;
+	}
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		if (keptPoints[i])
+		{
+			Y->addPointIndex(i); //can't fail (see above)
+		}
+	}
+
 	return Y;
 }
 
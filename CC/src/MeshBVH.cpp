@@ -0,0 +1,727 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "MeshBVH.h"
+
+//local
+#include "DistanceComputationTools.h"
+#include "GenericIndexedMesh.h"
+#include "GenericProgressCallback.h"
+
+//system
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+#include <limits>
+#include <stdio.h>
+
+using namespace CCLib;
+
+//! Number of bins used to evaluate the SAH
+static const unsigned SAH_BIN_COUNT = 16;
+//! Depth above which the triangles are simply split at the median (to bound the tree depth)
+static const unsigned MAX_SAH_DEPTH = 48;
+//! Max query stack size
+static const unsigned MAX_STACK_SIZE = 128;
+//! Relative tolerance on the bounding-boxes distances (so as to never cull a box because of rounding errors)
+static const PointCoordinateType BOX_DISTANCE_TOLERANCE = static_cast<PointCoordinateType>(1.0e-5);
+
+MeshBVH::MeshBVH()
+	: m_mesh(0)
+{
+}
+
+void MeshBVH::clear()
+{
+	m_mesh = 0;
+	m_nodes.clear();
+	m_triangles.clear();
+	m_indexes.clear();
+	m_positions.clear();
+	m_vertIndexes.clear();
+	m_edgeNormals.clear();
+	m_vertexNormals.clear();
+	m_centroids.clear();
+}
+
+//! Returns the half surface area of a box
+static inline double HalfArea(const CCVector3& bbMin, const CCVector3& bbMax)
+{
+	CCVector3d d(	static_cast<double>(bbMax.x) - bbMin.x,
+					static_cast<double>(bbMax.y) - bbMin.y,
+					static_cast<double>(bbMax.z) - bbMin.z);
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+//! Extends a box with the vertices of a triangle
+static inline void AddTriangle(const SimpleTriangle& tri, CCVector3& bbMin, CCVector3& bbMax)
+{
+	for (unsigned char k = 0; k < 3; ++k)
+	{
+		bbMin.u[k] = std::min(bbMin.u[k], std::min(tri.A.u[k], std::min(tri.B.u[k], tri.C.u[k])));
+		bbMax.u[k] = std::max(bbMax.u[k], std::max(tri.A.u[k], std::max(tri.B.u[k], tri.C.u[k])));
+	}
+}
+
+//! Returns an 'empty' box (i.e. that any point can extend)
+static inline void InitBox(CCVector3& bbMin, CCVector3& bbMax)
+{
+	PointCoordinateType maxVal = std::numeric_limits<PointCoordinateType>::max();
+	bbMin = CCVector3(maxVal, maxVal, maxVal);
+	bbMax = CCVector3(-maxVal, -maxVal, -maxVal);
+}
+
+unsigned MeshBVH::splitRange(unsigned first, unsigned count, unsigned depth)
+{
+	assert(count > MAX_LEAF_SIZE);
+
+	//centroids bounding-box
+	CCVector3 cMin, cMax;
+	InitBox(cMin, cMax);
+	for (unsigned i = first; i < first + count; ++i)
+	{
+		const CCVector3& C = m_centroids[i];
+		for (unsigned char k = 0; k < 3; ++k)
+		{
+			cMin.u[k] = std::min(cMin.u[k], C.u[k]);
+			cMax.u[k] = std::max(cMax.u[k], C.u[k]);
+		}
+	}
+
+	CCVector3 extent = cMax - cMin;
+	unsigned char largestDim = 0;
+	if (extent.y > extent.x)
+		largestDim = 1;
+	if (extent.z > extent.u[largestDim])
+		largestDim = 2;
+
+	if (extent.u[largestDim] <= 0)
+	{
+		//all the centroids are the same: any split will do
+		return count / 2;
+	}
+
+	int bestDim = -1;
+	unsigned bestSplit = 0;
+	if (depth < MAX_SAH_DEPTH)
+	{
+		//evaluate the SAH cost of each bin boundary along each dimension
+		double bestCost = std::numeric_limits<double>::max();
+		for (unsigned char k = 0; k < 3; ++k)
+		{
+			if (extent.u[k] <= 0)
+				continue;
+
+			unsigned binCount[SAH_BIN_COUNT];
+			CCVector3 binMin[SAH_BIN_COUNT], binMax[SAH_BIN_COUNT];
+			for (unsigned b = 0; b < SAH_BIN_COUNT; ++b)
+			{
+				binCount[b] = 0;
+				InitBox(binMin[b], binMax[b]);
+			}
+
+			PointCoordinateType scale = static_cast<PointCoordinateType>(SAH_BIN_COUNT) / extent.u[k];
+			for (unsigned i = first; i < first + count; ++i)
+			{
+				unsigned b = std::min(static_cast<unsigned>((m_centroids[i].u[k] - cMin.u[k]) * scale), SAH_BIN_COUNT - 1);
+				++binCount[b];
+				AddTriangle(m_triangles[i], binMin[b], binMax[b]);
+			}
+
+			//right side areas (cumulated)
+			double rightArea[SAH_BIN_COUNT];
+			unsigned rightCount[SAH_BIN_COUNT];
+			{
+				CCVector3 bbMin, bbMax;
+				InitBox(bbMin, bbMax);
+				unsigned n = 0;
+				for (unsigned b = SAH_BIN_COUNT - 1; b > 0; --b)
+				{
+					n += binCount[b];
+					if (binCount[b])
+					{
+						for (unsigned char d = 0; d < 3; ++d)
+						{
+							bbMin.u[d] = std::min(bbMin.u[d], binMin[b].u[d]);
+							bbMax.u[d] = std::max(bbMax.u[d], binMax[b].u[d]);
+						}
+					}
+					rightCount[b] = n;
+					rightArea[b] = (n ? HalfArea(bbMin, bbMax) : 0);
+				}
+			}
+
+			//left side (cumulated) + cost
+			{
+				CCVector3 bbMin, bbMax;
+				InitBox(bbMin, bbMax);
+				unsigned n = 0;
+				for (unsigned b = 0; b + 1 < SAH_BIN_COUNT; ++b)
+				{
+					n += binCount[b];
+					if (binCount[b])
+					{
+						for (unsigned char d = 0; d < 3; ++d)
+						{
+							bbMin.u[d] = std::min(bbMin.u[d], binMin[b].u[d]);
+							bbMax.u[d] = std::max(bbMax.u[d], binMax[b].u[d]);
+						}
+					}
+					if (n == 0 || rightCount[b + 1] == 0)
+						continue;
+
+					double cost = HalfArea(bbMin, bbMax) * n + rightArea[b + 1] * rightCount[b + 1];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestDim = k;
+						bestSplit = b + 1;
+					}
+				}
+			}
+		}
+	}
+
+	if (bestDim >= 0)
+	{
+		//partition the triangles (the ones in the bins below 'bestSplit' first)
+		PointCoordinateType scale = static_cast<PointCoordinateType>(SAH_BIN_COUNT) / extent.u[bestDim];
+		unsigned i = first;
+		unsigned j = first + count;
+		while (i < j)
+		{
+			unsigned b = std::min(static_cast<unsigned>((m_centroids[i].u[bestDim] - cMin.u[bestDim]) * scale), SAH_BIN_COUNT - 1);
+			if (b < bestSplit)
+			{
+				++i;
+			}
+			else
+			{
+				--j;
+				std::swap(m_centroids[i], m_centroids[j]);
+				std::swap(m_triangles[i], m_triangles[j]);
+				std::swap(m_indexes[i], m_indexes[j]);
+			}
+		}
+
+		unsigned leftCount = i - first;
+		if (leftCount != 0 && leftCount != count)
+		{
+			return leftCount;
+		}
+	}
+
+	//fall back to a median split along the largest dimension
+	std::vector<unsigned> order;
+	try
+	{
+		order.resize(count);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory: any split will do
+		return count / 2;
+	}
+	for (unsigned i = 0; i < count; ++i)
+	{
+		order[i] = first + i;
+	}
+
+	unsigned halfCount = count / 2;
+	const std::vector<CCVector3>& centroids = m_centroids;
+	std::nth_element(order.begin(), order.begin() + halfCount, order.end(), [&centroids, largestDim](unsigned a, unsigned b)
+	{
+		const PointCoordinateType ca = centroids[a].u[largestDim];
+		const PointCoordinateType cb = centroids[b].u[largestDim];
+		return (ca < cb || (ca == cb && a < b));
+	});
+
+	//apply the permutation
+	std::vector<CCVector3> centroids2(count);
+	std::vector<SimpleTriangle> triangles2(count);
+	std::vector<unsigned> indexes2(count);
+	for (unsigned i = 0; i < count; ++i)
+	{
+		centroids2[i] = m_centroids[order[i]];
+		triangles2[i] = m_triangles[order[i]];
+		indexes2[i] = m_indexes[order[i]];
+	}
+	std::copy(centroids2.begin(), centroids2.end(), m_centroids.begin() + first);
+	std::copy(triangles2.begin(), triangles2.end(), m_triangles.begin() + first);
+	std::copy(indexes2.begin(), indexes2.end(), m_indexes.begin() + first);
+
+	return halfCount;
+}
+
+void MeshBVH::setChild(unsigned nodeIndex, unsigned char childIndex, unsigned first, unsigned count, unsigned depth)
+{
+	CCVector3 bbMin, bbMax;
+	InitBox(bbMin, bbMax);
+	for (unsigned i = first; i < first + count; ++i)
+	{
+		AddTriangle(m_triangles[i], bbMin, bbMax);
+	}
+
+	unsigned child = 0;
+	unsigned triangleCount = 0;
+	if (count > MAX_LEAF_SIZE)
+	{
+		//warning: the nodes vector may be reallocated by the sub-tree construction
+		child = buildNode(first, count, depth + 1);
+	}
+	else if (count != 0)
+	{
+		child = first;
+		triangleCount = count;
+	}
+
+	Node& node = m_nodes[nodeIndex];
+	for (unsigned char k = 0; k < 3; ++k)
+	{
+		node.bbMin[k][childIndex] = bbMin.u[k];
+		node.bbMax[k][childIndex] = bbMax.u[k];
+	}
+	node.child[childIndex] = child;
+	node.triangleCount[childIndex] = triangleCount;
+}
+
+unsigned MeshBVH::buildNode(unsigned first, unsigned count, unsigned depth)
+{
+	unsigned nodeIndex = static_cast<unsigned>(m_nodes.size());
+	m_nodes.push_back(Node());
+
+	if (count > MAX_LEAF_SIZE)
+	{
+		unsigned leftCount = splitRange(first, count, depth);
+		setChild(nodeIndex, 0, first, leftCount, depth);
+		setChild(nodeIndex, 1, first + leftCount, count - leftCount, depth);
+	}
+	else
+	{
+		//single leaf (root only)
+		assert(nodeIndex == 0);
+		setChild(nodeIndex, 0, first, count, depth);
+		setChild(nodeIndex, 1, first, 0, depth);
+	}
+
+	return nodeIndex;
+}
+
+bool MeshBVH::build(GenericIndexedMesh* mesh, GenericProgressCallback* progressCb/*=0*/)
+{
+	clear();
+
+	unsigned triCount = (mesh ? mesh->size() : 0);
+	if (triCount == 0)
+	{
+		return false;
+	}
+
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("BVH computation");
+			char info[256];
+			sprintf(info, "Triangles: %u", triCount);
+			progressCb->setInfo(info);
+		}
+		progressCb->update(0);
+		progressCb->start();
+	}
+
+	try
+	{
+		m_triangles.resize(triCount);
+		m_indexes.resize(triCount);
+		m_centroids.resize(triCount);
+		//a binary tree with (at least) one triangle per leaf has less than 'triCount' inner nodes
+		m_nodes.reserve(triCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		clear();
+		return false;
+	}
+
+	for (unsigned i = 0; i < triCount; ++i)
+	{
+		SimpleTriangle& tri = m_triangles[i];
+		mesh->getTriangleVertices(i, tri.A, tri.B, tri.C);
+		m_indexes[i] = i;
+		m_centroids[i] = (tri.A + tri.B + tri.C) / 3;
+	}
+
+	if (progressCb)
+	{
+		progressCb->update(50.0f);
+	}
+
+	buildNode(0, triCount, 0);
+
+	//the centroids are only necessary for the build process
+	m_centroids.clear();
+	m_centroids.shrink_to_fit();
+
+	if (progressCb)
+	{
+		progressCb->update(75.0f);
+	}
+
+	if (!computePseudoNormals(mesh))
+	{
+		//not enough memory
+		clear();
+		return false;
+	}
+	m_mesh = mesh;
+
+	if (progressCb)
+	{
+		progressCb->update(100.0f);
+		progressCb->stop();
+	}
+
+	return true;
+}
+
+//! Edge of a triangle (see MeshBVH::computePseudoNormals)
+struct TriangleEdge
+{
+	//! Vertices indexes (sorted)
+	unsigned v1, v2;
+	//! Triangle position
+	unsigned pos;
+	//! Edge index in the triangle (0 = AB, 1 = BC, 2 = CA)
+	unsigned char edge;
+
+	inline bool operator < (const TriangleEdge& e) const { return v1 < e.v1 || (v1 == e.v1 && v2 < e.v2); }
+};
+
+bool MeshBVH::computePseudoNormals(GenericIndexedMesh* mesh)
+{
+	unsigned triCount = static_cast<unsigned>(m_triangles.size());
+
+	std::vector<CCVector3> faceNormals;
+	std::vector<TriangleEdge> edges;
+	try
+	{
+		m_positions.resize(triCount);
+		m_vertIndexes.resize(3 * static_cast<size_t>(triCount));
+		m_edgeNormals.resize(3 * static_cast<size_t>(triCount), CCVector3(0, 0, 0));
+		faceNormals.resize(triCount);
+		edges.resize(3 * static_cast<size_t>(triCount));
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	unsigned vertCount = 0;
+	for (unsigned pos = 0; pos < triCount; ++pos)
+	{
+		m_positions[m_indexes[pos]] = pos;
+
+		const VerticesIndexes* tsi = mesh->getTriangleVertIndexes(m_indexes[pos]);
+		for (unsigned char k = 0; k < 3; ++k)
+		{
+			m_vertIndexes[3 * static_cast<size_t>(pos) + k] = tsi->i[k];
+			vertCount = std::max(vertCount, tsi->i[k] + 1);
+
+			TriangleEdge& e = edges[3 * static_cast<size_t>(pos) + k];
+			e.v1 = std::min(tsi->i[k], tsi->i[(k + 1) % 3]);
+			e.v2 = std::max(tsi->i[k], tsi->i[(k + 1) % 3]);
+			e.pos = pos;
+			e.edge = k;
+		}
+
+		//(unit) face normal
+		const SimpleTriangle& tri = m_triangles[pos];
+		CCVector3d N = CCVector3d::fromArray((tri.B - tri.A).u).cross(CCVector3d::fromArray((tri.C - tri.A).u));
+		double norm = N.norm();
+		faceNormals[pos] = (norm > 0 ? CCVector3::fromArray((N / norm).u) : CCVector3(0, 0, 0));
+	}
+
+	//vertices: sum of the adjacent faces normals weighted by the incident angles
+	try
+	{
+		m_vertexNormals.resize(vertCount, CCVector3(0, 0, 0));
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+	for (unsigned pos = 0; pos < triCount; ++pos)
+	{
+		const SimpleTriangle& tri = m_triangles[pos];
+		const CCVector3* V[3] = { &tri.A, &tri.B, &tri.C };
+		for (unsigned char k = 0; k < 3; ++k)
+		{
+			CCVector3d u = CCVector3d::fromArray((*V[(k + 1) % 3] - *V[k]).u);
+			CCVector3d v = CCVector3d::fromArray((*V[(k + 2) % 3] - *V[k]).u);
+			double angle = atan2(u.cross(v).norm(), u.dot(v));
+			m_vertexNormals[m_vertIndexes[3 * static_cast<size_t>(pos) + k]] += faceNormals[pos] * static_cast<PointCoordinateType>(angle);
+		}
+	}
+
+	//edges: sum of the adjacent faces normals (same weight for each face)
+	std::sort(edges.begin(), edges.end());
+	for (size_t i = 0; i < edges.size(); )
+	{
+		size_t j = i;
+		CCVector3 N(0, 0, 0);
+		for (; j < edges.size() && edges[j].v1 == edges[i].v1 && edges[j].v2 == edges[i].v2; ++j)
+		{
+			N += faceNormals[edges[j].pos];
+		}
+		for (; i < j; ++i)
+		{
+			m_edgeNormals[3 * static_cast<size_t>(edges[i].pos) + edges[i].edge] = N;
+		}
+	}
+
+	return true;
+}
+
+//! Closest feature of a triangle (see ClosestFeature)
+enum TriangleFeature { FEATURE_A = 0, FEATURE_B = 1, FEATURE_C = 2, FEATURE_AB = 3, FEATURE_BC = 4, FEATURE_CA = 5, FEATURE_FACE = 6 };
+
+//! Returns the closest feature (vertex, edge or face) of a triangle to a point, as well as the closest point
+/** See C. Ericson, "Real-Time Collision Detection", 2005 (Voronoi regions of the triangle).
+**/
+static TriangleFeature ClosestFeature(const CCVector3& P, const SimpleTriangle& tri, CCVector3d& Q)
+{
+	//we do all computations with double precision (see DistanceComputationTools::computePoint2TriangleDistance)
+	CCVector3d A = CCVector3d::fromArray(tri.A.u);
+	CCVector3d AB = CCVector3d::fromArray(tri.B.u) - A;
+	CCVector3d AC = CCVector3d::fromArray(tri.C.u) - A;
+	CCVector3d AP = CCVector3d::fromArray(P.u) - A;
+
+	double d1 = AB.dot(AP);
+	double d2 = AC.dot(AP);
+	if (d1 <= 0 && d2 <= 0)
+	{
+		Q = A;
+		return FEATURE_A;
+	}
+
+	CCVector3d BP = AP - AB;
+	double d3 = AB.dot(BP);
+	double d4 = AC.dot(BP);
+	if (d3 >= 0 && d4 <= d3)
+	{
+		Q = A + AB;
+		return FEATURE_B;
+	}
+
+	double vc = d1 * d4 - d3 * d2;
+	if (vc <= 0 && d1 >= 0 && d3 <= 0)
+	{
+		Q = A + AB * (d1 / (d1 - d3));
+		return FEATURE_AB;
+	}
+
+	CCVector3d CP = AP - AC;
+	double d5 = AB.dot(CP);
+	double d6 = AC.dot(CP);
+	if (d6 >= 0 && d5 <= d6)
+	{
+		Q = A + AC;
+		return FEATURE_C;
+	}
+
+	double vb = d5 * d2 - d1 * d6;
+	if (vb <= 0 && d2 >= 0 && d6 <= 0)
+	{
+		Q = A + AC * (d2 / (d2 - d6));
+		return FEATURE_CA;
+	}
+
+	double va = d3 * d6 - d5 * d4;
+	if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+	{
+		Q = A + AB + (AC - AB) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		return FEATURE_BC;
+	}
+
+	return FEATURE_FACE;
+}
+
+ScalarType MeshBVH::computeSignedDistance(const CCVector3& P, unsigned triangleIndex, CCVector3* nearestP/*=0*/) const
+{
+	assert(triangleIndex < m_positions.size());
+	unsigned pos = m_positions[triangleIndex];
+	const SimpleTriangle& tri = m_triangles[pos];
+
+	ScalarType dist = DistanceComputationTools::computePoint2TriangleDistance(&P, &tri, true, nearestP);
+
+	CCVector3d Q;
+	TriangleFeature feature = ClosestFeature(P, tri, Q);
+	if (feature == FEATURE_FACE)
+	{
+		//the triangle normal is the right one
+		return dist;
+	}
+
+	const CCVector3& N = (feature < FEATURE_AB	? m_vertexNormals[m_vertIndexes[3 * static_cast<size_t>(pos) + feature]]
+												: m_edgeNormals[3 * static_cast<size_t>(pos) + (feature - FEATURE_AB)]);
+	double dot = (CCVector3d::fromArray(P.u) - Q).dot(CCVector3d::fromArray(N.u));
+	if (dot == 0)
+	{
+		//degenerate case (e.g. point on the mesh)
+		return dist;
+	}
+
+	return (dot < 0 ? -std::abs(dist) : std::abs(dist));
+}
+
+//! Computes the squared distances between a point and the two children bounding-boxes of a node
+template <class NodeType> static inline void ComputeBoxesSquareDist(const NodeType& node, const CCVector3& P, PointCoordinateType squareDist[2])
+{
+	//branch-less and in SoA layout so that the compiler can process both boxes at once
+	for (unsigned c = 0; c < 2; ++c)
+	{
+		PointCoordinateType d2 = 0;
+		for (unsigned k = 0; k < 3; ++k)
+		{
+			PointCoordinateType below = node.bbMin[k][c] - P.u[k];
+			PointCoordinateType above = P.u[k] - node.bbMax[k][c];
+			PointCoordinateType d = std::max(std::max(below, above), static_cast<PointCoordinateType>(0));
+			d2 += d * d;
+		}
+		squareDist[c] = d2;
+	}
+}
+
+//! Returns whether a box can be ignored or not
+static inline bool CanBeCulled(PointCoordinateType boxSquareDist, ScalarType bestSquareDist)
+{
+	return boxSquareDist > bestSquareDist * (1 + BOX_DISTANCE_TOLERANCE);
+}
+
+bool MeshBVH::findClosestTriangle(	const CCVector3& P,
+									ScalarType maxSquareDist,
+									unsigned& triangleIndex,
+									ScalarType& squareDist,
+									const GenericTriangle** triangle/*=0*/) const
+{
+	if (m_nodes.empty())
+	{
+		return false;
+	}
+
+	ScalarType best = (maxSquareDist >= 0 ? maxSquareDist : std::numeric_limits<ScalarType>::max());
+	bool found = false;
+	unsigned bestPos = 0;
+
+	//stack of the children to visit (node index + child index)
+	struct StackEntry
+	{
+		unsigned node;
+		unsigned child;
+		PointCoordinateType squareDist;
+	};
+	StackEntry stack[MAX_STACK_SIZE];
+	unsigned stackSize = 0;
+
+	unsigned nodeIndex = 0; //root
+	while (true)
+	{
+		//push the children (nearest on top)
+		{
+			const Node& node = m_nodes[nodeIndex];
+			PointCoordinateType d2[2];
+			ComputeBoxesSquareDist(node, P, d2);
+			unsigned nearest = (d2[1] < d2[0] ? 1 : 0);
+			unsigned farthest = 1 - nearest;
+			assert(stackSize + 2 <= MAX_STACK_SIZE);
+			if (!CanBeCulled(d2[farthest], best))
+			{
+				StackEntry& e = stack[stackSize++];
+				e.node = nodeIndex;
+				e.child = farthest;
+				e.squareDist = d2[farthest];
+			}
+			if (!CanBeCulled(d2[nearest], best))
+			{
+				StackEntry& e = stack[stackSize++];
+				e.node = nodeIndex;
+				e.child = nearest;
+				e.squareDist = d2[nearest];
+			}
+		}
+
+		//pop the next inner node (and process the leaves on the way)
+		nodeIndex = 0;
+		while (stackSize != 0)
+		{
+			const StackEntry& e = stack[--stackSize];
+			if (CanBeCulled(e.squareDist, best))
+			{
+				continue;
+			}
+
+			const Node& node = m_nodes[e.node];
+			unsigned triangleCount = node.triangleCount[e.child];
+			if (triangleCount != 0)
+			{
+				//leaf
+				unsigned firstTriangle = node.child[e.child];
+				for (unsigned i = firstTriangle; i < firstTriangle + triangleCount; ++i)
+				{
+					ScalarType d2 = DistanceComputationTools::computePoint2TriangleDistance(&P, &m_triangles[i], false);
+					if (d2 < best || (found && d2 == best && m_indexes[i] < m_indexes[bestPos]))
+					{
+						best = d2;
+						bestPos = i;
+						found = true;
+					}
+				}
+			}
+			else if (node.child[e.child] != 0)
+			{
+				//inner node
+				nodeIndex = node.child[e.child];
+				break;
+			}
+		}
+
+		if (nodeIndex == 0)
+		{
+			//nothing left to visit
+			break;
+		}
+	}
+
+	if (!found)
+	{
+		return false;
+	}
+
+	triangleIndex = m_indexes[bestPos];
+	squareDist = best;
+	if (triangle)
+	{
+		*triangle = &m_triangles[bestPos];
+	}
+
+	return true;
+}
@@ -29,8 +29,23 @@
 #include "CCConst.h"
 
 //system
+#include <algorithm>
 #include <assert.h>
-#include <random>
+#include <limits>
+#include <new>
+#include <vector>
+
+#ifdef USE_QT
+#ifndef _DEBUG
+//enables multi-threading handling
+#define ENABLE_MT_MESH_SAMPLING
+#endif
+#endif
+
+#ifdef ENABLE_MT_MESH_SAMPLING
+#include <QtCore>
+#include <QtConcurrentMap>
+#endif
 
 using namespace CCLib;
 
@@ -117,41 +132,139 @@ void MeshSamplingTools::DecodeEdgeKey(unsigned long long key, unsigned& i1, unsi
 	i2 = static_cast<unsigned>( (key >> 32) & 0x00000000FFFFFFFF );
 }
 
-bool MeshSamplingTools::buildMeshEdgeUsageMap(GenericIndexedMesh* mesh, EdgeUsageMap& edgeMap)
+//! Minimum number of edges keys per sorted chunk
+static const size_t EDGE_KEYS_MIN_CHUNK_SIZE = (1 << 16);
+
+//! Range of edges keys (sorted independently or merged)
+struct EdgeKeysRange
+{
+	//! First key
+	unsigned long long* begin;
+	//! First key of the second half (merge only)
+	unsigned long long* middle;
+	//! Last key (excluded)
+	unsigned long long* end;
+};
+
+#ifdef ENABLE_MT_MESH_SAMPLING
+static void SortEdgeKeys_MT(EdgeKeysRange& range)
 {
-	edgeMap.clear();
+	std::sort(range.begin, range.end);
+}
 
-	if (!mesh)
-		return false;
+static void MergeEdgeKeys_MT(EdgeKeysRange& range)
+{
+	std::inplace_merge(range.begin, range.middle, range.end);
+}
+#endif
 
-	try
+//! Sorts the edges keys in ascending order
+/** If multi-threading is enabled, contiguous chunks are sorted in parallel
+	then merged (two by two, also in parallel).
+**/
+static void SortEdgeKeys(std::vector<unsigned long long>& edgeKeys)
+{
+#ifdef ENABLE_MT_MESH_SAMPLING
+	size_t maxChunkCount = edgeKeys.size() / EDGE_KEYS_MIN_CHUNK_SIZE;
+	size_t chunkCount = std::min(static_cast<size_t>(std::max(QThread::idealThreadCount(), 1)), maxChunkCount);
+	if (chunkCount > 1)
 	{
-		mesh->placeIteratorAtBegining();
-		//for all triangles
-		for (unsigned n=0; n<mesh->size(); ++n)
+		try
 		{
-			VerticesIndexes* tri = mesh->getNextTriangleVertIndexes();
+			std::vector<EdgeKeysRange> ranges(chunkCount);
+			unsigned long long* data = &(edgeKeys[0]);
+			for (size_t i = 0; i < chunkCount; ++i)
+			{
+				ranges[i].begin = data + (edgeKeys.size() * i) / chunkCount;
+				ranges[i].end = data + (edgeKeys.size() * (i + 1)) / chunkCount;
+				ranges[i].middle = ranges[i].end;
+			}
 
-			//for all edges
-			for (unsigned j=0; j<3; ++j)
+			QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+			QtConcurrent::blockingMap(ranges, SortEdgeKeys_MT);
+
+			//merge the sorted chunks
+			while (ranges.size() > 1)
 			{
-				unsigned i1 = tri->i[j];
-				unsigned i2 = tri->i[(j+1) % 3];
-				//build unique index
-				unsigned long long edgeKey = ComputeEdgeKey(i1,i2);
-				++edgeMap[edgeKey];
+				std::vector<EdgeKeysRange> merged((ranges.size() + 1) / 2);
+				for (size_t i = 0; i < merged.size(); ++i)
+				{
+					merged[i] = ranges[2 * i];
+					if (2 * i + 1 < ranges.size())
+					{
+						merged[i].middle = ranges[2 * i + 1].begin;
+						merged[i].end = ranges[2 * i + 1].end;
+					}
+				}
+				QtConcurrent::blockingMap(merged, MergeEdgeKeys_MT);
+				ranges = merged;
 			}
+			return;
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory: we fall back to the sequential sort
+			//(sorting already sorted chunks is not an issue)
 		}
 	}
+#endif
+
+	std::sort(edgeKeys.begin(), edgeKeys.end());
+}
+
+bool MeshSamplingTools::buildSortedMeshEdgeKeys(GenericIndexedMesh* mesh, std::vector<unsigned long long>& edgeKeys)
+{
+	edgeKeys.clear();
+
+	if (!mesh)
+		return false;
+
+	unsigned triCount = mesh->size();
+	try
+	{
+		edgeKeys.resize(3 * static_cast<size_t>(triCount));
+	}
 	catch (const std::bad_alloc&)
 	{
 		//not enough memory
 		return false;
 	}
 
+	mesh->placeIteratorAtBegining();
+	//for all triangles
+	for (unsigned n=0; n<triCount; ++n)
+	{
+		VerticesIndexes* tri = mesh->getNextTriangleVertIndexes();
+
+		//for all edges
+		for (unsigned j=0; j<3; ++j)
+		{
+			unsigned i1 = tri->i[j];
+			unsigned i2 = tri->i[(j+1) % 3];
+			//build unique index
+			edgeKeys[3*static_cast<size_t>(n) + j] = ComputeEdgeKey(i1,i2);
+		}
+	}
+
+	//identical keys (i.e. the same edge used by several triangles) are now contiguous
+	SortEdgeKeys(edgeKeys);
+
 	return true;
 }
 
+//! Returns the number of triangles using the edge starting at a given position in the sorted edges keys
+/** \param edgeKeys sorted edges keys
+	\param pos edge (first) position
+	\return number of consecutive identical keys
+**/
+static size_t GetEdgeUsage(const std::vector<unsigned long long>& edgeKeys, size_t pos)
+{
+	size_t next = pos + 1;
+	while (next < edgeKeys.size() && edgeKeys[next] == edgeKeys[pos])
+		++next;
+	return next - pos;
+}
+
 bool MeshSamplingTools::computeMeshEdgesConnectivity(GenericIndexedMesh* mesh, EdgeConnectivityStats& stats)
 {
 	stats = EdgeConnectivityStats();
@@ -160,18 +273,20 @@ bool MeshSamplingTools::computeMeshEdgesConnectivity(GenericIndexedMesh* mesh, E
 		return false;
 
 	//count the number of triangles using each edge
-	EdgeUsageMap edgeCounters;
-	if (!buildMeshEdgeUsageMap(mesh,edgeCounters))
+	std::vector<unsigned long long> edgeKeys;
+	if (!buildSortedMeshEdgeKeys(mesh,edgeKeys))
 		return false;
 
 	//for all edges
-	stats.edgesCount = static_cast<unsigned>(edgeCounters.size());
-	for (std::map<unsigned long long, unsigned>::const_iterator edgeIt = edgeCounters.begin(); edgeIt != edgeCounters.end(); ++edgeIt)
+	for (size_t pos = 0; pos < edgeKeys.size(); )
 	{
-		assert(edgeIt->second != 0);
-		if (edgeIt->second == 1)
+		size_t usage = GetEdgeUsage(edgeKeys, pos);
+		pos += usage;
+
+		++stats.edgesCount;
+		if (usage == 1)
 			++stats.edgesNotShared;
-		else if (edgeIt->second == 2)
+		else if (usage == 2)
 			++stats.edgesSharedByTwo;
 		else
 			++stats.edgesSharedByMore;
@@ -189,44 +304,48 @@ bool MeshSamplingTools::flagMeshVerticesByType(GenericIndexedMesh* mesh, ScalarF
 	flags->fill(NAN_VALUE);
 
 	//count the number of triangles using each edge
-	EdgeUsageMap edgeCounters;
-	if (!buildMeshEdgeUsageMap(mesh,edgeCounters))
+	std::vector<unsigned long long> edgeKeys;
+	if (!buildSortedMeshEdgeKeys(mesh,edgeKeys))
 		return false;
 
 	//now scan all the edges and flag their vertices
 	{
 		if (stats)
-			stats->edgesCount = static_cast<unsigned>(edgeCounters.size());
+			*stats = EdgeConnectivityStats();
 
 		//for all edges
-		for (std::map<unsigned long long, unsigned>::const_iterator edgeIt = edgeCounters.begin(); edgeIt != edgeCounters.end(); ++edgeIt)
+		for (size_t pos = 0; pos < edgeKeys.size(); )
 		{
+			size_t usage = GetEdgeUsage(edgeKeys, pos);
 			unsigned i1, i2;
-			DecodeEdgeKey(edgeIt->first, i1, i2);
+			DecodeEdgeKey(edgeKeys[pos], i1, i2);
+			pos += usage;
+
+			if (stats)
+				++stats->edgesCount;
 
 			ScalarType flag = NAN_VALUE;
-			if (edgeIt->second == 1)
+			if (usage == 1)
 			{
 				//only one triangle uses this edge
 				flag = static_cast<ScalarType>(VERTEX_BORDER);
 				if (stats)
 					++stats->edgesNotShared;
 			}
-			else if (edgeIt->second == 2)
+			else if (usage == 2)
 			{
 				//two triangles use this edge
 				flag = static_cast<ScalarType>(VERTEX_NORMAL);
 				if (stats)
 					++stats->edgesSharedByTwo;
 			}
-			else if (edgeIt->second > 2)
+			else
 			{
 				//more than two triangles use this edge!
 				flag = static_cast<ScalarType>(VERTEX_NON_MANIFOLD);
 				if (stats)
 					++stats->edgesSharedByMore;
 			}
-			//else --> isolated vertex?
 
 			flags->setValue(i1,flag);
 			flags->setValue(i2,flag);
@@ -274,6 +393,126 @@ SimpleCloud* MeshSamplingTools::samplePointsOnMesh(	GenericMesh* mesh,
 	return samplePointsOnMesh(mesh, samplingDensity, theoreticNumberOfPoints, progressCb, triIndices);
 }
 
+/*** MESH SAMPLING ***/
+
+//! Counter-based random numbers stream (one per triangle)
+/** Based on the SplitMix64 generator: the ith number of a stream only depends on the
+	triangle index and on i, so that the sampled points don't depend on the order in
+	which the triangles are processed (nor on the number of threads).
+**/
+class TriangleRandomStream
+{
+public:
+
+	//! Default constructor
+	explicit TriangleRandomStream(unsigned triangleIndex)
+		: m_state(Mix(static_cast<unsigned long long>(triangleIndex) ^ 0x5851F42D4C957F2DULL))
+	{}
+
+	//! Returns the next number of the stream (uniform in [0,1[)
+	inline double next()
+	{
+		m_state += 0x9E3779B97F4A7C15ULL;
+		return static_cast<double>(Mix(m_state) >> 11) * (1.0 / 9007199254740992.0); //53 bits
+	}
+
+protected:
+
+	//! SplitMix64 mixing function
+	static inline unsigned long long Mix(unsigned long long z)
+	{
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	//! Current state
+	unsigned long long m_state;
+};
+
+//! Triangle to be sampled (vertex O and edges OA and OB)
+struct MeshSamplingTriangle
+{
+	CCVector3 O;
+	CCVector3 u;
+	CCVector3 v;
+};
+
+//! Range of triangles to be sampled
+struct MeshSamplingRange
+{
+	//! First triangle index
+	unsigned i1;
+	//! Last triangle index (excluded)
+	unsigned i2;
+};
+
+//! Mesh sampling shared parameters
+struct MeshSamplingParams
+{
+	//! Triangles of the current block
+	const MeshSamplingTriangle* triangles;
+	//! Index of the first triangle of the current block
+	unsigned firstTriangle;
+	//! Index of the first point of each triangle (prefix sum of the number of points per triangle)
+	const unsigned* offsets;
+	SimpleCloud* cloud;
+	GenericChunkedArray<1,unsigned>* triIndices;
+};
+
+//! Max number of triangles read at once (second pass)
+static const unsigned MESH_SAMPLING_BLOCK_SIZE = 65536;
+//! Max number of triangles per (parallel) job
+static const unsigned MESH_SAMPLING_RANGE_SIZE = 256;
+
+static void SampleTriangles(const MeshSamplingParams& params, const MeshSamplingRange& range)
+{
+	for (unsigned n = range.i1; n < range.i2; ++n)
+	{
+		const MeshSamplingTriangle& tri = params.triangles[n - params.firstTriangle];
+
+		unsigned firstPoint = params.offsets[n];
+		unsigned lastPoint = params.offsets[n + 1];
+		if (firstPoint == lastPoint)
+			continue;
+
+		TriangleRandomStream randomStream(n);
+		//the first number of the stream is used for the fractional part of the number of points (see 1st pass)
+		randomStream.next();
+
+		for (unsigned i = firstPoint; i < lastPoint; ++i)
+		{
+			//we generate random points as in:
+			//'Greg Turk. Generating random points in triangles. In A. S. Glassner, editor, Graphics Gems, pages 24-28. Academic Press, 1990.'
+			double x = randomStream.next();
+			double y = randomStream.next();
+
+			//we test if the generated point lies on the right side of (AB)
+			if (x+y > 1.0)
+			{
+				x = 1.0-x;
+				y = 1.0-y;
+			}
+
+			CCVector3 P = tri.O + static_cast<PointCoordinateType>(x) * tri.u + static_cast<PointCoordinateType>(y) * tri.v;
+
+			params.cloud->setPoint(i, P);
+			if (params.triIndices)
+				params.triIndices->setValue(i, n);
+		}
+	}
+}
+
+#ifdef ENABLE_MT_MESH_SAMPLING
+static QMutex s_meshSampling_MT_mutex;
+static const MeshSamplingParams* s_meshSampling_MT = 0;
+
+static void SampleTriangles_MT(const MeshSamplingRange& range)
+{
+	SampleTriangles(*s_meshSampling_MT, range);
+}
+#endif
+
 SimpleCloud* MeshSamplingTools::samplePointsOnMesh(	GenericMesh* mesh,
 													double samplingDensity,
 													unsigned theoreticNumberOfPoints,
@@ -288,46 +527,24 @@ SimpleCloud* MeshSamplingTools::samplePointsOnMesh(	GenericMesh* mesh,
 	if (triCount == 0)
 		return 0;
 
-	SimpleCloud* sampledCloud = new SimpleCloud();
-	if (!sampledCloud->reserve(theoreticNumberOfPoints)) //not enough memory
-	{
-		delete sampledCloud;
-		return 0;
-	}
-
 	if (triIndices)
 	{
 	    triIndices->clear(); //just in case
-
-		if (!triIndices->reserve(theoreticNumberOfPoints) || triIndices->capacity() < theoreticNumberOfPoints)
-		{
-			//not enough memory? DGM TODO: we should warn the caller
-			delete sampledCloud;
-			triIndices->clear();
-			return 0;
-		}
 	}
 
-	NormalizedProgress normProgress(progressCb, triCount);
-    if (progressCb)
-    {
-		if (progressCb->textCanBeEdited())
-		{
-			progressCb->setMethodTitle("Mesh sampling");
-			char buffer[256];
-			sprintf(buffer, "Triangles: %u\nPoints: %u", triCount, theoreticNumberOfPoints);
-			progressCb->setInfo(buffer);
-		}
-        progressCb->update(0);
-		progressCb->start();
+	//1st pass: number of points to generate on each face
+	std::vector<unsigned> offsets;
+	try
+	{
+		offsets.resize(static_cast<size_t>(triCount) + 1);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return 0;
 	}
 
-	unsigned addedPoints = 0;
-	std::random_device rd;   // non-deterministic generator
-	std::mt19937 gen(rd());  // to seed mersenne twister.
-	std::uniform_real_distribution<double> dist(0, 1);
-
-	//for each triangle
+	unsigned long long pointCount = 0;
 	mesh->placeIteratorAtBegining();
 	for (unsigned n=0; n<triCount; ++n)
 	{
@@ -338,12 +555,8 @@ SimpleCloud* MeshSamplingTools::samplePointsOnMesh(	GenericMesh* mesh,
 		const CCVector3 *A = tri->_getB();
 		const CCVector3 *B = tri->_getC();
 
-		//edges (OA and OB)
-		CCVector3 u = *A - *O;
-		CCVector3 v = *B - *O;
-
 		//we compute the (twice) the triangle area
-		CCVector3 N = u.cross(v);
+		CCVector3 N = (*A - *O).cross(*B - *O);
 		double S = N.normd() / 2;
 
 		//we deduce the number of points to generate on this face
@@ -355,69 +568,146 @@ SimpleCloud* MeshSamplingTools::samplePointsOnMesh(	GenericMesh* mesh,
 		if (fracPart > 0)
 		{
 			//we add a point with the same probability as its (relative) area
-			if (dist(gen) <= fracPart)
+			if (TriangleRandomStream(n).next() <= fracPart)
                 pointsToAdd += 1;
 		}
 
-		if (pointsToAdd)
+		offsets[n] = static_cast<unsigned>(pointCount);
+		pointCount += pointsToAdd;
+		if (pointCount > std::numeric_limits<unsigned>::max())
 		{
-			if (addedPoints + pointsToAdd >= theoreticNumberOfPoints)
-			{
-				theoreticNumberOfPoints += pointsToAdd;
-				if (!sampledCloud->reserve(theoreticNumberOfPoints)
-					|| (triIndices && triIndices->capacity() < theoreticNumberOfPoints && !triIndices->reserve(theoreticNumberOfPoints))) //not enough memory
-				{
-					delete sampledCloud;
-					sampledCloud = 0;
-					if (triIndices)
-					{
-						triIndices->clear();
-					}
-					break;
-				}
-			}
+			//too many points
+			return 0;
+		}
+	}
+	offsets[triCount] = static_cast<unsigned>(pointCount);
 
-			for (unsigned i=0; i<pointsToAdd; ++i)
-			{
-				//we generate random points as in:
-				//'Greg Turk. Generating random points in triangles. In A. S. Glassner, editor, Graphics Gems, pages 24-28. Academic Press, 1990.'
-				double x = dist(gen);
-				double y = dist(gen);
+	//the output cloud is allocated at once
+	SimpleCloud* sampledCloud = new SimpleCloud();
+	if (pointCount == 0)
+	{
+		return sampledCloud;
+	}
+	if (!sampledCloud->resize(static_cast<unsigned>(pointCount))) //not enough memory
+	{
+		delete sampledCloud;
+		return 0;
+	}
+	if (triIndices && !triIndices->resize(static_cast<unsigned>(pointCount)))
+	{
+		//not enough memory? DGM TODO: we should warn the caller
+		delete sampledCloud;
+		triIndices->clear();
+		return 0;
+	}
 
-				//we test if the generated point lies on the right side of (AB)
-				if (x+y > 1.0)
-				{
-                    x = 1.0-x;
-                    y = 1.0-y;
-                }
+	NormalizedProgress normProgress(progressCb, triCount);
+    if (progressCb)
+    {
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("Mesh sampling");
+			char buffer[256];
+			sprintf(buffer, "Triangles: %u\nPoints: %u", triCount, static_cast<unsigned>(pointCount));
+			progressCb->setInfo(buffer);
+		}
+        progressCb->update(0);
+		progressCb->start();
+	}
+
+	//2nd pass: the triangles are read by blocks, and the points of each block are
+	//generated in parallel (each triangle has its own range of points and random stream)
+	std::vector<MeshSamplingTriangle> triangles;
+	std::vector<MeshSamplingRange> ranges;
+	try
+	{
+		triangles.resize(std::min(triCount, MESH_SAMPLING_BLOCK_SIZE));
+		ranges.reserve((triangles.size() + MESH_SAMPLING_RANGE_SIZE - 1) / MESH_SAMPLING_RANGE_SIZE);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		delete sampledCloud;
+		if (triIndices)
+			triIndices->clear();
+		return 0;
+	}
 
-				CCVector3 P = (*O) + static_cast<PointCoordinateType>(x) * u + static_cast<PointCoordinateType>(y) * v;
+	MeshSamplingParams params;
+	params.triangles = &(triangles[0]);
+	params.offsets = &(offsets[0]);
+	params.cloud = sampledCloud;
+	params.triIndices = triIndices;
 
-				sampledCloud->addPoint(P);
-				if (triIndices)
-					triIndices->addElement(n);
-				++addedPoints;
+	unsigned sampledTriCount = 0;
+	mesh->placeIteratorAtBegining();
+	while (sampledTriCount < triCount)
+	{
+		unsigned blockSize = std::min(triCount - sampledTriCount, MESH_SAMPLING_BLOCK_SIZE);
+		for (unsigned j=0; j<blockSize; ++j)
+		{
+			const GenericTriangle* tri = mesh->_getNextTriangle();
+			MeshSamplingTriangle& t = triangles[j];
+			t.O = *tri->_getA();
+			t.u = *tri->_getB() - t.O;
+			t.v = *tri->_getC() - t.O;
+		}
+		params.firstTriangle = sampledTriCount;
+
+		ranges.clear();
+		for (unsigned j=0; j<blockSize; j+=MESH_SAMPLING_RANGE_SIZE)
+		{
+			MeshSamplingRange range;
+			range.i1 = sampledTriCount + j;
+			range.i2 = sampledTriCount + std::min(j + MESH_SAMPLING_RANGE_SIZE, blockSize);
+			ranges.push_back(range); //can't fail (see above)
+		}
+
+		bool processed = false;
+#ifdef ENABLE_MT_MESH_SAMPLING
+		if (ranges.size() > 1 && s_meshSampling_MT_mutex.tryLock())
+		{
+			s_meshSampling_MT = &params;
+			QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+			QtConcurrent::blockingMap(ranges, SampleTriangles_MT);
+			s_meshSampling_MT = 0;
+			s_meshSampling_MT_mutex.unlock();
+			processed = true;
+		}
+#endif
+		if (!processed)
+		{
+			for (size_t r=0; r<ranges.size(); ++r)
+			{
+				SampleTriangles(params, ranges[r]);
 			}
 		}
 
-		if (progressCb && !normProgress.oneStep())
+		sampledTriCount += blockSize;
+
+		if (progressCb && !normProgress.steps(blockSize))
 			break;
 	}
 
-	if (sampledCloud) //can be in case of memory overflow!
+	if (sampledTriCount < triCount)
 	{
+		//process cancelled by the user: we only keep the points sampled so far
+		unsigned addedPoints = offsets[sampledTriCount];
 		if (addedPoints)
 		{
-			sampledCloud->resize(addedPoints); //should always be ok as addedPoints < theoreticNumberOfPoints
+			sampledCloud->resize(addedPoints); //should always be ok as addedPoints < pointCount
 			if (triIndices)
 				triIndices->resize(addedPoints);
 		}
 		else
 		{
+			sampledCloud->clear();
 			if (triIndices)
 				triIndices->clear();
 		}
 	}
 
+	sampledCloud->invalidateBoundingBox();
+
 	return sampledCloud;
 }
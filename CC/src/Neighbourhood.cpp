@@ -33,7 +33,7 @@
 #ifdef USE_EIGEN
 #include "eigen/Eigen/Eigenvalues"
 #else
-#include "Jacobi.h"
+#include "EigenSolver3x3.h"
 #endif
 
 //system
@@ -157,12 +157,17 @@ void Neighbourhood::computeGravityCenter()
 
 	//sum
 	CCVector3d Psum(0,0,0);
-	for (unsigned i=0; i<count; ++i)
+	for (unsigned i=0; i<count; )
 	{
-		const CCVector3* P = m_associatedCloud->getPoint(i);
-		Psum.x += P->x;
-		Psum.y += P->y;
-		Psum.z += P->z;
+		unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+		const CCVector3* P = m_associatedCloud->getPointsBlock(i, blockSize);
+		for (unsigned j=0; j<blockSize; ++j, ++P)
+		{
+			Psum.x += P->x;
+			Psum.y += P->y;
+			Psum.z += P->z;
+		}
+		i += blockSize;
 	}
 
 	CCVector3 G(static_cast<PointCoordinateType>(Psum.x / count),
@@ -191,16 +196,22 @@ CCLib::SquareMatrixd Neighbourhood::computeCovarianceMatrix()
 	double mXZ = 0.0;
 	double mYZ = 0.0;
 
-	for (unsigned i = 0; i < count; ++i)
+	for (unsigned i = 0; i < count; )
 	{
-		CCVector3 P = *m_associatedCloud->getPoint(i) - *G;
-
-		mXX += static_cast<double>(P.x)*P.x;
-		mYY += static_cast<double>(P.y)*P.y;
-		mZZ += static_cast<double>(P.z)*P.z;
-		mXY += static_cast<double>(P.x)*P.y;
-		mXZ += static_cast<double>(P.x)*P.z;
-		mYZ += static_cast<double>(P.y)*P.z;
+		unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+		const CCVector3* Q = m_associatedCloud->getPointsBlock(i, blockSize);
+		for (unsigned j = 0; j < blockSize; ++j, ++Q)
+		{
+			CCVector3 P = *Q - *G;
+
+			mXX += static_cast<double>(P.x)*P.x;
+			mYY += static_cast<double>(P.y)*P.y;
+			mZZ += static_cast<double>(P.z)*P.z;
+			mXY += static_cast<double>(P.x)*P.y;
+			mXZ += static_cast<double>(P.x)*P.z;
+			mYZ += static_cast<double>(P.y)*P.z;
+		}
+		i += blockSize;
 	}
 
 	//symmetry
@@ -231,17 +242,112 @@ PointCoordinateType Neighbourhood::computeLargestRadius()
 	}
 
 	double maxSquareDist = 0;
-	for (unsigned i=0; i<pointCount; ++i)
+	for (unsigned i=0; i<pointCount; )
 	{
-		const CCVector3* P = m_associatedCloud->getPoint(i);
-		double d2 = (*P-*G).norm2();
-		if (d2 > maxSquareDist)
-			maxSquareDist = d2;
+		unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+		const CCVector3* P = m_associatedCloud->getPointsBlock(i, blockSize);
+		for (unsigned j=0; j<blockSize; ++j, ++P)
+		{
+			double d2 = (*P-*G).norm2();
+			if (d2 > maxSquareDist)
+				maxSquareDist = d2;
+		}
+		i += blockSize;
 	}
 
 	return static_cast<PointCoordinateType>(sqrt(maxSquareDist));
 }
 
+//! Finalizes the LS plane computation (see Neighbourhood::ComputeLSPlane)
+/** \param vectors X (main direction) and N (normal) vectors as input, unit (X,Y,N) base as output
+	\param G a point of the plane
+	\param planeEquation output plane equation
+**/
+static bool FinalizeLSPlane(CCVector3 vectors[3], const CCVector3& G, PointCoordinateType planeEquation[4])
+{
+	//make sure all vectors are unit!
+	if (vectors[2].norm2() < ZERO_TOLERANCE)
+	{
+		//this means that the points are colinear!
+		//vectors[2] = CCVector3(0,0,1); //any normal will do
+		return false;
+	}
+	else
+	{
+		vectors[2].normalize();
+	}
+	//normalize X as well
+	vectors[0].normalize();
+	//and update Y
+	vectors[1] = vectors[2].cross(vectors[0]);
+
+	//deduce the proper equation
+	planeEquation[0] = vectors[2].x;
+	planeEquation[1] = vectors[2].y;
+	planeEquation[2] = vectors[2].z;
+
+	//eventually we just have to compute the 'constant' coefficient a3
+	//we use the fact that the plane pass through G --> GM.N = 0 (scalar prod)
+	//i.e. a0*G[0]+a1*G[1]+a2*G[2]=a3
+	planeEquation[3] = G.dot(vectors[2]);
+
+	return true;
+}
+
+bool Neighbourhood::ComputeLSPlane(	const CCLib::SquareMatrixd& covMat,
+									const CCVector3& G,
+									PointCoordinateType planeEquation[4],
+									CCVector3* planeVectors/*=0*/)
+{
+	if (covMat.size() != 3)
+	{
+		assert(false);
+		return false;
+	}
+
+	CCVector3 vectors[3];
+
+#ifdef USE_EIGEN
+	Eigen::Matrix3d A = ToEigen(covMat);
+	Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> es;
+	es.compute(A);
+
+	//eigen values (and vectors) are sorted in ascending order
+	const auto& eVec = es.eigenvectors();
+	
+	//get normal
+	vectors[2] = CCVector3::fromArray(eVec.col(0).data()); //smallest eigenvalue
+	//get also X (Y will be deduced by cross product, see below
+	vectors[0] = CCVector3::fromArray(eVec.col(2).data()); //biggest eigenvalue
+#else
+	//we determine plane normal by computing the smallest eigen value of M = 1/n * S[(p-µ)*(p-µ)']
+	double eigValues[3];
+	double eigVectors[3][3];
+	if (!EigenSolver3x3<double>::ComputeEigenValuesAndVectors(covMat, eigValues, eigVectors))
+	{
+		//failed to compute the eigen values!
+		return false;
+	}
+
+	//the smallest eigen vector corresponds to the "least square best fitting plane" normal
+	vectors[2] = CCVector3::fromArray(eigVectors[2]);
+	//get also X (Y will be deduced by cross product, see below
+	vectors[0] = CCVector3::fromArray(eigVectors[0]);
+#endif
+
+	if (!FinalizeLSPlane(vectors, G, planeEquation))
+		return false;
+
+	if (planeVectors)
+	{
+		planeVectors[0] = vectors[0];
+		planeVectors[1] = vectors[1];
+		planeVectors[2] = vectors[2];
+	}
+
+	return true;
+}
+
 bool Neighbourhood::computeLeastSquareBestFittingPlane()
 {
 	//invalidate previous LS plane (if any)
@@ -258,52 +364,13 @@ bool Neighbourhood::computeLeastSquareBestFittingPlane()
 		return false;
 	}
 
-	CCVector3 G(0,0,0);
 	if (pointCount > 3)
 	{
 		CCLib::SquareMatrixd covMat = computeCovarianceMatrix();
 
-#ifdef USE_EIGEN
-		Eigen::Matrix3d A = ToEigen(covMat);
-		Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> es;
-		es.compute(A);
-
-		//eigen values (and vectors) are sorted in ascending order
-		const auto& eVec = es.eigenvectors();
-		
-		//get normal
-		m_lsPlaneVectors[2] = CCVector3::fromArray(eVec.col(0).data()); //smallest eigenvalue
-		//get also X (Y will be deduced by cross product, see below
-		m_lsPlaneVectors[0] = CCVector3::fromArray(eVec.col(2).data()); //biggest eigenvalue
-#else
-		//we determine plane normal by computing the smallest eigen value of M = 1/n * S[(p-µ)*(p-µ)']
-		CCLib::SquareMatrixd eigVectors;
-		std::vector<double> eigValues;
-		if (!Jacobi<double>::ComputeEigenValuesAndVectors(covMat, eigVectors, eigValues, true))
-		{
-			//failed to compute the eigen values!
+		//the centroid should already be up-to-date (see computeCovarianceMatrix)
+		if (!ComputeLSPlane(covMat, *getGravityCenter(), m_lsPlaneEquation, m_lsPlaneVectors))
 			return false;
-		}
-
-		//get normal
-		{
-			CCVector3d vec(0,0,1);
-			double minEigValue = 0;
-			//the smallest eigen vector corresponds to the "least square best fitting plane" normal
-			Jacobi<double>::GetMinEigenValueAndVector(eigVectors, eigValues, minEigValue, vec.u);
-			m_lsPlaneVectors[2] = CCVector3::fromArray(vec.u);
-		}
-
-		//get also X (Y will be deduced by cross product, see below
-		{
-			CCVector3d vec;
-			double maxEigValue = 0;
-			Jacobi<double>::GetMaxEigenValueAndVector(eigVectors, eigValues, maxEigValue, vec.u);
-			m_lsPlaneVectors[0] = CCVector3::fromArray(vec.u);
-		}
-#endif
-		//get the centroid (should already be up-to-date - see computeCovarianceMatrix)
-		G = *getGravityCenter();
 	}
 	else
 	{
@@ -318,34 +385,9 @@ bool Neighbourhood::computeLeastSquareBestFittingPlane()
 		m_lsPlaneVectors[2] = m_lsPlaneVectors[0].cross(m_lsPlaneVectors[1]);
 
 		//the plane passes through any of the 3 points
-		G = *A;
-	}
-
-	//make sure all vectors are unit!
-	if (m_lsPlaneVectors[2].norm2() < ZERO_TOLERANCE)
-	{
-		//this means that the points are colinear!
-		//m_lsPlaneVectors[2] = CCVector3(0,0,1); //any normal will do
-		return false;
-	}
-	else
-	{
-		m_lsPlaneVectors[2].normalize();
+		if (!FinalizeLSPlane(m_lsPlaneVectors, *A, m_lsPlaneEquation))
+			return false;
 	}
-	//normalize X as well
-	m_lsPlaneVectors[0].normalize();
-	//and update Y
-	m_lsPlaneVectors[1] = m_lsPlaneVectors[2].cross(m_lsPlaneVectors[0]);
-
-	//deduce the proper equation
-	m_lsPlaneEquation[0] = m_lsPlaneVectors[2].x;
-	m_lsPlaneEquation[1] = m_lsPlaneVectors[2].y;
-	m_lsPlaneEquation[2] = m_lsPlaneVectors[2].z;
-
-	//eventually we just have to compute the 'constant' coefficient a3
-	//we use the fact that the plane pass through G --> GM.N = 0 (scalar prod)
-	//i.e. a0*G[0]+a1*G[1]+a2*G[2]=a3
-	m_lsPlaneEquation[3] = G.dot(m_lsPlaneVectors[2]);
 
 	m_structuresValidity |= FLAG_LS_PLANE;
 
@@ -417,34 +459,40 @@ bool Neighbourhood::computeQuadric()
 	{
 		float* _A = &(A[0]);
 		float* _b = &(b[0]);
-		for (unsigned i=0; i<count; ++i)
+		for (unsigned i=0; i<count; )
 		{
-			CCVector3 P = *m_associatedCloud->getPoint(i) - *G;
-
-			float lX = static_cast<float>(P.u[idx.x]);
-			float lY = static_cast<float>(P.u[idx.y]);
-			float lZ = static_cast<float>(P.u[idx.z]);
-
-			*_A++ = 1.0f;
-			*_A++ = lX;
-			*_A++ = lY;
-			*_A = lX*lX;
-			//by the way, we track the max 'X' squared dimension
-			if (*_A > lmax2)
-				lmax2 = *_A;
-			++_A;
-			*_A++ = lX*lY;
-			*_A = lY*lY;
-			//by the way, we track the max 'Y' squared dimension
-			if (*_A > lmax2)
-				lmax2 = *_A;
-			++_A;
-
-			*_b++ = lZ;
-			lZ *= lZ;
-			//and don't forget to track the max 'Z' squared dimension as well
-			if (lZ > lmax2)
-				lmax2 = lZ;
+			unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+			const CCVector3* Q = m_associatedCloud->getPointsBlock(i, blockSize);
+			for (unsigned j=0; j<blockSize; ++j, ++Q)
+			{
+				CCVector3 P = *Q - *G;
+
+				float lX = static_cast<float>(P.u[idx.x]);
+				float lY = static_cast<float>(P.u[idx.y]);
+				float lZ = static_cast<float>(P.u[idx.z]);
+
+				*_A++ = 1.0f;
+				*_A++ = lX;
+				*_A++ = lY;
+				*_A = lX*lX;
+				//by the way, we track the max 'X' squared dimension
+				if (*_A > lmax2)
+					lmax2 = *_A;
+				++_A;
+				*_A++ = lX*lY;
+				*_A = lY*lY;
+				//by the way, we track the max 'Y' squared dimension
+				if (*_A > lmax2)
+					lmax2 = *_A;
+				++_A;
+
+				*_b++ = lZ;
+				lZ *= lZ;
+				//and don't forget to track the max 'Z' squared dimension as well
+				if (lZ > lmax2)
+					lmax2 = lZ;
+			}
+			i += blockSize;
 		}
 	}
 
@@ -618,21 +666,27 @@ bool Neighbourhood::compute3DQuadric(double quadricEquation[10])
 		}
 
 		PointCoordinateType* _M = &(M[0]);
-		for (unsigned i=0; i<count; ++i)
+		for (unsigned i=0; i<count; )
 		{
-			CCVector3 P = *m_associatedCloud->getPoint(i) - *G;
-
-			//we fill the ith line
-			(*_M++) = P.x * P.x;
-			(*_M++) = P.y * P.y;
-			(*_M++) = P.z * P.z;
-			(*_M++) = P.x * P.y;
-			(*_M++) = P.y * P.z;
-			(*_M++) = P.x * P.z;
-			(*_M++) = P.x;
-			(*_M++) = P.y;
-			(*_M++) = P.z;
-			(*_M++) = 1;
+			unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+			const CCVector3* Q = m_associatedCloud->getPointsBlock(i, blockSize);
+			for (unsigned j=0; j<blockSize; ++j, ++Q)
+			{
+				CCVector3 P = *Q - *G;
+
+				//we fill the ith line
+				(*_M++) = P.x * P.x;
+				(*_M++) = P.y * P.y;
+				(*_M++) = P.z * P.z;
+				(*_M++) = P.x * P.y;
+				(*_M++) = P.y * P.z;
+				(*_M++) = P.x * P.z;
+				(*_M++) = P.x;
+				(*_M++) = P.y;
+				(*_M++) = P.z;
+				(*_M++) = 1;
+			}
+			i += blockSize;
 		}
 	}
 
@@ -931,18 +985,14 @@ ScalarType Neighbourhood::computeCurvature(unsigned neighbourIndex, CC_CURVATURE
 			//compute curvature as the rate of change of the surface
 			e = CCVector3d::fromArray(eVal.data());
 #else
-			CCLib::SquareMatrixd eigVectors;
-			std::vector<double> eigValues;
-			if (!Jacobi<double>::ComputeEigenValuesAndVectors(covMat, eigVectors, eigValues, true))
-			{
-				//failure
-				return NAN_VALUE;
-			}
+			double m[6];
+			EigenSolver3x3<double>::ToPacked(covMat, m);
+			EigenSolver3x3<double>::ComputeEigenValues(m, e.u);
 
 			//compute curvature as the rate of change of the surface
-			e.x = eigValues[0];
-			e.y = eigValues[1];
-			e.z = eigValues[2];
+			e.x = fabs(e.x);
+			e.y = fabs(e.y);
+			e.z = fabs(e.z);
 #endif
 			double sum = e.x + e.y + e.z; //we work with absolute values
 			if (sum < ZERO_TOLERANCE)
@@ -0,0 +1,275 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "PolygonInclusionGrid.h"
+
+//local
+#include "GenericIndexedCloud.h"
+
+//system
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+
+using namespace CCLib;
+
+PolygonInclusionGrid::PolygonInclusionGrid()
+	: m_gridMin(0, 0)
+	, m_gridMax(0, 0)
+	, m_cellWidth(0)
+	, m_cellHeight(0)
+	, m_colCount(0)
+	, m_rowCount(0)
+{
+}
+
+void PolygonInclusionGrid::clear()
+{
+	m_gridMin = m_gridMax = CCVector2(0, 0);
+	m_cellWidth = m_cellHeight = 0;
+	m_colCount = m_rowCount = 0;
+
+	m_cells.clear();
+	m_rowStart.clear();
+	m_rowEdges.clear();
+}
+
+bool PolygonInclusionGrid::build(const GenericIndexedCloud* polyVertices, unsigned resolution/*=DEFAULT_RESOLUTION*/)
+{
+	unsigned vertCount = (polyVertices ? polyVertices->size() : 0);
+
+	std::vector<CCVector2> vertices;
+	try
+	{
+		vertices.resize(vertCount);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		clear();
+		return false;
+	}
+
+	for (unsigned i = 0; i < vertCount; ++i)
+	{
+		CCVector3 P;
+		polyVertices->getPoint(i, P);
+		vertices[i] = CCVector2(P.x, P.y);
+	}
+
+	return build(vertices, resolution);
+}
+
+bool PolygonInclusionGrid::build(const std::vector<CCVector2>& polyVertices, unsigned resolution/*=DEFAULT_RESOLUTION*/)
+{
+	clear();
+
+	//same convention as ManualSegmentationTools::isPointInsidePoly: no point can be inside
+	size_t vertCount = polyVertices.size();
+	if (vertCount < 2)
+		return true;
+
+	//polygon bounding-box
+	CCVector2 bbMin = polyVertices[0];
+	CCVector2 bbMax = polyVertices[0];
+	PointCoordinateType maxAbsCoord = 0;
+	for (size_t i = 0; i < vertCount; ++i)
+	{
+		const CCVector2& P = polyVertices[i];
+		bbMin.x = std::min(bbMin.x, P.x);
+		bbMin.y = std::min(bbMin.y, P.y);
+		bbMax.x = std::max(bbMax.x, P.x);
+		bbMax.y = std::max(bbMax.y, P.y);
+		maxAbsCoord = std::max(maxAbsCoord, std::max(std::abs(P.x), std::abs(P.y)));
+	}
+
+	PointCoordinateType maxDim = std::max(bbMax.x - bbMin.x, bbMax.y - bbMin.y);
+	if (!(maxDim > 0))
+	{
+		//degenerate polygon: no point can be inside
+		return true;
+	}
+
+	//the cells that are not flagged as 'boundary' must be far enough from the edges
+	//so that the crossing test can't be affected by round-off errors
+	PointCoordinateType margin = (maxDim + maxAbsCoord / 10) * static_cast<PointCoordinateType>(1.0e-4);
+	m_gridMin = bbMin - CCVector2(margin, margin);
+	m_gridMax = bbMax + CCVector2(margin, margin);
+
+	if (resolution == 0)
+		resolution = 1;
+	PointCoordinateType gridWidth = m_gridMax.x - m_gridMin.x;
+	PointCoordinateType gridHeight = m_gridMax.y - m_gridMin.y;
+	PointCoordinateType gridMaxDim = std::max(gridWidth, gridHeight);
+	m_colCount = std::max<unsigned>(1, static_cast<unsigned>(ceil(resolution * gridWidth / gridMaxDim)));
+	m_rowCount = std::max<unsigned>(1, static_cast<unsigned>(ceil(resolution * gridHeight / gridMaxDim)));
+	m_cellWidth = gridWidth / m_colCount;
+	m_cellHeight = gridHeight / m_rowCount;
+
+	try
+	{
+		m_cells.resize(static_cast<size_t>(m_colCount) * m_rowCount, CELL_OUTSIDE);
+		m_rowStart.resize(m_rowCount + 1, 0);
+
+		//first pass: we count the edges of each row
+		//second pass: we store them and we flag the cells they cross
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			for (size_t i = 1; i <= vertCount; ++i)
+			{
+				const CCVector2& A = polyVertices[i - 1];
+				const CCVector2& B = polyVertices[i % vertCount];
+
+				//horizontal edges are never crossed (but the points lying on them
+				//can't be classified as their neighbours, hence the 'boundary' cells)
+				bool horizontal = (A.y == B.y);
+				if (pass == 0 && horizontal)
+					continue;
+
+				PointCoordinateType yMin = std::min(A.y, B.y);
+				PointCoordinateType yMax = std::max(A.y, B.y);
+				unsigned firstRow = getRow(std::max(yMin - margin, m_gridMin.y));
+				unsigned lastRow = getRow(std::min(yMax + margin, m_gridMax.y));
+
+				for (unsigned r = firstRow; r <= lastRow; ++r)
+				{
+					if (pass == 0)
+					{
+						++m_rowStart[r + 1];
+						continue;
+					}
+
+					double x1 = A.x;
+					double x2 = B.x;
+					if (!horizontal)
+					{
+						Edge& edge = m_rowEdges[m_rowStart[r]++];
+						edge.ax = A.x;
+						edge.ay = A.y;
+						edge.bx = B.x;
+						edge.by = B.y;
+
+						//part of the edge inside the row (+ margin)
+						double rowMinY = m_gridMin.y + r * static_cast<double>(m_cellHeight) - margin;
+						double rowMaxY = rowMinY + m_cellHeight + 2 * margin;
+						double y1 = std::max(rowMinY, static_cast<double>(yMin));
+						double y2 = std::max(y1, std::min(rowMaxY, static_cast<double>(yMax)));
+						x1 = A.x + (static_cast<double>(B.x) - A.x) * (y1 - A.y) / (static_cast<double>(B.y) - A.y);
+						x2 = A.x + (static_cast<double>(B.x) - A.x) * (y2 - A.y) / (static_cast<double>(B.y) - A.y);
+					}
+
+					//flag the corresponding cells as 'boundary'
+					unsigned firstCol = getCol(static_cast<PointCoordinateType>(std::max(std::min(x1, x2) - margin, static_cast<double>(m_gridMin.x))));
+					unsigned lastCol = getCol(static_cast<PointCoordinateType>(std::min(std::max(x1, x2) + margin, static_cast<double>(m_gridMax.x))));
+					unsigned char* cells = &(m_cells[static_cast<size_t>(r) * m_colCount]);
+					for (unsigned c = firstCol; c <= lastCol; ++c)
+					{
+						cells[c] = CELL_BOUNDARY;
+					}
+				}
+			}
+
+			if (pass == 0)
+			{
+				//convert the counts to start indexes
+				for (unsigned r = 0; r < m_rowCount; ++r)
+				{
+					m_rowStart[r + 1] += m_rowStart[r];
+				}
+				m_rowEdges.resize(m_rowStart[m_rowCount]);
+			}
+		}
+
+		//the second pass has moved each row start index to the start of the next row
+		for (unsigned r = m_rowCount; r > 0; --r)
+		{
+			m_rowStart[r] = m_rowStart[r - 1];
+		}
+		m_rowStart[0] = 0;
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		clear();
+		return false;
+	}
+
+	//the other cells are either fully inside or fully outside: we test their center
+	for (unsigned r = 0; r < m_rowCount; ++r)
+	{
+		unsigned char* cells = &(m_cells[static_cast<size_t>(r) * m_colCount]);
+		CCVector2 C(0, m_gridMin.y + (r + static_cast<PointCoordinateType>(0.5)) * m_cellHeight);
+		for (unsigned c = 0; c < m_colCount; ++c)
+		{
+			if (cells[c] != CELL_BOUNDARY)
+			{
+				C.x = m_gridMin.x + (c + static_cast<PointCoordinateType>(0.5)) * m_cellWidth;
+				cells[c] = (isInsideRow(C, r) ? CELL_INSIDE : CELL_OUTSIDE);
+			}
+		}
+	}
+
+	return true;
+}
+
+bool PolygonInclusionGrid::isInsideRow(const CCVector2& P, unsigned row) const
+{
+	bool inside = false;
+
+	for (unsigned i = m_rowStart[row]; i < m_rowStart[row + 1]; ++i)
+	{
+		const Edge& edge = m_rowEdges[i];
+
+		//same test as ManualSegmentationTools::isPointInsidePoly (W. Randolph Franklin)
+		if ((edge.by <= P.y && P.y < edge.ay) || (edge.ay <= P.y && P.y < edge.by))
+		{
+			PointCoordinateType t = (P.x - edge.bx)*(edge.ay - edge.by) - (edge.ax - edge.bx)*(P.y - edge.by);
+			if (edge.ay < edge.by)
+				t = -t;
+			if (t < 0)
+				inside = !inside;
+		}
+	}
+
+	return inside;
+}
+
+bool PolygonInclusionGrid::isInside(const CCVector2& P) const
+{
+	//empty grid (nothing can be inside)
+	if (m_rowCount == 0)
+	{
+		return false;
+	}
+
+	//outside of the grid (or invalid point)
+	if (!(	P.x >= m_gridMin.x && P.x <= m_gridMax.x
+		&&	P.y >= m_gridMin.y && P.y <= m_gridMax.y))
+	{
+		return false;
+	}
+
+	unsigned row = getRow(P.y);
+	unsigned char state = m_cells[static_cast<size_t>(row) * m_colCount + getCol(P.x)];
+	if (state != CELL_BOUNDARY)
+	{
+		return (state == CELL_INSIDE);
+	}
+
+	return isInsideRow(P, row);
+}
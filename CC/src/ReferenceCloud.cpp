@@ -134,6 +134,34 @@ const CCVector3* ReferenceCloud::getCurrentPointCoordinates() const
 	return m_theAssociatedCloud->getPointPersistentPtr(m_theIndexes->getValue(m_globalIterator));
 }
 
+const CCVector3* ReferenceCloud::getPointsBlock(unsigned index, unsigned& count)
+{
+	assert(m_theAssociatedCloud && index < size());
+	count = std::min(std::min(count, size() - index), static_cast<unsigned>(DEFAULT_POINTS_BLOCK_SIZE));
+
+	//we gather the points in the local buffer
+	if (m_pointsBlock.size() < count)
+	{
+		try
+		{
+			m_pointsBlock.resize(count);
+		}
+		catch (const std::bad_alloc&)
+		{
+			//not enough memory: we fall back to the standard access
+			count = 1;
+			return getPoint(index);
+		}
+	}
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		m_pointsBlock[i] = *m_theAssociatedCloud->getPointPersistentPtr(m_theIndexes->getValue(index + i));
+	}
+
+	return &(m_pointsBlock.front());
+}
+
 bool ReferenceCloud::addPointIndex(unsigned globalIndex)
 {
 	if (m_theIndexes->capacity() == m_theIndexes->currentSize())
@@ -33,6 +33,7 @@
 #include "ManualSegmentationTools.h"
 #include "GeometricalAnalysisTools.h"
 #include "KdTree.h"
+#include "MeshBVH.h"
 #include "SimpleCloud.h"
 #include "ChunkedPointCloud.h"
 #include "Garbage.h"
@@ -246,16 +247,20 @@ ICPRegistrationTools::RESULT_TYPE ICPRegistrationTools::Register(	GenericIndexed
 	{
 		assert(!params.modelWeights);
 
-		//we'll use the mesh vertices to estimate the right octree level
-		DgmOctree dataOctree(data.cloud);
-		DgmOctree modelOctree(inputModelCloud);
-		if (dataOctree.build() < static_cast<int>(data.cloud->size()) || modelOctree.build() < static_cast<int>(inputModelCloud->size()))
+		//no octree is needed if the cloud/mesh distances are computed with the mesh BVH (see below)
+		if (!params.useMeshBVH)
 		{
-			//an error occurred during the octree computation: probably there's not enough memory
-			return ICP_ERROR_NOT_ENOUGH_MEMORY;
-		}
+			//we'll use the mesh vertices to estimate the right octree level
+			DgmOctree dataOctree(data.cloud);
+			DgmOctree modelOctree(inputModelCloud);
+			if (dataOctree.build() < static_cast<int>(data.cloud->size()) || modelOctree.build() < static_cast<int>(inputModelCloud->size()))
+			{
+				//an error occurred during the octree computation: probably there's not enough memory
+				return ICP_ERROR_NOT_ENOUGH_MEMORY;
+			}
 
-		meshDistOctreeLevel = dataOctree.findBestLevelForComparisonWithOctree(&modelOctree);
+			meshDistOctreeLevel = dataOctree.findBestLevelForComparisonWithOctree(&modelOctree);
+		}
 	}
 	else /*if (inputModelCloud)*/
 	{
@@ -323,10 +328,17 @@ ICPRegistrationTools::RESULT_TYPE ICPRegistrationTools::Register(	GenericIndexed
 	}
 
 	//Closest Point Set (see ICP algorithm)
+	MeshBVH modelMeshBVH; //the model mesh doesn't move: its BVH (if any) is computed once for all the iterations
 	if (inputModelMesh)
 	{
 		data.CPSetPlain = new ChunkedPointCloud;
 		cloudGarbage.add(data.CPSetPlain);
+
+		if (params.useMeshBVH && !modelMeshBVH.build(inputModelMesh))
+		{
+			//not enough memory
+			return ICP_ERROR_NOT_ENOUGH_MEMORY;
+		}
 	}
 	else
 	{
@@ -351,6 +363,8 @@ ICPRegistrationTools::RESULT_TYPE ICPRegistrationTools::Register(	GenericIndexed
 		c2mDistParams.octreeLevel = meshDistOctreeLevel;
 		c2mDistParams.CPSet = data.CPSetPlain;
 		c2mDistParams.maxThreadCount = params.maxThreadCount;
+		c2mDistParams.useBVH = params.useMeshBVH;
+		c2mDistParams.bvh = &modelMeshBVH;
 		if (DistanceComputationTools::computeCloud2MeshDistance(data.cloud, inputModelMesh, c2mDistParams, progressCb) < 0)
 		{
 			//an error occurred during distances computation...
@@ -781,6 +795,8 @@ ICPRegistrationTools::RESULT_TYPE ICPRegistrationTools::Register(	GenericIndexed
 			c2mDistParams.octreeLevel = meshDistOctreeLevel;
 			c2mDistParams.CPSet = data.CPSetPlain;
 			c2mDistParams.maxThreadCount = params.maxThreadCount;
+			c2mDistParams.useBVH = params.useMeshBVH;
+			c2mDistParams.bvh = &modelMeshBVH;
 			if (DistanceComputationTools::computeCloud2MeshDistance(data.cloud, inputModelMesh, c2mDistParams) < 0)
 			{
 				//an error occurred during distances computation...
@@ -29,6 +29,19 @@
 #include <stdint.h>
 #include <stdio.h> //for sprintf
 
+//Qt
+#ifdef USE_QT
+#ifndef _DEBUG
+//enables multi-threading handling
+#define ENABLE_MT_SAITO
+#endif
+#endif
+
+#ifdef ENABLE_MT_SAITO
+#include <QtCore>
+#include <QtConcurrentMap>
+#endif
+
 using namespace CCLib;
 
 bool SaitoSquaredDistanceTransform::EDT_1D(GridElement* slice, size_t r, size_t c)
@@ -72,6 +85,149 @@ bool SaitoSquaredDistanceTransform::EDT_1D(GridElement* slice, size_t r, size_t
 	return true;
 }
 
+//! Number of contiguous columns processed together by the column-wise scans
+/** The columns are strided in memory: they are copied by tiles so that each
+	read/write of the grid covers a full cache line (16 x 4 bytes).
+**/
+static const size_t COLUMN_TILE_WIDTH = 16;
+
+typedef SaitoSquaredDistanceTransform::GridElement GridElement;
+
+//! Forward and backward scans of the Saito algorithm along a column
+/** \param in original column values (contiguous)
+	\param out updated column values (should be initialized with the original values)
+	\param n number of values
+	\param sq lookup table of integer squares
+**/
+static void SaitoColumnScans(const GridElement* in, GridElement* out, size_t n, const std::vector<GridElement>& sq)
+{
+	//forward scan
+	{
+		GridElement a = 0;
+		GridElement buffer = in[0];
+
+		for (size_t k = 1; k < n; ++k)
+		{
+			if (a != 0)
+				--a;
+			GridElement value = in[k];
+			if (value > buffer + 1)
+			{
+				GridElement b = (value - buffer - 1) / 2;
+				if (k + b + 1 > n)
+					b = static_cast<GridElement>(n - 1 - k);
+
+				for (GridElement l = a; l <= b; ++l)
+				{
+					GridElement m = buffer + sq[l + 1];
+					size_t index = k + l;
+					if (in[index] <= m)
+					{
+						//proceed to next value
+						break;
+					}
+					if (m < out[index])
+						out[index] = m;
+				}
+				a = b;
+			}
+			else
+			{
+				a = 0;
+			}
+			buffer = value;
+		}
+	}
+
+	//backward scan
+	{
+		GridElement a = 0;
+		GridElement buffer = in[n - 1];
+
+		for (size_t k = n - 2; k != static_cast<size_t>(-1); --k)
+		{
+			if (a != 0)
+				--a;
+			GridElement value = in[k];
+			if (value > buffer + 1)
+			{
+				GridElement b = (value - buffer - 1) / 2;
+				if (k < b)
+					b = static_cast<GridElement>(k);
+
+				for (GridElement l = a; l <= b; ++l)
+				{
+					GridElement m = buffer + sq[l + 1];
+					size_t index = k - l;
+					if (in[index] <= m)
+					{
+						//proceed to next value
+						break;
+					}
+					if (m < out[index])
+						out[index] = m;
+				}
+				a = b;
+			}
+			else
+			{
+				a = 0;
+			}
+			buffer = value;
+		}
+	}
+}
+
+//! Applies the Saito column scans to a set of columns, by tiles of contiguous columns
+/** Each tile is transposed in a local buffer so that the scans are performed on contiguous values.
+	\param data first value of the first column
+	\param columnCount number of columns (contiguous in memory)
+	\param n number of values per column
+	\param stride distance between two consecutive values of a column
+	\param sq lookup table of integer squares
+	\param tileIn tile buffer (at least n * COLUMN_TILE_WIDTH elements)
+	\param tileOut tile buffer (at least n * COLUMN_TILE_WIDTH elements)
+**/
+static void SaitoTiledColumnScans(	GridElement* data,
+									size_t columnCount,
+									size_t n,
+									size_t stride,
+									const std::vector<GridElement>& sq,
+									GridElement* tileIn,
+									GridElement* tileOut)
+{
+	for (size_t i = 0; i < columnCount; i += COLUMN_TILE_WIDTH)
+	{
+		size_t w = std::min(COLUMN_TILE_WIDTH, columnCount - i);
+
+		//copy the tile (transposed)
+		const GridElement* src = data + i;
+		for (size_t k = 0; k < n; ++k, src += stride)
+		{
+			for (size_t t = 0; t < w; ++t)
+			{
+				tileIn[t*n + k] = src[t];
+			}
+		}
+		memcpy(tileOut, tileIn, n * w * sizeof(GridElement));
+
+		for (size_t t = 0; t < w; ++t)
+		{
+			SaitoColumnScans(tileIn + t*n, tileOut + t*n, n, sq);
+		}
+
+		//write the tile back
+		GridElement* dest = data + i;
+		for (size_t k = 0; k < n; ++k, dest += stride)
+		{
+			for (size_t t = 0; t < w; ++t)
+			{
+				dest[t] = tileOut[t*n + k];
+			}
+		}
+	}
+}
+
 //:
 // Assumes given a Lookup table of integer squares.
 // Also assumes the image \a im already has infinity in all non-zero points.
@@ -94,10 +250,10 @@ bool SaitoSquaredDistanceTransform::SDT_2D(Grid3D<GridElement>& grid, size_t sli
 	
 	// 2nd step: horizontal scan
 	{
-		std::vector<GridElement> colData;
+		std::vector<GridElement> tileData;
 		try
 		{
-			colData.resize(r);
+			tileData.resize(2 * r * COLUMN_TILE_WIDTH);
 		}
 		catch (const std::bad_alloc&)
 		{
@@ -105,116 +261,103 @@ bool SaitoSquaredDistanceTransform::SDT_2D(Grid3D<GridElement>& grid, size_t sli
 			return false;
 		}
 
-		//for each column
-		for (size_t i = 0; i < c; ++i)
-		{
-			//fill buffer with column values
-			{
-				GridElement* pt = sliceData + i;
-				for (size_t j = 0; j < r; ++j, pt += c)
-					colData[j] = *pt;
-			}
-
-			//forward scan
-			GridElement* pt = sliceData + i + c;
-			{
-				GridElement a = 0;
-				GridElement buffer = colData[0];
+		SaitoTiledColumnScans(sliceData, c, r, c, sq, &(tileData[0]), &(tileData[r * COLUMN_TILE_WIDTH]));
+	}
 
-				for (size_t j = 1; j < r; ++j, pt += c)
-				{
-					size_t rowIndex = j;
-					if (a != 0)
-						--a;
-					if (colData[rowIndex] > buffer + 1)
-					{
-						GridElement b = (colData[rowIndex] - buffer - 1) / 2;
-						if (rowIndex + b + 1 > r)
-							b = static_cast<GridElement>(r - 1 - rowIndex);
-
-						GridElement* npt = pt + a*c;
-						for (GridElement l = a; l <= b; ++l)
-						{
-							GridElement m = buffer + sq[l + 1];
-							if (colData[rowIndex + l] <= m)
-							{
-								//proceed to next column
-								break;
-							}
-							if (m < *npt)
-								*npt = m;
-							npt += c;
-						}
-						a = b;
-					}
-					else
-					{
-						a = 0;
-					}
-					buffer = colData[rowIndex];
-				}
-			}
+	return true;
+}
 
-			//backward scan
-			pt -= 2 * c;
-			{
-				GridElement a = 0;
-				GridElement buffer = colData[r - 1];
+bool SaitoSquaredDistanceTransform::SDT_Z(Grid3D<GridElement>& grid, size_t rowIndex, const std::vector<GridElement>& sq)
+{
+	const Tuple3ui& gridSize = grid.size();
+	size_t r = gridSize.y;
+	size_t c = gridSize.x;
+	size_t p = gridSize.z;
 
-				for (size_t j = 1; j < r; ++j, pt -= c)
-				{
-					size_t rowIndex = r - j - 1;
-					if (a != 0)
-						--a;
-					if (colData[rowIndex] > buffer + 1)
-					{
-						GridElement b = (colData[rowIndex] - buffer - 1) / 2;
-						if (rowIndex < b)
-							b = static_cast<GridElement>(rowIndex);
-
-						GridElement* npt = pt - a*c;
-						for (GridElement l = a; l <= b; ++l)
-						{
-							GridElement m = buffer + sq[l + 1];
-							if (colData[rowIndex - l] <= m)
-							{
-								//proceed to next column
-								break;
-							}
-							if (m < *npt)
-								*npt = m;
-							npt -= c;
-						}
-						a = b;
-					}
-					else
-					{
-						a = 0;
-					}
-					buffer = colData[rowIndex];
-				}
-			}
-		}
+	std::vector<GridElement> tileData;
+	try
+	{
+		tileData.resize(2 * p * COLUMN_TILE_WIDTH);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
 	}
 
+	SaitoTiledColumnScans(grid.data() + rowIndex * c, c, p, r*c, sq, &(tileData[0]), &(tileData[p * COLUMN_TILE_WIDTH]));
+
 	return true;
 }
 
+//parameters shared by the threads
+static Grid3D<GridElement>* s_grid_MT = 0;
+static const std::vector<GridElement>* s_sq_MT = 0;
+static GridElement s_maxDistance_MT = 0;
+static NormalizedProgress* s_normProgress_MT = 0;
+static bool s_success_MT = true;
+
+void SaitoSquaredDistanceTransform::ProcessSlice(const size_t& sliceIndex)
+{
+	if (!s_success_MT)
+	{
+		//process cancelled or failed
+		return;
+	}
+
+	const Tuple3ui& gridSize = s_grid_MT->size();
+	size_t voxelCount = static_cast<size_t>(gridSize.x) * gridSize.y;
+	GridElement* sliceData = s_grid_MT->data() + sliceIndex * voxelCount;
+
+	for (size_t i = 0; i < voxelCount; ++i)
+	{
+		//DGM: warning we must invert the input image here!
+		if (sliceData[i] == 0)
+			sliceData[i] = s_maxDistance_MT;
+		else
+			sliceData[i] = 0;
+	}
+
+	if (!SDT_2D(*s_grid_MT, sliceIndex, *s_sq_MT) || (s_normProgress_MT && !s_normProgress_MT->oneStep()))
+	{
+		s_success_MT = false;
+	}
+}
+
+void SaitoSquaredDistanceTransform::ProcessRow(const size_t& rowIndex)
+{
+	if (!s_success_MT)
+	{
+		//process cancelled or failed
+		return;
+	}
+
+	if (!SDT_Z(*s_grid_MT, rowIndex, *s_sq_MT) || (s_normProgress_MT && !s_normProgress_MT->oneStep()))
+	{
+		s_success_MT = false;
+	}
+}
+
 bool SaitoSquaredDistanceTransform::SDT_3D(Grid3D<GridElement>& grid, GenericProgressCallback* progressCb/*=0*/)
 {
 	const Tuple3ui& gridSize = grid.size();
 	size_t r = gridSize.y;
 	size_t c = gridSize.x;
 	size_t p = gridSize.z;
-	size_t voxelCount = r*c*p;
 
 	size_t diag = static_cast<size_t>(ceil(sqrt(static_cast<double>(r*r + c*c + p*p))) - 1);
 	size_t nsqr = 2 * (diag + 1);
 
 	std::vector<GridElement> sq;
+#ifdef ENABLE_MT_SAITO
+	std::vector<size_t> indexes;
+#endif
 	try
 	{
 		sq.resize(nsqr);
+#ifdef ENABLE_MT_SAITO
+		indexes.resize(std::max(p, r));
+#endif
 	}
 	catch (const std::bad_alloc&)
 	{
@@ -243,128 +386,46 @@ bool SaitoSquaredDistanceTransform::SDT_3D(Grid3D<GridElement>& grid, GenericPro
 		progressCb->start();
 	}
 
-	GridElement* data = grid.data();
+	s_grid_MT = &grid;
+	s_sq_MT = &sq;
+	s_maxDistance_MT = maxDistance;
+	s_normProgress_MT = progressCb ? &normProgress : 0;
+	s_success_MT = true;
+
+	//the slices are independent for the 2D EDT, and so are the rows for the final pass along Z
+#ifdef ENABLE_MT_SAITO
+	for (size_t i = 0; i < indexes.size(); ++i)
 	{
-		for (size_t i = 0; i < voxelCount; ++i)
-		{
-			//DGM: warning we must invert the input image here!
-			if (data[i] == 0)
-				data[i] = maxDistance;
-			else
-				data[i] = 0;
-		}
+		indexes[i] = i;
 	}
 
 	// 2D EDT for each slice
-	for (size_t k = 0; k < p; ++k)
-	{
-		if (!SDT_2D(grid, k, sq))
-		{
-			return false;
-		}
-
-		if (progressCb && !normProgress.oneStep())
-		{
-			//process cancelled by user
-			return false;
-		}
-	}
+	QtConcurrent::blockingMap(indexes.begin(), indexes.begin() + p, ProcessSlice);
 
 	// Now, for each pixel, compute final distance by searching along Z direction
-	size_t rc = r*c;
-	std::vector<GridElement> colData;
-	try
+	if (s_success_MT)
 	{
-		colData.resize(p);
+		QtConcurrent::blockingMap(indexes.begin(), indexes.begin() + r, ProcessRow);
 	}
-	catch (const std::bad_alloc&)
+#else
+	// 2D EDT for each slice
+	for (size_t k = 0; k < p && s_success_MT; ++k)
 	{
-		//not enough memory
-		return false;
+		ProcessSlice(k);
 	}
 
-	for (size_t j = 0; j < r; ++j, data += c)
+	// Now, for each pixel, compute final distance by searching along Z direction
+	for (size_t j = 0; j < r && s_success_MT; ++j)
 	{
-		for (size_t i = 0; i < c; ++i)
-		{
-			GridElement* pt = data + i;
-
-			for (size_t k = 0; k < p; ++k, pt += rc)
-				colData[k] = *pt;
-
-			pt = data + i + rc;
-			GridElement a = 0;
-			GridElement buffer = colData[0];
-
-			for (size_t k = 1; k < p; ++k, pt += rc)
-			{
-				if (a != 0)
-					--a;
-				if (colData[k] > buffer + 1)
-				{
-					GridElement b = (colData[k] - buffer - 1) / 2;
-					if (k + b + 1 > p)
-						b = static_cast<GridElement>(p - 1 - k);
-
-					GridElement* npt = pt + a*rc;
-					for (GridElement l = a; l <= b; ++l)
-					{
-						GridElement m = buffer + sq[l + 1];
-						if (colData[k + l] <= m)
-							break;   // go to next plane k
-						if (m < *npt)
-							*npt = m;
-						npt += rc;
-					}
-					a = b;
-				}
-				else
-				{
-					a = 0;
-				}
-				buffer = colData[k];
-			}
-
-			a = 0;
-			pt -= 2 * rc;
-			buffer = colData[p - 1];
-
-			for (size_t k = p - 2; k != static_cast<size_t>(-1); --k, pt -= rc)
-			{
-				if (a != 0)
-					--a;
-				if (colData[k] > buffer + 1)
-				{
-					GridElement b = (colData[k] - buffer - 1) / 2;
-					if (k < b)
-						b = static_cast<GridElement>(k);
+		ProcessRow(j);
+	}
+#endif
 
-					GridElement* npt = pt - a*rc;
-					for (GridElement l = a; l <= b; ++l)
-					{
-						GridElement m = buffer + sq[l + 1];
-						if (colData[k - l] <= m)
-							break;   // go to next column k
-						if (m < *npt)
-							*npt = m;
-						npt -= rc;
-					}
-					a = b;
-				}
-				else
-				{
-					a = 0;
-				}
-				buffer = colData[k];
-			}
-		}
+	bool success = s_success_MT;
 
-		if (progressCb && !normProgress.oneStep())
-		{
-			//process cancelled by user
-			return false;
-		}
-	}
+	s_grid_MT = 0;
+	s_sq_MT = 0;
+	s_normProgress_MT = 0;
 
-	return true;
+	return success;
 }
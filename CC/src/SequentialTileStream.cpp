@@ -0,0 +1,360 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "SequentialTileStream.h"
+
+//local
+#include "GenericProgressCallback.h"
+#include "ReferenceCloud.h"
+
+//system
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include <vector>
+
+using namespace CCLib;
+
+SequentialTileStream::SequentialTileStream(PointReader* reader, PointWriter* writer, unsigned maxTilePointCount)
+	: m_reader(reader)
+	, m_writer(writer)
+	, m_maxTilePointCount(std::max<unsigned>(maxTilePointCount, 1))
+	, m_pointCount(0)
+	, m_recordSize(0)
+	, m_bbMin(0, 0, 0)
+	, m_bbMax(0, 0, 0)
+	, m_currentTile(0)
+	, m_writtenCount(0)
+{
+	assert(m_reader && m_writer);
+}
+
+SequentialTileStream::~SequentialTileStream()
+{
+	release();
+}
+
+void SequentialTileStream::release()
+{
+	m_tiling.clear();
+	ChunkedArrayAllocator::Release(m_sortedPoints);
+	ChunkedArrayAllocator::Release(m_sortedRecords);
+	m_tilePoints.clear();
+}
+
+bool SequentialTileStream::init(GenericProgressCallback* progressCb/*=0*/)
+{
+	release();
+	m_pointCount = 0;
+	m_currentTile = 0;
+	m_writtenCount = 0;
+
+	if (!m_reader || !m_writer)
+	{
+		assert(false);
+		return false;
+	}
+
+	m_pointCount = m_reader->size();
+	m_recordSize = m_reader->recordSize();
+	if (m_pointCount == 0)
+	{
+		//nothing to do
+		return true;
+	}
+
+	std::vector<unsigned char> record;
+	try
+	{
+		record.resize(std::max<unsigned>(m_recordSize, 1));
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	//the cloud is read 3 times
+	NormalizedProgress normProgress(progressCb, m_pointCount);
+	if (progressCb)
+	{
+		if (progressCb->textCanBeEdited())
+		{
+			progressCb->setMethodTitle("Sort points by tile");
+		}
+		progressCb->start();
+	}
+
+	bool success = true;
+	for (unsigned pass = 0; pass < 3 && success; ++pass)
+	{
+		if (progressCb)
+		{
+			if (progressCb->textCanBeEdited())
+			{
+				char buffer[64];
+				sprintf(buffer, "Points: %u\nPass %u/3", m_pointCount, pass + 1);
+				progressCb->setInfo(buffer);
+			}
+			normProgress.reset();
+			progressCb->update(0);
+		}
+
+		if (pass == 1)
+		{
+			//tiling grid
+			if (!m_tiling.init(m_bbMin, m_bbMax))
+			{
+				//not enough memory
+				success = false;
+				break;
+			}
+		}
+		else if (pass == 2)
+		{
+			//tiles
+			if (	!m_tiling.computeTiles(m_maxTilePointCount)
+				||	!ChunkedArrayAllocator::Resize(m_sortedPoints, static_cast<size_t>(m_pointCount) * sizeof(CCVector3), ChunkedArrayAllocator::FILE_MAPPED_ALLOCATION)
+				||	!ChunkedArrayAllocator::Resize(m_sortedRecords, static_cast<size_t>(m_pointCount) * m_recordSize, ChunkedArrayAllocator::FILE_MAPPED_ALLOCATION) )
+			{
+				//not enough memory (or disk space)
+				success = false;
+				break;
+			}
+		}
+
+		if (!m_reader->rewind())
+		{
+			//reading error
+			success = false;
+			break;
+		}
+
+		//counting sort positions (3rd pass)
+		std::vector<unsigned> fillIndexes;
+		if (pass == 2)
+		{
+			const std::vector<TilingGrid::Tile>& tiles = m_tiling.tiles();
+			try
+			{
+				fillIndexes.resize(tiles.size());
+			}
+			catch (const std::bad_alloc&)
+			{
+				//not enough memory
+				success = false;
+				break;
+			}
+			for (size_t t = 0; t < tiles.size(); ++t)
+			{
+				fillIndexes[t] = tiles[t].first;
+			}
+		}
+
+		for (unsigned i = 0; i < m_pointCount; ++i)
+		{
+			CCVector3 P;
+			if (!m_reader->readPoint(P, &(record[0])))
+			{
+				//reading error
+				success = false;
+				break;
+			}
+
+			switch (pass)
+			{
+			case 0: //bounding-box
+				if (i != 0)
+				{
+					for (unsigned char d = 0; d < 3; ++d)
+					{
+						m_bbMin.u[d] = std::min(m_bbMin.u[d], P.u[d]);
+						m_bbMax.u[d] = std::max(m_bbMax.u[d], P.u[d]);
+					}
+				}
+				else
+				{
+					m_bbMin = m_bbMax = P;
+				}
+				break;
+
+			case 1: //number of points per tiling grid cell
+				m_tiling.countPoint(P);
+				break;
+
+			case 2: //sort by tile
+				{
+					size_t index = fillIndexes[m_tiling.getTileIndex(P)]++;
+					static_cast<CCVector3*>(m_sortedPoints.data)[index] = P;
+					if (m_recordSize != 0)
+					{
+						memcpy(static_cast<unsigned char*>(m_sortedRecords.data) + index * m_recordSize, &(record[0]), m_recordSize);
+					}
+				}
+				break;
+			}
+
+			if (progressCb && !normProgress.oneStep())
+			{
+				//process cancelled by the user
+				success = false;
+				break;
+			}
+		}
+	}
+
+	if (progressCb)
+	{
+		progressCb->stop();
+	}
+
+	if (!success)
+	{
+		release();
+	}
+
+	return success;
+}
+
+unsigned SequentialTileStream::tileCount()
+{
+	return static_cast<unsigned>(m_tiling.tiles().size());
+}
+
+void SequentialTileStream::getBoundingBox(CCVector3& bbMin, CCVector3& bbMax)
+{
+	bbMin = m_bbMin;
+	bbMax = m_bbMax;
+}
+
+GenericIndexedCloudPersist* SequentialTileStream::loadTile(	unsigned tileIndex,
+															PointCoordinateType halo,
+															unsigned& coreCount,
+															CCVector3& tileMin,
+															CCVector3& tileMax)
+{
+	const std::vector<TilingGrid::Tile>& tiles = m_tiling.tiles();
+	if (tileIndex >= tiles.size())
+	{
+		assert(false);
+		return 0;
+	}
+
+	const TilingGrid::Tile& tile = tiles[tileIndex];
+	const CCVector3* sortedPoints = static_cast<const CCVector3*>(m_sortedPoints.data);
+	m_currentTile = tileIndex;
+	m_tilePoints.clear();
+	coreCount = tile.count;
+
+	//core points
+	if (!m_tilePoints.reserve(tile.count))
+	{
+		//not enough memory
+		return 0;
+	}
+	for (unsigned i = 0; i < tile.count; ++i)
+	{
+		const CCVector3& P = sortedPoints[static_cast<size_t>(tile.first) + i];
+		m_tilePoints.addPoint(P);
+
+		if (i != 0)
+		{
+			for (unsigned char d = 0; d < 3; ++d)
+			{
+				tileMin.u[d] = std::min(tileMin.u[d], P.u[d]);
+				tileMax.u[d] = std::max(tileMax.u[d], P.u[d]);
+			}
+		}
+		else
+		{
+			tileMin = tileMax = P;
+		}
+	}
+
+	if (halo <= 0)
+	{
+		return &m_tilePoints;
+	}
+
+	//halo points
+	CCVector3 haloMin = tileMin - CCVector3(halo, halo, halo);
+	CCVector3 haloMax = tileMax + CCVector3(halo, halo, halo);
+	for (unsigned t = 0; t < tiles.size(); ++t)
+	{
+		if (t == tileIndex || !m_tiling.tileIntersects(t, haloMin, haloMax))
+			continue;
+
+		const TilingGrid::Tile& other = tiles[t];
+		for (unsigned i = 0; i < other.count; ++i)
+		{
+			const CCVector3& P = sortedPoints[static_cast<size_t>(other.first) + i];
+			if (	P.x >= haloMin.x && P.x <= haloMax.x
+				&&	P.y >= haloMin.y && P.y <= haloMax.y
+				&&	P.z >= haloMin.z && P.z <= haloMax.z )
+			{
+				if (m_tilePoints.size() == m_tilePoints.capacity() && !m_tilePoints.reserve(m_tilePoints.size() + std::max<unsigned>(m_tilePoints.size() / 2, 1024)))
+				{
+					//not enough memory
+					m_tilePoints.clear();
+					return 0;
+				}
+				m_tilePoints.addPoint(P);
+			}
+		}
+	}
+
+	return &m_tilePoints;
+}
+
+bool SequentialTileStream::writeTileSelection(unsigned tileIndex, ReferenceCloud& selection)
+{
+	const std::vector<TilingGrid::Tile>& tiles = m_tiling.tiles();
+	if (tileIndex != m_currentTile || tileIndex >= tiles.size())
+	{
+		//the selection must be associated to the last loaded tile
+		assert(false);
+		return false;
+	}
+
+	const TilingGrid::Tile& tile = tiles[tileIndex];
+	const CCVector3* sortedPoints = static_cast<const CCVector3*>(m_sortedPoints.data);
+	const unsigned char* sortedRecords = static_cast<const unsigned char*>(m_sortedRecords.data);
+
+	unsigned count = selection.size();
+	for (unsigned i = 0; i < count; ++i)
+	{
+		unsigned localIndex = selection.getPointGlobalIndex(i);
+		if (localIndex >= tile.count)
+		{
+			//only the core points can be written
+			assert(false);
+			return false;
+		}
+
+		size_t index = static_cast<size_t>(tile.first) + localIndex;
+		if (!m_writer->writePoint(sortedPoints[index], m_recordSize != 0 ? sortedRecords + index * m_recordSize : 0))
+		{
+			//writing error
+			return false;
+		}
+		++m_writtenCount;
+	}
+
+	return true;
+}
@@ -68,6 +68,12 @@ void SimpleCloud::addPoint(const PointCoordinateType P[])
 	m_validBB=false;
 }
 
+void SimpleCloud::setPoint(unsigned index, const CCVector3& P)
+{
+	assert(index < m_points->currentSize());
+	m_points->setValue(index, P.u);
+}
+
 void SimpleCloud::forEach(genericPointAction& action)
 {
 	unsigned n = m_points->currentSize();
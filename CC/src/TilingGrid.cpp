@@ -0,0 +1,199 @@
+//##########################################################################
+//#                                                                        #
+//#                               CCLIB                                    #
+//#                                                                        #
+//#  This program is free software; you can redistribute it and/or modify  #
+//#  it under the terms of the GNU Library General Public License as       #
+//#  published by the Free Software Foundation; version 2 or later of the  #
+//#  License.                                                              #
+//#                                                                        #
+//#  This program is distributed in the hope that it will be useful,       #
+//#  but WITHOUT ANY WARRANTY; without even the implied warranty of        #
+//#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the          #
+//#  GNU General Public License for more details.                          #
+//#                                                                        #
+//#          COPYRIGHT: EDF R&D / TELECOM ParisTech (ENST-TSI)             #
+//#                                                                        #
+//##########################################################################
+
+#include "TilingGrid.h"
+
+//system
+#include <assert.h>
+#include <new>
+
+using namespace CCLib;
+
+TilingGrid::TilingGrid()
+	: m_gridMin(0, 0, 0)
+	, m_cellSize(1.0)
+	, m_gridSize(1, 1, 1)
+{
+}
+
+void TilingGrid::clear()
+{
+	m_cells.clear();
+	m_tiles.clear();
+	m_gridSize.x = m_gridSize.y = m_gridSize.z = 1;
+}
+
+bool TilingGrid::init(const CCVector3& bbMin, const CCVector3& bbMax)
+{
+	clear();
+
+	CCVector3 diag = bbMax - bbMin;
+	PointCoordinateType maxDim = std::max(diag.x, std::max(diag.y, diag.z));
+	m_cellSize = (maxDim > 0 ? static_cast<double>(maxDim) / RESOLUTION : 1.0);
+	m_gridMin = CCVector3d(bbMin.x, bbMin.y, bbMin.z);
+	for (unsigned char d = 0; d < 3; ++d)
+	{
+		int cellCount = static_cast<int>(ceil(diag.u[d] / m_cellSize));
+		m_gridSize.u[d] = std::min(std::max(cellCount, 1), static_cast<int>(RESOLUTION));
+	}
+
+	try
+	{
+		m_cells.resize(static_cast<size_t>(m_gridSize.x) * m_gridSize.y * m_gridSize.z, 0);
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		return false;
+	}
+
+	return true;
+}
+
+void TilingGrid::splitCells(const Tuple3i& minPos, const Tuple3i& maxPos, unsigned maxTilePointCount)
+{
+	//we split the box along its largest dimension (in cells)
+	Tuple3i extent(maxPos.x - minPos.x, maxPos.y - minPos.y, maxPos.z - minPos.z);
+	unsigned char dim = 0;
+	if (extent.y > extent.u[dim])
+		dim = 1;
+	if (extent.z > extent.u[dim])
+		dim = 2;
+
+	//marginal histogram along this dimension
+	std::vector<unsigned> slices(extent.u[dim], 0);
+	unsigned count = 0;
+	{
+		Tuple3i cellPos;
+		for (cellPos.z = minPos.z; cellPos.z < maxPos.z; ++cellPos.z)
+		{
+			for (cellPos.y = minPos.y; cellPos.y < maxPos.y; ++cellPos.y)
+			{
+				cellPos.x = minPos.x;
+				size_t cellIndex = getCellIndex(cellPos);
+				for (; cellPos.x < maxPos.x; ++cellPos.x, ++cellIndex)
+				{
+					unsigned n = m_cells[cellIndex];
+					slices[cellPos.u[dim] - minPos.u[dim]] += n;
+					count += n;
+				}
+			}
+		}
+	}
+
+	if (count == 0)
+	{
+		//empty boxes are skipped
+		return;
+	}
+
+	if (count <= maxTilePointCount || extent.u[dim] < 2)
+	{
+		m_tiles.push_back(Tile(minPos, maxPos, count));
+		return;
+	}
+
+	//we split the box at the (approximate) median
+	int splitPos = minPos.u[dim] + 1;
+	{
+		unsigned cumulated = 0;
+		for (int k = 0; k < extent.u[dim]; ++k)
+		{
+			cumulated += slices[k];
+			if (2 * static_cast<size_t>(cumulated) >= count)
+			{
+				splitPos = minPos.u[dim] + k + 1;
+				break;
+			}
+		}
+		splitPos = std::min(splitPos, maxPos.u[dim] - 1);
+	}
+
+	Tuple3i splitMax = maxPos;
+	splitMax.u[dim] = splitPos;
+	Tuple3i splitMin = minPos;
+	splitMin.u[dim] = splitPos;
+
+	splitCells(minPos, splitMax, maxTilePointCount);
+	splitCells(splitMin, maxPos, maxTilePointCount);
+}
+
+bool TilingGrid::computeTiles(unsigned maxTilePointCount)
+{
+	m_tiles.clear();
+	if (m_cells.empty())
+	{
+		//not initialized
+		assert(false);
+		return false;
+	}
+
+	try
+	{
+		splitCells(Tuple3i(0, 0, 0), m_gridSize, std::max<unsigned>(maxTilePointCount, 1));
+	}
+	catch (const std::bad_alloc&)
+	{
+		//not enough memory
+		m_tiles.clear();
+		return false;
+	}
+
+	//the cells now store the index of their tile
+	unsigned firstPoint = 0;
+	for (size_t t = 0; t < m_tiles.size(); ++t)
+	{
+		Tile& tile = m_tiles[t];
+		tile.first = firstPoint;
+		firstPoint += tile.count;
+
+		Tuple3i cellPos;
+		for (cellPos.z = tile.minPos.z; cellPos.z < tile.maxPos.z; ++cellPos.z)
+		{
+			for (cellPos.y = tile.minPos.y; cellPos.y < tile.maxPos.y; ++cellPos.y)
+			{
+				cellPos.x = tile.minPos.x;
+				size_t cellIndex = getCellIndex(cellPos);
+				for (; cellPos.x < tile.maxPos.x; ++cellPos.x, ++cellIndex)
+				{
+					m_cells[cellIndex] = static_cast<unsigned>(t);
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool TilingGrid::tileIntersects(unsigned tileIndex, const CCVector3& boxMin, const CCVector3& boxMax) const
+{
+	assert(tileIndex < m_tiles.size());
+	const Tile& tile = m_tiles[tileIndex];
+
+	for (unsigned char d = 0; d < 3; ++d)
+	{
+		double cellsMin = m_gridMin.u[d] + tile.minPos.u[d] * m_cellSize;
+		double cellsMax = m_gridMin.u[d] + tile.maxPos.u[d] * m_cellSize;
+		if (cellsMin - m_cellSize > boxMax.u[d] || cellsMax + m_cellSize < boxMin.u[d])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -22,15 +22,26 @@
 #include "GenericProgressCallback.h"
 #include "GenericIndexedCloudPersist.h"
 #include "Neighbourhood.h"
-#include "SortAlgo.h"
 
 //system
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <string.h>
 
 //Qt
 #ifdef USE_QT
 #include <QCoreApplication>
+#ifndef _DEBUG
+//enables multi-threading handling
+#define ENABLE_MT_TRUEKDTREE
+#endif
+#endif
+
+#ifdef ENABLE_MT_TRUEKDTREE
+#include <QtCore>
+#include <QtConcurrentMap>
+#include <QThreadPool>
 #endif
 
 using namespace CCLib;
@@ -58,12 +69,19 @@ void TrueKdTree::clear()
 	m_root = 0;
 }
 
-//shared structure used to sort the points along a single dimension (see TrueKdTree::split)
-static std::vector<PointCoordinateType> s_sortedCoordsForSplit;
+//progress notification (only the main thread notifies the callback)
+//DGM: this state is shared by all the trees (see TrueKdTree::build)
 static GenericProgressCallback* s_progressCb = 0;
-static unsigned s_lastProgressCount = 0;
+static std::atomic<unsigned> s_lastProgressCount(0);
 static unsigned s_totalProgressCount = 0;
 static unsigned s_lastProgress = 0;
+static std::atomic<bool> s_canceled(false);
+
+//! Minimum number of points in a cell to split its sub-cells in parallel
+static const unsigned MIN_POINTS_FOR_PARALLEL_SPLIT = 65536;
+
+//! Interval between two progress notifications while the main thread waits for the worker threads (in ms)
+static const unsigned long PROGRESS_POLLING_INTERVAL_MS = 50;
 
 static void InitProgress(GenericProgressCallback* progressCb, unsigned totalCount)
 {
@@ -71,6 +89,7 @@ static void InitProgress(GenericProgressCallback* progressCb, unsigned totalCoun
 	s_totalProgressCount = totalCount;
 	s_lastProgressCount = 0;
 	s_lastProgress = 0;
+	s_canceled = false;
 
 	if (s_progressCb)
 	{
@@ -88,13 +107,18 @@ static void InitProgress(GenericProgressCallback* progressCb, unsigned totalCoun
 	}
 }
 
-static inline void UpdateProgress(unsigned increment)
+static inline void UpdateProgress(unsigned increment, bool mainThread)
 {
 	if (s_progressCb)
 	{
 		assert(s_totalProgressCount != 0);
-		s_lastProgressCount += increment;
-		float fPercent = static_cast<float>(s_lastProgressCount) / static_cast<float>(s_totalProgressCount) * 100.0f;
+		unsigned progressCount = (s_lastProgressCount += increment);
+		if (!mainThread)
+		{
+			//only the main thread can notify the callback
+			return;
+		}
+		float fPercent = static_cast<float>(progressCount) / static_cast<float>(s_totalProgressCount) * 100.0f;
 		unsigned uiPercent = static_cast<unsigned>(fPercent);
 		if (uiPercent > s_lastProgress)
 		{
@@ -103,52 +127,245 @@ static inline void UpdateProgress(unsigned increment)
 #ifdef USE_QT
 			QCoreApplication::processEvents();
 #endif
+			if (s_progressCb->isCancelRequested())
+			{
+				//the worker threads will stop as soon as possible
+				s_canceled = true;
+			}
 		}
 	}
 }
 
-TrueKdTree::BaseNode* TrueKdTree::split(ReferenceCloud* subset)
+#ifdef ENABLE_MT_TRUEKDTREE
+//! Notifies the progress made by the worker threads (main thread only)
+/** Events are processed even if the progress hasn't changed, so that the
+	GUI remains responsive (and the process can be canceled).
+**/
+static void PollProgress()
 {
-	assert(subset); //subset will always be taken care of by this method
-	
-	unsigned count = subset->size();
+	if (s_progressCb)
+	{
+		UpdateProgress(0, true);
+		QCoreApplication::processEvents();
+		if (s_progressCb->isCancelRequested())
+		{
+			s_canceled = true;
+		}
+	}
+}
+#endif
+
+struct TrueKdTree::CellStats
+{
+	//! Sums origin (the first point of the cell)
+	/** The sums are expressed relatively to a point of the cell to avoid cancellation
+		errors when the covariance matrix is deduced from them (shifted data algorithm).
+	**/
+	CCVector3d origin;
+	//! Sum of the points coordinates (relatively to the origin)
+	double sum[3];
+	//! Sum of the squared coordinates (XX, YY, ZZ, XY, XZ and YZ - relatively to the origin)
+	double sum2[6];
+	//! Bounding-box
+	CCVector3 bbMin, bbMax;
+
+	CellStats()
+		: origin(0, 0, 0)
+		, bbMin(0, 0, 0)
+		, bbMax(0, 0, 0)
+	{
+		memset(sum, 0, sizeof(double) * 3);
+		memset(sum2, 0, sizeof(double) * 6);
+	}
+
+	//! Adds a point
+	inline void add(const CCVector3& P, bool first)
+	{
+		if (first)
+		{
+			origin = CCVector3d(P.x, P.y, P.z);
+		}
+
+		double x = P.x - origin.x;
+		double y = P.y - origin.y;
+		double z = P.z - origin.z;
+		sum[0] += x;
+		sum[1] += y;
+		sum[2] += z;
+		sum2[0] += x*x;
+		sum2[1] += y*y;
+		sum2[2] += z*z;
+		sum2[3] += x*y;
+		sum2[4] += x*z;
+		sum2[5] += y*z;
+
+		if (first)
+		{
+			bbMin = bbMax = P;
+		}
+		else
+		{
+			if (P.x < bbMin.x) bbMin.x = P.x; else if (P.x > bbMax.x) bbMax.x = P.x;
+			if (P.y < bbMin.y) bbMin.y = P.y; else if (P.y > bbMax.y) bbMax.y = P.y;
+			if (P.z < bbMin.z) bbMin.z = P.z; else if (P.z > bbMax.z) bbMax.z = P.z;
+		}
+	}
+};
+
+struct TrueKdTree::SplitTask
+{
+	//! Tree
+	TrueKdTree* tree;
+	//! Index of the first point (in TrueKdTree::m_indexes)
+	unsigned first;
+	//! Number of points
+	unsigned count;
+	//! Cell statistics
+	CellStats stats;
+	//! Resulting (sub-)tree
+	BaseNode* result;
+};
+
+void TrueKdTree::Split_MT(SplitTask& task)
+{
+	task.result = task.tree->split(task.first, task.count, task.stats, false);
+}
+
+ReferenceCloud* TrueKdTree::createSubset(unsigned first, unsigned count) const
+{
+	ReferenceCloud* subset = new ReferenceCloud(m_associatedCloud);
+	if (!subset->reserve(count))
+	{
+		//not enough memory
+		delete subset;
+		return 0;
+	}
+
+	for (unsigned i=0; i<count; ++i)
+	{
+		subset->addPointIndex(m_indexes[first + i]);
+	}
+
+	return subset;
+}
+
+bool TrueKdTree::fitPlane(unsigned first, unsigned count, const CellStats& stats, PointCoordinateType planeEquation[4], double& rms) const
+{
+	rms = 0;
+
+	//we need at least 3 points to compute a plane
+	if (count < 3)
+	{
+		return false;
+	}
+	else if (count == 3)
+	{
+		//3 points: the LS plane is simply defined by the points
+		ReferenceCloud triangle(m_associatedCloud);
+		if (!triangle.reserve(3))
+			return false;
+		triangle.addPointIndex(m_indexes[first]);
+		triangle.addPointIndex(m_indexes[first + 1]);
+		triangle.addPointIndex(m_indexes[first + 2]);
+		const PointCoordinateType* eq = Neighbourhood(&triangle).getLSPlane();
+		if (!eq)
+			return false;
+		memcpy(planeEquation, eq, sizeof(PointCoordinateType) * 4);
+		return true;
+	}
+
+	//covariance matrix (deduced from the cell statistics)
+	double mean[3] = { stats.sum[0] / count, stats.sum[1] / count, stats.sum[2] / count };
+	SquareMatrixd covMat(3);
+	covMat.m_values[0][0] = stats.sum2[0] / count - mean[0] * mean[0];
+	covMat.m_values[1][1] = stats.sum2[1] / count - mean[1] * mean[1];
+	covMat.m_values[2][2] = stats.sum2[2] / count - mean[2] * mean[2];
+	covMat.m_values[1][0] = covMat.m_values[0][1] = stats.sum2[3] / count - mean[0] * mean[1];
+	covMat.m_values[2][0] = covMat.m_values[0][2] = stats.sum2[4] / count - mean[0] * mean[2];
+	covMat.m_values[2][1] = covMat.m_values[1][2] = stats.sum2[5] / count - mean[1] * mean[2];
+
+	CCVector3 G(static_cast<PointCoordinateType>(stats.origin.x + mean[0]),
+				static_cast<PointCoordinateType>(stats.origin.y + mean[1]),
+				static_cast<PointCoordinateType>(stats.origin.z + mean[2]));
+
+	CCVector3 planeVectors[3];
+	if (!Neighbourhood::ComputeLSPlane(covMat, G, planeEquation, planeVectors))
+		return false;
+
+	//the RMS distance to the LS plane is simply sqrt(N'.Cov.N)
+	const CCVector3& N = planeVectors[2];
+	double var = 0;
+	for (unsigned i=0; i<3; ++i)
+		for (unsigned j=0; j<3; ++j)
+			var += N.u[i] * covMat.m_values[i][j] * N.u[j];
+	rms = (var > 0 ? sqrt(var) : 0);
+
+	return true;
+}
+
+TrueKdTree::BaseNode* TrueKdTree::split(unsigned first, unsigned count, const CellStats& stats, bool mainThread)
+{
+	if (s_canceled)
+	{
+		//process canceled by the user
+		return 0;
+	}
 
-	const PointCoordinateType* planeEquation = Neighbourhood(subset).getLSPlane();
-	if (!planeEquation)
+	PointCoordinateType planeEquation[4];
+	double rms = 0;
+	if (!fitPlane(first, count, stats, planeEquation, rms))
 	{
 		//an error occurred during LS plane computation?! (maybe the (3) points are aligned) 
 		//we return an invalid Leaf (so as the above level understands that it's not a memory issue)
-		delete subset;
 		PointCoordinateType fakePlaneEquation[4] = {0,0,0,0};
 		return new Leaf(0, fakePlaneEquation, static_cast<ScalarType>(-1));
 	}
 
 	//we always split sets larger than a given size
 	ScalarType error = -1;
+	ReferenceCloud* subset = 0;
 	if (count < m_maxPointCountPerCell || count < 2 * m_minPointCountPerCell)
 	{
 		assert(fabs(CCVector3(planeEquation).norm2() - 1.0) < 1.0e-6);
-		error = (count > 3 ? DistanceComputationTools::ComputeCloud2PlaneDistance(subset, planeEquation, m_errorMeasure) : 0);
+		if (count <= 3)
+		{
+			error = 0;
+		}
+		else if (m_errorMeasure == DistanceComputationTools::RMS)
+		{
+			//the RMS is directly deduced from the cell statistics
+			error = static_cast<ScalarType>(rms);
+		}
+		else
+		{
+			subset = createSubset(first, count);
+			if (!subset)
+				return 0;
+			error = DistanceComputationTools::ComputeCloud2PlaneDistance(subset, planeEquation, m_errorMeasure);
+		}
 	
 		//we can't split cells with less than twice the minimum number of points per cell! (and min >= 3 so as to fit a plane)
 		bool isLeaf = (error <= m_maxError || count < 2 * m_minPointCountPerCell);
 		if (isLeaf)
 		{
-			UpdateProgress(count);
+			if (!subset && (subset = createSubset(first, count)) == 0)
+				return 0;
+			UpdateProgress(count, mainThread);
 			//the Leaf class takes ownership of the subset!
-			return new Leaf(subset,planeEquation,error);
+			return new Leaf(subset, planeEquation, error);
+		}
+
+		if (subset)
+		{
+			delete subset;
+			subset = 0;
 		}
 	}
 
 	/*** proceed with a 'standard' binary partition ***/
 
 	//cell limits (dimensions)
-	CCVector3 dims;
-	{
-		CCVector3 bbMin,bbMax;
-		subset->getBoundingBox(bbMin,bbMax);
-		dims = bbMax - bbMin;
-	}
+	CCVector3 dims = stats.bbMax - stats.bbMin;
 
 	//find the largest dimension
 	uint8_t splitDim = X_DIM;
@@ -157,89 +374,147 @@ TrueKdTree::BaseNode* TrueKdTree::split(ReferenceCloud* subset)
 	if (dims.z > dims.u[splitDim])
 		splitDim = Z_DIM;
 
-	//find the median by sorting the points coordinates
-	assert(s_sortedCoordsForSplit.size() >= static_cast<size_t>(count));
+	//find the median coordinate (no need to sort all the coordinates)
+	PointCoordinateType* coords = &(m_coordsBuffer[first]);
 	for (unsigned i=0; i<count; ++i)
 	{
-		const CCVector3* P = subset->getPoint(i);
-		s_sortedCoordsForSplit[i] = P->u[splitDim];
+		coords[i] = m_associatedCloud->getPoint(m_indexes[first + i])->u[splitDim];
 	}
-	SortAlgo(s_sortedCoordsForSplit.begin(), s_sortedCoordsForSplit.begin() + count);
-
 	unsigned splitCount = count/2;
 	assert(splitCount >= 3); //count >= 6 (see above)
-	
+	std::nth_element(coords, coords + splitCount, coords + count);
+	PointCoordinateType medianCoord = coords[splitCount];
+
+	//number of coordinates below / below or equal to the median (and the next coordinate above it)
+	unsigned belowCount = 0;
+	unsigned belowOrEqualCount = 0;
+	PointCoordinateType nextCoord = medianCoord;
+	for (unsigned i=0; i<count; ++i)
+	{
+		PointCoordinateType c = coords[i];
+		if (c < medianCoord)
+		{
+			++belowCount;
+			++belowOrEqualCount;
+		}
+		else if (c == medianCoord)
+		{
+			++belowOrEqualCount;
+		}
+		else if (nextCoord == medianCoord || c < nextCoord)
+		{
+			nextCoord = c;
+		}
+	}
+
 	//we must check that the split value is the 'first one'
-	if (s_sortedCoordsForSplit[splitCount-1] == s_sortedCoordsForSplit[splitCount])
+	PointCoordinateType splitCoord = medianCoord;
+	if (belowCount != splitCount)
 	{
-		if (s_sortedCoordsForSplit[2] != s_sortedCoordsForSplit[splitCount]) //can we go backward?
+		assert(belowCount < splitCount);
+		if (belowCount >= 3) //can we go backward?
 		{
-			while (/*splitCount>0 &&*/ s_sortedCoordsForSplit[splitCount-1] == s_sortedCoordsForSplit[splitCount])
-			{
-				assert(splitCount > 3);
-				--splitCount;
-			}
+			splitCount = belowCount;
 		}
-		else if (s_sortedCoordsForSplit[count-3] != s_sortedCoordsForSplit[splitCount]) //can we go forward?
+		else if (belowOrEqualCount + 3 <= count) //can we go forward?
 		{
-			do
-			{
-				++splitCount;
-				assert(splitCount < count-3);
-			}
-			while (/*splitCount+1<count &&*/ s_sortedCoordsForSplit[splitCount] == s_sortedCoordsForSplit[splitCount-1]);
+			splitCount = belowOrEqualCount;
+			splitCoord = nextCoord;
 		}
 		else //in fact we can't split this cell!
 		{
-			UpdateProgress(count);
 			if (error < 0)
-				error = (count != 3 ? DistanceComputationTools::ComputeCloud2PlaneDistance(subset, planeEquation, m_errorMeasure) : 0);
+			{
+				if (m_errorMeasure == DistanceComputationTools::RMS)
+				{
+					error = static_cast<ScalarType>(rms);
+				}
+				else
+				{
+					subset = createSubset(first, count);
+					if (!subset)
+						return 0;
+					error = DistanceComputationTools::ComputeCloud2PlaneDistance(subset, planeEquation, m_errorMeasure);
+				}
+			}
+			if (!subset && (subset = createSubset(first, count)) == 0)
+				return 0;
+			UpdateProgress(count, mainThread);
 			//the Leaf class takes ownership of the subset!
 			return new Leaf(subset, planeEquation, error);
 		}
 	}
 
-	PointCoordinateType splitCoord = s_sortedCoordsForSplit[splitCount]; //count > 3 --> splitCount >= 2
-
-	ReferenceCloud* leftSubset = new ReferenceCloud(subset->getAssociatedCloud());
-	ReferenceCloud* rightSubset = new ReferenceCloud(subset->getAssociatedCloud());
-	if (!leftSubset->reserve(splitCount) || !rightSubset->reserve(count-splitCount))
+	//partition the points (the order is preserved) and compute the sub-cells statistics at the same time
+	SplitTask subTasks[2];
+	subTasks[0].tree = subTasks[1].tree = this;
+	subTasks[0].first = first;
+	subTasks[0].count = splitCount;
+	subTasks[1].first = first + splitCount;
+	subTasks[1].count = count - splitCount;
+	subTasks[0].result = subTasks[1].result = 0;
 	{
-		//not enough memory!
-		delete leftSubset;
-		delete rightSubset;
-		delete subset;
-		return 0;
+		unsigned* indexes = &(m_indexes[first]);
+		unsigned* rightIndexes = &(m_indexesBuffer[first]);
+		unsigned leftCount = 0;
+		unsigned rightCount = 0;
+		for (unsigned i=0; i<count; ++i)
+		{
+			unsigned index = indexes[i];
+			const CCVector3* P = m_associatedCloud->getPoint(index);
+			if (P->u[splitDim] < splitCoord)
+			{
+				subTasks[0].stats.add(*P, leftCount == 0);
+				indexes[leftCount++] = index;
+			}
+			else
+			{
+				subTasks[1].stats.add(*P, rightCount == 0);
+				rightIndexes[rightCount++] = index;
+			}
+		}
+		assert(leftCount == splitCount);
+		memcpy(indexes + leftCount, rightIndexes, sizeof(unsigned) * rightCount);
 	}
 
-	//fill subsets
-	for (unsigned i=0; i<count; ++i)
+	//process sub-cells
+#ifdef ENABLE_MT_TRUEKDTREE
+	if (subTasks[1].count >= MIN_POINTS_FOR_PARALLEL_SPLIT && subTasks[0].count >= MIN_POINTS_FOR_PARALLEL_SPLIT)
 	{
-		const CCVector3* P = subset->getPoint(i);
-		if (P->u[splitDim] < splitCoord)
+		//each sub-cell only touches its own part of the buffers: they can be split in parallel
+		if (mainThread)
 		{
-			leftSubset->addPointIndex(subset->getPointGlobalIndex(i));
+			//the main thread notifies the progress made by the worker threads while they split the sub-cells
+			QFuture<void> future = QtConcurrent::map(subTasks, subTasks + 2, Split_MT);
+			while (!future.isFinished())
+			{
+				PollProgress();
+				QThread::msleep(PROGRESS_POLLING_INTERVAL_MS);
+			}
+			PollProgress();
 		}
 		else
 		{
-			rightSubset->addPointIndex(subset->getPointGlobalIndex(i));
+			QtConcurrent::blockingMap(subTasks, subTasks + 2, Split_MT);
 		}
 	}
-
-	//process subsets (if any)
-	BaseNode* leftChild = split(leftSubset);
-	if (!leftChild)
+	else
+#endif
 	{
-		delete subset;
-		delete rightSubset;
-		return 0;
+		subTasks[0].result = split(subTasks[0].first, subTasks[0].count, subTasks[0].stats, mainThread);
+		if (subTasks[0].result)
+			subTasks[1].result = split(subTasks[1].first, subTasks[1].count, subTasks[1].stats, mainThread);
 	}
 
-	BaseNode* rightChild = split(rightSubset);
-	if (!rightChild)
+	BaseNode* leftChild = subTasks[0].result;
+	BaseNode* rightChild = subTasks[1].result;
+	if (!leftChild || !rightChild)
 	{
-		delete subset;
-		delete leftChild;
+		//not enough memory!
+		if (leftChild)
+			delete leftChild;
+		if (rightChild)
+			delete rightChild;
 		return 0;
 	}
 
@@ -251,15 +526,14 @@ TrueKdTree::BaseNode* TrueKdTree::split(ReferenceCloud* subset)
 		delete rightChild;
 
 		//this node will become a leaf!
-		UpdateProgress(count);
+		subset = createSubset(first, count);
+		if (!subset)
+			return 0;
+		UpdateProgress(count, mainThread);
 		//the Leaf class takes ownership of the subset!
 		return new Leaf(subset, planeEquation, error);
 	}
 
-	//we can now delete the subset
-	delete subset;
-	subset = 0;
-
 	Node* node = new Node;
 	{
 		node->leftChild = leftChild;
@@ -291,37 +565,58 @@ bool TrueKdTree::build(	double maxError,
 		return false;
 	}
 
-	//structures used to sort the points along the 3 dimensions
+	//structures used to partition the points
 	try
 	{
-		s_sortedCoordsForSplit.resize(count);
+		m_indexes.resize(count);
+		m_indexesBuffer.resize(count);
+		m_coordsBuffer.resize(count);
 	}
 	catch (const std::bad_alloc&)
 	{
 		//not enough memory!
+		m_indexes.clear();
+		m_indexesBuffer.clear();
+		m_coordsBuffer.clear();
 		return false;
 	}
 
-	//initial 'subset' to start recursion
-	ReferenceCloud* subset = new ReferenceCloud(m_associatedCloud);
-	if (!subset->addPointIndex(0,count))
+	//initial cell statistics
+	CellStats stats;
 	{
-		//not enough memory
-		delete subset;
-		return false;
+		for (unsigned i=0; i<count; )
+		{
+			unsigned blockSize = GenericIndexedCloud::DEFAULT_POINTS_BLOCK_SIZE;
+			const CCVector3* P = m_associatedCloud->getPointsBlock(i, blockSize);
+			for (unsigned j=0; j<blockSize; ++j, ++P)
+			{
+				m_indexes[i + j] = i + j;
+				stats.add(*P, i + j == 0);
+			}
+			i += blockSize;
+		}
 	}
 
 	InitProgress(progressCb,count);
 
+#ifdef ENABLE_MT_TRUEKDTREE
+	if (count >= 2 * MIN_POINTS_FOR_PARALLEL_SPLIT)
+	{
+		QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+	}
+#endif
+
 	//launch recursive process
 	m_maxError = maxError;
 	m_minPointCountPerCell = std::max<unsigned>(3,minPointCountPerCell);
 	m_maxPointCountPerCell = std::max<unsigned>(2*minPointCountPerCell,maxPointCountPerCell); //the max number of point per cell can't be < 2*min
 	m_errorMeasure = errorMeasure;
-	m_root = split(subset);
+	m_root = split(0, count, stats, true);
 
-	//clear static structure
-	s_sortedCoordsForSplit.clear();
+	//clear temporary structures
+	m_indexes.clear();
+	m_indexesBuffer.clear();
+	m_coordsBuffer.clear();
 
 	return (m_root != 0);
 }
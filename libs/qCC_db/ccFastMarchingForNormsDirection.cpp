@@ -104,7 +104,12 @@ int ccFastMarchingForNormsDirection::init(	ccGenericPointCloud* cloud,
 			aCell->C = *CCLib::Neighbourhood(&Yk).getGravityCenter();
 		}
 
-		m_theGrid[gridPos] = aCell;
+		if (!m_theGrid.setCell(gridPos, aCell))
+		{
+			//not enough memory
+			delete aCell;
+			return -1;
+		}
 
 		cellCodes.pop_back();
 	}
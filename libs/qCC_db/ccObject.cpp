@@ -58,8 +58,9 @@
 	v4.5 - 10/06/2016 - Transformation history is now saved
 	v4.6 - 11/03/2016 - Null normal vector code added
 	v4.7 - 12/22/2016 - Return index added to ccWaveform
+	v4.8 - 10/16/2026 - Octree structure (optionally) saved along with point clouds
 **/
-const unsigned c_currentDBVersion = 47; //4.7
+const unsigned c_currentDBVersion = 48; //4.8
 
 //! Default unique ID generator (using the system persistent settings as we did previously proved to be not reliable)
 static ccUniqueIDGenerator::Shared s_uniqueIDGenerator(new ccUniqueIDGenerator);
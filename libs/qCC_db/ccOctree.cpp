@@ -31,6 +31,12 @@
 #include <ScalarFieldTools.h>
 #include <RayAndBox.h>
 
+//Qt
+#include <QFile>
+
+//system
+#include <cstring>
+
 #ifdef QT_DEBUG
 //#define DEBUG_PICKING_MECHANISM
 #endif
@@ -94,9 +100,338 @@ void ccOctree::clear()
 	m_glListID = 0;
 	m_glListIsDeprecated = true;
 
+	if (m_frustumIntersector)
+	{
+		delete m_frustumIntersector;
+		m_frustumIntersector = 0;
+	}
+
 	DgmOctree::clear();
 }
 
+bool ccOctree::insertPoints(unsigned firstIndex)
+{
+	//warn the others that the octree organization is going to change
+	emit updated();
+
+	m_glListIsDeprecated = true;
+
+	//the frustum intersector relies on the former cells
+	if (m_frustumIntersector)
+	{
+		delete m_frustumIntersector;
+		m_frustumIntersector = 0;
+	}
+
+	return DgmOctree::insertPoints(firstIndex);
+}
+
+bool ccOctree::removePoints(const cellIndexesContainer& removedIndexes)
+{
+	//warn the others that the octree organization is going to change
+	emit updated();
+
+	m_glListIsDeprecated = true;
+
+	//the frustum intersector relies on the former cells
+	if (m_frustumIntersector)
+	{
+		delete m_frustumIntersector;
+		m_frustumIntersector = 0;
+	}
+
+	return DgmOctree::removePoints(removedIndexes);
+}
+
+//! Computes a (64 bits) checksum of the cloud points coordinates
+/** FNV-1a hash over the raw coordinates.
+**/
+static uint64_t ComputePointsChecksum(CCLib::GenericIndexedCloudPersist* cloud)
+{
+	uint64_t checksum = 14695981039346656037ULL;
+	const uint64_t prime = 1099511628211ULL;
+
+	unsigned pointCount = cloud->size();
+	for (unsigned i = 0; i < pointCount; ++i)
+	{
+		const CCVector3* P = cloud->getPoint(i);
+		for (unsigned j = 0; j < 3; ++j)
+		{
+			uint64_t bits = 0;
+			memcpy(&bits, P->u + j, sizeof(PointCoordinateType));
+			checksum ^= bits;
+			checksum *= prime;
+		}
+	}
+	checksum ^= static_cast<uint64_t>(pointCount);
+	checksum *= prime;
+
+	return checksum;
+}
+
+//! Size of a (index, cell code) record in octree files
+static const size_t c_octreeRecordSize = 4 + sizeof(CCLib::DgmOctree::CellCode);
+//! Number of records written/read at once
+static const size_t c_octreeRecordsPerChunk = 65536;
+
+bool ccOctree::toFile(QFile& out) const
+{
+	assert(m_theAssociatedCloud);
+
+	const uint32_t levelCount = MAX_OCTREE_LEVEL + 1;
+	const uint32_t recordCount = static_cast<uint32_t>(m_thePointsAndTheirCellCodes.size());
+	assert(recordCount == m_numberOfProjectedPoints);
+
+	//size of the data that follows (so as to be able to skip it at loading time)
+	uint64_t dataSize =	  1 //max level
+						+ 1 //cell code size
+						+ 4 //cloud size
+						+ 8 //checksum
+						+ 4 //number of projected points
+						+ 4 * 3 * 8 //bounding-boxes
+						+ 1 //user-defined limits
+						+ 6 * levelCount * 4 //fill indexes
+						+ levelCount * (4 + 4 + 8 + 8) //cells statistics
+						+ static_cast<uint64_t>(recordCount) * c_octreeRecordSize;
+	if (out.write((const char*)&dataSize, 8) < 0)
+		return false;
+
+	//header
+	{
+		uint8_t maxLevel = static_cast<uint8_t>(MAX_OCTREE_LEVEL);
+		uint8_t codeSize = static_cast<uint8_t>(sizeof(CellCode));
+		uint32_t cloudSize = m_theAssociatedCloud->size();
+		uint64_t checksum = ComputePointsChecksum(m_theAssociatedCloud);
+		if (	out.write((const char*)&maxLevel, 1) < 0
+			||	out.write((const char*)&codeSize, 1) < 0
+			||	out.write((const char*)&cloudSize, 4) < 0
+			||	out.write((const char*)&checksum, 8) < 0
+			||	out.write((const char*)&recordCount, 4) < 0)
+		{
+			return false;
+		}
+	}
+
+	//bounding-boxes (always saved as doubles)
+	{
+		const CCVector3* boxes[4] = { &m_dimMin, &m_dimMax, &m_pointsMin, &m_pointsMax };
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			CCVector3d d = CCVector3d::fromArray(boxes[i]->u);
+			if (out.write((const char*)d.u, 3 * 8) < 0)
+				return false;
+		}
+	}
+
+	//whether the octree box and the points filter (= points bounding-box) were specified by the user
+	{
+		uint8_t userDefinedLimits = (m_userDefinedLimits ? 1 : 0);
+		if (out.write((const char*)&userDefinedLimits, 1) < 0)
+			return false;
+	}
+
+	//fill indexes
+	for (uint32_t i = 0; i < 6 * levelCount; ++i)
+	{
+		int32_t index = static_cast<int32_t>(m_fillIndexes[i]);
+		if (out.write((const char*)&index, 4) < 0)
+			return false;
+	}
+
+	//cells statistics
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		uint32_t cellCount = static_cast<uint32_t>(m_cellCount[i]);
+		uint32_t maxPop = static_cast<uint32_t>(m_maxCellPopulation[i]);
+		if (	out.write((const char*)&cellCount, 4) < 0
+			||	out.write((const char*)&maxPop, 4) < 0
+			||	out.write((const char*)(m_averageCellPopulation + i), 8) < 0
+			||	out.write((const char*)(m_stdDevCellPopulation + i), 8) < 0)
+		{
+			return false;
+		}
+	}
+
+	//(index, code) records (written by chunks)
+	if (recordCount != 0)
+	{
+		std::vector<char> buffer;
+		try
+		{
+			buffer.resize(std::min<size_t>(recordCount, c_octreeRecordsPerChunk) * c_octreeRecordSize);
+		}
+		catch (const std::bad_alloc&)
+		{
+			return false;
+		}
+
+		for (size_t start = 0; start < recordCount; start += c_octreeRecordsPerChunk)
+		{
+			size_t stop = std::min<size_t>(recordCount, start + c_octreeRecordsPerChunk);
+			char* _buffer = &(buffer.front());
+			for (size_t i = start; i < stop; ++i)
+			{
+				const IndexAndCode& ic = m_thePointsAndTheirCellCodes[i];
+				uint32_t index = static_cast<uint32_t>(ic.theIndex);
+				memcpy(_buffer, &index, 4);
+				memcpy(_buffer + 4, &ic.theCode, sizeof(CellCode));
+				_buffer += c_octreeRecordSize;
+			}
+			if (out.write(&(buffer.front()), static_cast<qint64>((stop - start) * c_octreeRecordSize)) < 0)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool ccOctree::fromFile(QFile& in, bool& upToDate)
+{
+	assert(m_theAssociatedCloud);
+	upToDate = false;
+
+	uint64_t dataSize = 0;
+	if (in.read((char*)&dataSize, 8) < 0)
+		return false;
+	qint64 endPos = in.pos() + static_cast<qint64>(dataSize);
+
+	const uint32_t levelCount = MAX_OCTREE_LEVEL + 1;
+
+	//header
+	uint32_t recordCount = 0;
+	{
+		uint8_t maxLevel = 0;
+		uint8_t codeSize = 0;
+		uint32_t cloudSize = 0;
+		uint64_t checksum = 0;
+		if (	in.read((char*)&maxLevel, 1) < 0
+			||	in.read((char*)&codeSize, 1) < 0
+			||	in.read((char*)&cloudSize, 4) < 0
+			||	in.read((char*)&checksum, 8) < 0
+			||	in.read((char*)&recordCount, 4) < 0)
+		{
+			return false;
+		}
+
+		QString skipReason;
+		if (maxLevel != MAX_OCTREE_LEVEL || codeSize != sizeof(CellCode))
+		{
+			skipReason = "incompatible octree format";
+		}
+		else if (cloudSize != m_theAssociatedCloud->size() || recordCount > cloudSize)
+		{
+			skipReason = "the number of points has changed";
+		}
+		else if (checksum != ComputePointsChecksum(m_theAssociatedCloud))
+		{
+			skipReason = "the points have changed";
+		}
+
+		if (!skipReason.isEmpty())
+		{
+			ccLog::Warning(QString("[ccOctree] Saved octree is out of date (%1): it will be ignored").arg(skipReason));
+			return in.seek(endPos);
+		}
+	}
+
+	clear();
+
+	//bounding-boxes (always saved as doubles)
+	{
+		CCVector3* boxes[4] = { &m_dimMin, &m_dimMax, &m_pointsMin, &m_pointsMax };
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			CCVector3d d;
+			if (in.read((char*)d.u, 3 * 8) < 0)
+				return false;
+			*boxes[i] = CCVector3::fromArray(d.u);
+		}
+	}
+
+	//whether the octree box and the points filter (= points bounding-box) were specified by the user
+	{
+		uint8_t userDefinedLimits = 0;
+		if (in.read((char*)&userDefinedLimits, 1) < 0)
+			return false;
+		m_userDefinedLimits = (userDefinedLimits != 0);
+	}
+
+	//fill indexes
+	for (uint32_t i = 0; i < 6 * levelCount; ++i)
+	{
+		int32_t index = 0;
+		if (in.read((char*)&index, 4) < 0)
+			return false;
+		m_fillIndexes[i] = static_cast<int>(index);
+	}
+
+	//cells statistics
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		uint32_t cellCount = 0;
+		uint32_t maxPop = 0;
+		if (	in.read((char*)&cellCount, 4) < 0
+			||	in.read((char*)&maxPop, 4) < 0
+			||	in.read((char*)(m_averageCellPopulation + i), 8) < 0
+			||	in.read((char*)(m_stdDevCellPopulation + i), 8) < 0)
+		{
+			return false;
+		}
+		m_cellCount[i] = static_cast<unsigned>(cellCount);
+		m_maxCellPopulation[i] = static_cast<unsigned>(maxPop);
+	}
+
+	//(index, code) records (read by chunks)
+	if (recordCount != 0)
+	{
+		std::vector<char> buffer;
+		try
+		{
+			m_thePointsAndTheirCellCodes.resize(recordCount);
+			buffer.resize(std::min<size_t>(recordCount, c_octreeRecordsPerChunk) * c_octreeRecordSize);
+		}
+		catch (const std::bad_alloc&)
+		{
+			ccLog::Warning("[ccOctree] Not enough memory to load the saved octree: it will be ignored");
+			clear();
+			return in.seek(endPos);
+		}
+
+		unsigned cloudSize = m_theAssociatedCloud->size();
+		for (size_t start = 0; start < recordCount; start += c_octreeRecordsPerChunk)
+		{
+			size_t stop = std::min<size_t>(recordCount, start + c_octreeRecordsPerChunk);
+			if (in.read(&(buffer.front()), static_cast<qint64>((stop - start) * c_octreeRecordSize)) < 0)
+				return false;
+
+			const char* _buffer = &(buffer.front());
+			for (size_t i = start; i < stop; ++i)
+			{
+				IndexAndCode& ic = m_thePointsAndTheirCellCodes[i];
+				uint32_t index = 0;
+				memcpy(&index, _buffer, 4);
+				memcpy(&ic.theCode, _buffer + 4, sizeof(CellCode));
+				_buffer += c_octreeRecordSize;
+
+				if (index >= cloudSize)
+				{
+					ccLog::Warning("[ccOctree] Saved octree is corrupted: it will be ignored");
+					clear();
+					return in.seek(endPos);
+				}
+				ic.theIndex = static_cast<unsigned>(index);
+			}
+		}
+	}
+	m_numberOfProjectedPoints = recordCount;
+
+	//the cell sizes are not saved (they can be deduced from the bounding-box)
+	updateCellSizeTable();
+
+	upToDate = (m_numberOfProjectedPoints != 0);
+	return true;
+}
+
 ccBBox ccOctree::getSquareBB() const
 {
 	return ccBBox(m_dimMin, m_dimMax);
@@ -35,6 +35,7 @@
 
 class ccGenericPointCloud;
 class ccOctreeFrustumIntersector;
+class QFile;
 class ccCameraSensor;
 
 //! Octree structure
@@ -77,8 +78,32 @@ public: //GENERAL METHODS
 	//! Returns the points bounding-box
 	ccBBox getPointsBB() const;
 
+	//! Saves the octree structure to a file
+	/** A checksum of the associated cloud points is saved as well so that
+		the structure can be safely discarded at loading time if the points
+		don't match anymore. The octree and points bounding-boxes are saved
+		with the 'user-defined limits' flag (see DgmOctree::build), so that
+		points inserted afterwards are filtered the same way.
+		\param out output file (already opened)
+		\return success
+	**/
+	bool toFile(QFile& out) const;
+
+	//! Loads the octree structure from a file
+	/** The associated cloud points must have been loaded already.
+		If the stored structure doesn't match them (different checksum,
+		different maximum level, etc.) it is skipped and 'upToDate' is
+		set to false.
+		\param in input file (already opened)
+		\param upToDate whether the loaded structure can be used or not
+		\return false only if a read error occurred
+	**/
+	bool fromFile(QFile& in, bool& upToDate);
+
 	//inherited from DgmOctree
 	virtual void clear() override;
+	virtual bool insertPoints(unsigned firstIndex) override;
+	virtual bool removePoints(const cellIndexesContainer& removedIndexes) override;
 
 public: //RENDERING
 	
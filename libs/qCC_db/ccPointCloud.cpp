@@ -25,6 +25,7 @@
 #include <GeometricalAnalysisTools.h>
 #include <ReferenceCloud.h>
 #include <ManualSegmentationTools.h>
+#include <PolygonInclusionGrid.h>
 
 //local
 #include "ccNormalVectors.h"
@@ -530,13 +531,19 @@ const ccPointCloud& ccPointCloud::append(ccPointCloud* addedCloud, unsigned poin
 	if (size() == pointCountBefore) //in some cases points have already been copied! (ok it's tricky)
 	{
 		//we remove structures that are not compatible with fusion process
-		deleteOctree();
 		unallocateVisibilityArray();
 
 		for (unsigned i = 0; i < addedPoints; i++)
 		{
 			addPoint(*addedCloud->getPoint(i));
 		}
+
+		//we try to update the octree (instead of recomputing it)
+		ccOctree::Shared octree = getOctree();
+		if (octree && !octree->insertPoints(pointCountBefore))
+		{
+			deleteOctree();
+		}
 	}
 
 	//deprecate internal structures
@@ -3246,12 +3253,36 @@ ccGenericPointCloud* ccPointCloud::createNewCloudFromVisibilitySelection(bool re
 	//shall the visible points be erased from this cloud?
 	if (removeSelectedPoints && !isLocked())
 	{
-		//we drop the octree before modifying this cloud's contents
-		deleteOctree();
-		clearLOD();
-
 		unsigned count = size();
 
+		//we try to update the octree before modifying this cloud's contents (otherwise we drop it)
+		ccOctree::Shared octree = getOctree();
+		if (octree)
+		{
+			CCLib::DgmOctree::cellIndexesContainer removedIndexes;
+			bool success = true;
+			try
+			{
+				for (unsigned i = 0; i < count; ++i)
+				{
+					if (m_pointsVisibility->getValue(i) == POINT_VISIBLE)
+					{
+						removedIndexes.push_back(i);
+					}
+				}
+			}
+			catch (const std::bad_alloc&)
+			{
+				success = false;
+			}
+
+			if (!success || !octree->removePoints(removedIndexes) || octree->getNumberOfProjectedPoints() == 0)
+			{
+				deleteOctree();
+			}
+		}
+		clearLOD();
+
 		//we have to take care of scan grids first
 		{
 			//we need a map between old and new indexes
@@ -3948,6 +3979,19 @@ int ccPointCloud::addScalarField(ccScalarField* sf)
 	return static_cast<int>(m_scalarFields.size())-1;
 }
 
+//! Whether the octree should be saved along with the cloud or not
+static bool s_octreeSerialization = false;
+
+void ccPointCloud::SetOctreeSerialization(bool state)
+{
+	s_octreeSerialization = state;
+}
+
+bool ccPointCloud::GetOctreeSerialization()
+{
+	return s_octreeSerialization;
+}
+
 bool ccPointCloud::toFile_MeOnly(QFile& out) const
 {
 	if (!ccGenericPointCloud::toFile_MeOnly(out))
@@ -4121,6 +4165,18 @@ bool ccPointCloud::toFile_MeOnly(QFile& out) const
 		}
 	}
 
+	//Octree (dataVersion >= 48)
+	ccOctree::Shared octree = (s_octreeSerialization ? getOctree() : ccOctree::Shared(0));
+	bool withOctree = (octree && octree->getNumberOfProjectedPoints() != 0);
+	if (out.write((const char*)&withOctree, sizeof(bool)) < 0)
+	{
+		return WriteError();
+	}
+	if (withOctree && !octree->toFile(out))
+	{
+		return WriteError();
+	}
+
 	return true;
 }
 
@@ -4443,6 +4499,29 @@ bool ccPointCloud::fromFile_MeOnly(QFile& in, short dataVersion, int flags)
 		}
 	}
 
+	//Octree (dataVersion >= 48)
+	if (dataVersion >= 48)
+	{
+		bool withOctree = false;
+		if (in.read((char*)&withOctree, sizeof(bool)) < 0)
+		{
+			return ReadError();
+		}
+		if (withOctree)
+		{
+			ccOctree::Shared octree(new ccOctree(this));
+			bool upToDate = false;
+			if (!octree->fromFile(in, upToDate))
+			{
+				return ReadError();
+			}
+			if (upToDate)
+			{
+				setOctree(octree);
+			}
+		}
+	}
+
 	//notifyGeometryUpdate(); //FIXME: we can't call it now as the dependent 'pointers' are not valid yet!
 
 	//We should update the VBOs (just in case)
@@ -4536,12 +4615,17 @@ CCLib::ReferenceCloud* ccPointCloud::crop2D(const ccPolyline* poly, unsigned cha
 	unsigned char X = ((orthoDim+1) % 3);
 	unsigned char Y = ((X+1) % 3);
 
+	//the polygon is rasterized first (so as to avoid testing all its edges for each point)
+	CCLib::PolygonInclusionGrid polyGrid;
+	bool usePolyGrid = polyGrid.build(poly);
+
 	for (unsigned i=0; i<count; ++i)
 	{
 		const CCVector3* P = point(i);
 
 		CCVector2 P2D( P->u[X], P->u[Y] );
-		bool pointIsInside = CCLib::ManualSegmentationTools::isPointInsidePoly(P2D, poly);
+		bool pointIsInside = usePolyGrid	? polyGrid.isInside(P2D)
+											: CCLib::ManualSegmentationTools::isPointInsidePoly(P2D, poly);
 		if (inside == pointIsInside)
 		{
 			ref->addPointIndex(i);
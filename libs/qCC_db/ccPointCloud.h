@@ -412,6 +412,15 @@ public: //waveform (e.g. from airborne scanners)
 
 public: //other methods
 
+	//! Sets whether the octree (if any) should be saved along with the cloud (BIN files)
+	/** Disabled by default (the octree roughly doubles the size of the saved data).
+		At loading time, the saved octree is only restored if the cloud points
+		still match it (checksum). Otherwise it is simply ignored.
+	**/
+	static void SetOctreeSerialization(bool state);
+	//! Returns whether the octree (if any) is saved along with the cloud (BIN files)
+	static bool GetOctreeSerialization();
+
 	//! Returns the cloud gravity center
 	/** \return gravity center
 	**/
@@ -161,7 +161,12 @@ int FastMarchingForFacetExtraction::init(	ccGenericPointCloud* cloud,
 				aCell->N = N;
 				aCell->C = C;
 				aCell->planarError = error;
-				m_theGrid[gridPos] = aCell;
+				if (!m_theGrid.setCell(gridPos, aCell))
+				{
+					//not enough memory
+					delete aCell;
+					return -1;
+				}
 			}
 			else
 			{
@@ -347,7 +352,7 @@ unsigned FastMarchingForFacetExtraction::updateFlagsTable(	ccGenericPointCloud*
 	{
 		//we remove the processed cell so as to be sure not to consider them again!
 		CCLib::FastMarching::Cell* cell = m_theGrid[m_activeCells[i]];
-		m_theGrid[m_activeCells[i]] = 0;
+		m_theGrid.setCell(m_activeCells[i], 0);
 		if (cell)
 			delete cell;
 	}
@@ -369,7 +374,7 @@ unsigned FastMarchingForFacetExtraction::updateFlagsTable(	ccGenericPointCloud*
 			//++pointCount;
 		}
 
-		m_theGrid[m_activeCells[i]] = 0;
+		m_theGrid.setCell(m_activeCells[i], 0);
 		delete aCell;
 	}
 
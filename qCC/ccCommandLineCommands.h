@@ -5,11 +5,13 @@
 
 //CCLib
 #include <CloudSamplingTools.h>
+#include <CloudTileStream.h>
 #include <WeibullDistribution.h>
 #include <NormalDistribution.h>
 #include <StatisticalTestingTools.h>
 #include <Neighbourhood.h>
 #include <AutoSegmentationTools.h>
+#include <ChunkedArrayAllocator.h>
 
 //qCC_db
 #include <ccProgressDialog.h>
@@ -72,6 +74,13 @@ static const char COMMAND_BEST_FIT_PLANE_MAKE_HORIZ[]		= "MAKE_HORIZ";
 static const char COMMAND_BEST_FIT_PLANE_KEEP_LOADED[]		= "KEEP_LOADED";
 static const char COMMAND_ORIENT_NORMALS[]					= "ORIENT_NORMS_MST";
 static const char COMMAND_SOR_FILTER[]						= "SOR";
+static const char COMMAND_NOISE_FILTER[]					= "NOISE";
+static const char COMMAND_NOISE_FILTER_KNN[]				= "KNN";
+static const char COMMAND_NOISE_FILTER_RADIUS[]				= "RADIUS";
+static const char COMMAND_NOISE_FILTER_REL[]				= "REL";
+static const char COMMAND_NOISE_FILTER_ABS[]				= "ABS";
+static const char COMMAND_NOISE_FILTER_RIP[]				= "RIP";
+static const char COMMAND_TILES[]							= "TILES";
 static const char COMMAND_SAMPLE_MESH[]						= "SAMPLE_MESH";
 static const char COMMAND_CROSS_SECTION[]					= "CROSS_SECTION";
 static const char COMMAND_CROP[]							= "CROP";
@@ -88,6 +97,7 @@ static const char COMMAND_C2M_DIST_FLIP_NORMALS[]			= "FLIP_NORMS";
 static const char COMMAND_C2C_DIST[]						= "C2C_DIST";
 static const char COMMAND_C2C_SPLIT_XYZ[]					= "SPLIT_XYZ";
 static const char COMMAND_C2C_LOCAL_MODEL[]					= "MODEL";
+static const char COMMAND_C2C_ALL_CLOUDS[]					= "ALL_CLOUDS";
 static const char COMMAND_C2X_MAX_DISTANCE[]				= "MAX_DIST";
 static const char COMMAND_C2X_OCTREE_LEVEL[]				= "OCTREE_LEVEL";
 static const char COMMAND_STAT_TEST[]						= "STAT_TEST";
@@ -126,6 +136,9 @@ static const char COMMAND_POP_CLOUDS[]						= "POP_CLOUDS";
 static const char COMMAND_CLEAR_MESHES[]					= "CLEAR_MESHES";
 static const char COMMAND_POP_MESHES[]						= "POP_MESHES";
 static const char COMMAND_NO_TIMESTAMP[]					= "NO_TIMESTAMP";
+static const char COMMAND_BIN_SAVE_OCTREES[]				= "BIN_SAVE_OCTREES";
+static const char COMMAND_MEMORY_BUDGET[]					= "MEMORY_BUDGET";
+static const char COMMAND_SCRATCH_DIR[]						= "SCRATCH_DIR";
 
 //options / modifiers
 static const char COMMAND_MAX_THREAD_COUNT[]				= "MAX_TCOUNT";
@@ -1700,6 +1713,58 @@ struct CommandOrientNormalsMST : public ccCommandLineInterface::Command
 	}
 };
 
+//! Reads the (optional) max number of points per tile for streamed filters
+/** \return false if an error occurred (count is left to 0 if the option is not set)
+**/
+static bool ReadMaxTilePointCount(ccCommandLineInterface& cmd, unsigned& count)
+{
+	count = 0;
+	if (cmd.arguments().empty() || !ccCommandLineInterface::IsCommand(cmd.arguments().front(), COMMAND_TILES))
+		return true;
+
+	//local option confirmed, we can move on
+	cmd.arguments().pop_front();
+	if (cmd.arguments().empty())
+		return cmd.error(QString("Missing parameter: max number of points per tile after \"-%1\"").arg(COMMAND_TILES));
+
+	QString countStr = cmd.arguments().takeFirst();
+	bool ok;
+	count = countStr.toUInt(&ok);
+	if (!ok || count == 0)
+		return cmd.error(QString("Invalid parameter: max number of points per tile (%1)").arg(countStr));
+
+	return true;
+}
+
+//! Replaces a cloud by its filtered version
+static bool ReplaceByCleanCloud(ccCommandLineInterface& cmd, size_t cloudIndex, CCLib::ReferenceCloud* selection, QString suffix)
+{
+	ccPointCloud* cloud = cmd.clouds()[cloudIndex].pc;
+	ccPointCloud* cleanCloud = cloud->partialClone(selection);
+	if (!cleanCloud)
+	{
+		return cmd.error(QString("Not enough memory to create a clean version of cloud '%1'!").arg(cloud->getName()));
+	}
+
+	cleanCloud->setName(cloud->getName() + QString(".clean"));
+	if (cmd.autoSaveMode())
+	{
+		CLCloudDesc cloudDesc(cleanCloud, cmd.clouds()[cloudIndex].basename, cmd.clouds()[cloudIndex].path, cmd.clouds()[cloudIndex].indexInFile);
+		QString errorStr = cmd.exportEntity(cloudDesc, suffix);
+		if (!errorStr.isEmpty())
+		{
+			delete cleanCloud;
+			return cmd.error(errorStr);
+		}
+	}
+	//replace current cloud by this one
+	delete cmd.clouds()[cloudIndex].pc;
+	cmd.clouds()[cloudIndex].pc = cleanCloud;
+	cmd.clouds()[cloudIndex].basename += QString("_") + suffix;
+
+	return true;
+}
+
 struct CommandSORFilter : public ccCommandLineInterface::Command
 {
 	CommandSORFilter() : ccCommandLineInterface::Command("S.O.R. filter", COMMAND_SOR_FILTER) {}
@@ -1724,6 +1789,11 @@ struct CommandSORFilter : public ccCommandLineInterface::Command
 		if (!ok || nSigma < 0)
 			return cmd.error(QString("Invalid parameter: sigma multiplier (%1)").arg(nSigma));
 
+		//optional: streamed processing (by tiles)
+		unsigned maxTilePointCount = 0;
+		if (!ReadMaxTilePointCount(cmd, maxTilePointCount))
+			return false;
+
 		if (cmd.clouds().empty())
 			return cmd.error(QString("No cloud available. Be sure to open one first!"));
 
@@ -1740,42 +1810,34 @@ struct CommandSORFilter : public ccCommandLineInterface::Command
 			assert(cloud);
 
 			//computation
-			CCLib::ReferenceCloud* selection = CCLib::CloudSamplingTools::sorFilter(cloud,
-																					knn,
-																					nSigma,
-																					0,
-																					progressDialog.data());
-
-			if (selection)
+			CCLib::ReferenceCloud* selection = 0;
+			if (maxTilePointCount != 0)
 			{
-				ccPointCloud* cleanCloud = cloud->partialClone(selection);
-				if (cleanCloud)
-				{
-					cleanCloud->setName(cloud->getName() + QString(".clean"));
-					if (cmd.autoSaveMode())
-					{
-						CLCloudDesc cloudDesc(cleanCloud, cmd.clouds()[i].basename, cmd.clouds()[i].path, cmd.clouds()[i].indexInFile);
-						QString errorStr = cmd.exportEntity(cloudDesc, "SOR");
-						if (!errorStr.isEmpty())
-						{
-							delete cleanCloud;
-							return cmd.error(errorStr);
-						}
-					}
-					//replace current cloud by this one
-					delete cmd.clouds()[i].pc;
-					cmd.clouds()[i].pc = cleanCloud;
-					cmd.clouds()[i].basename += QString("_SOR");
-					//delete cleanCloud;
-					//cleanCloud = 0;
-				}
-				else
+				CCLib::CloudTileStream stream(cloud, maxTilePointCount);
+				if (stream.init() && CCLib::CloudSamplingTools::sorFilterStreamed(stream, knn, nSigma, 0, progressDialog.data()))
 				{
-					return cmd.error(QString("Not enough memory to create a clean version of cloud '%1'!").arg(cloud->getName()));
+					cmd.print(QString("Cloud '%1' processed in %2 tile(s)").arg(cloud->getName()).arg(stream.tileCount()));
+					selection = new CCLib::ReferenceCloud(stream.selection());
 				}
+			}
+			else
+			{
+				selection = CCLib::CloudSamplingTools::sorFilter(	cloud,
+																	knn,
+																	nSigma,
+																	0,
+																	progressDialog.data());
+			}
+
+			if (selection)
+			{
+				bool success = ReplaceByCleanCloud(cmd, i, selection, "SOR");
 
 				delete selection;
 				selection = 0;
+
+				if (!success)
+					return false;
 			}
 			else
 			{
@@ -1794,6 +1856,159 @@ struct CommandSORFilter : public ccCommandLineInterface::Command
 	}
 };
 
+struct CommandNoiseFilter : public ccCommandLineInterface::Command
+{
+	CommandNoiseFilter() : ccCommandLineInterface::Command("Noise filter", COMMAND_NOISE_FILTER) {}
+
+	virtual bool process(ccCommandLineInterface& cmd) override
+	{
+		cmd.print("[NOISE FILTER]");
+
+		//neighbourhood: KNN {number of neighbors} or RADIUS {radius}
+		if (cmd.arguments().empty())
+			return cmd.error(QString("Missing parameter: neighbourhood type after \"-%1\" (%2/%3)").arg(COMMAND_NOISE_FILTER).arg(COMMAND_NOISE_FILTER_KNN).arg(COMMAND_NOISE_FILTER_RADIUS));
+
+		bool useKnn = false;
+		int knn = 6;
+		PointCoordinateType kernelRadius = 0;
+		{
+			QString typeArg = cmd.arguments().takeFirst().toUpper();
+			if (typeArg != COMMAND_NOISE_FILTER_KNN && typeArg != COMMAND_NOISE_FILTER_RADIUS)
+				return cmd.error(QString("Invalid parameter: neighbourhood type is expected after \"-%1\" (%2/%3)").arg(COMMAND_NOISE_FILTER).arg(COMMAND_NOISE_FILTER_KNN).arg(COMMAND_NOISE_FILTER_RADIUS));
+			useKnn = (typeArg == COMMAND_NOISE_FILTER_KNN);
+
+			if (cmd.arguments().empty())
+				return cmd.error(QString("Missing parameter: value after \"%1\"").arg(typeArg));
+			QString valueStr = cmd.arguments().takeFirst();
+			bool ok;
+			if (useKnn)
+			{
+				knn = valueStr.toInt(&ok);
+				if (!ok || knn <= 0)
+					return cmd.error(QString("Invalid parameter: number of neighbors (%1)").arg(valueStr));
+			}
+			else
+			{
+				kernelRadius = static_cast<PointCoordinateType>(valueStr.toDouble(&ok));
+				if (!ok || kernelRadius <= 0)
+					return cmd.error(QString("Invalid parameter: radius (%1)").arg(valueStr));
+			}
+		}
+
+		//error: REL {sigma multiplier} or ABS {absolute error}
+		if (cmd.arguments().empty())
+			return cmd.error(QString("Missing parameter: error type after neighbourhood (%1/%2)").arg(COMMAND_NOISE_FILTER_REL).arg(COMMAND_NOISE_FILTER_ABS));
+
+		bool useAbsoluteError = false;
+		double nSigma = 1.0;
+		double absoluteError = 0.0;
+		{
+			QString typeArg = cmd.arguments().takeFirst().toUpper();
+			if (typeArg != COMMAND_NOISE_FILTER_REL && typeArg != COMMAND_NOISE_FILTER_ABS)
+				return cmd.error(QString("Invalid parameter: error type is expected after neighbourhood (%1/%2)").arg(COMMAND_NOISE_FILTER_REL).arg(COMMAND_NOISE_FILTER_ABS));
+			useAbsoluteError = (typeArg == COMMAND_NOISE_FILTER_ABS);
+
+			if (cmd.arguments().empty())
+				return cmd.error(QString("Missing parameter: value after \"%1\"").arg(typeArg));
+			QString valueStr = cmd.arguments().takeFirst();
+			bool ok;
+			double value = valueStr.toDouble(&ok);
+			if (!ok || value < 0)
+				return cmd.error(QString("Invalid parameter: error (%1)").arg(valueStr));
+			if (useAbsoluteError)
+				absoluteError = value;
+			else
+				nSigma = value;
+		}
+
+		//optional: remove isolated points
+		bool removeIsolatedPoints = false;
+		if (!cmd.arguments().empty() && cmd.arguments().front().toUpper() == COMMAND_NOISE_FILTER_RIP)
+		{
+			cmd.arguments().pop_front();
+			removeIsolatedPoints = true;
+		}
+
+		//optional: streamed processing (by tiles)
+		unsigned maxTilePointCount = 0;
+		if (!ReadMaxTilePointCount(cmd, maxTilePointCount))
+			return false;
+
+		if (cmd.clouds().empty())
+			return cmd.error(QString("No cloud available. Be sure to open one first!"));
+
+		QScopedPointer<ccProgressDialog> progressDialog(0);
+		if (!cmd.silentMode())
+		{
+			progressDialog.reset(new ccProgressDialog(false, cmd.widgetParent()));
+			progressDialog->setAutoClose(false);
+		}
+
+		for (size_t i = 0; i < cmd.clouds().size(); ++i)
+		{
+			ccPointCloud* cloud = cmd.clouds()[i].pc;
+			assert(cloud);
+
+			//computation
+			CCLib::ReferenceCloud* selection = 0;
+			if (maxTilePointCount != 0)
+			{
+				CCLib::CloudTileStream stream(cloud, maxTilePointCount);
+				if (stream.init() && CCLib::CloudSamplingTools::noiseFilterStreamed(	stream,
+																						kernelRadius,
+																						nSigma,
+																						removeIsolatedPoints,
+																						useKnn,
+																						knn,
+																						useAbsoluteError,
+																						absoluteError,
+																						0,
+																						progressDialog.data()))
+				{
+					cmd.print(QString("Cloud '%1' processed in %2 tile(s)").arg(cloud->getName()).arg(stream.tileCount()));
+					selection = new CCLib::ReferenceCloud(stream.selection());
+				}
+			}
+			else
+			{
+				selection = CCLib::CloudSamplingTools::noiseFilter(	cloud,
+																	kernelRadius,
+																	nSigma,
+																	removeIsolatedPoints,
+																	useKnn,
+																	knn,
+																	useAbsoluteError,
+																	absoluteError,
+																	0,
+																	progressDialog.data());
+			}
+
+			if (selection)
+			{
+				bool success = ReplaceByCleanCloud(cmd, i, selection, "NOISE");
+
+				delete selection;
+				selection = 0;
+
+				if (!success)
+					return false;
+			}
+			else
+			{
+				return cmd.error(QString("Failed to apply noise filter on cloud '%1'! (not enough memory?)").arg(cloud->getName()));
+			}
+		}
+
+		if (progressDialog)
+		{
+			progressDialog->close();
+			QCoreApplication::processEvents();
+		}
+
+		return true;
+	}
+};
+
 struct CommandSampleMesh : public ccCommandLineInterface::Command
 {
 	CommandSampleMesh() : ccCommandLineInterface::Command("Sample mesh", COMMAND_SAMPLE_MESH) {}
@@ -2284,7 +2499,6 @@ struct CommandDist : public ccCommandLineInterface::Command
 			return cmd.error(QString("No point cloud available. Be sure to open or generate one first!"));
 		else if (m_cloud2meshDist && cmd.clouds().size() != 1)
 			cmd.warning("Multiple point clouds loaded! We take the first one by default");
-		CLCloudDesc& compCloud = cmd.clouds().front();
 
 		//reference entity
 		ccHObject* refEntity = 0;
@@ -2300,8 +2514,6 @@ struct CommandDist : public ccCommandLineInterface::Command
 		{
 			if (cmd.clouds().size() < 2)
 				return cmd.error(QString("Only one point cloud available. Be sure to open or generate a second one before performing C2C distance!"));
-			else if (cmd.clouds().size() > 2)
-				cmd.warning("More than 3 point clouds loaded! We take the second one as reference by default");
 			refEntity = cmd.clouds()[1].pc;
 		}
 
@@ -2315,6 +2527,7 @@ struct CommandDist : public ccCommandLineInterface::Command
 		int modelIndex = 0;
 		bool useKNN = true;
 		double nSize = 0;
+		bool allClouds = false;
 
 		while (!cmd.arguments().empty())
 		{
@@ -2359,9 +2572,16 @@ struct CommandDist : public ccCommandLineInterface::Command
 				cmd.arguments().pop_front();
 
 				splitXYZ = true;
+			}
+			else if (ccCommandLineInterface::IsCommand(argument, COMMAND_C2C_ALL_CLOUDS))
+			{
+				//local option confirmed, we can move on
+				cmd.arguments().pop_front();
+
+				allClouds = true;
 
 				if (m_cloud2meshDist)
-					cmd.warning("Parameter \"-%1\" ignored: only for C2C distance!");
+					cmd.warning(QString("Parameter \"-%1\" ignored: only for C2C distance!").arg(COMMAND_C2C_ALL_CLOUDS));
 			}
 			else if (ccCommandLineInterface::IsCommand(argument, COMMAND_C2C_LOCAL_MODEL))
 			{
@@ -2432,79 +2652,105 @@ struct CommandDist : public ccCommandLineInterface::Command
 			}
 		}
 
-		//spawn dialog (virtually) so as to prepare the comparison process
-		ccComparisonDlg compDlg(compCloud.pc,
-								refEntity,
-								m_cloud2meshDist ? ccComparisonDlg::CLOUDMESH_DIST : ccComparisonDlg::CLOUDCLOUD_DIST,
-								cmd.widgetParent(),
-								true);
-
-		//update parameters
-		if (maxDist > 0)
-		{
-			compDlg.maxDistCheckBox->setChecked(true);
-			compDlg.maxSearchDistSpinBox->setValue(maxDist);
-		}
-		if (octreeLevel > 0)
+		//compared cloud(s)
+		std::vector<size_t> comparedCloudIndexes(1, 0);
+		if (!m_cloud2meshDist && cmd.clouds().size() > 2)
 		{
-			compDlg.octreeLevelComboBox->setCurrentIndex(octreeLevel);
-		}
-		if (maxThreadCount != 0)
-		{
-			compDlg.maxThreadCountSpinBox->setValue(maxThreadCount);
+			if (allClouds)
+			{
+				//all the clouds (but the reference one) are compared to the reference cloud
+				for (size_t i = 2; i < cmd.clouds().size(); ++i)
+					comparedCloudIndexes.push_back(i);
+			}
+			else
+			{
+				cmd.warning("More than 3 point clouds loaded! We take the second one as reference by default");
+			}
 		}
 
-		//C2M-only parameters
-		if (m_cloud2meshDist)
-		{
-			if (flipNormals)
-				compDlg.flipNormalsCheckBox->setChecked(true);
-		}
-		//C2C-only parameters
-		else
+		//the reference octree and local models are shared by all the comparisons (C2C only)
+		QSharedPointer<CCLib::Cloud2CloudReferenceContext> refContext;
+
+		for (size_t i = 0; i < comparedCloudIndexes.size(); ++i)
 		{
+			CLCloudDesc& compCloud = cmd.clouds()[comparedCloudIndexes[i]];
+			if (comparedCloudIndexes.size() > 1)
+				cmd.print(QString("Compared cloud: %1").arg(compCloud.pc->getName()));
+
+			//spawn dialog (virtually) so as to prepare the comparison process
+			//(the reference context is already used by the approximate distances computation)
+			ccComparisonDlg compDlg(compCloud.pc,
+									refEntity,
+									m_cloud2meshDist ? ccComparisonDlg::CLOUDMESH_DIST : ccComparisonDlg::CLOUDCLOUD_DIST,
+									cmd.widgetParent(),
+									true,
+									refContext);
+
+			//update parameters
+			if (maxDist > 0)
+			{
+				compDlg.maxDistCheckBox->setChecked(true);
+				compDlg.maxSearchDistSpinBox->setValue(maxDist);
+			}
+			if (octreeLevel > 0)
+			{
+				compDlg.octreeLevelComboBox->setCurrentIndex(octreeLevel);
+			}
+			if (maxThreadCount != 0)
+			{
+				compDlg.maxThreadCountSpinBox->setValue(maxThreadCount);
+			}
 			if (splitXYZ)
 			{
-				//DGM: not true anymore
-				//if (maxDist > 0)
-				//	cmd.warning("'Split XYZ' option is ignored if max distance is defined!");
 				compDlg.split3DCheckBox->setChecked(true);
 			}
-			if (modelIndex != 0)
+
+			//C2M-only parameters
+			if (m_cloud2meshDist)
 			{
-				compDlg.localModelComboBox->setCurrentIndex(modelIndex);
-				if (useKNN)
-				{
-					compDlg.lmKNNRadioButton->setChecked(true);
-					compDlg.lmKNNSpinBox->setValue(static_cast<int>(nSize));
-				}
-				else
+				if (flipNormals)
+					compDlg.flipNormalsCheckBox->setChecked(true);
+			}
+			//C2C-only parameters
+			else
+			{
+				if (modelIndex != 0)
 				{
-					compDlg.lmRadiusRadioButton->setChecked(true);
-					compDlg.lmRadiusDoubleSpinBox->setValue(nSize);
+					compDlg.localModelComboBox->setCurrentIndex(modelIndex);
+					if (useKNN)
+					{
+						compDlg.lmKNNRadioButton->setChecked(true);
+						compDlg.lmKNNSpinBox->setValue(static_cast<int>(nSize));
+					}
+					else
+					{
+						compDlg.lmRadiusRadioButton->setChecked(true);
+						compDlg.lmRadiusDoubleSpinBox->setValue(nSize);
+					}
 				}
 			}
-		}
 
-		if (!compDlg.computeDistances())
-		{
-			compDlg.cancelAndExit();
-			return cmd.error("An error occurred during distances computation!");
-		}
+			if (!compDlg.computeDistances())
+			{
+				compDlg.cancelAndExit();
+				return cmd.error("An error occurred during distances computation!");
+			}
+			refContext = compDlg.getReferenceContext();
 
-		compDlg.applyAndExit();
+			compDlg.applyAndExit();
 
-		QString suffix(m_cloud2meshDist ? "_C2M_DIST" : "_C2C_DIST");
-		if (maxDist > 0)
-			suffix += QString("_MAX_DIST_%1").arg(maxDist);
+			QString suffix(m_cloud2meshDist ? "_C2M_DIST" : "_C2C_DIST");
+			if (maxDist > 0)
+				suffix += QString("_MAX_DIST_%1").arg(maxDist);
 
-		compCloud.basename += suffix;
+			compCloud.basename += suffix;
 
-		if (cmd.autoSaveMode())
-		{
-			QString errorStr = cmd.exportEntity(compCloud);
-			if (!errorStr.isEmpty())
-				return cmd.error(errorStr);
+			if (cmd.autoSaveMode())
+			{
+				QString errorStr = cmd.exportEntity(compCloud);
+				if (!errorStr.isEmpty())
+					return cmd.error(errorStr);
+			}
 		}
 
 		return true;
@@ -2515,7 +2761,7 @@ struct CommandDist : public ccCommandLineInterface::Command
 
 struct CommandC2MDist : public CommandDist
 {
-	CommandC2MDist() : CommandDist(false, "C2M distance", COMMAND_C2M_DIST) {}
+	CommandC2MDist() : CommandDist(true, "C2M distance", COMMAND_C2M_DIST) {}
 };
 
 struct CommandC2CDist : public CommandDist
@@ -3744,4 +3990,60 @@ struct CommandSetNoTimestamp : public ccCommandLineInterface::Command
 	}
 };
 
+struct CommandBinSaveOctrees : public ccCommandLineInterface::Command
+{
+	CommandBinSaveOctrees() : ccCommandLineInterface::Command("Save octrees (BIN)", COMMAND_BIN_SAVE_OCTREES) {}
+
+	virtual bool process(ccCommandLineInterface& cmd) override
+	{
+		cmd.print("[BIN] Octrees will be saved along with the clouds");
+		ccPointCloud::SetOctreeSerialization(true);
+		return true;
+	}
+};
+
+struct CommandMemoryBudget : public ccCommandLineInterface::Command
+{
+	CommandMemoryBudget() : ccCommandLineInterface::Command("Memory budget", COMMAND_MEMORY_BUDGET) {}
+
+	virtual bool process(ccCommandLineInterface& cmd) override
+	{
+		if (cmd.arguments().empty())
+		{
+			return cmd.error(QString("Missing parameter: memory budget (in MB) after \"-%1\"").arg(COMMAND_MEMORY_BUDGET));
+		}
+
+		bool ok;
+		qulonglong budget_mb = cmd.arguments().takeFirst().toULongLong(&ok);
+		if (!ok)
+		{
+			return cmd.error("Invalid memory budget!");
+		}
+		ChunkedArrayAllocator::SetMemoryBudget(static_cast<size_t>(budget_mb) << 20);
+
+		//optional scratch directory
+		if (!cmd.arguments().empty())
+		{
+			QString argument = cmd.arguments().front();
+			if (ccCommandLineInterface::IsCommand(argument, COMMAND_SCRATCH_DIR))
+			{
+				//local option confirmed, we can move on
+				cmd.arguments().pop_front();
+				if (cmd.arguments().empty())
+				{
+					return cmd.error(QString("Missing parameter: directory after \"-%1\"").arg(COMMAND_SCRATCH_DIR));
+				}
+				ChunkedArrayAllocator::SetScratchDirectory(cmd.arguments().takeFirst().toStdString());
+			}
+		}
+
+		if (budget_mb != 0)
+			cmd.print(QString("Memory budget: %1 MB (beyond this, data will be stored in scratch files in '%2')").arg(budget_mb).arg(QString::fromStdString(ChunkedArrayAllocator::GetScratchDirectory())));
+		else
+			cmd.print("Memory budget: none");
+
+		return true;
+	}
+};
+
 #endif //COMMAND_LINE_COMMANDS_HEADER
@@ -26,6 +26,7 @@
 #include <MeshSamplingTools.h>
 #include <ScalarField.h>
 #include <DgmOctree.h>
+#include <Cloud2CloudReferenceContext.h>
 #include <ScalarFieldTools.h>
 
 //qCC_db
@@ -55,7 +56,8 @@ ccComparisonDlg::ccComparisonDlg(	ccHObject* compEntity,
 									ccHObject* refEntity,
 									CC_COMPARISON_TYPE cpType,
 									QWidget* parent/*=0*/,
-									bool noDisplay/*=false*/)
+									bool noDisplay/*=false*/,
+									QSharedPointer<CCLib::Cloud2CloudReferenceContext> refContext/*=QSharedPointer<CCLib::Cloud2CloudReferenceContext>()*/)
 	: QDialog(parent, Qt::Tool)
 	, Ui::ComparisonDialog()
 	, m_compEnt(compEntity)
@@ -66,8 +68,7 @@ ccComparisonDlg::ccComparisonDlg(	ccHObject* compEntity,
 	, m_refEnt(refEntity)
 	, m_refCloud(0)
 	, m_refMesh(0)
-	, m_refOctree(0)
-	, m_refOctreeIsPartial(false)
+	, m_refContext(refContext)
 	, m_refVisibility(false)
 	, m_compType(cpType)
 	, m_noDisplay(noDisplay)
@@ -118,12 +119,15 @@ ccComparisonDlg::ccComparisonDlg(	ccHObject* compEntity,
 		localModelingTab->setEnabled(false);
 		signedDistCheckBox->setEnabled(true);
 		signedDistCheckBox->setChecked(true);
+		split3DCheckBox->setEnabled(true);
 		filterVisibilityCheckBox->setEnabled(false);
 		filterVisibilityCheckBox->setVisible(false);
 	}
 	else
 	{
 		signedDistCheckBox->setEnabled(false);
+		useBVHCheckBox->setEnabled(false);
+		useBVHCheckBox->setVisible(false);
 		split3DCheckBox->setEnabled(true);
 		lmRadiusDoubleSpinBox->setValue(compEntBBox.getDiagNorm() / 200.0);
 		filterVisibilityCheckBox->setEnabled(m_refCloud && m_refCloud->isA(CC_TYPES::POINT_CLOUD) && static_cast<ccPointCloud*>(m_refCloud)->hasSensor());
@@ -202,20 +206,25 @@ bool ccComparisonDlg::prepareEntitiesForComparison()
 	{
 		m_refMesh = ccHObjectCaster::ToGenericMesh(m_refEnt);
 		m_refCloud = m_refMesh->getAssociatedCloud();
-		m_refOctree.clear();
+		m_refContext.clear();
 	}
 	else /*if (m_compType == CLOUDCLOUD_DIST)*/
 	{
 		m_refCloud = ccHObjectCaster::ToGenericPointCloud(m_refEnt);
 
-		//for computing cloud/cloud distances we need also the reference cloud's octree
-		m_refOctree = m_refCloud->getOctree();
-		if (!m_refOctree)
+		//for computing cloud/cloud distances we need also the reference cloud's octree:
+		//it is held by the reference context (so that it is built only once for the
+		//approximate and the precise distances, and for all the clouds sharing this context)
+		if (m_refContext && m_refContext->referenceCloud() != m_refCloud)
+		{
+			//the context doesn't correspond to the reference cloud
+			m_refContext.clear();
+		}
+		if (!m_refContext)
 		{
-			m_refOctree = ccOctree::Shared(new ccOctree(m_refCloud));
+			m_refContext = QSharedPointer<CCLib::Cloud2CloudReferenceContext>(new CCLib::Cloud2CloudReferenceContext(m_refCloud));
 		}
 	}
-	m_refOctreeIsPartial = false;
 
 	return true;
 }
@@ -264,11 +273,7 @@ void ccComparisonDlg::releaseOctrees()
 		m_compOctreeIsPartial = false;
 	}
 
-	if (m_refOctree && m_refCloud)
-	{
-		m_refOctree.clear();
-		m_refOctreeIsPartial = false;
-	}
+	m_refContext.clear();
 }
 
 void ccComparisonDlg::updateDisplay(bool showSF, bool showRef)
@@ -299,7 +304,7 @@ bool ccComparisonDlg::isValid()
 	if (	!m_compCloud
 		||	!m_compOctree
 		||	(!m_refMesh && !m_refCloud)
-		||	(!m_refMesh && !m_refOctree))
+		||	(!m_refMesh && !m_refContext))
 	{
 		ccLog::Error("Dialog initialization error! (void entity)");
 		return false;
@@ -349,7 +354,8 @@ bool ccComparisonDlg::computeApproxDistances()
 																								0,
 																								&progressDlg,
 																								m_compOctree.data(),
-																								m_refOctree.data());
+																								0,
+																								m_refContext.data());
 		}
 		break;
 	
@@ -496,7 +502,9 @@ int ccComparisonDlg::determineBestOctreeLevel(double maxSearchDist)
 	//if the reference is a mesh
 	double meanTriangleSurface = 1.0;
 	CCLib::GenericIndexedMesh* mesh = 0;
-	if (!m_refOctree)
+	//if the reference is a cloud, its octree is the context one (see computeApproxDistances)
+	const CCLib::DgmOctree* refOctree = (m_refContext ? m_refContext->octree() : 0);
+	if (!refOctree)
 	{
 		if (!m_refMesh)
 		{
@@ -547,9 +555,9 @@ int ccComparisonDlg::determineBestOctreeLevel(double maxSearchDist)
 
 		//we also use the reference cloud density (points/cell) if we have the info
 		double refListDensity = 1.0;
-		if (m_refOctree)
+		if (refOctree)
 		{
-			refListDensity = m_refOctree->computeMeanOctreeDensity(static_cast<unsigned char>(level));
+			refListDensity = refOctree->computeMeanOctreeDensity(static_cast<unsigned char>(level));
 		}
 
 		CCLib::DgmOctree::CellCode tempCode = 0xFFFFFFFF;
@@ -709,46 +717,50 @@ bool ccComparisonDlg::computeDistances()
 
 	QElapsedTimer eTimer;
 	eTimer.start();
-	switch(m_compType)
+
+	//split distances (common to both comparison types)
+	CCLib::ScalarField* splitDistances[3] = { 0, 0, 0 };
+	if (split3D)
 	{
-	case CLOUDCLOUD_DIST: //cloud-cloud
+		//we create 3 new scalar fields, one for each dimension
+		unsigned count = m_compCloud->size();
 
-		if (split3D)
+		bool success = true;
+		for (unsigned j = 0; j < 3; ++j)
 		{
-			//we create 3 new scalar fields, one for each dimension
-			unsigned count = m_compCloud->size();
-
-			bool success = true;
-			for (unsigned j = 0; j < 3; ++j)
+			ccScalarField* sfDim = new ccScalarField();
+			sfDim->link();
+			splitDistances[j] = sfDim;
+			if (!sfDim->resize(count))
 			{
-				ccScalarField* sfDim = new ccScalarField();
-				if (sfDim->resize(count))
-				{
-					sfDim->link();
-					c2cParams.splitDistances[j] = sfDim;
-				}
-				else
-				{
-					success = false;
-					break;
-				}
+				success = false;
+				break;
 			}
+		}
 
-			if (!success)
-			{
-				ccLog::Error("[ComputeDistances] Not enough memory to generate 3D split fields!");
+		if (!success)
+		{
+			ccLog::Error("[ComputeDistances] Not enough memory to generate 3D split fields!");
 
-				for (unsigned j = 0; j < 3; ++j)
+			for (unsigned j = 0; j < 3; ++j)
+			{
+				if (splitDistances[j])
 				{
-					if (c2cParams.splitDistances[j])
-					{
-						c2cParams.splitDistances[j]->release();
-						c2cParams.splitDistances[j] = 0;
-					}
+					splitDistances[j]->release();
+					splitDistances[j] = 0;
 				}
 			}
 		}
-		
+	}
+	for (unsigned j = 0; j < 3; ++j)
+	{
+		c2cParams.splitDistances[j] = c2mParams.splitDistances[j] = splitDistances[j];
+	}
+
+	switch(m_compType)
+	{
+	case CLOUDCLOUD_DIST: //cloud-cloud
+
 		if (m_refCloud->isA(CC_TYPES::POINT_CLOUD))
 		{
 			ccPointCloud* pc = static_cast<ccPointCloud*>(m_refCloud);
@@ -819,22 +831,19 @@ bool ccComparisonDlg::computeDistances()
 			c2cParams.multiThread = multiThread;
 			c2cParams.CPSet = 0;
 		}
+
+		//the reference octree and local models are kept for the next computations
+		c2cParams.referenceContext = m_refContext.data();
 		
 		result = CCLib::DistanceComputationTools::computeCloud2CloudDistance(	m_compCloud,
 																				m_refCloud,
 																				c2cParams,
 																				&progressDlg,
-																				m_compOctree.data(),
-																				m_refOctree.data());
+																				m_compOctree.data());
 		break;
 
 	case CLOUDMESH_DIST: //cloud-mesh
 
-		if (multiThread && maxDistCheckBox->isChecked())
-		{
-			ccLog::Warning("[Cloud/Mesh comparison] Max search distance is not supported in multi-thread mode! Switching to single thread mode...");
-		}
-
 		//setup parameters
 		{
 			c2mParams.octreeLevel = static_cast<unsigned char>(octreeLevel);
@@ -844,6 +853,9 @@ bool ccComparisonDlg::computeDistances()
 			c2mParams.flipNormals = flipNormals;
 			c2mParams.multiThread = multiThread;
 		}
+
+		//the BVH is computed for each computation (the mesh may have been modified in between)
+		c2mParams.useBVH = useBVHCheckBox->isChecked();
 		
 		result = CCLib::DistanceComputationTools::computeCloud2MeshDistance(	m_compCloud,
 																				m_refMesh,
@@ -910,7 +922,7 @@ bool ccComparisonDlg::computeDistances()
 			static const QChar charDim[3] = { 'X', 'Y', 'Z' };
 			for (unsigned j = 0; j < 3; ++j)
 			{
-				CCLib::ScalarField* sf = c2cParams.splitDistances[j];
+				CCLib::ScalarField* sf = splitDistances[j];
 				if (sf)
 				{
 					sf->setName(qPrintable(m_sfName + QString(" (%1)").arg(charDim[j])));
@@ -937,7 +949,7 @@ bool ccComparisonDlg::computeDistances()
 
 	for (unsigned j = 0; j < 3; ++j)
 	{
-		CCLib::ScalarField* sf = c2cParams.splitDistances[j];
+		CCLib::ScalarField* sf = splitDistances[j];
 		if (sf)
 		{
 			sf->release();
@@ -27,6 +27,11 @@
 
 #include <ui_comparisonDlg.h>
 
+namespace CCLib
+{
+	class Cloud2CloudReferenceContext;
+}
+
 class ccHObject;
 class ccPointCloud;
 class ccGenericPointCloud;
@@ -47,11 +52,19 @@ public:
 	};
 
 	//! Default constructor
+	/** \param compEntity compared entity
+		\param refEntity reference entity
+		\param cpType comparison type
+		\param parent parent widget
+		\param noDisplay whether the display should be refreshed or not
+		\param refContext reference cloud context of a former comparison with the same reference cloud (cloud-to-cloud distances only - optional)
+	**/
 	ccComparisonDlg(ccHObject* compEntity,
 					ccHObject* refEntity,
 					CC_COMPARISON_TYPE cpType,
 					QWidget* parent = 0,
-					bool noDisplay = false);
+					bool noDisplay = false,
+					QSharedPointer<CCLib::Cloud2CloudReferenceContext> refContext = QSharedPointer<CCLib::Cloud2CloudReferenceContext>());
 
 	//! Default destructor
 	~ccComparisonDlg();
@@ -61,6 +74,9 @@ public:
 	//! Returns compared entity
 	ccHObject* getReferenceEntity() { return m_refEnt; }
 
+	//! Returns the reference cloud context (cloud-to-cloud distances only - may be null)
+	QSharedPointer<CCLib::Cloud2CloudReferenceContext> getReferenceContext() const { return m_refContext; }
+
 public slots:
 	bool computeDistances();
 	void applyAndExit();
@@ -98,10 +114,8 @@ protected:
 	ccGenericPointCloud* m_refCloud;
 	//! Reference entity equivalent mesh (if any)
 	ccGenericMesh* m_refMesh;
-	//! Reference entity's octree
-	ccOctree::Shared m_refOctree;
-	//! Whether the reference entity octree is partial or not
-	bool m_refOctreeIsPartial;
+	//! Reference cloud context (cloud-to-cloud distances only - holds the reference octree and is reused for successive computations)
+	QSharedPointer<CCLib::Cloud2CloudReferenceContext> m_refContext;
 	//! Initial reference entity visibility
 	bool m_refVisibility;
 
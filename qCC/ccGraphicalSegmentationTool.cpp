@@ -23,6 +23,7 @@
 
 //CCLib
 #include <ManualSegmentationTools.h>
+#include <PolygonInclusionGrid.h>
 #include <SquareMatrix.h>
 
 //qCC_db
@@ -629,6 +630,10 @@ void ccGraphicalSegmentationTool::segment(bool keepPointsInside)
 	const double half_w = camera.viewport[2] / 2.0;
 	const double half_h = camera.viewport[3] / 2.0;
 
+	//the polygon is rasterized first (so as to avoid testing all its edges for each point)
+	CCLib::PolygonInclusionGrid polyGrid;
+	bool usePolyGrid = polyGrid.build(m_segmentationPoly);
+
 	//for each selected entity
 	for (QSet<ccHObject*>::const_iterator p = m_toSegment.begin(); p != m_toSegment.end(); ++p)
 	{
@@ -656,7 +661,8 @@ void ccGraphicalSegmentationTool::segment(bool keepPointsInside)
 				CCVector2 P2D(	static_cast<PointCoordinateType>(Q2D.x-half_w),
 								static_cast<PointCoordinateType>(Q2D.y-half_h) );
 				
-				bool pointInside = CCLib::ManualSegmentationTools::isPointInsidePoly(P2D, m_segmentationPoly);
+				bool pointInside = usePolyGrid	? polyGrid.isInside(P2D)
+												: CCLib::ManualSegmentationTools::isPointInsidePoly(P2D, m_segmentationPoly);
 
 				visibilityArray->setValue(i, keepPointsInside != pointInside ? POINT_HIDDEN : POINT_VISIBLE );
 			}
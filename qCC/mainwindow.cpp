@@ -2787,12 +2787,10 @@ void MainWindow::doRemoveDuplicatePoints()
 				break;
 			}
 
-			ccOctree::Shared octree = cloud->getOctree();
-
+			//no octree: the (faster) hash grid is used instead
 			int result = CCLib::GeometricalAnalysisTools::flagDuplicatePoints(	cloud,
 																				minDistanceBetweenPoints,
-																				&pDlg,
-																				octree.data());
+																				&pDlg);
 
 			if (result >= 0)
 			{